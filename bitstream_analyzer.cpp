@@ -0,0 +1,476 @@
+#include "bitstream_analyzer.h"
+#include "nal_parser.h"
+#include "nal_emulation.h"
+#include <stdio.h>
+#include <string.h>
+
+// 解析中の状態
+struct AnalyzerState {
+    BitstreamStatistics* pStats;
+    BitstreamFrame current;            // 組み立て中のフレーム
+    bool frameOpen;                    // currentが有効か
+    bool hasSlice;                     // currentにスライスが含まれているか
+
+    // スライディングウィンドウ (直近windowFramesフレームのサイズのリング)
+    std::vector<UINT32> windowSizes;
+    size_t windowPos;
+    UINT64 windowSum;
+    UINT32 framesInWindow;
+    bool windowFilled;
+
+    // GOP
+    UINT32 framesSinceIdr;
+    bool seenIdr;
+    UINT64 totalFrameBytes;
+};
+
+// スライスヘッダー先頭の指数ゴロム符号を読むための小さなビットリーダー
+struct SliceBitReader {
+    const BYTE* pData;
+    size_t size;
+    size_t bitPos;
+};
+
+static bool ReadBit(SliceBitReader* pReader, UINT32* pBit)
+{
+    if (pReader->bitPos >= pReader->size * 8) {
+        return false;
+    }
+    *pBit = (pReader->pData[pReader->bitPos >> 3] >> (7 - (pReader->bitPos & 7))) & 1;
+    pReader->bitPos++;
+    return true;
+}
+
+// ue(v) を読む
+static bool ReadUe(SliceBitReader* pReader, UINT32* pValue)
+{
+    UINT32 leadingZeros = 0;
+    UINT32 bit = 0;
+    while (true) {
+        if (!ReadBit(pReader, &bit)) {
+            return false;
+        }
+        if (bit) {
+            break;
+        }
+        if (++leadingZeros > 31) {
+            return false;
+        }
+    }
+    UINT32 value = 0;
+    for (UINT32 i = 0; i < leadingZeros; i++) {
+        if (!ReadBit(pReader, &bit)) {
+            return false;
+        }
+        value = (value << 1) | bit;
+    }
+    *pValue = (1u << leadingZeros) - 1 + value;
+    return true;
+}
+
+// スライスヘッダーからfirst_mb_in_sliceとslice_typeを取り出す
+static bool ParseSliceHeader(const BYTE* pNal, size_t size, UINT32* pFirstMb, UINT32* pSliceType)
+{
+    // 先頭数バイトだけエミュレーション防止バイトを除いて読む
+    BYTE rbsp[16];
+    size_t ebspSize = (size - 1 < sizeof(rbsp)) ? size - 1 : sizeof(rbsp);
+    SliceBitReader reader = { rbsp, EbspToRbsp(pNal + 1, ebspSize, rbsp), 0 };
+    return ReadUe(&reader, pFirstMb) && ReadUe(&reader, pSliceType);
+}
+
+// 組み立て中のフレームを確定する (endOffsetは次のフレームの先頭位置)
+static void FinishFrame(AnalyzerState* pState, UINT64 endOffset)
+{
+    if (!pState->frameOpen) {
+        return;
+    }
+    BitstreamStatistics* pStats = pState->pStats;
+    BitstreamFrame& frame = pState->current;
+    frame.size = static_cast<UINT32>(endOffset - frame.offset);
+
+    // スライディングウィンドウのビットレート
+    if (pState->framesInWindow == pState->windowSizes.size()) {
+        pState->windowSum -= pState->windowSizes[pState->windowPos];
+    } else {
+        pState->framesInWindow++;
+    }
+    pState->windowSizes[pState->windowPos] = frame.size;
+    pState->windowSum += frame.size;
+    pState->windowPos = (pState->windowPos + 1) % pState->windowSizes.size();
+    frame.windowBitrate = pState->windowSum * 8.0 * pStats->frameRate / pState->framesInWindow;
+    if (pState->framesInWindow == pState->windowSizes.size()) {
+        if (!pState->windowFilled || frame.windowBitrate < pStats->minWindowBitrate) {
+            pStats->minWindowBitrate = frame.windowBitrate;
+        }
+        if (!pState->windowFilled || frame.windowBitrate > pStats->maxWindowBitrate) {
+            pStats->maxWindowBitrate = frame.windowBitrate;
+        }
+        pState->windowFilled = true;
+    }
+
+    // フレームサイズ
+    if (pStats->frames.empty() || frame.size < pStats->minFrameSize) {
+        pStats->minFrameSize = frame.size;
+    }
+    if (frame.size > pStats->maxFrameSize) {
+        pStats->maxFrameSize = frame.size;
+    }
+    if (frame.keyFrame && frame.size > pStats->maxKeyFrameSize) {
+        pStats->maxKeyFrameSize = frame.size;
+    }
+    pState->totalFrameBytes += frame.size;
+
+    // GOP (IDRからIDRまでのフレーム数)
+    if (frame.keyFrame) {
+        if (pState->seenIdr) {
+            pStats->gopLengths.push_back(pState->framesSinceIdr);
+        }
+        pState->seenIdr = true;
+        pState->framesSinceIdr = 0;
+    }
+    pState->framesSinceIdr++;
+
+    switch (frame.sliceType) {
+    case 'P': pStats->sliceTypeCounts[0]++; break;
+    case 'B': pStats->sliceTypeCounts[1]++; break;
+    case 'I': pStats->sliceTypeCounts[2]++; break;
+    case 'S': pStats->sliceTypeCounts[3]++; break;
+    default: break;
+    }
+
+    pStats->frames.push_back(frame);
+    pState->frameOpen = false;
+    pState->hasSlice = false;
+}
+
+// NALユニット1つを分類し、必要ならフレームを区切る
+// framingOffsetはこのNALユニットのスタートコード (または長さ) の位置
+static void AnalyzeNal(AnalyzerState* pState, const BYTE* pNal, size_t size, UINT64 framingOffset)
+{
+    BitstreamStatistics* pStats = pState->pStats;
+    pStats->nalCount++;
+    if (size == 0) {
+        pStats->invalidNalCount++;
+        return;
+    }
+    if (pNal[0] & 0x80) {
+        pStats->invalidNalCount++;
+    }
+
+    BYTE type = GetNalUnitType(pNal[0]);
+    pStats->nalTypeCounts[type]++;
+    pStats->nalTypeBytes[type] += size;
+
+    // 新しいアクセスユニットの始まりかどうか (ISO/IEC 14496-10 7.4.1.2.3の簡略版)
+    bool startsAccessUnit = false;
+    bool isSlice = IsSliceNalType(type);
+    UINT32 firstMb = 1;
+    UINT32 sliceType = 0;
+    bool sliceParsed = false;
+    if (isSlice) {
+        // データパーティションB/Cの先頭はslice_idなのでスライスヘッダーは読まない
+        bool hasSliceHeader = type != NAL_TYPE_SLICE_DPB && type != NAL_TYPE_SLICE_DPC;
+        sliceParsed = hasSliceHeader && size > 1 && ParseSliceHeader(pNal, size, &firstMb, &sliceType);
+        startsAccessUnit = pState->hasSlice && sliceParsed && firstMb == 0;
+    } else if ((type >= NAL_TYPE_SEI && type <= NAL_TYPE_AUD) || (type >= 14 && type <= 18)) {
+        startsAccessUnit = pState->hasSlice;
+    }
+
+    if (startsAccessUnit) {
+        FinishFrame(pState, framingOffset);
+    }
+    if (!pState->frameOpen) {
+        memset(&pState->current, 0, sizeof(pState->current));
+        pState->current.offset = framingOffset;
+        pState->current.sliceType = '?';
+        pState->frameOpen = true;
+    }
+    pState->current.nalCount++;
+
+    if (isSlice) {
+        if (!pState->hasSlice && sliceParsed) {
+            static const char sliceTypeNames[5] = { 'P', 'B', 'I', 'S', 'S' };
+            pState->current.sliceType = sliceTypeNames[sliceType % 5];
+        }
+        if (type == NAL_TYPE_IDR) {
+            pState->current.keyFrame = TRUE;
+        }
+        pState->hasSlice = true;
+    }
+}
+
+// [begin, end) のAnnex B区間を解析する
+// 最初のNALユニットのframingOffsetはfirstFramingOffsetとする (レコードの先頭に合わせるため)
+static void AnalyzeAnnexBRange(AnalyzerState* pState, const BYTE* pData, size_t begin, size_t end,
+                               UINT64 firstFramingOffset)
+{
+    size_t startCodeLength = 0;
+    size_t start = FindStartCode(pData, begin, end, &startCodeLength);
+    UINT64 framingOffset = firstFramingOffset;
+    while (start < end) {
+        size_t nalStart = start + startCodeLength;
+        size_t nextLength = 0;
+        size_t next = FindStartCode(pData, nalStart, end, &nextLength);
+
+        // 次のスタートコードまでの末尾のゼロ (trailing_zero_8bits) を除く
+        size_t nalEnd = next;
+        while (nalEnd > nalStart && pData[nalEnd - 1] == 0x00) {
+            nalEnd--;
+        }
+        if (nalEnd > nalStart) {
+            AnalyzeNal(pState, pData + nalStart, nalEnd - nalStart, framingOffset);
+        }
+
+        start = next;
+        startCodeLength = nextLength;
+        framingOffset = start;
+    }
+}
+
+// 1回の走査でストリームを解析する関数
+HRESULT AnalyzeBitstream(const BYTE* pData, size_t size, BitstreamFormat format, double frameRate,
+                         UINT32 windowFrames, BitstreamStatistics* pStats)
+{
+    if (!pStats || (!pData && size > 0)) {
+        return E_POINTER;
+    }
+    if (frameRate <= 0.0 || windowFrames == 0) {
+        return E_INVALIDARG;
+    }
+
+    pStats->fileSize = size;
+    pStats->nalCount = 0;
+    pStats->invalidNalCount = 0;
+    memset(pStats->nalTypeCounts, 0, sizeof(pStats->nalTypeCounts));
+    memset(pStats->nalTypeBytes, 0, sizeof(pStats->nalTypeBytes));
+    memset(pStats->sliceTypeCounts, 0, sizeof(pStats->sliceTypeCounts));
+    pStats->frames.clear();
+    pStats->gopLengths.clear();
+    pStats->frameRate = frameRate;
+    pStats->windowFrames = windowFrames;
+    pStats->averageBitrate = 0.0;
+    pStats->minWindowBitrate = 0.0;
+    pStats->maxWindowBitrate = 0.0;
+    pStats->minFrameSize = 0;
+    pStats->maxFrameSize = 0;
+    pStats->maxKeyFrameSize = 0;
+
+    // 形式の自動判定 (先頭がスタートコードならAnnex B)
+    if (format == BITSTREAM_FORMAT_AUTO) {
+        bool startCode3 = size >= 3 && pData[0] == 0 && pData[1] == 0 && pData[2] == 1;
+        bool startCode4 = size >= 4 && pData[0] == 0 && pData[1] == 0 && pData[2] == 0 && pData[3] == 1;
+        format = (startCode3 || startCode4) ? BITSTREAM_FORMAT_ANNEX_B : BITSTREAM_FORMAT_LENGTH_PREFIXED;
+    }
+    pStats->format = format;
+
+    // フレーム数の見積もり (1フレーム平均4KB) で再確保を減らす
+    pStats->frames.reserve(size / 4096 + 16);
+
+    AnalyzerState state;
+    state.pStats = pStats;
+    memset(&state.current, 0, sizeof(state.current));
+    state.frameOpen = false;
+    state.hasSlice = false;
+    state.windowSizes.assign(windowFrames, 0);
+    state.windowPos = 0;
+    state.windowSum = 0;
+    state.framesInWindow = 0;
+    state.windowFilled = false;
+    state.framesSinceIdr = 0;
+    state.seenIdr = false;
+    state.totalFrameBytes = 0;
+
+    if (format == BITSTREAM_FORMAT_ANNEX_B) {
+        AnalyzeAnnexBRange(&state, pData, 0, size, 0);
+    } else {
+        size_t pos = 0;
+        while (pos + 4 <= size) {
+            size_t length = (static_cast<size_t>(pData[pos]) << 24) | (static_cast<size_t>(pData[pos + 1]) << 16) |
+                            (static_cast<size_t>(pData[pos + 2]) << 8) | pData[pos + 3];
+            size_t payload = pos + 4;
+            if (length > size - payload) {
+                // 途中で切れたレコード
+                pStats->invalidNalCount++;
+                break;
+            }
+            // レコード内にスタートコードがあればAnnex Bとして分割する (SplitNalUnitsと同じ扱い)
+            size_t startCodeLength = 0;
+            if (length > 0 && FindStartCode(pData, payload, payload + length, &startCodeLength) < payload + length) {
+                AnalyzeAnnexBRange(&state, pData, payload, payload + length, pos);
+            } else if (length > 0) {
+                AnalyzeNal(&state, pData + payload, length, pos);
+            }
+            pos = payload + length;
+        }
+    }
+    FinishFrame(&state, size);
+
+    if (!pStats->frames.empty()) {
+        pStats->averageBitrate = state.totalFrameBytes * 8.0 * frameRate / pStats->frames.size();
+    }
+    if (!state.windowFilled && !pStats->frames.empty()) {
+        // ウィンドウより短いストリームでは全体の値を使う
+        pStats->minWindowBitrate = pStats->frames.back().windowBitrate;
+        pStats->maxWindowBitrate = pStats->frames.back().windowBitrate;
+    }
+    if (state.seenIdr) {
+        pStats->gopLengths.push_back(state.framesSinceIdr);
+    }
+    return S_OK;
+}
+
+// 形式の名前を返す (ログ・レポート用)
+const char* GetBitstreamFormatName(BitstreamFormat format)
+{
+    switch (format) {
+    case BITSTREAM_FORMAT_ANNEX_B: return "annexb";
+    case BITSTREAM_FORMAT_LENGTH_PREFIXED: return "length-prefixed";
+    default: return "auto";
+    }
+}
+
+// GOP長の最小・最大・平均
+static void GetGopRange(const BitstreamStatistics* pStats, UINT32* pMin, UINT32* pMax, double* pAverage)
+{
+    *pMin = 0;
+    *pMax = 0;
+    *pAverage = 0.0;
+    UINT64 total = 0;
+    for (size_t i = 0; i < pStats->gopLengths.size(); i++) {
+        UINT32 length = pStats->gopLengths[i];
+        if (i == 0 || length < *pMin) {
+            *pMin = length;
+        }
+        if (length > *pMax) {
+            *pMax = length;
+        }
+        total += length;
+    }
+    if (!pStats->gopLengths.empty()) {
+        *pAverage = static_cast<double>(total) / pStats->gopLengths.size();
+    }
+}
+
+// 統計の概要を表示する関数
+void PrintBitstreamSummary(const BitstreamStatistics* pStats)
+{
+    size_t frameCount = pStats->frames.size();
+    printf("Format: %s, %llu bytes, %llu NAL units (%llu invalid), %zu frames\n",
+           GetBitstreamFormatName(pStats->format),
+           static_cast<unsigned long long>(pStats->fileSize),
+           static_cast<unsigned long long>(pStats->nalCount),
+           static_cast<unsigned long long>(pStats->invalidNalCount), frameCount);
+
+    printf("NAL types:\n");
+    for (int type = 0; type < 32; type++) {
+        if (pStats->nalTypeCounts[type] == 0) {
+            continue;
+        }
+        printf("  %2d %-12s %10llu units %14llu bytes\n", type, GetNalUnitTypeName(static_cast<BYTE>(type)),
+               static_cast<unsigned long long>(pStats->nalTypeCounts[type]),
+               static_cast<unsigned long long>(pStats->nalTypeBytes[type]));
+    }
+
+    printf("Frames: I %llu, P %llu, B %llu, SP/SI %llu\n",
+           static_cast<unsigned long long>(pStats->sliceTypeCounts[2]),
+           static_cast<unsigned long long>(pStats->sliceTypeCounts[0]),
+           static_cast<unsigned long long>(pStats->sliceTypeCounts[1]),
+           static_cast<unsigned long long>(pStats->sliceTypeCounts[3]));
+    if (frameCount > 0) {
+        printf("Frame size: min %u, max %u, avg %.0f bytes (max key frame %u)\n",
+               pStats->minFrameSize, pStats->maxFrameSize,
+               pStats->averageBitrate / 8.0 / pStats->frameRate, pStats->maxKeyFrameSize);
+    }
+
+    UINT32 gopMin = 0;
+    UINT32 gopMax = 0;
+    double gopAverage = 0.0;
+    GetGopRange(pStats, &gopMin, &gopMax, &gopAverage);
+    printf("GOP (IDR spacing): %zu GOPs, min %u, max %u, avg %.1f frames\n",
+           pStats->gopLengths.size(), gopMin, gopMax, gopAverage);
+
+    printf("Bitrate @ %.3f fps: avg %.1f kbps, %u-frame window min %.1f / max %.1f kbps\n",
+           pStats->frameRate, pStats->averageBitrate / 1000.0, pStats->windowFrames,
+           pStats->minWindowBitrate / 1000.0, pStats->maxWindowBitrate / 1000.0);
+}
+
+// 概要・NALタイプ分布・GOP構造をJSONで書き出す関数
+HRESULT WriteBitstreamReportJson(const BitstreamStatistics* pStats, const char* filename)
+{
+    FILE* pFile = fopen(filename, "w");
+    if (!pFile) {
+        printf("Failed to open %s for writing.\n", filename);
+        return E_FAIL;
+    }
+
+    UINT32 gopMin = 0;
+    UINT32 gopMax = 0;
+    double gopAverage = 0.0;
+    GetGopRange(pStats, &gopMin, &gopMax, &gopAverage);
+    size_t frameCount = pStats->frames.size();
+
+    fprintf(pFile, "{\n");
+    fprintf(pFile, "  \"format\": \"%s\",\n", GetBitstreamFormatName(pStats->format));
+    fprintf(pFile, "  \"fileSize\": %llu,\n", static_cast<unsigned long long>(pStats->fileSize));
+    fprintf(pFile, "  \"nalCount\": %llu,\n", static_cast<unsigned long long>(pStats->nalCount));
+    fprintf(pFile, "  \"invalidNalCount\": %llu,\n", static_cast<unsigned long long>(pStats->invalidNalCount));
+    fprintf(pFile, "  \"frameCount\": %zu,\n", frameCount);
+    fprintf(pFile, "  \"frameRate\": %.6f,\n", pStats->frameRate);
+    fprintf(pFile, "  \"bitrate\": { \"average\": %.1f, \"windowFrames\": %u, \"windowMin\": %.1f, \"windowMax\": %.1f },\n",
+            pStats->averageBitrate, pStats->windowFrames, pStats->minWindowBitrate, pStats->maxWindowBitrate);
+    fprintf(pFile, "  \"frameSize\": { \"min\": %u, \"max\": %u, \"average\": %.1f, \"maxKeyFrame\": %u },\n",
+            pStats->minFrameSize, pStats->maxFrameSize,
+            frameCount ? pStats->averageBitrate / 8.0 / pStats->frameRate : 0.0, pStats->maxKeyFrameSize);
+    fprintf(pFile, "  \"sliceTypes\": { \"I\": %llu, \"P\": %llu, \"B\": %llu, \"SP/SI\": %llu },\n",
+            static_cast<unsigned long long>(pStats->sliceTypeCounts[2]),
+            static_cast<unsigned long long>(pStats->sliceTypeCounts[0]),
+            static_cast<unsigned long long>(pStats->sliceTypeCounts[1]),
+            static_cast<unsigned long long>(pStats->sliceTypeCounts[3]));
+
+    fprintf(pFile, "  \"nalTypes\": [");
+    bool first = true;
+    for (int type = 0; type < 32; type++) {
+        if (pStats->nalTypeCounts[type] == 0) {
+            continue;
+        }
+        fprintf(pFile, "%s\n    { \"type\": %d, \"name\": \"%s\", \"count\": %llu, \"bytes\": %llu }",
+                first ? "" : ",", type, GetNalUnitTypeName(static_cast<BYTE>(type)),
+                static_cast<unsigned long long>(pStats->nalTypeCounts[type]),
+                static_cast<unsigned long long>(pStats->nalTypeBytes[type]));
+        first = false;
+    }
+    fprintf(pFile, "\n  ],\n");
+
+    fprintf(pFile, "  \"gop\": { \"count\": %zu, \"min\": %u, \"max\": %u, \"average\": %.2f, \"lengths\": [",
+            pStats->gopLengths.size(), gopMin, gopMax, gopAverage);
+    for (size_t i = 0; i < pStats->gopLengths.size(); i++) {
+        fprintf(pFile, "%s%u", i ? ", " : "", pStats->gopLengths[i]);
+    }
+    fprintf(pFile, "] }\n");
+    fprintf(pFile, "}\n");
+
+    bool failed = ferror(pFile) != 0;
+    fclose(pFile);
+    return failed ? E_FAIL : S_OK;
+}
+
+// フレームごとの統計をCSVで書き出す関数
+HRESULT WriteBitstreamReportCsv(const BitstreamStatistics* pStats, const char* filename)
+{
+    FILE* pFile = fopen(filename, "w");
+    if (!pFile) {
+        printf("Failed to open %s for writing.\n", filename);
+        return E_FAIL;
+    }
+
+    fprintf(pFile, "frame,offset,size,nal_count,slice_type,key_frame,window_bitrate_bps\n");
+    for (size_t i = 0; i < pStats->frames.size(); i++) {
+        const BitstreamFrame& frame = pStats->frames[i];
+        fprintf(pFile, "%zu,%llu,%u,%u,%c,%d,%.0f\n", i, static_cast<unsigned long long>(frame.offset),
+                frame.size, frame.nalCount, frame.sliceType, frame.keyFrame ? 1 : 0, frame.windowBitrate);
+    }
+
+    bool failed = ferror(pFile) != 0;
+    fclose(pFile);
+    return failed ? E_FAIL : S_OK;
+}
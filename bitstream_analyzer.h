@@ -0,0 +1,61 @@
+#pragma once
+
+#include "portable_types.h"
+#include <vector>
+
+// 入力ストリームの形式
+enum BitstreamFormat {
+    BITSTREAM_FORMAT_AUTO = 0,             // 先頭のスタートコードの有無で判定する
+    BITSTREAM_FORMAT_ANNEX_B = 1,          // スタートコード区切り (00 00 01 / 00 00 00 01)
+    BITSTREAM_FORMAT_LENGTH_PREFIXED = 2   // 4バイトのビッグエンディアン長 + データ (output.h264の形式)
+};
+
+// 1フレーム (アクセスユニット) 分の統計
+struct BitstreamFrame {
+    UINT64 offset;                     // ファイル内の先頭位置 (スタートコード・長さを含む)
+    UINT32 size;                       // ファイル上のバイト数 (次のフレームの先頭まで)
+    UINT32 nalCount;                   // NALユニット数
+    char sliceType;                    // 'I' / 'P' / 'B' / 'S' (スライスを解析できなければ '?')
+    BOOL keyFrame;                     // IDRスライスを含むか
+    double windowBitrate;              // このフレームで終わるスライディングウィンドウのビットレート (bps)
+};
+
+// ストリーム全体の統計
+struct BitstreamStatistics {
+    BitstreamFormat format;            // 実際に解析した形式
+    UINT64 fileSize;                   // 入力サイズ
+    UINT64 nalCount;                   // NALユニット数
+    UINT64 invalidNalCount;            // forbidden_zero_bitが立っている・長さが不正なNALユニット数
+    UINT64 nalTypeCounts[32];          // nal_unit_typeごとの個数
+    UINT64 nalTypeBytes[32];           // nal_unit_typeごとのバイト数 (NALヘッダー以降)
+    UINT64 sliceTypeCounts[4];         // フレームのスライスタイプごとの個数 (P, B, I, SP/SI)
+
+    std::vector<BitstreamFrame> frames; // フレームごとの統計
+    std::vector<UINT32> gopLengths;    // IDRからIDRまでのフレーム数 (最後のGOPは末尾まで)
+
+    double frameRate;                  // ビットレート計算に使うフレームレート
+    UINT32 windowFrames;               // スライディングウィンドウのフレーム数
+    double averageBitrate;             // ストリーム全体の平均ビットレート (bps)
+    double minWindowBitrate;           // ウィンドウビットレートの最小 (ウィンドウが埋まってから)
+    double maxWindowBitrate;           // ウィンドウビットレートの最大
+    UINT32 minFrameSize;
+    UINT32 maxFrameSize;
+    UINT32 maxKeyFrameSize;
+};
+
+// 1回の走査でストリームを解析する関数
+// フレームの区切りはAUD/SPS/PPS/SEIの出現とfirst_mb_in_slice == 0で判定する
+HRESULT AnalyzeBitstream(const BYTE* pData, size_t size, BitstreamFormat format, double frameRate,
+                         UINT32 windowFrames, BitstreamStatistics* pStats);
+
+// 統計の概要を表示する関数
+void PrintBitstreamSummary(const BitstreamStatistics* pStats);
+
+// 概要・NALタイプ分布・GOP構造をJSONで書き出す関数
+HRESULT WriteBitstreamReportJson(const BitstreamStatistics* pStats, const char* filename);
+
+// フレームごとの統計をCSVで書き出す関数
+HRESULT WriteBitstreamReportCsv(const BitstreamStatistics* pStats, const char* filename);
+
+// 形式の名前を返す (ログ・レポート用)
+const char* GetBitstreamFormatName(BitstreamFormat format);
@@ -0,0 +1,233 @@
+#include "bitstream_cache.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+// エントリーのファイルの拡張子
+#define BITSTREAM_EXTENSION ".h264"
+#define KEY_EXTENSION ".key"
+#define TEMPORARY_EXTENSION ".tmp"
+
+// 64ビットのFNV-1aハッシュ
+static UINT64 HashFnv1a(const std::string& text)
+{
+    UINT64 hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < text.size(); i++) {
+        hash ^= static_cast<BYTE>(text[i]);
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static std::string GetEntryPath(const char* directory, const BitstreamCacheKey* pKey, const char* extension)
+{
+    return std::string(directory) + "/" + pKey->name + extension;
+}
+
+void InitializeBitstreamCacheKey(BitstreamCacheKey* pKey)
+{
+    pKey->description.clear();
+    pKey->name.clear();
+    AddBitstreamCacheKeyField(pKey, "cache_version", static_cast<UINT64>(BITSTREAM_CACHE_VERSION));
+}
+
+void AddBitstreamCacheKeyField(BitstreamCacheKey* pKey, const char* field, const char* value)
+{
+    pKey->description += field;
+    pKey->description += '=';
+    pKey->description += value;
+    pKey->description += '\n';
+}
+
+void AddBitstreamCacheKeyField(BitstreamCacheKey* pKey, const char* field, UINT64 value)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(value));
+    AddBitstreamCacheKeyField(pKey, field, text);
+}
+
+void FinishBitstreamCacheKey(BitstreamCacheKey* pKey)
+{
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(HashFnv1a(pKey->description)));
+    pKey->name = name;
+}
+
+// ファイル全体を読み込む (なければfalse)
+static bool ReadTextFile(const std::string& path, std::string* pText)
+{
+    FILE* pFile = fopen(path.c_str(), "rb");
+    if (!pFile) {
+        return false;
+    }
+    pText->clear();
+    char buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0) {
+        pText->append(buffer, read);
+    }
+    fclose(pFile);
+    return true;
+}
+
+// 長さプレフィックス形式 (ビッグエンディアン4バイト) をNALユニットのビューに分ける (形式が壊れていればfalse)
+static bool SplitLengthPrefixed(const BYTE* data, size_t size, std::vector<NalUnitView>& nalUnits)
+{
+    size_t pos = 0;
+    while (pos < size) {
+        if (size - pos < 4) {
+            return false;
+        }
+        size_t length = (static_cast<size_t>(data[pos]) << 24) | (data[pos + 1] << 16) | (data[pos + 2] << 8) | data[pos + 3];
+        pos += 4;
+        if (length == 0 || length > size - pos) {
+            return false;
+        }
+        NalUnitView view;
+        view.pData = data + pos;
+        view.size = length;
+        view.type = GetNalUnitType(data[pos]);
+        nalUnits.push_back(view);
+        pos += length;
+    }
+    return true;
+}
+
+HRESULT LookupBitstreamCache(const char* directory, const BitstreamCacheKey* pKey, BitstreamCacheEntry* pEntry)
+{
+    if (!directory || !pKey || !pEntry || pKey->name.empty()) {
+        return E_INVALIDARG;
+    }
+    pEntry->file.pData = NULL;
+    pEntry->file.size = 0;
+    pEntry->nalUnits.clear();
+
+    // .keyは.h264の後に書くので、.keyがあれば.h264は書き終わっている
+    std::string storedDescription;
+    if (!ReadTextFile(GetEntryPath(directory, pKey, KEY_EXTENSION), &storedDescription)) {
+        printf("Bitstream cache miss: %s\n", pKey->name.c_str());
+        return S_FALSE;
+    }
+    if (storedDescription != pKey->description) {
+        printf("Bitstream cache miss: %s (key collision, entry will be replaced)\n", pKey->name.c_str());
+        return S_FALSE;
+    }
+
+    std::string path = GetEntryPath(directory, pKey, BITSTREAM_EXTENSION);
+    if (FAILED(OpenMappedFile(&pEntry->file, path.c_str()))) {
+        return S_FALSE;
+    }
+    if (!pEntry->file.pData || !SplitLengthPrefixed(pEntry->file.pData, pEntry->file.size, pEntry->nalUnits)) {
+        printf("Bitstream cache entry is corrupt: %s\n", path.c_str());
+        CloseMappedFile(&pEntry->file);
+        pEntry->nalUnits.clear();
+        return S_FALSE;
+    }
+    printf("Bitstream cache hit: %s (%zu NAL units, %zu bytes)\n", path.c_str(), pEntry->nalUnits.size(),
+           pEntry->file.size);
+    return S_OK;
+}
+
+// 書き終えた一時ファイルをエントリーの名前にする (既存のエントリーは置き換える)
+static bool ReplaceFile(const std::string& temporaryPath, const std::string& path)
+{
+#ifdef _WIN32
+    return MoveFileExA(temporaryPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+static bool CreateCacheDirectory(const char* directory)
+{
+#ifdef _WIN32
+    int result = _mkdir(directory);
+#else
+    int result = mkdir(directory, 0755);
+#endif
+    return result == 0 || errno == EEXIST;
+}
+
+HRESULT StoreBitstreamCache(const char* directory, const BitstreamCacheKey* pKey, const NalStore* pStore)
+{
+    if (!directory || !pKey || !pStore || pKey->name.empty()) {
+        return E_INVALIDARG;
+    }
+    // 先頭のチャンクを解放済みのストアでは、SPS/PPSや最初のIDRが欠けたエントリーになってしまう
+    if (pStore->firstLiveEntry != 0) {
+        printf("Bitstream cache: the NAL store has released its first %zu NAL units\n", pStore->firstLiveEntry);
+        return E_UNEXPECTED;
+    }
+    if (!CreateCacheDirectory(directory)) {
+        printf("Failed to create bitstream cache directory: %s\n", directory);
+        return E_FAIL;
+    }
+
+    // 古いキーを先に消し、ビットストリームを置き換える間にヒットしないようにする
+    std::string keyPath = GetEntryPath(directory, pKey, KEY_EXTENSION);
+    remove(keyPath.c_str());
+
+    // ビットストリーム (output.h264と同じ形式)
+    std::string path = GetEntryPath(directory, pKey, BITSTREAM_EXTENSION);
+    std::string temporaryPath = path + TEMPORARY_EXTENSION;
+    FILE* pFile = fopen(temporaryPath.c_str(), "wb");
+    if (!pFile) {
+        printf("Failed to open %s for writing.\n", temporaryPath.c_str());
+        return E_FAIL;
+    }
+    bool written = true;
+    const size_t nalCount = GetNalStoreCount(pStore);
+    for (size_t i = 0; written && i < nalCount; i++) {
+        NalUnitView nalUnit = GetNalStoreUnit(pStore, i);
+        BYTE lengthBytes[4];
+        lengthBytes[0] = (nalUnit.size >> 24) & 0xFF;
+        lengthBytes[1] = (nalUnit.size >> 16) & 0xFF;
+        lengthBytes[2] = (nalUnit.size >> 8) & 0xFF;
+        lengthBytes[3] = nalUnit.size & 0xFF;
+        written = fwrite(lengthBytes, 1, 4, pFile) == 4 && fwrite(nalUnit.pData, 1, nalUnit.size, pFile) == nalUnit.size;
+    }
+    if (fclose(pFile) != 0) {
+        written = false;
+    }
+    if (!written || !ReplaceFile(temporaryPath, path)) {
+        printf("Failed to write bitstream cache entry: %s\n", path.c_str());
+        remove(temporaryPath.c_str());
+        return E_FAIL;
+    }
+
+    // キー (これがあるエントリーだけをヒットとして扱う)
+    std::string temporaryKeyPath = keyPath + TEMPORARY_EXTENSION;
+    pFile = fopen(temporaryKeyPath.c_str(), "wb");
+    if (!pFile) {
+        printf("Failed to open %s for writing.\n", temporaryKeyPath.c_str());
+        return E_FAIL;
+    }
+    written = fwrite(pKey->description.data(), 1, pKey->description.size(), pFile) == pKey->description.size();
+    if (fclose(pFile) != 0) {
+        written = false;
+    }
+    if (!written || !ReplaceFile(temporaryKeyPath, keyPath)) {
+        printf("Failed to write bitstream cache key: %s\n", keyPath.c_str());
+        remove(temporaryKeyPath.c_str());
+        return E_FAIL;
+    }
+
+    printf("Bitstream cache stored: %s (%zu NAL units)\n", path.c_str(), nalCount);
+    return S_OK;
+}
+
+void CloseBitstreamCacheEntry(BitstreamCacheEntry* pEntry)
+{
+    // ヒットしたエントリー (NALユニットが1つ以上ある) だけがファイルを開いている
+    if (!pEntry || pEntry->nalUnits.empty()) {
+        return;
+    }
+    CloseMappedFile(&pEntry->file);
+    pEntry->nalUnits.clear();
+}
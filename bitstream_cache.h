@@ -0,0 +1,56 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nal_parser.h"
+#include "nal_store.h"
+#include "mapped_file.h"
+#include <string>
+#include <vector>
+
+// エンコード結果のディスクキャッシュ (内容アドレス方式)
+// - キーはソースの説明 (テストパターンのパラメーターなど) とエンコーダーの設定を "名前=値" の行で並べた文字列で、
+//   エントリーのファイル名はそのハッシュにする
+// - 値はoutput.h264と同じ長さプレフィックス形式のビットストリーム
+//   ヒットしたらメモリマップしてそのまま使うので、エンコーダーの起動もエンコードもしない
+// - キーの文字列もエントリーと一緒に保存し、ヒットしたときに一致を確かめる (ハッシュの衝突で別の結果を使わないように)
+// - 一時ファイルに書いてから名前を変えるので、書き込み中に止まっても壊れたエントリーは残らない
+// エンコーダーの出力が変わる変更をしたときは、BITSTREAM_CACHE_VERSIONを上げるか、キャッシュのディレクトリを消すこと
+
+// キーに含めるキャッシュの版 (エンコーダーの出力が変わったら上げる)
+#define BITSTREAM_CACHE_VERSION 1
+
+// 既定のキャッシュのディレクトリ
+#define BITSTREAM_CACHE_DEFAULT_DIRECTORY "nal_cache"
+
+// キャッシュのキー
+struct BitstreamCacheKey {
+    std::string description;           // 設定を "名前=値" の行で並べた文字列 (エントリーの.keyファイルの中身)
+    std::string name;                  // descriptionのハッシュ (16進数、エントリーのファイル名)
+};
+
+// ヒットしたエントリー
+struct BitstreamCacheEntry {
+    MappedFile file;                   // 長さプレフィックス形式のビットストリーム
+    std::vector<NalUnitView> nalUnits; // fileの中を指すビュー (CloseBitstreamCacheEntryまで有効)
+};
+
+// キーを空にして、キャッシュの版だけを入れる関数
+void InitializeBitstreamCacheKey(BitstreamCacheKey* pKey);
+
+// キーに設定を1つ追加する関数 (追加する順番もキーの一部)
+void AddBitstreamCacheKeyField(BitstreamCacheKey* pKey, const char* field, const char* value);
+void AddBitstreamCacheKeyField(BitstreamCacheKey* pKey, const char* field, UINT64 value);
+
+// 追加した設定からエントリーの名前を求める関数
+void FinishBitstreamCacheKey(BitstreamCacheKey* pKey);
+
+// エントリーを探してメモリマップする関数
+// ヒットしたらS_OK、エントリーがない (キーが一致しない・壊れている場合も含む) ならS_FALSE
+HRESULT LookupBitstreamCache(const char* directory, const BitstreamCacheKey* pKey, BitstreamCacheEntry* pEntry);
+
+// ストアのNALユニットを長さプレフィックス形式でエントリーに書き込む関数 (ディレクトリがなければ作る)
+// ストアの先頭のチャンクを解放済み (ReleaseNalStoreChunks後) ならE_UNEXPECTED
+HRESULT StoreBitstreamCache(const char* directory, const BitstreamCacheKey* pKey, const NalStore* pStore);
+
+// エントリーのメモリマップを解除する関数
+void CloseBitstreamCacheEntry(BitstreamCacheEntry* pEntry);
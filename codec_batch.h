@@ -0,0 +1,80 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include "encoded_sample.h"
+#include <stddef.h>
+#include <vector>
+
+// バッチAPI (EncodeFrameBatch/DecodeNalBatch) の出力先
+// アリーナは呼び出し側が所有し、バッチをまたいで使い回す
+// 各バッチの先頭でclearするだけなので容量は残り、同じ大きさのバッチが続けば確保は発生しない
+// Media Foundationとソフトウェアの両方のバックエンドで共通に使う
+
+// アリーナ内のNALユニット1つの位置 (スタートコードなし)
+struct BatchNalRange {
+    size_t offset;                     // data内の先頭
+    size_t size;                       // バイト数
+};
+
+// エンコード結果の出力サンプル1つ分
+struct EncodeBatchItem {
+    size_t inputIndex;                 // このサンプルが出力されたときに入力したフレームの番号 (バッチ内)
+    EncodedSampleInfo sample;          // タイムスタンプとNALユニットの範囲 (firstNalIndexはnals内の番号)
+};
+
+// エンコードのバッチ出力
+struct EncodeBatchArena {
+    std::vector<BYTE> data;            // 全NALユニットを出力順に続けて詰めたもの
+    std::vector<BatchNalRange> nals;   // NALユニットの位置 (出力順)
+    std::vector<EncodeBatchItem> items; // 出力サンプル (出力順)
+};
+
+// デコード結果のフレーム1つ分
+struct DecodeBatchItem {
+    size_t nalIndex;                   // このフレームが出力されたときに入力したNALユニットの番号 (バッチ内)
+    size_t offset;                     // data内の先頭 (隙間なく詰めたNV12、width x codedHeight)
+    size_t size;                       // バイト数
+};
+
+// デコードのバッチ出力
+struct DecodeBatchArena {
+    std::vector<BYTE> data;            // 全フレームを出力順に続けて詰めたもの
+    std::vector<DecodeBatchItem> frames; // フレームの位置 (出力順)
+    UINT32 width;                      // フレームの幅 (行ピッチも同じ)
+    UINT32 codedHeight;                // フレームの符号化高さ
+    UINT32 height;                     // 表示高さ
+};
+
+// エンコードのバッチ出力を空にする (容量は残す)
+inline void ResetEncodeBatchArena(EncodeBatchArena* pArena)
+{
+    pArena->data.clear();
+    pArena->nals.clear();
+    pArena->items.clear();
+}
+
+// デコードのバッチ出力を空にする (容量は残す)
+inline void ResetDecodeBatchArena(DecodeBatchArena* pArena, UINT32 width, UINT32 height, UINT32 codedHeight)
+{
+    pArena->data.clear();
+    pArena->frames.clear();
+    pArena->width = width;
+    pArena->height = height;
+    pArena->codedHeight = codedHeight;
+}
+
+// デコード結果のフレームを、アリーナを指すストライド付きフレームのビューとして返す
+// (ビューはアリーナを次のバッチで使うまで有効)
+inline Nv12Frame GetDecodeBatchFrame(const DecodeBatchArena* pArena, size_t index)
+{
+    Nv12Frame view = {};
+    view.pY = const_cast<BYTE*>(pArena->data.data()) + pArena->frames[index].offset;
+    view.pUV = view.pY + static_cast<size_t>(pArena->width) * pArena->codedHeight;
+    view.width = pArena->width;
+    view.height = pArena->codedHeight;
+    view.stride = pArena->width;
+    view.cropWidth = pArena->width;
+    view.cropHeight = pArena->height;
+    return view;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stddef.h>
+
+// エンコーダーのフレームレート (Media Foundationとソフトウェアの両方のエンコーダーで共通)
+#define ENCODER_FRAME_RATE_NUM 30
+#define ENCODER_FRAME_RATE_DENOM 1
+
+// エンコーダー出力サンプル1つ分の情報 (outputNalUnits内の範囲とタイムスタンプ)
+// Media Foundationとソフトウェアの両方のエンコーダーで共通に使う
+struct EncodedSampleInfo {
+    LONGLONG sampleTime;               // サンプル時刻 (100ns単位、EncodeFrameが設定した値)
+    LONGLONG duration;                 // サンプルの長さ (100ns単位)
+    BOOL keyFrame;                     // キーフレーム (CleanPoint) かどうか
+    size_t firstNalIndex;              // 出力NALユニット配列内の先頭インデックス
+    size_t nalCount;                   // このサンプルから取り出したNALユニット数
+};
@@ -0,0 +1,587 @@
+#include "fmp4_muxer.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// 簡素化されたエラーチェック用マクロ
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// MFのタイムスタンプと同じ100ns単位
+static const UINT32 FMP4_TIMESCALE = 10000000;
+
+// trunのサンプルフラグ
+static const UINT32 SAMPLE_FLAGS_SYNC = 0x02000000;      // sample_depends_on = 2 (他に依存しない)
+static const UINT32 SAMPLE_FLAGS_NON_SYNC = 0x01010000;  // sample_depends_on = 1, is_non_sync_sample
+
+// ボックス書き込み用の関数群
+static void Put8(std::vector<BYTE>& buf, UINT32 value)
+{
+    buf.push_back(static_cast<BYTE>(value));
+}
+
+static void Put16(std::vector<BYTE>& buf, UINT32 value)
+{
+    buf.push_back(static_cast<BYTE>(value >> 8));
+    buf.push_back(static_cast<BYTE>(value));
+}
+
+static void Put32(std::vector<BYTE>& buf, UINT32 value)
+{
+    buf.push_back(static_cast<BYTE>(value >> 24));
+    buf.push_back(static_cast<BYTE>(value >> 16));
+    buf.push_back(static_cast<BYTE>(value >> 8));
+    buf.push_back(static_cast<BYTE>(value));
+}
+
+static void Put64(std::vector<BYTE>& buf, UINT64 value)
+{
+    Put32(buf, static_cast<UINT32>(value >> 32));
+    Put32(buf, static_cast<UINT32>(value));
+}
+
+static void PutZeros(std::vector<BYTE>& buf, size_t count)
+{
+    buf.insert(buf.end(), count, 0);
+}
+
+static void PutFourCC(std::vector<BYTE>& buf, const char* fourcc)
+{
+    buf.insert(buf.end(), fourcc, fourcc + 4);
+}
+
+static void Patch32(std::vector<BYTE>& buf, size_t offset, UINT32 value)
+{
+    buf[offset + 0] = static_cast<BYTE>(value >> 24);
+    buf[offset + 1] = static_cast<BYTE>(value >> 16);
+    buf[offset + 2] = static_cast<BYTE>(value >> 8);
+    buf[offset + 3] = static_cast<BYTE>(value);
+}
+
+// ボックスを開始し、サイズを後で埋めるための位置を返す
+static size_t BeginBox(std::vector<BYTE>& buf, const char* type)
+{
+    size_t offset = buf.size();
+    Put32(buf, 0);
+    PutFourCC(buf, type);
+    return offset;
+}
+
+// FullBox (version + flags付き) を開始する
+static size_t BeginFullBox(std::vector<BYTE>& buf, const char* type, UINT32 version, UINT32 flags)
+{
+    size_t offset = BeginBox(buf, type);
+    Put32(buf, (version << 24) | (flags & 0xFFFFFF));
+    return offset;
+}
+
+// ボックスを閉じてサイズを埋める
+static void EndBox(std::vector<BYTE>& buf, size_t offset)
+{
+    Patch32(buf, offset, static_cast<UINT32>(buf.size() - offset));
+}
+
+// 単位行列 (mvhd/tkhd用)
+static void PutMatrix(std::vector<BYTE>& buf)
+{
+    static const UINT32 matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; i++) {
+        Put32(buf, matrix[i]);
+    }
+}
+
+// ギャザー書き込み (POSIXではwritevで、データをコピーせずにまとめて書き込む)
+static HRESULT WriteGather(FILE* pFile, const std::vector<Fmp4IoChunk>& chunks)
+{
+#ifdef _WIN32
+    // Windowsではstdioのバッファ経由で書き込む（大きなペイロードはバッファを経由しない）
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (fwrite(chunks[i].pData, 1, chunks[i].size, pFile) != chunks[i].size) {
+            return E_FAIL;
+        }
+    }
+    return S_OK;
+#else
+    const size_t batchSize = 1024; // IOV_MAXの下限
+    struct iovec iov[batchSize];
+    int fd = fileno(pFile);
+    size_t index = 0;
+
+    while (index < chunks.size()) {
+        size_t count = 0;
+        while (count < batchSize && index + count < chunks.size()) {
+            iov[count].iov_base = const_cast<BYTE*>(chunks[index + count].pData);
+            iov[count].iov_len = chunks[index + count].size;
+            count++;
+        }
+
+        // 部分書き込みの場合は、書き込めた分だけiovを進めて再試行する
+        struct iovec* pIov = iov;
+        size_t remaining = count;
+        while (remaining > 0) {
+            ssize_t written = writev(fd, pIov, static_cast<int>(remaining));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return E_FAIL;
+            }
+            size_t done = static_cast<size_t>(written);
+            while (remaining > 0 && done >= pIov->iov_len) {
+                done -= pIov->iov_len;
+                pIov++;
+                remaining--;
+            }
+            if (remaining > 0) {
+                pIov->iov_base = static_cast<BYTE*>(pIov->iov_base) + done;
+                pIov->iov_len -= done;
+            }
+        }
+        index += count;
+    }
+    return S_OK;
+#endif
+}
+
+// ボックス1つ分を書き込む
+static HRESULT WriteBuffer(Fmp4Muxer* pMuxer, const std::vector<BYTE>& buf)
+{
+    pMuxer->ioChunks.clear();
+    Fmp4IoChunk chunk = { buf.data(), buf.size() };
+    pMuxer->ioChunks.push_back(chunk);
+    HRESULT hr = WriteGather(pMuxer->pFile, pMuxer->ioChunks);
+    if (SUCCEEDED(hr)) {
+        pMuxer->bytesWritten += buf.size();
+    }
+    return hr;
+}
+
+// avcC (AVCDecoderConfigurationRecord) を書き込む
+static void PutAvcC(Fmp4Muxer* pMuxer, std::vector<BYTE>& buf)
+{
+    const std::vector<BYTE>& sps = pMuxer->sps;
+    const std::vector<BYTE>& pps = pMuxer->pps;
+
+    size_t avcC = BeginBox(buf, "avcC");
+    Put8(buf, 1);                      // configurationVersion
+    Put8(buf, sps[1]);                 // AVCProfileIndication
+    Put8(buf, sps[2]);                 // profile_compatibility
+    Put8(buf, sps[3]);                 // AVCLevelIndication
+    Put8(buf, 0xFC | 3);               // lengthSizeMinusOne = 3 (4バイトの長さプレフィックス)
+    Put8(buf, 0xE0 | 1);               // numOfSequenceParameterSets
+    Put16(buf, static_cast<UINT32>(sps.size()));
+    buf.insert(buf.end(), sps.begin(), sps.end());
+    Put8(buf, 1);                      // numOfPictureParameterSets
+    Put16(buf, static_cast<UINT32>(pps.size()));
+    buf.insert(buf.end(), pps.begin(), pps.end());
+
+    // High系プロファイルでは4:2:0 8bitとして拡張フィールドを付ける
+    BYTE profile = sps[1];
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+        Put8(buf, 0xFC | 1);           // chroma_format = 1 (4:2:0)
+        Put8(buf, 0xF8 | 0);           // bit_depth_luma_minus8
+        Put8(buf, 0xF8 | 0);           // bit_depth_chroma_minus8
+        Put8(buf, 0);                  // numOfSequenceParameterSetExt
+    }
+    EndBox(buf, avcC);
+}
+
+// ftypとmoov (サンプルを持たない初期化セグメント) を書き出す
+static HRESULT WriteInitializationSegment(Fmp4Muxer* pMuxer)
+{
+    std::vector<BYTE>& buf = pMuxer->boxBuffer;
+    buf.clear();
+
+    size_t ftyp = BeginBox(buf, "ftyp");
+    PutFourCC(buf, "iso6");            // major_brand
+    Put32(buf, 0);                     // minor_version
+    PutFourCC(buf, "iso6");
+    PutFourCC(buf, "cmfc");
+    PutFourCC(buf, "isom");
+    PutFourCC(buf, "avc1");
+    PutFourCC(buf, "mp41");
+    EndBox(buf, ftyp);
+
+    size_t moov = BeginBox(buf, "moov");
+
+    size_t mvhd = BeginFullBox(buf, "mvhd", 0, 0);
+    Put32(buf, 0);                     // creation_time
+    Put32(buf, 0);                     // modification_time
+    Put32(buf, pMuxer->timescale);
+    Put32(buf, 0);                     // duration (フラグメント化されているので0)
+    Put32(buf, 0x00010000);            // rate 1.0
+    Put16(buf, 0x0100);                // volume 1.0
+    PutZeros(buf, 2 + 8);              // reserved
+    PutMatrix(buf);
+    PutZeros(buf, 6 * 4);              // pre_defined
+    Put32(buf, 2);                     // next_track_ID
+    EndBox(buf, mvhd);
+
+    size_t trak = BeginBox(buf, "trak");
+
+    size_t tkhd = BeginFullBox(buf, "tkhd", 0, 0x000003); // track_enabled | track_in_movie
+    Put32(buf, 0);                     // creation_time
+    Put32(buf, 0);                     // modification_time
+    Put32(buf, 1);                     // track_ID
+    Put32(buf, 0);                     // reserved
+    Put32(buf, 0);                     // duration
+    PutZeros(buf, 8);                  // reserved
+    Put16(buf, 0);                     // layer
+    Put16(buf, 0);                     // alternate_group
+    Put16(buf, 0);                     // volume (映像は0)
+    Put16(buf, 0);                     // reserved
+    PutMatrix(buf);
+    Put32(buf, pMuxer->width << 16);   // 16.16固定小数点
+    Put32(buf, pMuxer->height << 16);
+    EndBox(buf, tkhd);
+
+    size_t mdia = BeginBox(buf, "mdia");
+
+    size_t mdhd = BeginFullBox(buf, "mdhd", 0, 0);
+    Put32(buf, 0);                     // creation_time
+    Put32(buf, 0);                     // modification_time
+    Put32(buf, pMuxer->timescale);
+    Put32(buf, 0);                     // duration
+    Put16(buf, 0x55C4);                // language = "und"
+    Put16(buf, 0);                     // pre_defined
+    EndBox(buf, mdhd);
+
+    size_t hdlr = BeginFullBox(buf, "hdlr", 0, 0);
+    Put32(buf, 0);                     // pre_defined
+    PutFourCC(buf, "vide");
+    PutZeros(buf, 3 * 4);              // reserved
+    const char handlerName[] = "VideoHandler";
+    buf.insert(buf.end(), handlerName, handlerName + sizeof(handlerName)); // 終端の0を含む
+    EndBox(buf, hdlr);
+
+    size_t minf = BeginBox(buf, "minf");
+
+    size_t vmhd = BeginFullBox(buf, "vmhd", 0, 1);
+    Put16(buf, 0);                     // graphicsmode
+    PutZeros(buf, 3 * 2);              // opcolor
+    EndBox(buf, vmhd);
+
+    size_t dinf = BeginBox(buf, "dinf");
+    size_t dref = BeginFullBox(buf, "dref", 0, 0);
+    Put32(buf, 1);                     // entry_count
+    size_t url = BeginFullBox(buf, "url ", 0, 1); // 同じファイル内
+    EndBox(buf, url);
+    EndBox(buf, dref);
+    EndBox(buf, dinf);
+
+    size_t stbl = BeginBox(buf, "stbl");
+
+    size_t stsd = BeginFullBox(buf, "stsd", 0, 0);
+    Put32(buf, 1);                     // entry_count
+    size_t avc1 = BeginBox(buf, "avc1");
+    PutZeros(buf, 6);                  // reserved
+    Put16(buf, 1);                     // data_reference_index
+    Put16(buf, 0);                     // pre_defined
+    Put16(buf, 0);                     // reserved
+    PutZeros(buf, 3 * 4);              // pre_defined
+    Put16(buf, pMuxer->width);
+    Put16(buf, pMuxer->height);
+    Put32(buf, 0x00480000);            // horizresolution 72dpi
+    Put32(buf, 0x00480000);            // vertresolution 72dpi
+    Put32(buf, 0);                     // reserved
+    Put16(buf, 1);                     // frame_count
+    PutZeros(buf, 32);                 // compressorname
+    Put16(buf, 0x0018);                // depth
+    Put16(buf, 0xFFFF);                // pre_defined = -1
+    PutAvcC(pMuxer, buf);
+    EndBox(buf, avc1);
+    EndBox(buf, stsd);
+
+    // サンプルはすべてフラグメント側にあるので、テーブルは空
+    size_t stts = BeginFullBox(buf, "stts", 0, 0);
+    Put32(buf, 0);
+    EndBox(buf, stts);
+    size_t stsc = BeginFullBox(buf, "stsc", 0, 0);
+    Put32(buf, 0);
+    EndBox(buf, stsc);
+    size_t stsz = BeginFullBox(buf, "stsz", 0, 0);
+    Put32(buf, 0);                     // sample_size
+    Put32(buf, 0);                     // sample_count
+    EndBox(buf, stsz);
+    size_t stco = BeginFullBox(buf, "stco", 0, 0);
+    Put32(buf, 0);
+    EndBox(buf, stco);
+
+    EndBox(buf, stbl);
+    EndBox(buf, minf);
+    EndBox(buf, mdia);
+    EndBox(buf, trak);
+
+    size_t mvex = BeginBox(buf, "mvex");
+    size_t trex = BeginFullBox(buf, "trex", 0, 0);
+    Put32(buf, 1);                     // track_ID
+    Put32(buf, 1);                     // default_sample_description_index
+    Put32(buf, 0);                     // default_sample_duration
+    Put32(buf, 0);                     // default_sample_size
+    Put32(buf, 0);                     // default_sample_flags
+    EndBox(buf, trex);
+    EndBox(buf, mvex);
+
+    EndBox(buf, moov);
+
+    HRESULT hr = WriteBuffer(pMuxer, buf);
+    CHECK_HR(hr, "Write fMP4 initialization segment");
+
+    pMuxer->headerWritten = TRUE;
+    printf("fMP4 initialization segment written: %zu bytes (SPS %zu bytes, PPS %zu bytes)\n",
+           buf.size(), pMuxer->sps.size(), pMuxer->pps.size());
+    return hr;
+}
+
+// マルチプレクサーを初期化して出力ファイルを開く関数
+HRESULT InitializeFmp4Muxer(Fmp4Muxer* pMuxer, const char* filename, UINT32 width, UINT32 height,
+                            Fmp4FragmentMode fragmentMode, UINT32 fragmentDurationMs)
+{
+    if (!pMuxer || !filename || width == 0 || height == 0) {
+        return E_INVALIDARG;
+    }
+
+    pMuxer->pFile = fopen(filename, "wb");
+    if (!pMuxer->pFile) {
+        printf("Failed to open %s for writing.\n", filename);
+        return E_FAIL;
+    }
+
+    pMuxer->width = width;
+    pMuxer->height = height;
+    pMuxer->timescale = FMP4_TIMESCALE;
+    pMuxer->fragmentMode = fragmentMode;
+    pMuxer->fragmentDuration = static_cast<LONGLONG>(fragmentDurationMs) * 10000;
+    pMuxer->sps.clear();
+    pMuxer->pps.clear();
+    pMuxer->headerWritten = FALSE;
+    pMuxer->sequenceNumber = 1;
+    pMuxer->samples.clear();
+    pMuxer->payloads.clear();
+    pMuxer->bytesWritten = 0;
+    pMuxer->fragmentCount = 0;
+    pMuxer->sampleCount = 0;
+
+    printf("fMP4 muxer initialized: %s (%dx%d, %s)\n", filename, width, height,
+           fragmentMode == FMP4_FRAGMENT_PER_GOP ? "fragment per GOP" : "fragment per duration");
+    return S_OK;
+}
+
+// NALユニットに分割済みの1サンプルを追加する
+static HRESULT WriteSplitSample(Fmp4Muxer* pMuxer, std::vector<NalUnitView>& views,
+                                LONGLONG sampleTime, LONGLONG duration, BOOL keyFrame)
+{
+    HRESULT hr = S_OK;
+
+    // パラメータセットはavcCへ、スライス等はペイロードとして参照する
+    size_t payloadCount = 0;
+    UINT32 sampleSize = 0;
+    for (size_t i = 0; i < views.size(); i++) {
+        const NalUnitView& nal = views[i];
+        if (nal.type == NAL_TYPE_SPS) {
+            if (nal.size >= 4 && pMuxer->sps.empty()) {
+                pMuxer->sps.assign(nal.pData, nal.pData + nal.size);
+            }
+        } else if (nal.type == NAL_TYPE_PPS) {
+            if (pMuxer->pps.empty()) {
+                pMuxer->pps.assign(nal.pData, nal.pData + nal.size);
+            }
+        } else if (IsSliceNalType(nal.type) || nal.type == NAL_TYPE_SEI) {
+            if (nal.type == NAL_TYPE_IDR) {
+                keyFrame = TRUE;
+            }
+            views[payloadCount++] = nal;
+            sampleSize += static_cast<UINT32>(4 + nal.size);
+        }
+    }
+    if (payloadCount == 0) {
+        // パラメータセットだけのサンプルは書き出さない
+        return S_OK;
+    }
+
+    // 初期化セグメントはSPS/PPSが揃った時点で書き出す
+    if (!pMuxer->headerWritten) {
+        if (pMuxer->sps.empty() || pMuxer->pps.empty()) {
+            printf("fMP4: dropping sample before SPS/PPS\n");
+            return S_OK;
+        }
+        hr = WriteInitializationSegment(pMuxer);
+        CHECK_HR(hr, "WriteInitializationSegment");
+    }
+
+    // 直前のサンプルの長さはタイムスタンプの差から求める
+    // 間引いたフレームの分も直前のサンプルを伸ばして埋めるので、フラグメントを区切る前に決める
+    // (区切った後だと、前のフラグメントの終わりと次のtfdtの間に隙間ができる)
+    if (!pMuxer->samples.empty()) {
+        Fmp4PendingSample& previous = pMuxer->samples.back();
+        if (sampleTime > previous.sampleTime) {
+            previous.duration = sampleTime - previous.sampleTime;
+        }
+    }
+
+    // フラグメントの区切りを判定し、必要なら前のフラグメントを書き出す
+    if (!pMuxer->samples.empty()) {
+        const Fmp4PendingSample& first = pMuxer->samples.front();
+        bool cut = keyFrame ? true : false;
+        if (pMuxer->fragmentMode == FMP4_FRAGMENT_PER_DURATION &&
+            sampleTime - first.sampleTime >= pMuxer->fragmentDuration) {
+            cut = true;
+        }
+        if (cut) {
+            hr = Fmp4FlushFragment(pMuxer);
+            CHECK_HR(hr, "Fmp4FlushFragment");
+        }
+    }
+
+    size_t firstPayload = pMuxer->payloads.size();
+    pMuxer->payloads.insert(pMuxer->payloads.end(), views.begin(), views.begin() + payloadCount);
+
+    Fmp4PendingSample sample;
+    sample.sampleTime = sampleTime;
+    sample.duration = duration;
+    sample.size = sampleSize;
+    sample.keyFrame = keyFrame;
+    sample.firstPayload = firstPayload;
+    sample.payloadCount = payloadCount;
+    pMuxer->samples.push_back(sample);
+
+    return hr;
+}
+
+// 1サンプル (1フレーム分のNALユニット) を追加する関数
+HRESULT Fmp4WriteSample(Fmp4Muxer* pMuxer, const std::vector<BYTE>* pNalUnits, size_t nalCount,
+                        LONGLONG sampleTime, LONGLONG duration, BOOL keyFrame)
+{
+    if (!pMuxer || !pMuxer->pFile) {
+        return E_POINTER;
+    }
+
+    std::vector<NalUnitView> views;
+    for (size_t i = 0; i < nalCount; i++) {
+        SplitNalUnits(pNalUnits[i].data(), pNalUnits[i].size(), views);
+    }
+    return WriteSplitSample(pMuxer, views, sampleTime, duration, keyFrame);
+}
+
+// NALユニットのビューの配列を受け取る版
+HRESULT Fmp4WriteSample(Fmp4Muxer* pMuxer, const NalUnitView* pNalUnits, size_t nalCount,
+                        LONGLONG sampleTime, LONGLONG duration, BOOL keyFrame)
+{
+    if (!pMuxer || !pMuxer->pFile) {
+        return E_POINTER;
+    }
+
+    std::vector<NalUnitView> views;
+    for (size_t i = 0; i < nalCount; i++) {
+        SplitNalUnits(pNalUnits[i].pData, pNalUnits[i].size, views);
+    }
+    return WriteSplitSample(pMuxer, views, sampleTime, duration, keyFrame);
+}
+
+// 書き出し待ちのサンプルを1つのフラグメントとして書き出す関数
+HRESULT Fmp4FlushFragment(Fmp4Muxer* pMuxer)
+{
+    if (!pMuxer || !pMuxer->pFile) {
+        return E_POINTER;
+    }
+    if (pMuxer->samples.empty()) {
+        return S_OK;
+    }
+
+    const std::vector<Fmp4PendingSample>& samples = pMuxer->samples;
+    std::vector<BYTE>& buf = pMuxer->boxBuffer;
+    buf.clear();
+
+    // moof
+    size_t moof = BeginBox(buf, "moof");
+    size_t mfhd = BeginFullBox(buf, "mfhd", 0, 0);
+    Put32(buf, pMuxer->sequenceNumber);
+    EndBox(buf, mfhd);
+
+    size_t traf = BeginBox(buf, "traf");
+    size_t tfhd = BeginFullBox(buf, "tfhd", 0, 0x020000); // default-base-is-moof
+    Put32(buf, 1);                     // track_ID
+    EndBox(buf, tfhd);
+
+    size_t tfdt = BeginFullBox(buf, "tfdt", 1, 0);
+    Put64(buf, static_cast<UINT64>(samples.front().sampleTime)); // baseMediaDecodeTime
+    EndBox(buf, tfdt);
+
+    // data-offset | sample-duration | sample-size | sample-flags
+    size_t trun = BeginFullBox(buf, "trun", 0, 0x000701);
+    Put32(buf, static_cast<UINT32>(samples.size()));
+    size_t dataOffsetPosition = buf.size();
+    Put32(buf, 0);                     // data_offset (後で埋める)
+    UINT64 mdatPayloadSize = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        Put32(buf, static_cast<UINT32>(samples[i].duration));
+        Put32(buf, samples[i].size);
+        Put32(buf, samples[i].keyFrame ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+        mdatPayloadSize += samples[i].size;
+    }
+    EndBox(buf, trun);
+    EndBox(buf, traf);
+    EndBox(buf, moof);
+
+    // mdatのヘッダーもmoofの直後に置き、data_offsetはmoof先頭からの位置
+    Put32(buf, static_cast<UINT32>(8 + mdatPayloadSize));
+    PutFourCC(buf, "mdat");
+    Patch32(buf, dataOffsetPosition, static_cast<UINT32>(buf.size() - moof));
+
+    // 長さプレフィックスを先にすべて作ってから参照を組み立てる (再確保でポインタが無効にならないように)
+    const std::vector<NalUnitView>& payloads = pMuxer->payloads;
+    pMuxer->lengthPrefixes.resize(payloads.size() * 4);
+    for (size_t i = 0; i < payloads.size(); i++) {
+        Patch32(pMuxer->lengthPrefixes, i * 4, static_cast<UINT32>(payloads[i].size));
+    }
+
+    std::vector<Fmp4IoChunk>& chunks = pMuxer->ioChunks;
+    chunks.clear();
+    Fmp4IoChunk header = { buf.data(), buf.size() };
+    chunks.push_back(header);
+    for (size_t i = 0; i < payloads.size(); i++) {
+        Fmp4IoChunk prefix = { pMuxer->lengthPrefixes.data() + i * 4, 4 };
+        Fmp4IoChunk payload = { payloads[i].pData, payloads[i].size };
+        chunks.push_back(prefix);
+        chunks.push_back(payload);
+    }
+
+    HRESULT hr = WriteGather(pMuxer->pFile, chunks);
+    CHECK_HR(hr, "Write fMP4 fragment");
+
+    pMuxer->bytesWritten += buf.size() + mdatPayloadSize;
+    pMuxer->fragmentCount++;
+    pMuxer->sampleCount += samples.size();
+    pMuxer->sequenceNumber++;
+
+    printf("fMP4 fragment %u: %zu samples, %llu bytes\n", pMuxer->fragmentCount,
+           samples.size(), static_cast<unsigned long long>(mdatPayloadSize));
+
+    pMuxer->samples.clear();
+    pMuxer->payloads.clear();
+    return hr;
+}
+
+// 残りのサンプルを書き出してファイルを閉じる関数
+HRESULT CloseFmp4Muxer(Fmp4Muxer* pMuxer)
+{
+    if (!pMuxer || !pMuxer->pFile) {
+        return E_POINTER;
+    }
+
+    HRESULT hr = Fmp4FlushFragment(pMuxer);
+
+    fclose(pMuxer->pFile);
+    pMuxer->pFile = NULL;
+
+    printf("fMP4 muxer closed: %u fragments, %llu samples, %llu bytes\n", pMuxer->fragmentCount,
+           static_cast<unsigned long long>(pMuxer->sampleCount),
+           static_cast<unsigned long long>(pMuxer->bytesWritten));
+    return hr;
+}
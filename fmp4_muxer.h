@@ -0,0 +1,78 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nal_parser.h"
+#include <stdio.h>
+#include <vector>
+
+// フラグメント (moof + mdat) の区切り方
+enum Fmp4FragmentMode {
+    FMP4_FRAGMENT_PER_GOP = 0,         // キーフレームごとに区切る
+    FMP4_FRAGMENT_PER_DURATION = 1     // 指定時間ごとに区切る (キーフレームでも区切る)
+};
+
+// ギャザー書き込みの1要素 (データはコピーせず参照する)
+struct Fmp4IoChunk {
+    const BYTE* pData;
+    size_t size;
+};
+
+// 書き出し待ちのサンプル
+struct Fmp4PendingSample {
+    LONGLONG sampleTime;               // 100ns単位
+    LONGLONG duration;                 // 100ns単位
+    UINT32 size;                       // 長さプレフィックスを含むサイズ
+    BOOL keyFrame;
+    size_t firstPayload;               // payloads内の先頭インデックス
+    size_t payloadCount;
+};
+
+// フラグメント化MP4 (CMAF) マルチプレクサー構造体
+// サンプルのNALユニットはコピーせずに参照し、フラグメント書き出し時にギャザー書き込みする
+struct Fmp4Muxer {
+    FILE* pFile;                       // 出力ファイル
+
+    UINT32 width;                      // 表示幅
+    UINT32 height;                     // 表示高さ
+    UINT32 timescale;                  // タイムスケール (MFと同じ100ns単位 = 10000000)
+    Fmp4FragmentMode fragmentMode;     // フラグメントの区切り方
+    LONGLONG fragmentDuration;         // FMP4_FRAGMENT_PER_DURATIONでのフラグメント長 (100ns単位)
+
+    std::vector<BYTE> sps;             // avcCに格納するSPS
+    std::vector<BYTE> pps;             // avcCに格納するPPS
+    BOOL headerWritten;                // ftyp/moovを書き出したかどうか
+
+    UINT32 sequenceNumber;             // mfhdのシーケンス番号
+    std::vector<Fmp4PendingSample> samples; // 現在のフラグメントのサンプル
+    std::vector<NalUnitView> payloads; // 現在のフラグメントが参照するNALユニット
+
+    // 書き出し用の作業領域 (フラグメントごとに再利用する)
+    std::vector<BYTE> boxBuffer;
+    std::vector<BYTE> lengthPrefixes;
+    std::vector<Fmp4IoChunk> ioChunks;
+
+    UINT64 bytesWritten;               // 書き出したバイト数
+    UINT32 fragmentCount;              // 書き出したフラグメント数
+    UINT64 sampleCount;                // 書き出したサンプル数
+};
+
+// マルチプレクサーを初期化して出力ファイルを開く関数
+HRESULT InitializeFmp4Muxer(Fmp4Muxer* pMuxer, const char* filename, UINT32 width, UINT32 height,
+                            Fmp4FragmentMode fragmentMode, UINT32 fragmentDurationMs);
+
+// 1サンプル (1フレーム分のNALユニット) を追加する関数
+// SPS/PPSはavcCに取り込み、スライスのNALユニットはコピーせずに参照する
+// 参照したデータは、そのサンプルを含むフラグメントが書き出されるまで保持すること
+HRESULT Fmp4WriteSample(Fmp4Muxer* pMuxer, const std::vector<BYTE>* pNalUnits, size_t nalCount,
+                        LONGLONG sampleTime, LONGLONG duration, BOOL keyFrame);
+
+// 同じく、NALユニットのビュー (NalStoreのNALユニットなど) の配列を受け取る関数
+// ビューが指すデータも、フラグメントが書き出されるまで保持すること
+HRESULT Fmp4WriteSample(Fmp4Muxer* pMuxer, const NalUnitView* pNalUnits, size_t nalCount,
+                        LONGLONG sampleTime, LONGLONG duration, BOOL keyFrame);
+
+// 書き出し待ちのサンプルを1つのフラグメントとして書き出す関数
+HRESULT Fmp4FlushFragment(Fmp4Muxer* pMuxer);
+
+// 残りのサンプルを書き出してファイルを閉じる関数
+HRESULT CloseFmp4Muxer(Fmp4Muxer* pMuxer);
@@ -0,0 +1,271 @@
+// フラグメント化MP4マルチプレクサーのオフラインテスト (CTestから実行する。コーデックは使わない)
+// 合成したサンプルを、静止フレームの間引き (--skip-static) と同じように途中のフレームを抜いて書き出し、
+// ファイルのmoofを読み戻して次を検査する
+// - 各フラグメントのtfdtが、前のフラグメントの終わり (tfdt + trunの長さの合計) と一致すること
+//   (間引いたフレームの分は直前のサンプルが伸びて埋め、フラグメントの境目にも隙間がないこと)
+// - 各サンプルの時刻 (tfdt + それまでのtrunの長さの合計) が、書き込んだサンプルの時刻と一致すること
+// - サンプル数とキーフレームのフラグが書き込んだとおりであること
+#include "fmp4_muxer.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// 30fps (100ns単位)
+static const LONGLONG FRAME_DURATION = 333333;
+
+// trunのsample_flagsのうち、非同期サンプルを示すビット (sample_is_non_sync_sample)
+static const UINT32 SAMPLE_FLAG_NON_SYNC = 0x00010000;
+
+// テストケース (フラグメントの区切り方と、間引くフレーム)
+struct Fmp4TestCase {
+    const char* name;
+    Fmp4FragmentMode mode;
+    UINT32 fragmentDurationMs;
+    UINT32 keyInterval;                // キーフレームの間隔
+    UINT32 frameCount;
+    UINT32 skipped[4];                 // 間引くフレーム (0で終わり。フレーム0は間引かない)
+};
+
+static const Fmp4TestCase g_testCases[] = {
+    // キーフレームの直前を間引くと、前のフラグメントの最後のサンプルが次のフラグメントの先頭まで伸びる
+    { "gop_skip_before_key", FMP4_FRAGMENT_PER_GOP, 0, 8, 24, { 7, 15, 20, 0 } },
+    // キーフレームの直後を間引く (フラグメントの先頭のサンプルが伸びる)
+    { "gop_skip_after_key", FMP4_FRAGMENT_PER_GOP, 0, 8, 24, { 9, 17, 0, 0 } },
+    // 時間で区切るとき、区切りの位置のフレームを間引く (次のサンプルで区切られる)
+    { "duration_skip_at_cut", FMP4_FRAGMENT_PER_DURATION, 100, 30, 30, { 3, 6, 7, 13 } },
+};
+
+// 読み戻したサンプル
+struct ParsedSample {
+    LONGLONG decodeTime;               // tfdt + それまでの長さの合計
+    LONGLONG duration;
+    bool keyFrame;
+};
+
+static UINT32 Read32(const BYTE* p)
+{
+    return (static_cast<UINT32>(p[0]) << 24) | (static_cast<UINT32>(p[1]) << 16) |
+           (static_cast<UINT32>(p[2]) << 8) | p[3];
+}
+
+static UINT64 Read64(const BYTE* p)
+{
+    return (static_cast<UINT64>(Read32(p)) << 32) | Read32(p + 4);
+}
+
+// [pBegin, pEnd) の中から指定のボックスを探し、中身の範囲を返す
+static bool FindBox(const BYTE* pBegin, const BYTE* pEnd, const char* type, const BYTE** ppBody, const BYTE** ppBodyEnd)
+{
+    const BYTE* p = pBegin;
+    while (pEnd - p >= 8) {
+        UINT32 size = Read32(p);
+        if (size < 8 || size > static_cast<size_t>(pEnd - p)) {
+            return false;
+        }
+        if (memcmp(p + 4, type, 4) == 0) {
+            *ppBody = p + 8;
+            *ppBodyEnd = p + size;
+            return true;
+        }
+        p += size;
+    }
+    return false;
+}
+
+// 読み戻したフラグメント
+struct ParsedFragment {
+    LONGLONG baseDecodeTime;           // tfdt
+    LONGLONG endTime;                  // tfdt + trunの長さの合計
+};
+
+// ファイルのすべてのmoofからサンプルの時刻と長さを読み戻す関数
+static bool ParseFragments(const char* filename, std::vector<ParsedFragment>& fragments,
+                           std::vector<ParsedSample>& samples)
+{
+    FILE* pFile = fopen(filename, "rb");
+    if (!pFile) {
+        printf("Failed to open %s\n", filename);
+        return false;
+    }
+    std::vector<BYTE> data;
+    BYTE buffer[65536];
+    size_t read = 0;
+    while ((read = fread(buffer, 1, sizeof(buffer), pFile)) > 0) {
+        data.insert(data.end(), buffer, buffer + read);
+    }
+    fclose(pFile);
+
+    fragments.clear();
+    samples.clear();
+    const BYTE* p = data.data();
+    const BYTE* pEnd = data.data() + data.size();
+    while (pEnd - p >= 8) {
+        UINT32 size = Read32(p);
+        if (size < 8 || size > static_cast<size_t>(pEnd - p)) {
+            printf("Broken box at offset %zu\n", static_cast<size_t>(p - data.data()));
+            return false;
+        }
+        if (memcmp(p + 4, "moof", 4) == 0) {
+            const BYTE* pTraf = NULL;
+            const BYTE* pTrafEnd = NULL;
+            const BYTE* pTfdt = NULL;
+            const BYTE* pTfdtEnd = NULL;
+            const BYTE* pTrun = NULL;
+            const BYTE* pTrunEnd = NULL;
+            if (!FindBox(p + 8, p + size, "traf", &pTraf, &pTrafEnd) ||
+                !FindBox(pTraf, pTrafEnd, "tfdt", &pTfdt, &pTfdtEnd) ||
+                !FindBox(pTraf, pTrafEnd, "trun", &pTrun, &pTrunEnd) || pTfdt[0] != 1) {
+                printf("Fragment %zu: traf/tfdt/trun not found\n", fragments.size());
+                return false;
+            }
+            // trun: version/flags, sample_count, data_offset, 各サンプルの長さ・サイズ・フラグ
+            ParsedFragment fragment;
+            fragment.baseDecodeTime = static_cast<LONGLONG>(Read64(pTfdt + 4));
+            LONGLONG decodeTime = fragment.baseDecodeTime;
+            UINT32 sampleCount = Read32(pTrun + 4);
+            if (static_cast<size_t>(pTrunEnd - pTrun) < 12 + static_cast<size_t>(sampleCount) * 12) {
+                printf("Fragment %zu: trun is too short\n", fragments.size());
+                return false;
+            }
+            for (UINT32 i = 0; i < sampleCount; i++) {
+                const BYTE* pEntry = pTrun + 12 + i * 12;
+                ParsedSample sample;
+                sample.decodeTime = decodeTime;
+                sample.duration = Read32(pEntry);
+                sample.keyFrame = (Read32(pEntry + 8) & SAMPLE_FLAG_NON_SYNC) == 0;
+                samples.push_back(sample);
+                decodeTime += sample.duration;
+            }
+            fragment.endTime = decodeTime;
+            fragments.push_back(fragment);
+        }
+        p += size;
+    }
+    return true;
+}
+
+// テスト用のNALユニット (ゼロを含まないので、SplitNalUnitsがスタートコードと誤認することはない)
+static void MakeNal(std::vector<BYTE>& nal, BYTE header, size_t size)
+{
+    nal.assign(size, 0x5A);
+    nal[0] = header;
+}
+
+// 1つのケースを書き出して読み戻し、検査に失敗した数を返す関数
+static HRESULT RunCase(const Fmp4TestCase& testCase, size_t* pErrors)
+{
+    char filename[128];
+    snprintf(filename, sizeof(filename), "fmp4_muxer_%s.mp4", testCase.name);
+
+    Fmp4Muxer muxer = {};
+    HRESULT hr = InitializeFmp4Muxer(&muxer, filename, 320, 240, testCase.mode, testCase.fragmentDurationMs);
+    CHECK_HR(hr, "InitializeFmp4Muxer");
+
+    // マルチプレクサーはフラグメントを書き出すまでNALユニットを参照するので、全フレーム分を持っておく
+    std::vector<std::vector<std::vector<BYTE>>> frames(testCase.frameCount);
+    std::vector<LONGLONG> expectedTimes;
+    std::vector<bool> expectedKeys;
+    for (UINT32 f = 0; f < testCase.frameCount; f++) {
+        bool skipped = false;
+        for (size_t s = 0; s < sizeof(testCase.skipped) / sizeof(testCase.skipped[0]); s++) {
+            skipped = skipped || (testCase.skipped[s] != 0 && testCase.skipped[s] == f);
+        }
+        if (skipped) {
+            continue;
+        }
+        bool keyFrame = (f % testCase.keyInterval) == 0;
+        std::vector<std::vector<BYTE>>& nals = frames[f];
+        if (f == 0) {
+            nals.push_back(std::vector<BYTE>());
+            MakeNal(nals.back(), 0x67, 12);
+            nals.push_back(std::vector<BYTE>());
+            MakeNal(nals.back(), 0x68, 4);
+        }
+        nals.push_back(std::vector<BYTE>());
+        MakeNal(nals.back(), keyFrame ? 0x65 : 0x41, 100 + f);
+
+        LONGLONG sampleTime = f * FRAME_DURATION;
+        hr = Fmp4WriteSample(&muxer, nals.data(), nals.size(), sampleTime, FRAME_DURATION, keyFrame ? TRUE : FALSE);
+        if (FAILED(hr)) {
+            CloseFmp4Muxer(&muxer);
+        }
+        CHECK_HR(hr, "Fmp4WriteSample");
+        expectedTimes.push_back(sampleTime);
+        expectedKeys.push_back(keyFrame);
+    }
+    hr = CloseFmp4Muxer(&muxer);
+    CHECK_HR(hr, "CloseFmp4Muxer");
+
+    size_t errors = 0;
+    std::vector<ParsedFragment> fragments;
+    std::vector<ParsedSample> samples;
+    if (!ParseFragments(filename, fragments, samples)) {
+        *pErrors = 1;
+        return S_OK;
+    }
+    remove(filename);
+
+    if (fragments.size() < 2) {
+        printf("Only %zu fragments were written; the case does not cross a fragment boundary\n", fragments.size());
+        errors++;
+    }
+    for (size_t k = 1; k < fragments.size(); k++) {
+        if (fragments[k].baseDecodeTime != fragments[k - 1].endTime) {
+            printf("Fragment %zu: tfdt %lld, but the previous fragment ends at %lld\n", k,
+                   static_cast<long long>(fragments[k].baseDecodeTime),
+                   static_cast<long long>(fragments[k - 1].endTime));
+            errors++;
+        }
+    }
+    if (samples.size() != expectedTimes.size()) {
+        printf("%zu samples read back, expected %zu\n", samples.size(), expectedTimes.size());
+        errors++;
+    }
+    for (size_t i = 0; i < samples.size() && i < expectedTimes.size(); i++) {
+        if (samples[i].decodeTime != expectedTimes[i]) {
+            printf("Sample %zu: decode time %lld, expected %lld (timeline is not contiguous)\n", i,
+                   static_cast<long long>(samples[i].decodeTime), static_cast<long long>(expectedTimes[i]));
+            errors++;
+            break;
+        }
+        if (samples[i].keyFrame != expectedKeys[i]) {
+            printf("Sample %zu: key frame flag %d, expected %d\n", i, samples[i].keyFrame ? 1 : 0,
+                   expectedKeys[i] ? 1 : 0);
+            errors++;
+        }
+    }
+    if (!samples.empty() && samples.back().duration != FRAME_DURATION) {
+        printf("Last sample lasts %lld, expected %lld\n", static_cast<long long>(samples.back().duration),
+               static_cast<long long>(FRAME_DURATION));
+        errors++;
+    }
+
+    printf("%s: %zu fragments, %zu samples: %s\n", testCase.name, fragments.size(), samples.size(),
+           errors == 0 ? "OK" : "FAILED");
+    *pErrors = errors;
+    return S_OK;
+}
+
+int main()
+{
+    size_t failures = 0;
+    for (const auto& testCase : g_testCases) {
+        size_t errors = 0;
+        HRESULT hr = RunCase(testCase, &errors);
+        if (FAILED(hr) || errors > 0) {
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        printf("fMP4 muxer test FAILED: %zu cases\n", failures);
+        return 1;
+    }
+    printf("fMP4 muxer test passed\n");
+    return 0;
+}
@@ -0,0 +1,356 @@
+#include "frame_memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// mbindのモード (numaif.hを使わずにシステムコールを直接呼ぶ。libnumaに依存しないため)
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+// プロセス全体の設定
+static std::atomic<bool> g_hugePagesEnabled(true);
+static std::atomic<bool> g_numaBindingEnabled(true);
+
+// 明示的なヒュージページの確保に一度失敗したら、以降は試さない (予約がない環境で毎回失敗しないように)
+static std::atomic<bool> g_explicitHugePagesUnavailable(false);
+
+// 統計情報
+static std::atomic<UINT64> g_allocationCounts[FRAME_MEMORY_KIND_COUNT];
+static std::atomic<UINT64> g_allocationBytes[FRAME_MEMORY_KIND_COUNT];
+static std::atomic<UINT64> g_nodeBoundAllocations(0);
+
+// 2のべき乗の倍数に切り上げる
+static size_t RoundUpSize(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// NUMAノードが2つ以上あるか (1つならノードを指定しても意味がない)
+static bool HasMultipleNumaNodes()
+{
+#ifdef _WIN32
+    static const bool multiple = [] {
+        ULONG highestNode = 0;
+        return GetNumaHighestNodeNumber(&highestNode) && highestNode > 0;
+    }();
+    return multiple;
+#elif defined(__linux__)
+    // "0" や "0-1" の形式 (区切りがあれば複数)
+    static const bool multiple = [] {
+        FILE* pFile = fopen("/sys/devices/system/node/online", "r");
+        if (!pFile) {
+            return false;
+        }
+        char line[64] = {0};
+        bool result = fgets(line, sizeof(line), pFile) && (strchr(line, '-') || strchr(line, ','));
+        fclose(pFile);
+        return result;
+    }();
+    return multiple;
+#else
+    return false;
+#endif
+}
+
+#ifdef _WIN32
+// ラージページにはSeLockMemoryPrivilegeが必要 (付与されていてもトークンで有効にする必要がある)
+static bool EnableLockMemoryPrivilege()
+{
+    static const bool enabled = [] {
+        HANDLE hToken = NULL;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)) {
+            return false;
+        }
+        TOKEN_PRIVILEGES privileges = {};
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        bool result = LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+                      AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) &&
+                      GetLastError() == ERROR_SUCCESS;
+        CloseHandle(hToken);
+        return result;
+    }();
+    return enabled;
+}
+
+// ノードを指定してページを確保する
+static BYTE* AllocatePages(size_t size, DWORD flags, int numaNode)
+{
+    void* p = (numaNode == FRAME_MEMORY_NODE_ANY)
+                  ? VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | flags, PAGE_READWRITE)
+                  : VirtualAllocExNuma(GetCurrentProcess(), NULL, size, MEM_RESERVE | MEM_COMMIT | flags,
+                                       PAGE_READWRITE, static_cast<DWORD>(numaNode));
+    return static_cast<BYTE*>(p);
+}
+#elif defined(__linux__)
+// 透過的ヒュージページが無効 ("[never]") でないか
+static bool TransparentHugePagesAvailable()
+{
+    static const bool available = [] {
+        FILE* pFile = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (!pFile) {
+            return false;
+        }
+        char line[128] = {0};
+        bool result = fgets(line, sizeof(line), pFile) && !strstr(line, "[never]");
+        fclose(pFile);
+        return result;
+    }();
+    return available;
+}
+
+// 触る前のページにノードの優先を設定する (ページは最初に触ったときに割り当てられる)
+static bool BindToNode(void* p, size_t size, int numaNode)
+{
+    unsigned long nodeMask[16] = {0};
+    if (numaNode < 0 || numaNode >= static_cast<int>(sizeof(nodeMask) * 8)) {
+        return false;
+    }
+    nodeMask[numaNode / (sizeof(unsigned long) * 8)] |= 1UL << (numaNode % (sizeof(unsigned long) * 8));
+    return syscall(SYS_mbind, p, size, MPOL_PREFERRED, nodeMask, sizeof(nodeMask) * 8, 0) == 0;
+}
+
+// 匿名メモリをマップする (失敗したらNULL)
+static BYTE* MapAnonymous(size_t size, int extraFlags)
+{
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+    return (p == MAP_FAILED) ? NULL : static_cast<BYTE*>(p);
+}
+
+// 透過的ヒュージページは2MB境界にそろっている必要があるので、余分にマップして前後を切り落とす
+static BYTE* MapHugeAligned(size_t size)
+{
+    BYTE* pRaw = MapAnonymous(size + FRAME_MEMORY_HUGE_PAGE_SIZE, 0);
+    if (!pRaw) {
+        return NULL;
+    }
+    BYTE* p = reinterpret_cast<BYTE*>(RoundUpSize(reinterpret_cast<size_t>(pRaw), FRAME_MEMORY_HUGE_PAGE_SIZE));
+    if (p > pRaw) {
+        munmap(pRaw, p - pRaw);
+    }
+    size_t tail = (pRaw + size + FRAME_MEMORY_HUGE_PAGE_SIZE) - (p + size);
+    if (tail > 0) {
+        munmap(p + size, tail);
+    }
+    return p;
+}
+#endif
+
+// 確保方法ごとの実際の確保サイズ
+static size_t GetMappedSize(size_t size, UINT32 kind)
+{
+#ifdef _WIN32
+    if (kind == FRAME_MEMORY_HUGE_PAGES) {
+        return RoundUpSize(size, GetLargePageMinimum());
+    }
+    return size;
+#else
+    if (kind == FRAME_MEMORY_HUGE_PAGES || kind == FRAME_MEMORY_TRANSPARENT_HUGE_PAGES) {
+        return RoundUpSize(size, FRAME_MEMORY_HUGE_PAGE_SIZE);
+    }
+    return RoundUpSize(size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+#endif
+}
+
+// ページ単位で確保する (ヒュージページから順に試す。どれも使えなければNULL)
+static BYTE* AllocateMapped(size_t size, const FrameMemoryPolicy* pPolicy, UINT32* pKind)
+{
+    const bool huge = pPolicy->hugePages && size >= FRAME_MEMORY_HUGE_PAGE_SIZE;
+    const int numaNode = pPolicy->numaNode;
+    BYTE* p = NULL;
+
+#ifdef _WIN32
+    if (huge && !g_explicitHugePagesUnavailable.load(std::memory_order_relaxed)) {
+        if (GetLargePageMinimum() > 0 && EnableLockMemoryPrivilege()) {
+            p = AllocatePages(GetMappedSize(size, FRAME_MEMORY_HUGE_PAGES), MEM_LARGE_PAGES, numaNode);
+        }
+        if (p) {
+            *pKind = FRAME_MEMORY_HUGE_PAGES;
+        } else {
+            g_explicitHugePagesUnavailable.store(true, std::memory_order_relaxed);
+        }
+    }
+    if (!p) {
+        p = AllocatePages(size, 0, numaNode);
+        *pKind = FRAME_MEMORY_PAGES;
+    }
+    if (p && numaNode != FRAME_MEMORY_NODE_ANY) {
+        g_nodeBoundAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+#elif defined(__linux__)
+    if (huge && !g_explicitHugePagesUnavailable.load(std::memory_order_relaxed)) {
+        p = MapAnonymous(GetMappedSize(size, FRAME_MEMORY_HUGE_PAGES), MAP_HUGETLB);
+        if (p) {
+            *pKind = FRAME_MEMORY_HUGE_PAGES;
+        } else {
+            g_explicitHugePagesUnavailable.store(true, std::memory_order_relaxed);
+        }
+    }
+    if (!p && huge && TransparentHugePagesAvailable()) {
+        p = MapHugeAligned(GetMappedSize(size, FRAME_MEMORY_TRANSPARENT_HUGE_PAGES));
+        if (p) {
+            madvise(p, GetMappedSize(size, FRAME_MEMORY_TRANSPARENT_HUGE_PAGES), MADV_HUGEPAGE);
+            *pKind = FRAME_MEMORY_TRANSPARENT_HUGE_PAGES;
+        }
+    }
+    if (!p) {
+        p = MapAnonymous(GetMappedSize(size, FRAME_MEMORY_PAGES), 0);
+        *pKind = FRAME_MEMORY_PAGES;
+    }
+    if (p && numaNode != FRAME_MEMORY_NODE_ANY && BindToNode(p, GetMappedSize(size, *pKind), numaNode)) {
+        g_nodeBoundAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+#else
+    (void)huge;
+    (void)numaNode;
+    (void)pKind;
+#endif
+    return p;
+}
+
+// アラインされたヒープのメモリを確保する
+static BYTE* AllocateHeap(size_t size)
+{
+#ifdef _WIN32
+    return static_cast<BYTE*>(_aligned_malloc(size, FRAME_MEMORY_ALIGNMENT));
+#else
+    void* p = NULL;
+    if (posix_memalign(&p, FRAME_MEMORY_ALIGNMENT, size) != 0) {
+        return NULL;
+    }
+    return static_cast<BYTE*>(p);
+#endif
+}
+
+// プロセス全体の設定を変える関数
+void SetFrameMemoryOptions(bool hugePages, bool numaBinding)
+{
+    g_hugePagesEnabled.store(hugePages);
+    g_numaBindingEnabled.store(numaBinding);
+}
+
+// 呼び出し元のスレッドが動いているNUMAノードを返す関数
+int GetCurrentNumaNode()
+{
+#ifdef _WIN32
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    USHORT node = 0;
+    if (!GetNumaProcessorNodeEx(&processor, &node)) {
+        return FRAME_MEMORY_NODE_ANY;
+    }
+    return static_cast<int>(node);
+#elif defined(__linux__)
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+        return FRAME_MEMORY_NODE_ANY;
+    }
+    return static_cast<int>(node);
+#else
+    return FRAME_MEMORY_NODE_ANY;
+#endif
+}
+
+// 呼び出し元のスレッド用の既定のポリシーを返す関数
+void GetThreadFrameMemoryPolicy(FrameMemoryPolicy* pPolicy)
+{
+    pPolicy->hugePages = g_hugePagesEnabled.load();
+    pPolicy->numaNode = (g_numaBindingEnabled.load() && HasMultipleNumaNodes()) ? GetCurrentNumaNode()
+                                                                               : FRAME_MEMORY_NODE_ANY;
+}
+
+// sizeバイトを確保する関数
+HRESULT AllocateFrameMemory(size_t size, const FrameMemoryPolicy* pPolicy, BYTE** ppMemory, UINT32* pKind)
+{
+    if (!ppMemory || !pKind) {
+        return E_POINTER;
+    }
+    if (size == 0) {
+        return E_INVALIDARG;
+    }
+
+    BYTE* p = NULL;
+    UINT32 kind = FRAME_MEMORY_HEAP;
+    if (pPolicy && size >= FRAME_MEMORY_MIN_MAPPED_SIZE &&
+        ((pPolicy->hugePages && size >= FRAME_MEMORY_HUGE_PAGE_SIZE) || pPolicy->numaNode != FRAME_MEMORY_NODE_ANY)) {
+        p = AllocateMapped(size, pPolicy, &kind);
+    }
+    if (!p) {
+        // ページ単位で確保できない・しない場合は従来どおりヒープから
+        p = AllocateHeap(size);
+        kind = FRAME_MEMORY_HEAP;
+    }
+    if (!p) {
+        return E_OUTOFMEMORY;
+    }
+
+    g_allocationCounts[kind].fetch_add(1, std::memory_order_relaxed);
+    g_allocationBytes[kind].fetch_add(GetMappedSize(size, kind), std::memory_order_relaxed);
+    *ppMemory = p;
+    *pKind = kind;
+    return S_OK;
+}
+
+// AllocateFrameMemoryで確保したメモリを解放する関数
+void FreeFrameMemory(BYTE* pMemory, size_t size, UINT32 kind)
+{
+    if (!pMemory) {
+        return;
+    }
+    if (kind == FRAME_MEMORY_HEAP) {
+#ifdef _WIN32
+        _aligned_free(pMemory);
+#else
+        free(pMemory);
+#endif
+        return;
+    }
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(pMemory, 0, MEM_RELEASE);
+#else
+    munmap(pMemory, GetMappedSize(size, kind));
+#endif
+}
+
+// 確保方法ごとの回数とサイズを表示する関数
+void PrintFrameMemoryStatistics()
+{
+    static const char* kindNames[FRAME_MEMORY_KIND_COUNT] = {
+        "heap", "pages", "transparent huge pages", "huge pages"
+    };
+    printf("Frame memory:");
+    const char* separator = " ";
+    for (int kind = FRAME_MEMORY_KIND_COUNT - 1; kind >= 0; kind--) {
+        UINT64 count = g_allocationCounts[kind].load();
+        if (count > 0) {
+            printf("%s%s %llu (%.1f MB)", separator, kindNames[kind], static_cast<unsigned long long>(count),
+                   g_allocationBytes[kind].load() / 1048576.0);
+            separator = ", ";
+        }
+    }
+    printf("%s%llu NUMA-bound\n", separator, static_cast<unsigned long long>(g_nodeBoundAllocations.load()));
+}
+
+// これまでにAllocateFrameMemoryで確保した回数を返す関数
+UINT64 GetFrameMemoryAllocationCount()
+{
+    UINT64 count = 0;
+    for (int kind = 0; kind < FRAME_MEMORY_KIND_COUNT; kind++) {
+        count += g_allocationCounts[kind].load(std::memory_order_relaxed);
+    }
+    return count;
+}
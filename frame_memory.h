@@ -0,0 +1,63 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stddef.h>
+
+// フレームとビットストリームのバッファ用のメモリ確保
+// - 大きな確保はヒュージページにする (明示的なヒュージページ → 透過的ヒュージページ → 通常のページの順に試す)
+//   4Kのフレームは4KBページでは数千ページにまたがり、TLBミスが増えるため
+// - NUMAノードを指定すると、そのノードのメモリを優先して確保する (足りなければ他のノードから確保する)
+// - どれも使えない環境では、従来どおり64バイトアラインのヒープから確保する
+// 確保方法 (FrameMemoryKind) は解放時に必要なので、呼び出し側がサイズと一緒に持っておく
+
+// 確保したメモリの先頭のアライメント (NV12_FRAME_ALIGNMENTと同じ)
+#define FRAME_MEMORY_ALIGNMENT 64
+
+// ヒュージページのサイズ (x86-64の2MB。これより小さい確保はヒュージページにしない)
+#define FRAME_MEMORY_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// ページ単位で確保する最小サイズ (これより小さい確保はヒープから取り、ノードも指定しない)
+#define FRAME_MEMORY_MIN_MAPPED_SIZE (256 * 1024)
+
+// NUMAノードを指定しない
+#define FRAME_MEMORY_NODE_ANY (-1)
+
+// 確保方法
+enum FrameMemoryKind {
+    FRAME_MEMORY_HEAP = 0,                 // ヒープ (posix_memalign / _aligned_malloc)
+    FRAME_MEMORY_PAGES,                    // 通常のページ (mmap / VirtualAlloc)
+    FRAME_MEMORY_TRANSPARENT_HUGE_PAGES,   // 透過的ヒュージページ (mmap + madvise、Linuxのみ)
+    FRAME_MEMORY_HUGE_PAGES,               // 明示的なヒュージページ (MAP_HUGETLB / MEM_LARGE_PAGES)
+    FRAME_MEMORY_KIND_COUNT
+};
+
+// 確保のポリシー
+struct FrameMemoryPolicy {
+    bool hugePages;                    // 大きな確保をヒュージページにする
+    int numaNode;                      // 優先するNUMAノード (FRAME_MEMORY_NODE_ANYなら指定しない)
+};
+
+// プロセス全体の設定を変える関数 (既定はどちらも有効。mainのオプションから呼ぶ)
+void SetFrameMemoryOptions(bool hugePages, bool numaBinding);
+
+// 呼び出し元のスレッドが動いているNUMAノードを返す関数 (分からなければFRAME_MEMORY_NODE_ANY)
+int GetCurrentNumaNode();
+
+// 呼び出し元のスレッド用の既定のポリシーを返す関数
+// セッション (エンコーダー・デコーダー) は、初期化したスレッドのノードにプールを置く
+// (ノードが1つしかないホストではノードを指定しない)
+void GetThreadFrameMemoryPolicy(FrameMemoryPolicy* pPolicy);
+
+// sizeバイトを確保する関数 (pPolicyがNULLならヒープから確保する)
+// 確保したメモリはゼロで初期化されているとは限らない
+HRESULT AllocateFrameMemory(size_t size, const FrameMemoryPolicy* pPolicy, BYTE** ppMemory, UINT32* pKind);
+
+// AllocateFrameMemoryで確保したメモリを解放する関数 (sizeとkindは確保時と同じもの)
+void FreeFrameMemory(BYTE* pMemory, size_t size, UINT32 kind);
+
+// 確保方法ごとの回数とサイズを表示する関数
+void PrintFrameMemoryStatistics();
+
+// これまでにAllocateFrameMemoryで確保した回数 (確保方法の合計) を返す関数
+// operator newを通らない確保なので、確保回数を数えるときはこれも足す
+UINT64 GetFrameMemoryAllocationCount();
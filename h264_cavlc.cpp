@@ -0,0 +1,573 @@
+#include "h264_cavlc.h"
+
+// 可変長符号 (符号長とビット列)
+struct VlcCode {
+    BYTE length;
+    BYTE bits;
+};
+
+// coeff_token (表9-5) の符号長 [nCの範囲][TotalCoeff * 4 + TrailingOnes]
+// 0 <= nC < 2、2 <= nC < 4、4 <= nC < 8 の3つ (8 <= nCは6ビットの固定長)
+static const BYTE COEFF_TOKEN_LENGTH[3][4 * 17] = {
+    {
+         1,  0,  0,  0,
+         6,  2,  0,  0,     8,  6,  3,  0,     9,  8,  7,  5,    10,  9,  8,  6,
+        11, 10,  9,  7,    13, 11, 10,  8,    13, 13, 11,  9,    13, 13, 13, 10,
+        14, 14, 13, 11,    14, 14, 14, 13,    15, 15, 14, 14,    15, 15, 15, 14,
+        16, 15, 15, 15,    16, 16, 16, 15,    16, 16, 16, 16,    16, 16, 16, 16,
+    },
+    {
+         2,  0,  0,  0,
+         6,  2,  0,  0,     6,  5,  3,  0,     7,  6,  6,  4,     8,  6,  6,  4,
+         8,  7,  7,  5,     9,  8,  8,  6,    11,  9,  9,  6,    11, 11, 11,  7,
+        12, 11, 11,  9,    12, 12, 12, 11,    12, 12, 12, 11,    13, 13, 13, 12,
+        13, 13, 13, 13,    13, 14, 13, 13,    14, 14, 14, 13,    14, 14, 14, 14,
+    },
+    {
+         4,  0,  0,  0,
+         6,  4,  0,  0,     6,  5,  4,  0,     6,  5,  5,  4,     7,  5,  5,  4,
+         7,  5,  5,  4,     7,  6,  6,  4,     7,  6,  6,  4,     8,  7,  7,  5,
+         8,  8,  7,  6,     9,  8,  8,  7,     9,  9,  8,  8,     9,  9,  9,  8,
+        10,  9,  9,  9,    10, 10, 10, 10,    10, 10, 10, 10,    10, 10, 10, 10,
+    },
+};
+
+// coeff_tokenのビット列 (COEFF_TOKEN_LENGTHと同じ並び)
+static const BYTE COEFF_TOKEN_BITS[3][4 * 17] = {
+    {
+         1,  0,  0,  0,
+         5,  1,  0,  0,     7,  4,  1,  0,     7,  6,  5,  3,     7,  6,  5,  3,
+         7,  6,  5,  4,    15,  6,  5,  4,    11, 14,  5,  4,     8, 10, 13,  4,
+        15, 14,  9,  4,    11, 10, 13, 12,    15, 14,  9, 12,    11, 10, 13,  8,
+        15,  1,  9, 12,    11, 14, 13,  8,     7, 10,  9, 12,     4,  6,  5,  8,
+    },
+    {
+         3,  0,  0,  0,
+        11,  2,  0,  0,     7,  7,  3,  0,     7, 10,  9,  5,     7,  6,  5,  4,
+         4,  6,  5,  6,     7,  6,  5,  8,    15,  6,  5,  4,    11, 14, 13,  4,
+        15, 10,  9,  4,    11, 14, 13, 12,     8, 10,  9,  8,    15, 14, 13, 12,
+        11, 10,  9, 12,     7, 11,  6,  8,     9,  8, 10,  1,     7,  6,  5,  4,
+    },
+    {
+        15,  0,  0,  0,
+        15, 14,  0,  0,    11, 15, 13,  0,     8, 12, 14, 12,    15, 10, 11, 11,
+        11,  8,  9, 10,     9, 14, 13,  9,     8, 10,  9,  8,    15, 14, 13, 13,
+        11, 14, 10, 12,    15, 10, 13, 12,    11, 14,  9, 12,     8, 10, 13,  8,
+        13,  7,  9, 12,     9, 12, 11, 10,     5,  8,  7,  6,     1,  4,  3,  2,
+    },
+};
+
+// 色差DC (nC = -1) のcoeff_token [TotalCoeff * 4 + TrailingOnes]
+static const VlcCode CHROMA_DC_COEFF_TOKEN[4 * 5] = {
+    { 2, 1 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+    { 6, 7 }, { 1, 1 }, { 0, 0 }, { 0, 0 },
+    { 6, 4 }, { 6, 6 }, { 3, 1 }, { 0, 0 },
+    { 6, 3 }, { 7, 3 }, { 7, 2 }, { 6, 5 },
+    { 6, 2 }, { 8, 3 }, { 8, 2 }, { 7, 0 },
+};
+
+// total_zeros (表9-7、9-8) [TotalCoeff - 1][total_zeros]
+static const VlcCode TOTAL_ZEROS[15][16] = {
+    { {1,1}, {3,3}, {3,2}, {4,3}, {4,2}, {5,3}, {5,2}, {6,3}, {6,2}, {7,3}, {7,2}, {8,3}, {8,2}, {9,3}, {9,2}, {9,1} },
+    { {3,7}, {3,6}, {3,5}, {3,4}, {3,3}, {4,5}, {4,4}, {4,3}, {4,2}, {5,3}, {5,2}, {6,3}, {6,2}, {6,1}, {6,0} },
+    { {4,5}, {3,7}, {3,6}, {3,5}, {4,4}, {4,3}, {3,4}, {3,3}, {4,2}, {5,3}, {5,2}, {6,1}, {5,1}, {6,0} },
+    { {5,3}, {3,7}, {4,5}, {4,4}, {3,6}, {3,5}, {3,4}, {4,3}, {3,3}, {4,2}, {5,2}, {5,1}, {5,0} },
+    { {4,5}, {4,4}, {4,3}, {3,7}, {3,6}, {3,5}, {3,4}, {3,3}, {4,2}, {5,1}, {4,1}, {5,0} },
+    { {6,1}, {5,1}, {3,7}, {3,6}, {3,5}, {3,4}, {3,3}, {3,2}, {4,1}, {3,1}, {6,0} },
+    { {6,1}, {5,1}, {3,5}, {3,4}, {3,3}, {2,3}, {3,2}, {4,1}, {3,1}, {6,0} },
+    { {6,1}, {4,1}, {5,1}, {3,3}, {2,3}, {2,2}, {3,2}, {3,1}, {6,0} },
+    { {6,1}, {6,0}, {4,1}, {2,3}, {2,2}, {3,1}, {2,1}, {5,1} },
+    { {5,1}, {5,0}, {3,1}, {2,3}, {2,2}, {2,1}, {4,1} },
+    { {4,0}, {4,1}, {3,1}, {3,2}, {1,1}, {3,3} },
+    { {4,0}, {4,1}, {2,1}, {1,1}, {3,1} },
+    { {3,0}, {3,1}, {1,1}, {2,1} },
+    { {2,0}, {2,1}, {1,1} },
+    { {1,0}, {1,1} },
+};
+
+// 色差DCのtotal_zeros [TotalCoeff - 1][total_zeros]
+static const VlcCode CHROMA_DC_TOTAL_ZEROS[3][4] = {
+    { {1,1}, {2,1}, {3,1}, {3,0} },
+    { {1,1}, {2,1}, {2,0} },
+    { {1,1}, {1,0} },
+};
+
+// run_before (表9-10) [min(zerosLeft, 7) - 1][run_before]
+static const VlcCode RUN_BEFORE[7][15] = {
+    { {1,1}, {1,0} },
+    { {1,1}, {2,1}, {2,0} },
+    { {2,3}, {2,2}, {2,1}, {2,0} },
+    { {2,3}, {2,2}, {2,1}, {3,1}, {3,0} },
+    { {2,3}, {2,2}, {3,3}, {3,2}, {3,1}, {3,0} },
+    { {2,3}, {3,0}, {3,1}, {3,3}, {3,2}, {3,5}, {3,4} },
+    { {3,7}, {3,6}, {3,5}, {3,4}, {3,3}, {3,2}, {3,1}, {4,1}, {5,1}, {6,1}, {7,1}, {8,1}, {9,1}, {10,1}, {11,1} },
+};
+
+void H264ResetBitWriter(H264BitWriter* pWriter)
+{
+    pWriter->data.clear();
+    pWriter->cache = 0;
+    pWriter->cacheBits = 0;
+}
+
+void H264WriteBits(H264BitWriter* pWriter, UINT32 value, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    UINT64 mask = (count >= 32) ? 0xFFFFFFFFull : ((1ull << count) - 1);
+    pWriter->cache = (pWriter->cache << count) | (value & mask);
+    pWriter->cacheBits += count;
+    while (pWriter->cacheBits >= 8) {
+        pWriter->cacheBits -= 8;
+        pWriter->data.push_back(static_cast<BYTE>(pWriter->cache >> pWriter->cacheBits));
+    }
+}
+
+void H264WriteUe(H264BitWriter* pWriter, UINT32 value)
+{
+    UINT64 codeNum = static_cast<UINT64>(value) + 1;
+    int bits = 0;
+    while ((codeNum >> bits) > 1) {
+        bits++;
+    }
+    // 先頭のbits個の0と、bits + 1ビットのcodeNum + 1
+    if (2 * bits + 1 <= 32) {
+        H264WriteBits(pWriter, static_cast<UINT32>(codeNum), 2 * bits + 1);
+    } else {
+        H264WriteBits(pWriter, 0, bits);
+        H264WriteBits(pWriter, static_cast<UINT32>(codeNum), bits + 1);
+    }
+}
+
+void H264WriteSe(H264BitWriter* pWriter, int value)
+{
+    UINT32 codeNum = (value > 0) ? static_cast<UINT32>(2 * value - 1) : static_cast<UINT32>(-2 * static_cast<INT32>(value));
+    H264WriteUe(pWriter, codeNum);
+}
+
+void H264WriteTrailingBits(H264BitWriter* pWriter)
+{
+    H264WriteBits(pWriter, 1, 1);
+    if (pWriter->cacheBits > 0) {
+        H264WriteBits(pWriter, 0, 8 - pWriter->cacheBits);
+    }
+}
+
+size_t H264GetBitCount(const H264BitWriter* pWriter)
+{
+    return pWriter->data.size() * 8 + pWriter->cacheBits;
+}
+
+static inline void WriteCode(H264BitWriter* pWriter, const VlcCode& code)
+{
+    H264WriteBits(pWriter, code.bits, code.length);
+}
+
+// coeff_tokenを書き込む
+static void WriteCoeffToken(H264BitWriter* pWriter, int nC, int totalCoeff, int trailingOnes)
+{
+    int index = totalCoeff * 4 + trailingOnes;
+    if (nC < 0) {
+        WriteCode(pWriter, CHROMA_DC_COEFF_TOKEN[index]);
+    } else if (nC >= 8) {
+        // 6ビット固定長: 上位4ビットがTotalCoeff - 1、下位2ビットがTrailingOnes (0個は000011)
+        UINT32 bits = totalCoeff ? static_cast<UINT32>(((totalCoeff - 1) << 2) | trailingOnes) : 3;
+        H264WriteBits(pWriter, bits, 6);
+    } else {
+        int table = (nC < 2) ? 0 : (nC < 4 ? 1 : 2);
+        H264WriteBits(pWriter, COEFF_TOKEN_BITS[table][index], COEFF_TOKEN_LENGTH[table][index]);
+    }
+}
+
+// level_prefix / level_suffix を書き込む (levelCodeは規格9.2.2.1の値)
+static void WriteLevel(H264BitWriter* pWriter, int levelCode, int suffixLength)
+{
+    int prefix;
+    int suffix = 0;
+    int suffixSize = 0;
+    if (suffixLength == 0) {
+        if (levelCode < 14) {
+            prefix = levelCode;
+        } else if (levelCode < 30) {
+            prefix = 14;
+            suffix = levelCode - 14;
+            suffixSize = 4;
+        } else {
+            prefix = 15;
+            suffix = levelCode - 30;
+            suffixSize = 12;
+        }
+    } else if (levelCode < (15 << suffixLength)) {
+        prefix = levelCode >> suffixLength;
+        suffix = levelCode & ((1 << suffixLength) - 1);
+        suffixSize = suffixLength;
+    } else {
+        prefix = 15;
+        suffix = levelCode - (15 << suffixLength);
+        suffixSize = 12;
+    }
+    // level_prefixはprefix個の0と1
+    H264WriteBits(pWriter, 1, prefix + 1);
+    H264WriteBits(pWriter, static_cast<UINT32>(suffix), suffixSize);
+}
+
+int H264WriteResidualBlock(H264BitWriter* pWriter, const INT16* coeffs, int maxNumCoeff, int nC)
+{
+    // 高周波側から非ゼロ係数を集める
+    int levels[16];
+    int positions[16];
+    int totalCoeff = 0;
+    for (int i = maxNumCoeff - 1; i >= 0; i--) {
+        if (coeffs[i]) {
+            levels[totalCoeff] = coeffs[i];
+            positions[totalCoeff] = i;
+            totalCoeff++;
+        }
+    }
+
+    int trailingOnes = 0;
+    while (trailingOnes < totalCoeff && trailingOnes < 3 &&
+           (levels[trailingOnes] == 1 || levels[trailingOnes] == -1)) {
+        trailingOnes++;
+    }
+
+    WriteCoeffToken(pWriter, nC, totalCoeff, trailingOnes);
+    if (totalCoeff == 0) {
+        return 0;
+    }
+
+    // trailing_ones_sign_flag
+    for (int i = 0; i < trailingOnes; i++) {
+        H264WriteBits(pWriter, levels[i] < 0 ? 1 : 0, 1);
+    }
+
+    // 残りのレベル (suffixLengthは値の大きさに応じて増える)
+    int suffixLength = (totalCoeff > 10 && trailingOnes < 3) ? 1 : 0;
+    for (int i = trailingOnes; i < totalCoeff; i++) {
+        int level = levels[i];
+        int levelCode = (level > 0) ? 2 * level - 2 : -2 * level - 1;
+        if (i == trailingOnes && trailingOnes < 3) {
+            levelCode -= 2;
+        }
+        WriteLevel(pWriter, levelCode, suffixLength);
+
+        if (suffixLength == 0) {
+            suffixLength = 1;
+        }
+        int magnitude = level < 0 ? -level : level;
+        if (magnitude > (3 << (suffixLength - 1)) && suffixLength < 6) {
+            suffixLength++;
+        }
+    }
+
+    // total_zeros (最後の非ゼロ係数より前にあるゼロの数)
+    int zerosLeft = positions[0] + 1 - totalCoeff;
+    if (totalCoeff < maxNumCoeff) {
+        if (maxNumCoeff == 4) {
+            WriteCode(pWriter, CHROMA_DC_TOTAL_ZEROS[totalCoeff - 1][zerosLeft]);
+        } else {
+            WriteCode(pWriter, TOTAL_ZEROS[totalCoeff - 1][zerosLeft]);
+        }
+    }
+
+    // run_before (最後の係数の前のゼロは残りから決まるので書かない)
+    for (int i = 0; i < totalCoeff - 1 && zerosLeft > 0; i++) {
+        int run = positions[i] - positions[i + 1] - 1;
+        WriteCode(pWriter, RUN_BEFORE[(zerosLeft > 7 ? 7 : zerosLeft) - 1][run]);
+        zerosLeft -= run;
+    }
+    return totalCoeff;
+}
+
+// ---- 読み込み ----
+
+void H264InitBitReader(H264BitReader* pReader, const BYTE* data, size_t size)
+{
+    pReader->data = data;
+    pReader->size = size;
+    pReader->bitPos = 0;
+    pReader->overrun = false;
+}
+
+// 読み込み位置から最大32ビットを先読みする (終端より後ろは0として扱う)
+static inline UINT32 PeekBits(const H264BitReader* pReader, int count)
+{
+    size_t byteIndex = pReader->bitPos >> 3;
+    UINT64 window = 0;
+    if (byteIndex + 8 <= pReader->size) {
+        const BYTE* p = pReader->data + byteIndex;
+        window = (static_cast<UINT64>(p[0]) << 56) | (static_cast<UINT64>(p[1]) << 48) |
+                 (static_cast<UINT64>(p[2]) << 40) | (static_cast<UINT64>(p[3]) << 32) |
+                 (static_cast<UINT64>(p[4]) << 24) | (static_cast<UINT64>(p[5]) << 16) |
+                 (static_cast<UINT64>(p[6]) << 8) | static_cast<UINT64>(p[7]);
+    } else {
+        for (int i = 0; i < 8; i++) {
+            window <<= 8;
+            if (byteIndex + i < pReader->size) {
+                window |= pReader->data[byteIndex + i];
+            }
+        }
+    }
+    window <<= (pReader->bitPos & 7);
+    return static_cast<UINT32>(window >> (64 - count));
+}
+
+static inline void SkipBits(H264BitReader* pReader, int count)
+{
+    pReader->bitPos += count;
+    if (pReader->bitPos > pReader->size * 8) {
+        pReader->overrun = true;
+        pReader->bitPos = pReader->size * 8;
+    }
+}
+
+UINT32 H264ReadBits(H264BitReader* pReader, int count)
+{
+    if (count <= 0) {
+        return 0;
+    }
+    UINT32 value = PeekBits(pReader, count);
+    SkipBits(pReader, count);
+    return value;
+}
+
+UINT32 H264ReadUe(H264BitReader* pReader)
+{
+    // 先頭の0の数を数える (32個以上はビットストリームの誤り)
+    int leadingZeros = 0;
+    while (leadingZeros < 32 && H264ReadBits(pReader, 1) == 0) {
+        if (pReader->overrun) {
+            return 0;
+        }
+        leadingZeros++;
+    }
+    if (leadingZeros >= 32) {
+        pReader->overrun = true;
+        return 0;
+    }
+    UINT64 value = (1ull << leadingZeros) - 1 + H264ReadBits(pReader, leadingZeros);
+    return static_cast<UINT32>(value);
+}
+
+int H264ReadSe(H264BitReader* pReader)
+{
+    UINT32 codeNum = H264ReadUe(pReader);
+    return (codeNum & 1) ? static_cast<int>((codeNum + 1) / 2) : -static_cast<int>(codeNum / 2);
+}
+
+void H264AlignBitReader(H264BitReader* pReader)
+{
+    SkipBits(pReader, static_cast<int>((8 - (pReader->bitPos & 7)) & 7));
+}
+
+bool H264MoreRbspData(const H264BitReader* pReader)
+{
+    // 最後の1のビット (rbsp_stop_one_bit) より前に読み残しがあるか
+    size_t end = pReader->size;
+    while (end > 0 && pReader->data[end - 1] == 0) {
+        end--;
+    }
+    if (end == 0) {
+        return false;
+    }
+    BYTE last = pReader->data[end - 1];
+    int trailingZeros = 0;
+    while (!(last & (1 << trailingZeros))) {
+        trailingZeros++;
+    }
+    size_t stopBitPos = end * 8 - trailingZeros - 1;
+    return pReader->bitPos < stopBitPos;
+}
+
+// coeff_tokenの復号表 (符号長の短い順に並べ、先頭から一致を探す)
+struct CoeffTokenEntry {
+    BYTE length;
+    BYTE bits;
+    BYTE totalCoeff;
+    BYTE trailingOnes;
+};
+
+struct CoeffTokenDecodeTable {
+    CoeffTokenEntry entries[3][4 * 17];
+    int count[3];
+    CoeffTokenEntry chromaDc[4 * 5];
+    int chromaDcCount;
+};
+
+static int SortCoeffTokens(CoeffTokenEntry* entries, const BYTE* lengths, const BYTE* bits, int size)
+{
+    int count = 0;
+    for (int index = 0; index < size; index++) {
+        if (lengths[index] == 0) {
+            continue;
+        }
+        CoeffTokenEntry entry = { lengths[index], bits[index], static_cast<BYTE>(index / 4), static_cast<BYTE>(index % 4) };
+        int pos = count++;
+        while (pos > 0 && entries[pos - 1].length > entry.length) {
+            entries[pos] = entries[pos - 1];
+            pos--;
+        }
+        entries[pos] = entry;
+    }
+    return count;
+}
+
+static CoeffTokenDecodeTable BuildCoeffTokenDecodeTable()
+{
+    CoeffTokenDecodeTable table;
+    for (int t = 0; t < 3; t++) {
+        table.count[t] = SortCoeffTokens(table.entries[t], COEFF_TOKEN_LENGTH[t], COEFF_TOKEN_BITS[t], 4 * 17);
+    }
+    BYTE lengths[4 * 5];
+    BYTE bits[4 * 5];
+    for (int i = 0; i < 4 * 5; i++) {
+        lengths[i] = CHROMA_DC_COEFF_TOKEN[i].length;
+        bits[i] = CHROMA_DC_COEFF_TOKEN[i].bits;
+    }
+    table.chromaDcCount = SortCoeffTokens(table.chromaDc, lengths, bits, 4 * 5);
+    return table;
+}
+
+static const CoeffTokenEntry* FindCoeffToken(const CoeffTokenEntry* entries, int count, UINT32 peek16)
+{
+    for (int i = 0; i < count; i++) {
+        if ((peek16 >> (16 - entries[i].length)) == entries[i].bits) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// coeff_tokenを読む (誤りならfalse)
+static bool ReadCoeffToken(H264BitReader* pReader, int nC, int* pTotalCoeff, int* pTrailingOnes)
+{
+    if (nC >= 8) {
+        UINT32 bits = H264ReadBits(pReader, 6);
+        if (bits == 3) {
+            *pTotalCoeff = 0;
+            *pTrailingOnes = 0;
+            return true;
+        }
+        *pTotalCoeff = static_cast<int>(bits >> 2) + 1;
+        *pTrailingOnes = static_cast<int>(bits & 3);
+        return *pTrailingOnes <= *pTotalCoeff;
+    }
+
+    static const CoeffTokenDecodeTable table = BuildCoeffTokenDecodeTable();
+    UINT32 peek = PeekBits(pReader, 16);
+    const CoeffTokenEntry* pEntry;
+    if (nC < 0) {
+        pEntry = FindCoeffToken(table.chromaDc, table.chromaDcCount, peek);
+    } else {
+        int t = (nC < 2) ? 0 : (nC < 4 ? 1 : 2);
+        pEntry = FindCoeffToken(table.entries[t], table.count[t], peek);
+    }
+    if (!pEntry) {
+        return false;
+    }
+    SkipBits(pReader, pEntry->length);
+    *pTotalCoeff = pEntry->totalCoeff;
+    *pTrailingOnes = pEntry->trailingOnes;
+    return true;
+}
+
+// 短い可変長符号の表から一致する値を探す (見つからなければ-1)
+static int ReadCode(H264BitReader* pReader, const VlcCode* codes, int count)
+{
+    UINT32 peek = PeekBits(pReader, 16);
+    for (int i = 0; i < count; i++) {
+        if (codes[i].length > 0 && (peek >> (16 - codes[i].length)) == codes[i].bits) {
+            SkipBits(pReader, codes[i].length);
+            return i;
+        }
+    }
+    return -1;
+}
+
+int H264ReadResidualBlock(H264BitReader* pReader, INT16* coeffs, int maxNumCoeff, int nC)
+{
+    for (int i = 0; i < maxNumCoeff; i++) {
+        coeffs[i] = 0;
+    }
+
+    int totalCoeff = 0;
+    int trailingOnes = 0;
+    if (!ReadCoeffToken(pReader, nC, &totalCoeff, &trailingOnes) || totalCoeff > maxNumCoeff) {
+        return -1;
+    }
+    if (totalCoeff == 0) {
+        return 0;
+    }
+
+    // 高周波側からのレベル
+    int levels[16];
+    for (int i = 0; i < trailingOnes; i++) {
+        levels[i] = H264ReadBits(pReader, 1) ? -1 : 1;
+    }
+    int suffixLength = (totalCoeff > 10 && trailingOnes < 3) ? 1 : 0;
+    for (int i = trailingOnes; i < totalCoeff; i++) {
+        int prefix = 0;
+        while (H264ReadBits(pReader, 1) == 0) {
+            if (pReader->overrun || ++prefix > 32) {
+                return -1;
+            }
+        }
+        int suffixSize = suffixLength;
+        if (prefix == 14 && suffixLength == 0) {
+            suffixSize = 4;
+        } else if (prefix >= 15) {
+            suffixSize = prefix - 3;
+        }
+        int levelCode = ((prefix < 15 ? prefix : 15) << suffixLength);
+        if (suffixSize > 0) {
+            levelCode += static_cast<int>(H264ReadBits(pReader, suffixSize));
+        }
+        if (prefix >= 15 && suffixLength == 0) {
+            levelCode += 15;
+        }
+        if (prefix >= 16) {
+            levelCode += (1 << (prefix - 3)) - 4096;
+        }
+        if (i == trailingOnes && trailingOnes < 3) {
+            levelCode += 2;
+        }
+        levels[i] = (levelCode & 1) ? (-levelCode - 1) >> 1 : (levelCode + 2) >> 1;
+
+        if (suffixLength == 0) {
+            suffixLength = 1;
+        }
+        int magnitude = levels[i] < 0 ? -levels[i] : levels[i];
+        if (magnitude > (3 << (suffixLength - 1)) && suffixLength < 6) {
+            suffixLength++;
+        }
+    }
+
+    int zerosLeft = 0;
+    if (totalCoeff < maxNumCoeff) {
+        if (maxNumCoeff == 4) {
+            zerosLeft = ReadCode(pReader, CHROMA_DC_TOTAL_ZEROS[totalCoeff - 1], 4);
+        } else {
+            zerosLeft = ReadCode(pReader, TOTAL_ZEROS[totalCoeff - 1], 16);
+        }
+        if (zerosLeft < 0 || zerosLeft + totalCoeff > maxNumCoeff) {
+            return -1;
+        }
+    }
+
+    // 高周波側から係数を置く (run_beforeは係数の直前のゼロの数)
+    int position = totalCoeff + zerosLeft - 1;
+    for (int i = 0; i < totalCoeff; i++) {
+        coeffs[position] = static_cast<INT16>(levels[i]);
+        int run = 0;
+        if (i < totalCoeff - 1 && zerosLeft > 0) {
+            run = ReadCode(pReader, RUN_BEFORE[(zerosLeft > 7 ? 7 : zerosLeft) - 1], 15);
+            if (run < 0 || run > zerosLeft) {
+                return -1;
+            }
+            zerosLeft -= run;
+        }
+        position -= run + 1;
+    }
+    return pReader->overrun ? -1 : totalCoeff;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "portable_types.h"
+#include <vector>
+
+// H.264のビット読み書きとCAVLC (Context-Adaptive Variable Length Coding) の残差ブロック符号化・復号
+
+// RBSPを書き込むビットライター (エミュレーション防止バイトは書き込み後にRbspToEbspで挿入する)
+// dataはフレームをまたいで使い回すので、確保は最初の数フレームだけで済む
+struct H264BitWriter {
+    std::vector<BYTE> data;            // 書き込み済みのバイト
+    UINT64 cache;                      // まだバイトになっていないビット (下位cacheBitsビット)
+    int cacheBits;
+};
+
+// 書き込み位置を先頭に戻す関数 (確保済みの領域は残す)
+void H264ResetBitWriter(H264BitWriter* pWriter);
+
+// valueの下位countビット (count <= 32) を書き込む関数
+void H264WriteBits(H264BitWriter* pWriter, UINT32 value, int count);
+
+// 符号なし・符号付きExp-Golomb (ue(v)/se(v)) を書き込む関数
+void H264WriteUe(H264BitWriter* pWriter, UINT32 value);
+void H264WriteSe(H264BitWriter* pWriter, int value);
+
+// rbsp_trailing_bits (1と、バイト境界までの0) を書き込む関数
+void H264WriteTrailingBits(H264BitWriter* pWriter);
+
+// 書き込んだビット数を返す関数
+size_t H264GetBitCount(const H264BitWriter* pWriter);
+
+// residual_block_cavlcを書き込む関数
+// coeffsはスキャン順のmaxNumCoeff個の係数 (4: 色差DC、15: AC、16: 4x4/輝度DC)
+// nCは周囲のブロックの非ゼロ係数の数から求めた値 (色差DCは-1)
+// 戻り値はTotalCoeff (周囲のブロックのnCの計算に使う)
+int H264WriteResidualBlock(H264BitWriter* pWriter, const INT16* coeffs, int maxNumCoeff, int nC);
+
+// RBSPを読み込むビットリーダー (エミュレーション防止バイトは事前にEbspToRbspで除去しておく)
+// 終端を越えて読んだ場合は0を返し、overrunを立てる (呼び出し側でまとめてエラーにする)
+struct H264BitReader {
+    const BYTE* data;
+    size_t size;                       // バイト数
+    size_t bitPos;                     // 次に読むビットの位置
+    bool overrun;                      // 終端を越えて読もうとした
+};
+
+// 読み込み位置を先頭にしてリーダーを初期化する関数
+void H264InitBitReader(H264BitReader* pReader, const BYTE* data, size_t size);
+
+// countビット (count <= 32) を読む関数
+UINT32 H264ReadBits(H264BitReader* pReader, int count);
+
+// 符号なし・符号付きExp-Golomb (ue(v)/se(v)) を読む関数
+UINT32 H264ReadUe(H264BitReader* pReader);
+int H264ReadSe(H264BitReader* pReader);
+
+// 次のバイト境界まで読み飛ばす関数 (pcm_alignment_zero_bit)
+void H264AlignBitReader(H264BitReader* pReader);
+
+// rbsp_trailing_bitsより前にデータが残っているかを返す関数 (more_rbsp_data())
+bool H264MoreRbspData(const H264BitReader* pReader);
+
+// residual_block_cavlcを読む関数 (H264WriteResidualBlockの逆)
+// coeffsにスキャン順のmaxNumCoeff個の係数を書き込み、TotalCoeffを返す (ビットストリームの誤りなら-1)
+int H264ReadResidualBlock(H264BitReader* pReader, INT16* coeffs, int maxNumCoeff, int nC);
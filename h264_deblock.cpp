@@ -0,0 +1,192 @@
+#include "h264_deblock.h"
+#include <stdlib.h>
+
+// alpha' (表8-16) [indexA]
+static const BYTE ALPHA_TABLE[52] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      4,   4,   5,   6,   7,   8,   9,  10,  12,  13,  15,  17,  20,  22,  25,  28,
+     32,  36,  40,  45,  50,  56,  63,  71,  80,  90, 101, 113, 127, 144, 162, 182,
+    203, 226, 255, 255,
+};
+
+// beta' (表8-16) [indexB]
+static const BYTE BETA_TABLE[52] = {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      2,   2,   2,   3,   3,   3,   3,   4,   4,   4,   6,   6,   7,   7,   8,   8,
+      9,   9,  10,  10,  11,  11,  12,  12,  13,  13,  14,  14,  15,  15,  16,  16,
+     17,  17,  18,  18,
+};
+
+// tC0' (表8-17) [indexA][bS - 1]
+static const BYTE TC0_TABLE[52][3] = {
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 },
+    { 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 },
+    { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 1, 2 }, { 1, 2, 3 },
+    { 1, 2, 3 }, { 2, 2, 3 }, { 2, 2, 4 }, { 2, 3, 4 }, { 2, 3, 4 }, { 3, 3, 5 }, { 3, 4, 6 }, { 3, 4, 6 },
+    { 4, 5, 7 }, { 4, 5, 8 }, { 4, 6, 9 }, { 5, 7, 10 }, { 6, 8, 11 }, { 6, 8, 13 }, { 7, 10, 14 }, { 8, 11, 16 },
+    { 9, 12, 18 }, { 10, 13, 20 }, { 11, 15, 23 }, { 13, 17, 25 },
+};
+
+static inline int Clip3(int low, int high, int value)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+static inline BYTE Clip1(int value)
+{
+    return static_cast<BYTE>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+// エッジ1本分のフィルターパラメーター
+struct EdgeParams {
+    int alpha;
+    int beta;
+    int tc0;
+    int bS;
+};
+
+static inline bool GetEdgeParams(int qpAverage, int alphaOffset, int betaOffset, int bS, EdgeParams* pParams)
+{
+    int indexA = Clip3(0, 51, qpAverage + alphaOffset);
+    int indexB = Clip3(0, 51, qpAverage + betaOffset);
+    pParams->alpha = ALPHA_TABLE[indexA];
+    pParams->beta = BETA_TABLE[indexB];
+    pParams->tc0 = TC0_TABLE[indexA][bS - 1 < 2 ? bS - 1 : 2];
+    pParams->bS = bS;
+    // alphaかbetaが0ならどの画素もフィルターされない
+    return pParams->alpha > 0 && pParams->beta > 0;
+}
+
+// 輝度のエッジをフィルターする (pはエッジのq0側の先頭画素、stepはエッジを横切る方向、pitchはエッジに沿う方向)
+static void FilterLumaEdge(BYTE* p, ptrdiff_t step, ptrdiff_t pitch, const EdgeParams& params)
+{
+    const int alpha = params.alpha;
+    const int beta = params.beta;
+    for (int k = 0; k < 16; k++, p += pitch) {
+        int p0 = p[-step], p1 = p[-2 * step], p2 = p[-3 * step];
+        int q0 = p[0], q1 = p[step], q2 = p[2 * step];
+        if (abs(p0 - q0) >= alpha || abs(p1 - p0) >= beta || abs(q1 - q0) >= beta) {
+            continue;
+        }
+        bool ap = abs(p2 - p0) < beta;
+        bool aq = abs(q2 - q0) < beta;
+        if (params.bS == 4) {
+            bool strong = abs(p0 - q0) < ((alpha >> 2) + 2);
+            if (ap && strong) {
+                int p3 = p[-4 * step];
+                p[-step] = static_cast<BYTE>((p2 + 2 * p1 + 2 * p0 + 2 * q0 + q1 + 4) >> 3);
+                p[-2 * step] = static_cast<BYTE>((p2 + p1 + p0 + q0 + 2) >> 2);
+                p[-3 * step] = static_cast<BYTE>((2 * p3 + 3 * p2 + p1 + p0 + q0 + 4) >> 3);
+            } else {
+                p[-step] = static_cast<BYTE>((2 * p1 + p0 + q1 + 2) >> 2);
+            }
+            if (aq && strong) {
+                int q3 = p[3 * step];
+                p[0] = static_cast<BYTE>((p1 + 2 * p0 + 2 * q0 + 2 * q1 + q2 + 4) >> 3);
+                p[step] = static_cast<BYTE>((p0 + q0 + q1 + q2 + 2) >> 2);
+                p[2 * step] = static_cast<BYTE>((2 * q3 + 3 * q2 + q1 + q0 + p0 + 4) >> 3);
+            } else {
+                p[0] = static_cast<BYTE>((2 * q1 + q0 + p1 + 2) >> 2);
+            }
+        } else {
+            const int tc0 = params.tc0;
+            int tc = tc0 + (ap ? 1 : 0) + (aq ? 1 : 0);
+            int delta = Clip3(-tc, tc, ((q0 - p0) * 4 + (p1 - q1) + 4) >> 3);
+            if (ap) {
+                p[-2 * step] = static_cast<BYTE>(p1 + Clip3(-tc0, tc0, (p2 + ((p0 + q0 + 1) >> 1) - (p1 << 1)) >> 1));
+            }
+            if (aq) {
+                p[step] = static_cast<BYTE>(q1 + Clip3(-tc0, tc0, (q2 + ((p0 + q0 + 1) >> 1) - (q1 << 1)) >> 1));
+            }
+            p[-step] = Clip1(p0 + delta);
+            p[0] = Clip1(q0 - delta);
+        }
+    }
+}
+
+// 色差のエッジ (8画素) をフィルターする (NV12なのでUとVを1回で処理する)
+static void FilterChromaEdge(BYTE* p, ptrdiff_t step, ptrdiff_t pitch, ptrdiff_t componentStep, const EdgeParams& params)
+{
+    for (int k = 0; k < 16; k++) {
+        // k偶数はU、奇数はV (同じ位置の2成分)
+        BYTE* s = p + (k >> 1) * pitch + (k & 1) * componentStep;
+        int p0 = s[-step], p1 = s[-2 * step];
+        int q0 = s[0], q1 = s[step];
+        if (abs(p0 - q0) >= params.alpha || abs(p1 - p0) >= params.beta || abs(q1 - q0) >= params.beta) {
+            continue;
+        }
+        if (params.bS == 4) {
+            s[-step] = static_cast<BYTE>((2 * p1 + p0 + q1 + 2) >> 2);
+            s[0] = static_cast<BYTE>((2 * q1 + q0 + p1 + 2) >> 2);
+        } else {
+            int tc = params.tc0 + 1;
+            int delta = Clip3(-tc, tc, ((q0 - p0) * 4 + (p1 - q1) + 4) >> 3);
+            s[-step] = Clip1(p0 + delta);
+            s[0] = Clip1(q0 - delta);
+        }
+    }
+}
+
+// 1マクロブロックの輝度・色差のエッジをフィルターする
+static void DeblockMacroblock(Nv12Frame* pFrame, UINT32 mbX, UINT32 mbY, const H264DeblockMacroblock& cur,
+                              const H264DeblockMacroblock* pLeft, const H264DeblockMacroblock* pTop)
+{
+    const ptrdiff_t stride = pFrame->stride;
+    BYTE* pY = pFrame->pY + static_cast<size_t>(mbY) * 16 * stride + mbX * 16;
+    BYTE* pUV = pFrame->pUV + static_cast<size_t>(mbY) * 8 * stride + mbX * 16;
+    EdgeParams params;
+
+    // 輝度の垂直エッジ (左から右)、水平エッジ (上から下)
+    for (int dir = 0; dir < 2; dir++) {
+        const H264DeblockMacroblock* pNeighbor = dir == 0 ? pLeft : pTop;
+        ptrdiff_t step = dir == 0 ? 1 : stride;
+        ptrdiff_t pitch = dir == 0 ? stride : 1;
+        if (pNeighbor && GetEdgeParams((pNeighbor->qp + cur.qp + 1) >> 1, cur.alphaOffset, cur.betaOffset, 4, &params)) {
+            FilterLumaEdge(pY, step, pitch, params);
+        }
+        if (GetEdgeParams(cur.qp, cur.alphaOffset, cur.betaOffset, 3, &params)) {
+            for (int edge = 1; edge < 4; edge++) {
+                FilterLumaEdge(pY + edge * 4 * step, step, pitch, params);
+            }
+        }
+    }
+
+    // 色差の垂直エッジ、水平エッジ (色差の4画素目のエッジは輝度の8画素目のエッジに対応する)
+    for (int dir = 0; dir < 2; dir++) {
+        const H264DeblockMacroblock* pNeighbor = dir == 0 ? pLeft : pTop;
+        ptrdiff_t step = dir == 0 ? 2 : stride;
+        ptrdiff_t pitch = dir == 0 ? stride : 2;
+        if (pNeighbor &&
+            GetEdgeParams((pNeighbor->chromaQp + cur.chromaQp + 1) >> 1, cur.alphaOffset, cur.betaOffset, 4, &params)) {
+            FilterChromaEdge(pUV, step, pitch, 1, params);
+        }
+        if (GetEdgeParams(cur.chromaQp, cur.alphaOffset, cur.betaOffset, 3, &params)) {
+            FilterChromaEdge(pUV + 4 * step, step, pitch, 1, params);
+        }
+    }
+}
+
+void H264DeblockIntraFrame(Nv12Frame* pFrame, UINT32 mbWidth, UINT32 mbHeight, const H264DeblockMacroblock* macroblocks)
+{
+    for (UINT32 mbY = 0; mbY < mbHeight; mbY++) {
+        for (UINT32 mbX = 0; mbX < mbWidth; mbX++) {
+            const H264DeblockMacroblock& cur = macroblocks[static_cast<size_t>(mbY) * mbWidth + mbX];
+            if (cur.disableIdc == 1) {
+                continue;
+            }
+            const H264DeblockMacroblock* pLeft = mbX > 0 ? &cur - 1 : NULL;
+            const H264DeblockMacroblock* pTop = mbY > 0 ? &cur - mbWidth : NULL;
+            if (cur.disableIdc == 2) {
+                // スライス境界はフィルターしない
+                if (pLeft && pLeft->sliceIndex != cur.sliceIndex) {
+                    pLeft = NULL;
+                }
+                if (pTop && pTop->sliceIndex != cur.sliceIndex) {
+                    pTop = NULL;
+                }
+            }
+            DeblockMacroblock(pFrame, mbX, mbY, cur, pLeft, pTop);
+        }
+    }
+}
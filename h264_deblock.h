@@ -0,0 +1,21 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+
+// H.264のデブロッキングフィルター (8.7)。イントラのみのピクチャーを対象にする
+// (境界強度bSはマクロブロック境界で4、マクロブロック内部で3に固定)
+
+// フィルターに必要なマクロブロックごとの情報
+struct H264DeblockMacroblock {
+    BYTE qp;                           // QPY (I_PCMは0)
+    BYTE chromaQp;                     // 色差のQP (chroma_qp_index_offsetを反映した値)
+    BYTE disableIdc;                   // disable_deblocking_filter_idc (1: フィルターなし、2: スライス境界を除く)
+    signed char alphaOffset;           // FilterOffsetA (slice_alpha_c0_offset_div2 * 2)
+    signed char betaOffset;            // FilterOffsetB (slice_beta_offset_div2 * 2)
+    UINT16 sliceIndex;                 // ピクチャー内のスライス番号 (disableIdc == 2の判定に使う)
+};
+
+// フレーム全体 (mbWidth x mbHeightのマクロブロック) をラスター順にフィルターする関数
+// すべてのスライスの再構成が終わってから呼ぶこと
+void H264DeblockIntraFrame(Nv12Frame* pFrame, UINT32 mbWidth, UINT32 mbHeight, const H264DeblockMacroblock* macroblocks);
@@ -0,0 +1,191 @@
+// イントラのみのソフトウェアH.264エンコーダーのベンチマーク
+// スライス数 (= スレッド数) を1, 2, 4, ... と増やし、スループットとビットレートの変化を測る
+// 同じスレッド数のソフトウェアデコーダーで復号し、デコードのスループットも測る
+#include "h264_intra_encoder.h"
+#include "h264_intra_decoder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// 再現性のある疑似乱数 (xorshift64)
+static UINT64 NextRandom(UINT64& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// テストフレームに粒状ノイズを加える (平坦なグラデーションだけでは変換・CAVLCの負荷が実際より軽くなる)
+static void AddGrain(Nv12Frame* pFrame, UINT64 seed)
+{
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    for (UINT32 y = 0; y < pFrame->height; y++) {
+        BYTE* pRow = pFrame->pY + static_cast<size_t>(y) * pFrame->stride;
+        for (UINT32 x = 0; x < pFrame->width; x += 8) {
+            UINT64 r = NextRandom(state);
+            for (UINT32 k = 0; k < 8 && x + k < pFrame->width; k++) {
+                int value = pRow[x + k] + static_cast<int>((r >> (k * 8)) & 7) - 3;
+                pRow[x + k] = static_cast<BYTE>(value < 0 ? 0 : (value > 255 ? 255 : value));
+            }
+        }
+    }
+}
+
+// 引数の上限 (入力フレームはすべて先に確保するので、確保しきれない値を弾く)
+#define BENCH_MAX_DIMENSION 8192
+#define BENCH_MAX_FRAMES 1000
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [width] [height] [qp] [frames] [max slices]\n", program);
+    printf("  width       multiple of 16 (default 1920)\n");
+    printf("  height      even (default 1080)\n");
+    printf("  qp          0-51 (default 28)\n");
+    printf("  frames      1-%u (default 30)\n", BENCH_MAX_FRAMES);
+    printf("  max slices  1-%u (default: hardware threads)\n", H264_MAX_SLICES);
+}
+
+// 引数を10進の整数として読む (数字以外が混ざっているか、範囲外ならfalse)
+static bool ParseArgument(const char* text, UINT32 minValue, UINT32 maxValue, UINT32* pValue)
+{
+    char* end = NULL;
+    unsigned long value = strtoul(text, &end, 10);
+    if (end == text || *end != '\0' || text[0] == '-' || value < minValue || value > maxValue) {
+        return false;
+    }
+    *pValue = static_cast<UINT32>(value);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    UINT32 width = 1920;
+    UINT32 height = 1080;
+    UINT32 qp = 28;
+    UINT32 frameCount = 30;
+    UINT32 maxSlices = std::thread::hardware_concurrency();
+
+    if (argc > 1 && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0)) {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+    if (argc > 6 ||
+        (argc > 1 && (!ParseArgument(argv[1], 16, BENCH_MAX_DIMENSION, &width) || (width % 16) != 0)) ||
+        (argc > 2 && (!ParseArgument(argv[2], 2, BENCH_MAX_DIMENSION, &height) || (height % 2) != 0)) ||
+        (argc > 3 && !ParseArgument(argv[3], 0, 51, &qp)) ||
+        (argc > 4 && !ParseArgument(argv[4], 1, BENCH_MAX_FRAMES, &frameCount)) ||
+        (argc > 5 && !ParseArgument(argv[5], 1, H264_MAX_SLICES, &maxSlices))) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (maxSlices == 0) {
+        maxSlices = 1;
+    }
+    if (maxSlices > H264_MAX_SLICES) {
+        maxSlices = H264_MAX_SLICES;
+    }
+
+    // 入力フレームは先に作っておき、エンコード時間だけを測る
+    std::vector<Nv12Frame> frames(frameCount);
+    for (UINT32 i = 0; i < frameCount; i++) {
+        HRESULT hr = AllocateNv12Frame(&frames[i], width, height, AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT));
+        if (FAILED(hr)) {
+            printf("AllocateNv12Frame failed: 0x%08X\n", hr);
+            for (UINT32 k = 0; k < i; k++) {
+                FreeNv12Frame(&frames[k]);
+            }
+            return 1;
+        }
+        GenerateTestFrame(&frames[i], i);
+        AddGrain(&frames[i], i + 1);
+    }
+    printf("%ux%u, QP %u, %u frames, up to %u slices\n", width, height, qp, frameCount, maxSlices);
+    printf("slices      fps    kbps@30fps   PSNR(Y)   dec fps\n");
+
+    std::vector<UINT32> sliceCounts;
+    for (UINT32 n = 1; n < maxSlices; n *= 2) {
+        sliceCounts.push_back(n);
+    }
+    sliceCounts.push_back(maxSlices);
+
+    int result = 0;
+    std::vector<std::vector<BYTE>> nalUnits;
+    for (UINT32 sliceCount : sliceCounts) {
+        H264IntraEncoder* pEncoder = new H264IntraEncoder();
+        HRESULT hr = InitializeH264IntraEncoder(pEncoder, width, height, sliceCount);
+        if (FAILED(hr)) {
+            printf("InitializeH264IntraEncoder failed: 0x%08X\n", hr);
+            delete pEncoder;
+            result = 1;
+            break;
+        }
+
+        H264IntraDecoder* pDecoder = new H264IntraDecoder();
+        InitializeH264IntraDecoder(pDecoder, sliceCount);
+
+        UINT64 totalBytes = 0;
+        double psnrSum = 0.0;
+        double encodeMs = 0.0;
+        double decodeMs = 0.0;
+        for (UINT32 i = 0; i < frameCount; i++) {
+            nalUnits.clear();
+            auto start = std::chrono::steady_clock::now();
+            hr = EncodeH264IntraFrame(pEncoder, frames[i], qp, i == 0, nalUnits);
+            encodeMs += ElapsedMs(start);
+            if (FAILED(hr)) {
+                printf("EncodeH264IntraFrame failed: 0x%08X\n", hr);
+                result = 1;
+                break;
+            }
+            for (const auto& nal : nalUnits) {
+                totalBytes += nal.size();
+            }
+            psnrSum += GetH264IntraReconPsnr(pEncoder, frames[i]);
+
+            // 次のピクチャーの先頭を待たずに、フレームごとにFlushして完了させる
+            start = std::chrono::steady_clock::now();
+            for (const auto& nal : nalUnits) {
+                hr = DecodeH264Nal(pDecoder, nal.data(), nal.size());
+                if (FAILED(hr)) {
+                    break;
+                }
+            }
+            if (SUCCEEDED(hr)) {
+                hr = FlushH264IntraDecoder(pDecoder);
+            }
+            decodeMs += ElapsedMs(start);
+            if (FAILED(hr)) {
+                printf("DecodeH264Nal failed: 0x%08X\n", hr);
+                result = 1;
+                break;
+            }
+            while (Nv12Frame* pDecoded = TakeDecodedH264Frame(pDecoder)) {
+                ReleaseDecodedH264Frame(pDecoder, pDecoded);
+            }
+        }
+        printf("%6d %8.1f %12.1f %9.2f %9.1f\n", pEncoder->sliceCount, frameCount / (encodeMs / 1000.0),
+               totalBytes * 8.0 * 30.0 / frameCount / 1000.0, psnrSum / frameCount, frameCount / (decodeMs / 1000.0));
+
+        ShutdownH264IntraDecoder(pDecoder);
+        delete pDecoder;
+        ShutdownH264IntraEncoder(pEncoder);
+        delete pEncoder;
+        if (result != 0) {
+            break;
+        }
+    }
+
+    for (auto& frame : frames) {
+        FreeNv12Frame(&frame);
+    }
+    return result;
+}
@@ -0,0 +1,1020 @@
+#include "h264_intra_decoder.h"
+#include "h264_cavlc.h"
+#include "h264_transform.h"
+#include "nal_emulation.h"
+#include "pipeline_trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+// 簡素化されたエラーチェック用マクロ
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// NALユニットタイプ
+#define NAL_TYPE_SLICE     1
+#define NAL_TYPE_IDR       5
+#define NAL_TYPE_SEI       6
+#define NAL_TYPE_SPS       7
+#define NAL_TYPE_PPS       8
+#define NAL_TYPE_AUD       9
+#define NAL_TYPE_END_SEQ   10
+#define NAL_TYPE_END_STREAM 11
+
+// slice_type % 5
+#define SLICE_TYPE_I 2
+
+// mb_type (Iスライス)
+#define MB_TYPE_I_NXN 0
+#define MB_TYPE_I_PCM 25
+
+// 上限を超える値はビットストリームの誤りとして扱う
+#define H264_MAX_MB_WIDTH  512
+#define H264_MAX_MB_HEIGHT 512
+
+// 4x4ブロックの復号順 (luma4x4BlkIdx) -> マクロブロック内の位置 (4画素単位)
+static const BYTE BLOCK_X[16] = { 0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3 };
+static const BYTE BLOCK_Y[16] = { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 3, 3, 2, 2, 3, 3 };
+
+// マクロブロック内のラスター位置 -> 復号順
+static const BYTE RASTER_TO_BLOCK[16] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+
+// me(v)のcodeNum -> coded_block_pattern (イントラ、表9-4)
+static const BYTE CODE_NUM_TO_CBP[48] = {
+    47, 31, 15,  0, 23, 27, 29, 30,  7, 11, 13, 14, 39, 43, 45, 46,
+    16,  3,  5, 10, 12, 19, 21, 26, 28, 35, 37, 42, 44,  1,  2,  4,
+     8, 17, 18, 20, 24,  6,  9, 22, 25, 32, 33, 34, 36, 40, 38, 41,
+};
+
+static inline int ClipQp(int qp)
+{
+    return qp < 0 ? 0 : (qp > 51 ? 51 : qp);
+}
+
+// 未対応のストリームを1回だけ警告する
+static HRESULT ReportUnsupported(H264IntraDecoder* pDecoder, const char* what)
+{
+    if (!pDecoder->unsupportedReported) {
+        printf("Software decoder: unsupported stream (%s)\n", what);
+        pDecoder->unsupportedReported = true;
+    }
+    return E_NOTIMPL;
+}
+
+// ---- パラメーターセットとスライスヘッダー ----
+
+static HRESULT ParseSps(H264IntraDecoder* pDecoder, H264BitReader* pReader)
+{
+    H264SequenceParameterSet sps = {};
+    sps.profileIdc = H264ReadBits(pReader, 8);
+    H264ReadBits(pReader, 16);                       // constraint_set_flags, level_idc
+    UINT32 spsId = H264ReadUe(pReader);
+    if (spsId >= H264_MAX_SPS_COUNT) {
+        return E_FAIL;
+    }
+
+    switch (sps.profileIdc) {
+    case 100: case 110: case 122: case 244: case 44: case 83: case 86: case 118: case 128: case 138: case 139:
+    case 134: case 135: {
+        UINT32 chromaFormatIdc = H264ReadUe(pReader);
+        if (chromaFormatIdc == 3) {
+            H264ReadBits(pReader, 1);                // separate_colour_plane_flag
+        }
+        UINT32 bitDepthLuma = H264ReadUe(pReader) + 8;
+        UINT32 bitDepthChroma = H264ReadUe(pReader) + 8;
+        H264ReadBits(pReader, 1);                    // qpprime_y_zero_transform_bypass_flag
+        UINT32 scalingMatrixPresent = H264ReadBits(pReader, 1);
+        if (chromaFormatIdc != 1 || bitDepthLuma != 8 || bitDepthChroma != 8 || scalingMatrixPresent) {
+            return ReportUnsupported(pDecoder, "chroma format, bit depth or scaling matrix");
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    sps.log2MaxFrameNum = H264ReadUe(pReader) + 4;
+    sps.pocType = H264ReadUe(pReader);
+    if (sps.pocType == 0) {
+        sps.log2MaxPocLsb = H264ReadUe(pReader) + 4;
+    } else if (sps.pocType == 1) {
+        sps.deltaPicOrderAlwaysZero = H264ReadBits(pReader, 1) != 0;
+        H264ReadSe(pReader);                         // offset_for_non_ref_pic
+        H264ReadSe(pReader);                         // offset_for_top_to_bottom_field
+        UINT32 cycle = H264ReadUe(pReader);
+        if (cycle > 255) {
+            return E_FAIL;
+        }
+        for (UINT32 i = 0; i < cycle; i++) {
+            H264ReadSe(pReader);                     // offset_for_ref_frame
+        }
+    }
+    H264ReadUe(pReader);                             // max_num_ref_frames
+    H264ReadBits(pReader, 1);                        // gaps_in_frame_num_value_allowed_flag
+    sps.mbWidth = H264ReadUe(pReader) + 1;
+    sps.mbHeight = H264ReadUe(pReader) + 1;
+    if (!H264ReadBits(pReader, 1)) {
+        return ReportUnsupported(pDecoder, "interlaced");
+    }
+    H264ReadBits(pReader, 1);                        // direct_8x8_inference_flag
+    if (H264ReadBits(pReader, 1)) {
+        // 4:2:0のフレームなので、クロップの単位は2画素
+        sps.cropLeft = H264ReadUe(pReader) * 2;
+        sps.cropRight = H264ReadUe(pReader) * 2;
+        sps.cropTop = H264ReadUe(pReader) * 2;
+        sps.cropBottom = H264ReadUe(pReader) * 2;
+    }
+    // VUIは使わない
+
+    if (pReader->overrun || sps.log2MaxFrameNum > 16 || sps.pocType > 2 || sps.log2MaxPocLsb > 16 ||
+        sps.mbWidth > H264_MAX_MB_WIDTH || sps.mbHeight > H264_MAX_MB_HEIGHT ||
+        sps.cropLeft + sps.cropRight >= sps.mbWidth * 16 || sps.cropTop + sps.cropBottom >= sps.mbHeight * 16) {
+        return E_FAIL;
+    }
+    sps.valid = true;
+    pDecoder->sps[spsId] = sps;
+    return S_OK;
+}
+
+static HRESULT ParsePps(H264IntraDecoder* pDecoder, H264BitReader* pReader)
+{
+    H264PictureParameterSet pps = {};
+    UINT32 ppsId = H264ReadUe(pReader);
+    pps.spsId = H264ReadUe(pReader);
+    if (ppsId >= H264_MAX_PPS_COUNT || pps.spsId >= H264_MAX_SPS_COUNT) {
+        return E_FAIL;
+    }
+    if (H264ReadBits(pReader, 1)) {
+        return ReportUnsupported(pDecoder, "CABAC");
+    }
+    pps.bottomFieldPicOrderPresent = H264ReadBits(pReader, 1) != 0;
+    if (H264ReadUe(pReader) != 0) {
+        return ReportUnsupported(pDecoder, "slice groups");
+    }
+    H264ReadUe(pReader);                             // num_ref_idx_l0_default_active_minus1
+    H264ReadUe(pReader);                             // num_ref_idx_l1_default_active_minus1
+    H264ReadBits(pReader, 3);                        // weighted_pred_flag, weighted_bipred_idc
+    pps.picInitQp = 26 + H264ReadSe(pReader);
+    H264ReadSe(pReader);                             // pic_init_qs_minus26
+    pps.chromaQpIndexOffset = H264ReadSe(pReader);
+    pps.deblockingFilterControlPresent = H264ReadBits(pReader, 1) != 0;
+    H264ReadBits(pReader, 1);                        // constrained_intra_pred_flag (イントラのみなので影響しない)
+    pps.redundantPicCntPresent = H264ReadBits(pReader, 1) != 0;
+    if (H264MoreRbspData(pReader)) {
+        UINT32 transform8x8 = H264ReadBits(pReader, 1);
+        UINT32 scalingMatrixPresent = H264ReadBits(pReader, 1);
+        int secondChromaQpIndexOffset = H264ReadSe(pReader);
+        if (transform8x8 || scalingMatrixPresent || secondChromaQpIndexOffset != pps.chromaQpIndexOffset) {
+            return ReportUnsupported(pDecoder, "8x8 transform, scaling matrix or second chroma QP offset");
+        }
+    }
+
+    if (pReader->overrun || pps.picInitQp < 0 || pps.picInitQp > 51 ||
+        pps.chromaQpIndexOffset < -12 || pps.chromaQpIndexOffset > 12) {
+        return E_FAIL;
+    }
+    pps.valid = true;
+    pDecoder->pps[ppsId] = pps;
+    return S_OK;
+}
+
+// スライスヘッダーを読む (冗長ピクチャーのスライスならS_FALSE)
+static HRESULT ParseSliceHeader(H264IntraDecoder* pDecoder, H264BitReader* pReader, BYTE nalHeader,
+                                H264SliceHeader* pHeader, const H264PictureParameterSet** ppPps)
+{
+    pHeader->nalRefIdc = (nalHeader >> 5) & 3;
+    pHeader->idr = (nalHeader & 0x1F) == NAL_TYPE_IDR;
+    pHeader->firstMb = H264ReadUe(pReader);
+    pHeader->sliceType = H264ReadUe(pReader) % 5;
+    pHeader->ppsId = H264ReadUe(pReader);
+    if (pHeader->ppsId >= H264_MAX_PPS_COUNT || !pDecoder->pps[pHeader->ppsId].valid) {
+        printf("Software decoder: slice refers to missing PPS %u\n", pHeader->ppsId);
+        return E_FAIL;
+    }
+    const H264PictureParameterSet* pPps = &pDecoder->pps[pHeader->ppsId];
+    const H264SequenceParameterSet* pSps = &pDecoder->sps[pPps->spsId];
+    if (!pSps->valid) {
+        printf("Software decoder: PPS refers to missing SPS %u\n", pPps->spsId);
+        return E_FAIL;
+    }
+    if (pHeader->sliceType != SLICE_TYPE_I) {
+        return ReportUnsupported(pDecoder, "P/B/SI slices");
+    }
+
+    pHeader->frameNum = H264ReadBits(pReader, static_cast<int>(pSps->log2MaxFrameNum));
+    pHeader->idrPicId = pHeader->idr ? H264ReadUe(pReader) : 0;
+    pHeader->pocLsb = 0;
+    if (pSps->pocType == 0) {
+        pHeader->pocLsb = H264ReadBits(pReader, static_cast<int>(pSps->log2MaxPocLsb));
+        if (pPps->bottomFieldPicOrderPresent) {
+            H264ReadSe(pReader);                     // delta_pic_order_cnt_bottom
+        }
+    } else if (pSps->pocType == 1 && !pSps->deltaPicOrderAlwaysZero) {
+        H264ReadSe(pReader);                         // delta_pic_order_cnt[0]
+        if (pPps->bottomFieldPicOrderPresent) {
+            H264ReadSe(pReader);                     // delta_pic_order_cnt[1]
+        }
+    }
+    if (pPps->redundantPicCntPresent && H264ReadUe(pReader) > 0) {
+        return S_FALSE;                              // 冗長スライスは使わない
+    }
+
+    // Iスライスにはref_pic_list_modificationとpred_weight_tableがない
+    if (pHeader->nalRefIdc != 0) {
+        if (pHeader->idr) {
+            H264ReadBits(pReader, 2);                // no_output_of_prior_pics_flag, long_term_reference_flag
+        } else if (H264ReadBits(pReader, 1)) {
+            // adaptive_ref_pic_marking_mode_flag: 参照ピクチャーを使わないので読み飛ばす
+            for (int i = 0; i < 66; i++) {
+                UINT32 operation = H264ReadUe(pReader);
+                if (operation == 0 || pReader->overrun) {
+                    break;
+                }
+                if (operation == 1 || operation == 3) {
+                    H264ReadUe(pReader);             // difference_of_pic_nums_minus1
+                }
+                if (operation == 2) {
+                    H264ReadUe(pReader);             // long_term_pic_num
+                }
+                if (operation == 3 || operation == 6) {
+                    H264ReadUe(pReader);             // long_term_frame_idx
+                }
+                if (operation == 4) {
+                    H264ReadUe(pReader);             // max_long_term_frame_idx_plus1
+                }
+            }
+        }
+    }
+
+    pHeader->qp = pPps->picInitQp + H264ReadSe(pReader);
+    pHeader->disableDeblockingIdc = 0;
+    pHeader->alphaOffset = 0;
+    pHeader->betaOffset = 0;
+    if (pPps->deblockingFilterControlPresent) {
+        pHeader->disableDeblockingIdc = H264ReadUe(pReader);
+        if (pHeader->disableDeblockingIdc != 1) {
+            pHeader->alphaOffset = H264ReadSe(pReader) * 2;
+            pHeader->betaOffset = H264ReadSe(pReader) * 2;
+        }
+    }
+
+    if (pReader->overrun || pHeader->qp < 0 || pHeader->qp > 51 || pHeader->disableDeblockingIdc > 2 ||
+        pHeader->alphaOffset < -12 || pHeader->alphaOffset > 12 || pHeader->betaOffset < -12 ||
+        pHeader->betaOffset > 12 || pHeader->firstMb >= pSps->mbWidth * pSps->mbHeight) {
+        return E_FAIL;
+    }
+    *ppPps = pPps;
+    return S_OK;
+}
+
+// 前のスライスと別のピクチャーかどうか (7.4.1.2.4の比較のうち、フレームだけのストリームで必要なもの)
+static bool IsNewPicture(const H264SliceHeader& previous, const H264SliceHeader& current)
+{
+    return previous.frameNum != current.frameNum || previous.ppsId != current.ppsId ||
+           previous.idr != current.idr || (previous.nalRefIdc == 0) != (current.nalRefIdc == 0) ||
+           (current.idr && previous.idrPicId != current.idrPicId) || previous.pocLsb != current.pocLsb;
+}
+
+// ---- マクロブロックの復号 ----
+
+// 1スライスを復号する間の状態 (担当スレッドだけが使う)
+struct SliceDecodeContext {
+    H264IntraDecoder* pDecoder;
+    H264DecoderSlice* pSlice;
+    H264BitReader reader;
+    Nv12Frame* pFrame;
+    int qp;                            // 直前のマクロブロックのQPY (mb_qp_deltaの予測値)
+    int chromaQpOffset;
+};
+
+// 周囲のマクロブロック (A: 左、B: 上、C: 右上、D: 左上) の情報
+// 同じスライスのマクロブロックだけが使える (スライス内のマクロブロックは連続しているので、先頭より前なら別スライス)
+struct MacroblockNeighbors {
+    const H264MacroblockInfo* pA;
+    const H264MacroblockInfo* pB;
+    bool hasC;
+    bool hasD;
+};
+
+static void GetNeighbors(const SliceDecodeContext& ctx, UINT32 mbAddr, MacroblockNeighbors* pNeighbors)
+{
+    const UINT32 mbWidth = ctx.pDecoder->mbWidth;
+    const UINT32 firstMb = ctx.pSlice->header.firstMb;
+    const UINT32 mbX = mbAddr % mbWidth;
+    const H264MacroblockInfo* pInfo = &ctx.pDecoder->macroblocks[mbAddr];
+    bool hasA = mbX > 0 && mbAddr - 1 >= firstMb;
+    bool hasB = mbAddr >= mbWidth && mbAddr - mbWidth >= firstMb;
+    pNeighbors->pA = hasA ? pInfo - 1 : NULL;
+    pNeighbors->pB = hasB ? pInfo - mbWidth : NULL;
+    pNeighbors->hasC = mbAddr >= mbWidth && mbX + 1 < mbWidth && mbAddr - mbWidth + 1 >= firstMb;
+    pNeighbors->hasD = mbAddr > mbWidth && mbX > 0 && mbAddr - mbWidth - 1 >= firstMb;
+}
+
+static inline int CombineNc(int nA, int nB)
+{
+    if (nA >= 0 && nB >= 0) {
+        return (nA + nB + 1) >> 1;
+    }
+    return nA >= 0 ? nA : (nB >= 0 ? nB : 0);
+}
+
+static int LumaNc(const MacroblockNeighbors& neighbors, const H264MacroblockInfo* pInfo, int raster)
+{
+    int nA = -1, nB = -1;
+    if (raster & 3) {
+        nA = pInfo->lumaCoeffCount[raster - 1];
+    } else if (neighbors.pA) {
+        nA = neighbors.pA->lumaCoeffCount[raster + 3];
+    }
+    if (raster >= 4) {
+        nB = pInfo->lumaCoeffCount[raster - 4];
+    } else if (neighbors.pB) {
+        nB = neighbors.pB->lumaCoeffCount[raster + 12];
+    }
+    return CombineNc(nA, nB);
+}
+
+static int ChromaNc(const MacroblockNeighbors& neighbors, const H264MacroblockInfo* pInfo, int c, int b)
+{
+    int nA = -1, nB = -1;
+    if (b & 1) {
+        nA = pInfo->chromaCoeffCount[c][b - 1];
+    } else if (neighbors.pA) {
+        nA = neighbors.pA->type == H264_MB_I_PCM ? 16 : neighbors.pA->chromaCoeffCount[c][b + 1];
+    }
+    if (b >= 2) {
+        nB = pInfo->chromaCoeffCount[c][b - 2];
+    } else if (neighbors.pB) {
+        nB = neighbors.pB->type == H264_MB_I_PCM ? 16 : neighbors.pB->chromaCoeffCount[c][b + 2];
+    }
+    return CombineNc(nA, nB);
+}
+
+// スキャン順のレベルをラスター順に並べ替える (firstIndex == 1ならACだけ)
+static inline void GatherZigzag(const INT16 scan[16], INT16 raster[16], int firstIndex)
+{
+    raster[0] = 0;
+    for (int i = firstIndex; i < 16; i++) {
+        raster[H264_ZIGZAG_4X4[i]] = scan[i];
+    }
+}
+
+// I_PCM: 輝度256サンプル、Cb 64サンプル、Cr 64サンプルをそのまま置く
+static HRESULT DecodePcmMacroblock(SliceDecodeContext& ctx, BYTE* pY, BYTE* pUV, H264MacroblockInfo* pInfo)
+{
+    H264BitReader* pReader = &ctx.reader;
+    const UINT32 stride = ctx.pFrame->stride;
+    H264AlignBitReader(pReader);
+    size_t bytePos = pReader->bitPos >> 3;
+    if (bytePos + 384 > pReader->size) {
+        return E_FAIL;
+    }
+    const BYTE* pSamples = pReader->data + bytePos;
+    for (int y = 0; y < 16; y++) {
+        memcpy(pY + static_cast<size_t>(y) * stride, pSamples + y * 16, 16);
+    }
+    for (int c = 0; c < 2; c++) {
+        const BYTE* pChroma = pSamples + 256 + c * 64;
+        for (int y = 0; y < 8; y++) {
+            BYTE* pRow = pUV + static_cast<size_t>(y) * stride + c;
+            for (int x = 0; x < 8; x++) {
+                pRow[x * 2] = pChroma[y * 8 + x];
+            }
+        }
+    }
+    pReader->bitPos += 384 * 8;
+
+    pInfo->type = H264_MB_I_PCM;
+    memset(pInfo->intra4x4Modes, H264_I4X4_DC, sizeof(pInfo->intra4x4Modes));
+    memset(pInfo->lumaCoeffCount, 16, sizeof(pInfo->lumaCoeffCount));
+    memset(pInfo->chromaCoeffCount, 16, sizeof(pInfo->chromaCoeffCount));
+    return S_OK;
+}
+
+// 色差の予測と残差の加算 (NV12のUVに書き込む)
+static HRESULT ReconstructChroma(SliceDecodeContext& ctx, BYTE* pUV, const MacroblockNeighbors& neighbors,
+                                 int chromaMode, int cbpChroma, INT16 dcLevels[2][4], INT16 acLevels[2][4][16])
+{
+    const UINT32 stride = ctx.pFrame->stride;
+    const int qpc = H264ChromaQp(ClipQp(ctx.qp + ctx.chromaQpOffset));
+    for (int c = 0; c < 2; c++) {
+        H264IntraNeighbors n;
+        H264LoadChromaNeighborsNv12(pUV, stride, c, neighbors.pB != NULL, neighbors.pA != NULL, neighbors.hasD, &n);
+        if (!H264IsIntraChromaModeAvailable(&n, chromaMode)) {
+            return E_FAIL;
+        }
+        BYTE block[64];
+        H264PredictIntraChroma(&n, chromaMode, block);
+
+        if (cbpChroma) {
+            INT16 dc[4];
+            H264DequantizeChromaDc(dcLevels[c], dc, qpc);
+            for (int b = 0; b < 4; b++) {
+                INT16 levels[16], coeffs[16];
+                if (cbpChroma == 2) {
+                    GatherZigzag(acLevels[c][b], levels, 1);
+                    H264Dequantize4x4(levels, coeffs, qpc, 1);
+                } else {
+                    memset(coeffs, 0, sizeof(coeffs));
+                }
+                coeffs[0] = dc[b];
+                H264InverseTransformAdd4x4(coeffs, block + (b >> 1) * 32 + (b & 1) * 4, 8);
+            }
+        }
+
+        for (int y = 0; y < 8; y++) {
+            BYTE* pRow = pUV + static_cast<size_t>(y) * stride + c;
+            for (int x = 0; x < 8; x++) {
+                pRow[x * 2] = block[y * 8 + x];
+            }
+        }
+    }
+    return S_OK;
+}
+
+static HRESULT DecodeMacroblock(SliceDecodeContext& ctx, UINT32 mbAddr)
+{
+    H264IntraDecoder* pDecoder = ctx.pDecoder;
+    H264BitReader* pReader = &ctx.reader;
+    const UINT32 mbX = mbAddr % pDecoder->mbWidth;
+    const UINT32 mbY = mbAddr / pDecoder->mbWidth;
+    const UINT32 stride = ctx.pFrame->stride;
+    BYTE* pY = ctx.pFrame->pY + static_cast<size_t>(mbY) * 16 * stride + mbX * 16;
+    BYTE* pUV = ctx.pFrame->pUV + static_cast<size_t>(mbY) * 8 * stride + mbX * 16;
+    H264MacroblockInfo* pInfo = &pDecoder->macroblocks[mbAddr];
+    H264DeblockMacroblock* pDeblock = &pDecoder->deblockInfo[mbAddr];
+
+    MacroblockNeighbors neighbors;
+    GetNeighbors(ctx, mbAddr, &neighbors);
+
+    const H264SliceHeader& header = ctx.pSlice->header;
+    pDeblock->disableIdc = static_cast<BYTE>(header.disableDeblockingIdc);
+    pDeblock->alphaOffset = static_cast<signed char>(header.alphaOffset);
+    pDeblock->betaOffset = static_cast<signed char>(header.betaOffset);
+    pDeblock->sliceIndex = ctx.pSlice->index;
+
+    UINT32 mbType = H264ReadUe(pReader);
+    if (mbType == MB_TYPE_I_PCM) {
+        HRESULT hr = DecodePcmMacroblock(ctx, pY, pUV, pInfo);
+        // デブロッキングではI_PCMのQPYを0として扱う (mb_qp_deltaの予測値は変えない)
+        pDeblock->qp = 0;
+        pDeblock->chromaQp = static_cast<BYTE>(H264ChromaQp(ClipQp(ctx.chromaQpOffset)));
+        pDecoder->pcmMacroblocks++;
+        return hr;
+    }
+    if (mbType > MB_TYPE_I_PCM) {
+        return E_FAIL;
+    }
+
+    // マクロブロックレイヤーの構文 (予測モード、CBP、mb_qp_delta)
+    BYTE prevModeFlag[16] = {0};
+    BYTE remMode[16] = {0};
+    int intra16x16Mode = 0;
+    int cbpLuma, cbpChroma;
+    if (mbType == MB_TYPE_I_NXN) {
+        pInfo->type = H264_MB_I4X4;
+        for (int blk = 0; blk < 16; blk++) {
+            prevModeFlag[blk] = static_cast<BYTE>(H264ReadBits(pReader, 1));
+            if (!prevModeFlag[blk]) {
+                remMode[blk] = static_cast<BYTE>(H264ReadBits(pReader, 3));
+            }
+        }
+    } else {
+        pInfo->type = H264_MB_I16X16;
+        intra16x16Mode = static_cast<int>((mbType - 1) % 4);
+    }
+    UINT32 chromaMode = H264ReadUe(pReader);
+    if (chromaMode > 3) {
+        return E_FAIL;
+    }
+    if (mbType == MB_TYPE_I_NXN) {
+        UINT32 codeNum = H264ReadUe(pReader);
+        if (codeNum >= 48) {
+            return E_FAIL;
+        }
+        int cbp = CODE_NUM_TO_CBP[codeNum];
+        cbpLuma = cbp & 15;
+        cbpChroma = cbp >> 4;
+    } else {
+        cbpChroma = static_cast<int>(((mbType - 1) / 4) % 3);
+        cbpLuma = mbType >= 13 ? 15 : 0;
+    }
+    if (cbpLuma || cbpChroma || mbType != MB_TYPE_I_NXN) {
+        int delta = H264ReadSe(pReader);
+        if (delta < -26 || delta > 25) {
+            return E_FAIL;
+        }
+        ctx.qp = (ctx.qp + delta + 52) % 52;
+    }
+    pDeblock->qp = static_cast<BYTE>(ctx.qp);
+    pDeblock->chromaQp = static_cast<BYTE>(H264ChromaQp(ClipQp(ctx.qp + ctx.chromaQpOffset)));
+
+    // 残差 (スキャン順のレベル)
+    memset(pInfo->lumaCoeffCount, 0, sizeof(pInfo->lumaCoeffCount));
+    memset(pInfo->chromaCoeffCount, 0, sizeof(pInfo->chromaCoeffCount));
+    INT16 lumaLevels[16][16];
+    INT16 lumaDcLevels[16];
+    INT16 chromaDcLevels[2][4] = {};
+    INT16 chromaAcLevels[2][4][16];
+    if (mbType != MB_TYPE_I_NXN) {
+        if (H264ReadResidualBlock(pReader, lumaDcLevels, 16, LumaNc(neighbors, pInfo, 0)) < 0) {
+            return E_FAIL;
+        }
+    }
+    for (int blk = 0; blk < 16; blk++) {
+        int raster = BLOCK_Y[blk] * 4 + BLOCK_X[blk];
+        if (!(cbpLuma & (1 << (blk >> 2)))) {
+            continue;
+        }
+        int nC = LumaNc(neighbors, pInfo, raster);
+        int totalCoeff = (mbType == MB_TYPE_I_NXN)
+            ? H264ReadResidualBlock(pReader, lumaLevels[raster], 16, nC)
+            : H264ReadResidualBlock(pReader, lumaLevels[raster] + 1, 15, nC);
+        if (totalCoeff < 0) {
+            return E_FAIL;
+        }
+        pInfo->lumaCoeffCount[raster] = static_cast<BYTE>(totalCoeff);
+    }
+    if (cbpChroma) {
+        for (int c = 0; c < 2; c++) {
+            if (H264ReadResidualBlock(pReader, chromaDcLevels[c], 4, -1) < 0) {
+                return E_FAIL;
+            }
+        }
+    }
+    if (cbpChroma == 2) {
+        for (int c = 0; c < 2; c++) {
+            for (int b = 0; b < 4; b++) {
+                int totalCoeff = H264ReadResidualBlock(pReader, chromaAcLevels[c][b] + 1, 15, ChromaNc(neighbors, pInfo, c, b));
+                if (totalCoeff < 0) {
+                    return E_FAIL;
+                }
+                pInfo->chromaCoeffCount[c][b] = static_cast<BYTE>(totalCoeff);
+            }
+        }
+    }
+
+    // 輝度の再構成
+    const int qp = ctx.qp;
+    if (mbType == MB_TYPE_I_NXN) {
+        for (int blk = 0; blk < 16; blk++) {
+            int bx = BLOCK_X[blk], by = BLOCK_Y[blk];
+            int raster = by * 4 + bx;
+            bool hasLeft = bx > 0 || neighbors.pA;
+            bool hasTop = by > 0 || neighbors.pB;
+            bool hasTopLeft = (bx > 0 && by > 0) ? true
+                              : (by == 0 ? (bx > 0 ? neighbors.pB != NULL : neighbors.hasD) : neighbors.pA != NULL);
+            bool hasTopRight;
+            if (by == 0) {
+                hasTopRight = (bx < 3) ? neighbors.pB != NULL : neighbors.hasC;
+            } else {
+                hasTopRight = bx < 3 && RASTER_TO_BLOCK[raster - 3] < blk;
+            }
+
+            // 予測モードの予測値 (左と上のブロックの小さい方、どちらかがなければDC)
+            int modeA = -1, modeB = -1;
+            if (bx > 0) {
+                modeA = pInfo->intra4x4Modes[raster - 1];
+            } else if (neighbors.pA) {
+                modeA = neighbors.pA->type == H264_MB_I4X4 ? neighbors.pA->intra4x4Modes[raster + 3] : static_cast<int>(H264_I4X4_DC);
+            }
+            if (by > 0) {
+                modeB = pInfo->intra4x4Modes[raster - 4];
+            } else if (neighbors.pB) {
+                modeB = neighbors.pB->type == H264_MB_I4X4 ? neighbors.pB->intra4x4Modes[raster + 12] : static_cast<int>(H264_I4X4_DC);
+            }
+            int predictedMode = (modeA < 0 || modeB < 0) ? H264_I4X4_DC : (modeA < modeB ? modeA : modeB);
+            int mode = prevModeFlag[blk] ? predictedMode
+                                         : (remMode[blk] < predictedMode ? remMode[blk] : remMode[blk] + 1);
+            pInfo->intra4x4Modes[raster] = static_cast<BYTE>(mode);
+
+            BYTE* pBlock = pY + static_cast<size_t>(by * 4) * stride + bx * 4;
+            H264IntraNeighbors n;
+            H264LoadIntraNeighbors(pBlock, stride, 4, hasTop, hasLeft, hasTopLeft, hasTopRight, &n);
+            if (!H264IsIntra4x4ModeAvailable(&n, mode)) {
+                return E_FAIL;
+            }
+            BYTE pred[16];
+            H264PredictIntra4x4(&n, mode, pred);
+            for (int y = 0; y < 4; y++) {
+                memcpy(pBlock + static_cast<size_t>(y) * stride, pred + y * 4, 4);
+            }
+            if (pInfo->lumaCoeffCount[raster]) {
+                INT16 levels[16], coeffs[16];
+                GatherZigzag(lumaLevels[raster], levels, 0);
+                H264Dequantize4x4(levels, coeffs, qp, 0);
+                H264InverseTransformAdd4x4(coeffs, pBlock, stride);
+            }
+        }
+    } else {
+        memset(pInfo->intra4x4Modes, H264_I4X4_DC, sizeof(pInfo->intra4x4Modes));
+        H264IntraNeighbors n;
+        H264LoadIntraNeighbors(pY, stride, 16, neighbors.pB != NULL, neighbors.pA != NULL, neighbors.hasD, false, &n);
+        if (!H264IsIntra16x16ModeAvailable(&n, intra16x16Mode)) {
+            return E_FAIL;
+        }
+        BYTE pred[256];
+        H264PredictIntra16x16(&n, intra16x16Mode, pred);
+        for (int y = 0; y < 16; y++) {
+            memcpy(pY + static_cast<size_t>(y) * stride, pred + y * 16, 16);
+        }
+
+        INT16 dcLevels[16], dc[16];
+        for (int i = 0; i < 16; i++) {
+            dcLevels[H264_ZIGZAG_4X4[i]] = lumaDcLevels[i];
+        }
+        H264DequantizeLumaDc(dcLevels, dc, qp);
+        for (int raster = 0; raster < 16; raster++) {
+            INT16 levels[16], coeffs[16];
+            if (pInfo->lumaCoeffCount[raster]) {
+                GatherZigzag(lumaLevels[raster], levels, 1);
+                H264Dequantize4x4(levels, coeffs, qp, 1);
+            } else if (dc[raster]) {
+                memset(coeffs, 0, sizeof(coeffs));
+            } else {
+                continue;
+            }
+            coeffs[0] = dc[raster];
+            H264InverseTransformAdd4x4(coeffs, pY + static_cast<size_t>((raster >> 2) * 4) * stride + (raster & 3) * 4,
+                                       stride);
+        }
+    }
+
+    return ReconstructChroma(ctx, pUV, neighbors, static_cast<int>(chromaMode), cbpChroma, chromaDcLevels, chromaAcLevels);
+}
+
+// スライスのマクロブロックをすべて復号する (ワーカースレッドから呼ばれる)
+static void DecodeSliceData(H264IntraDecoder* pDecoder, H264DecoderSlice* pSlice)
+{
+    TRACE_SPAN("DecodeSlice", PIPELINE_TRACE_NO_FRAME);
+    SliceDecodeContext ctx;
+    ctx.pDecoder = pDecoder;
+    ctx.pSlice = pSlice;
+    H264InitBitReader(&ctx.reader, pSlice->rbsp.data(), pSlice->rbsp.size());
+    ctx.reader.bitPos = pSlice->dataBitPos;
+    ctx.pFrame = pDecoder->pPicture;
+    ctx.qp = pSlice->header.qp;
+    ctx.chromaQpOffset = pSlice->pPps->chromaQpIndexOffset;
+
+    const UINT32 mbCount = pDecoder->mbWidth * pDecoder->mbHeight;
+    UINT32 mbAddr = pSlice->header.firstMb;
+    pSlice->result = S_OK;
+    pSlice->decodedMbCount = 0;
+    do {
+        if (mbAddr >= mbCount) {
+            pSlice->result = E_FAIL;
+            break;
+        }
+        HRESULT hr = DecodeMacroblock(ctx, mbAddr);
+        if (FAILED(hr) || ctx.reader.overrun) {
+            pSlice->result = FAILED(hr) ? hr : E_FAIL;
+            break;
+        }
+        pSlice->decodedMbCount++;
+        mbAddr++;
+    } while (H264MoreRbspData(&ctx.reader));
+}
+
+// ---- スレッドとピクチャーの管理 ----
+
+static void DecoderWorker(H264IntraDecoder* pDecoder)
+{
+    TRACE_THREAD_NAME("decoder slice worker");
+    std::unique_lock<std::mutex> lock(pDecoder->mutex);
+    while (true) {
+        pDecoder->jobAvailable.wait(lock, [pDecoder] { return pDecoder->shuttingDown || !pDecoder->jobs.empty(); });
+        if (pDecoder->shuttingDown) {
+            return;
+        }
+        H264DecoderSlice* pSlice = pDecoder->jobs.front();
+        pDecoder->jobs.pop_front();
+        lock.unlock();
+
+        DecodeSliceData(pDecoder, pSlice);
+
+        lock.lock();
+        if (--pDecoder->pendingJobs == 0) {
+            pDecoder->jobDone.notify_all();
+        }
+    }
+}
+
+// SPSに合わせてフレームプールとマクロブロック情報を用意する
+static HRESULT ActivateSequence(H264IntraDecoder* pDecoder, const H264SequenceParameterSet& sps)
+{
+    if (pDecoder->framePoolInitialized && pDecoder->mbWidth == sps.mbWidth && pDecoder->mbHeight == sps.mbHeight) {
+        return S_OK;
+    }
+    if (pDecoder->framePoolInitialized) {
+        // サイズが変わった: 出力待ちと呼び出し側のフレームがすべて戻っていれば作り直す
+        if (!pDecoder->readyFrames.empty() || pDecoder->outstandingFrames > 0) {
+            printf("Software decoder: frame size changed while frames are still in use\n");
+            return E_FAIL;
+        }
+        FreeNv12FramePool(&pDecoder->framePool);
+        pDecoder->framePoolInitialized = false;
+    }
+
+    HRESULT hr = InitializeNv12FramePool(&pDecoder->framePool, H264_DECODER_POOL_SIZE, sps.mbWidth * 16,
+                                         sps.mbHeight * 16);
+    CHECK_HR(hr, "InitializeNv12FramePool for decoder");
+    pDecoder->framePoolInitialized = true;
+    pDecoder->mbWidth = sps.mbWidth;
+    pDecoder->mbHeight = sps.mbHeight;
+    pDecoder->macroblocks.assign(static_cast<size_t>(sps.mbWidth) * sps.mbHeight, H264MacroblockInfo());
+    pDecoder->deblockInfo.assign(pDecoder->macroblocks.size(), H264DeblockMacroblock());
+    pDecoder->mbDecoded.assign(pDecoder->macroblocks.size(), 0);
+    return S_OK;
+}
+
+// 復号できなかったマクロブロックを灰色で埋める
+// デブロッキングの情報は前のピクチャーのものが残っているので、フィルターなし・別スライスの扱いにする
+static void ConcealMacroblock(H264IntraDecoder* pDecoder, UINT32 mbAddr)
+{
+    Nv12Frame* pFrame = pDecoder->pPicture;
+    const UINT32 mbX = mbAddr % pDecoder->mbWidth;
+    const UINT32 mbY = mbAddr / pDecoder->mbWidth;
+    for (UINT32 y = 0; y < 16; y++) {
+        memset(pFrame->pY + static_cast<size_t>(mbY * 16 + y) * pFrame->stride + mbX * 16, 128, 16);
+    }
+    for (UINT32 y = 0; y < 8; y++) {
+        memset(pFrame->pUV + static_cast<size_t>(mbY * 8 + y) * pFrame->stride + mbX * 16, 128, 16);
+    }
+
+    H264DeblockMacroblock* pDeblock = &pDecoder->deblockInfo[mbAddr];
+    pDeblock->qp = 0;
+    pDeblock->chromaQp = 0;
+    pDeblock->disableIdc = 1;
+    pDeblock->alphaOffset = 0;
+    pDeblock->betaOffset = 0;
+    pDeblock->sliceIndex = 0xFFFF;
+}
+
+// 復号中のピクチャーの全スライスを待ち、デブロッキングして出力待ちにする
+static HRESULT FinishPicture(H264IntraDecoder* pDecoder)
+{
+    if (!pDecoder->pPicture) {
+        return S_OK;
+    }
+
+    // キューに残っているスライスはこのスレッドでも復号する
+    std::unique_lock<std::mutex> lock(pDecoder->mutex);
+    while (!pDecoder->jobs.empty()) {
+        H264DecoderSlice* pSlice = pDecoder->jobs.front();
+        pDecoder->jobs.pop_front();
+        lock.unlock();
+        DecodeSliceData(pDecoder, pSlice);
+        lock.lock();
+        pDecoder->pendingJobs--;
+    }
+    pDecoder->jobDone.wait(lock, [pDecoder] { return pDecoder->pendingJobs == 0; });
+    lock.unlock();
+
+    // スライスが復号したマクロブロックに印を付ける (スライスはfirstMbから連続した範囲を復号する)
+    HRESULT hr = S_OK;
+    const UINT32 mbCount = pDecoder->mbWidth * pDecoder->mbHeight;
+    std::fill(pDecoder->mbDecoded.begin(), pDecoder->mbDecoded.end(), 0);
+    for (size_t i = 0; i < pDecoder->sliceCount; i++) {
+        const H264DecoderSlice* pSlice = pDecoder->slices[i];
+        for (UINT32 k = 0; k < pSlice->decodedMbCount; k++) {
+            pDecoder->mbDecoded[pSlice->header.firstMb + k] = 1;
+        }
+        if (FAILED(pSlice->result)) {
+            printf("Software decoder: slice %zu (first MB %u) failed after %u macroblocks: 0x%08X\n", i,
+                   pSlice->header.firstMb, pSlice->decodedMbCount, pSlice->result);
+            hr = pSlice->result;
+        }
+    }
+
+    // 欠けたマクロブロックを補間する (古い画素やデブロッキングの情報を残さない)
+    UINT32 missingMbCount = 0;
+    for (UINT32 mbAddr = 0; mbAddr < mbCount; mbAddr++) {
+        if (!pDecoder->mbDecoded[mbAddr]) {
+            ConcealMacroblock(pDecoder, mbAddr);
+            missingMbCount++;
+        }
+    }
+    if (missingMbCount > 0) {
+        printf("Software decoder: picture has %u of %u macroblocks, %u concealed\n", mbCount - missingMbCount,
+               mbCount, missingMbCount);
+        pDecoder->concealedFrames++;
+        pDecoder->concealedMacroblocks += missingMbCount;
+        if (SUCCEEDED(hr)) {
+            hr = E_FAIL;
+        }
+    }
+
+    H264DeblockIntraFrame(pDecoder->pPicture, pDecoder->mbWidth, pDecoder->mbHeight, pDecoder->deblockInfo.data());
+
+    pDecoder->readyFrames.push_back(pDecoder->pPicture);
+    pDecoder->pPicture = NULL;
+    pDecoder->sliceCount = 0;
+    pDecoder->decodedFrames++;
+    return hr;
+}
+
+// スライスNALユニットを受け取り、ワーカーに渡す
+static HRESULT SubmitSlice(H264IntraDecoder* pDecoder, const BYTE* pNal, size_t size)
+{
+    HRESULT hr = S_OK;
+    if (pDecoder->sliceCount >= pDecoder->slices.size()) {
+        if (pDecoder->slices.size() >= 0xFFFF) {
+            return E_FAIL;
+        }
+        pDecoder->slices.push_back(new H264DecoderSlice());
+    }
+    size_t slot = pDecoder->sliceCount;
+    H264DecoderSlice* pSlice = pDecoder->slices[slot];
+
+    // エミュレーション防止バイトを除く (RBSPはEBSPより長くならない)
+    pSlice->rbsp.resize(size - 1);
+    pSlice->rbsp.resize(EbspToRbsp(pNal + 1, size - 1, pSlice->rbsp.data()));
+
+    H264BitReader reader;
+    H264InitBitReader(&reader, pSlice->rbsp.data(), pSlice->rbsp.size());
+    const H264PictureParameterSet* pPps = NULL;
+    hr = ParseSliceHeader(pDecoder, &reader, pNal[0], &pSlice->header, &pPps);
+    if (hr != S_OK) {
+        return hr;
+    }
+
+    // 前のピクチャーの続きでなければ、前のピクチャーを完了させる
+    if (pDecoder->pPicture && IsNewPicture(pDecoder->pictureHeader, pSlice->header)) {
+        // pSliceは前のピクチャーのスライスより後ろの作業領域なので、完了後に先頭と入れ替える
+        HRESULT hrFinish = FinishPicture(pDecoder);
+        if (FAILED(hrFinish)) {
+            hr = hrFinish;
+        }
+        std::swap(pDecoder->slices[0], pDecoder->slices[slot]);
+    }
+
+    if (!pDecoder->pPicture) {
+        const H264SequenceParameterSet& sps = pDecoder->sps[pPps->spsId];
+        HRESULT hrActivate = ActivateSequence(pDecoder, sps);
+        CHECK_HR(hrActivate, "ActivateSequence");
+        pDecoder->pPicture = TryAcquireNv12Frame(&pDecoder->framePool);
+        if (!pDecoder->pPicture) {
+            printf("Software decoder: no free frame (release decoded frames before decoding more)\n");
+            return E_FAIL;
+        }
+        pDecoder->pPicture->cropLeft = sps.cropLeft;
+        pDecoder->pPicture->cropTop = sps.cropTop;
+        pDecoder->pPicture->cropWidth = sps.mbWidth * 16 - sps.cropLeft - sps.cropRight;
+        pDecoder->pPicture->cropHeight = sps.mbHeight * 16 - sps.cropTop - sps.cropBottom;
+        pDecoder->pictureHeader = pSlice->header;
+    }
+
+    pSlice->dataBitPos = reader.bitPos;
+    pSlice->pPps = pPps;
+    pSlice->index = static_cast<UINT16>(pDecoder->sliceCount);
+    pSlice->result = S_OK;
+    pSlice->decodedMbCount = 0;
+    pDecoder->sliceCount++;
+    pDecoder->decodedSlices++;
+
+    {
+        std::lock_guard<std::mutex> lock(pDecoder->mutex);
+        pDecoder->jobs.push_back(pSlice);
+        pDecoder->pendingJobs++;
+    }
+    pDecoder->jobAvailable.notify_one();
+    return hr;
+}
+
+HRESULT InitializeH264IntraDecoder(H264IntraDecoder* pDecoder, UINT32 threadCount)
+{
+    if (!pDecoder) {
+        return E_POINTER;
+    }
+    for (int i = 0; i < H264_MAX_SPS_COUNT; i++) {
+        pDecoder->sps[i].valid = false;
+    }
+    for (int i = 0; i < H264_MAX_PPS_COUNT; i++) {
+        pDecoder->pps[i].valid = false;
+    }
+    pDecoder->mbWidth = 0;
+    pDecoder->mbHeight = 0;
+    pDecoder->framePoolInitialized = false;
+    pDecoder->outstandingFrames = 0;
+    pDecoder->pPicture = NULL;
+    pDecoder->sliceCount = 0;
+    pDecoder->pendingJobs = 0;
+    pDecoder->shuttingDown = false;
+    pDecoder->decodedFrames = 0;
+    pDecoder->decodedSlices = 0;
+    pDecoder->pcmMacroblocks = 0;
+    pDecoder->concealedFrames = 0;
+    pDecoder->concealedMacroblocks = 0;
+    pDecoder->unsupportedReported = false;
+
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    for (UINT32 i = 1; i < threadCount; i++) {
+        pDecoder->workers.push_back(std::thread(DecoderWorker, pDecoder));
+    }
+    return S_OK;
+}
+
+HRESULT DecodeH264Nal(H264IntraDecoder* pDecoder, const BYTE* pNal, size_t size)
+{
+    if (!pDecoder || !pNal) {
+        return E_POINTER;
+    }
+    if (size < 1 || (pNal[0] & 0x80)) {
+        return E_INVALIDARG;
+    }
+
+    BYTE nalType = pNal[0] & 0x1F;
+    switch (nalType) {
+    case NAL_TYPE_SLICE:
+    case NAL_TYPE_IDR:
+        return SubmitSlice(pDecoder, pNal, size);
+
+    case NAL_TYPE_SPS:
+    case NAL_TYPE_PPS: {
+        // パラメーターセットの前でアクセスユニットが区切られる (復号中のスライスが参照している可能性もある)
+        HRESULT hr = FinishPicture(pDecoder);
+        std::vector<BYTE> rbsp(size - 1);
+        rbsp.resize(EbspToRbsp(pNal + 1, size - 1, rbsp.data()));
+        H264BitReader reader;
+        H264InitBitReader(&reader, rbsp.data(), rbsp.size());
+        HRESULT hrParse = (nalType == NAL_TYPE_SPS) ? ParseSps(pDecoder, &reader) : ParsePps(pDecoder, &reader);
+        return FAILED(hrParse) ? hrParse : hr;
+    }
+
+    case NAL_TYPE_SEI:
+    case NAL_TYPE_AUD:
+    case NAL_TYPE_END_SEQ:
+    case NAL_TYPE_END_STREAM:
+        return FinishPicture(pDecoder);
+
+    default:
+        // その他のNALユニット (データパーティションなど) は無視する
+        return S_OK;
+    }
+}
+
+HRESULT FlushH264IntraDecoder(H264IntraDecoder* pDecoder)
+{
+    if (!pDecoder) {
+        return E_POINTER;
+    }
+    return FinishPicture(pDecoder);
+}
+
+Nv12Frame* TakeDecodedH264Frame(H264IntraDecoder* pDecoder)
+{
+    if (!pDecoder || pDecoder->readyFrames.empty()) {
+        return NULL;
+    }
+    Nv12Frame* pFrame = pDecoder->readyFrames.front();
+    pDecoder->readyFrames.pop_front();
+    pDecoder->outstandingFrames++;
+    return pFrame;
+}
+
+void ReleaseDecodedH264Frame(H264IntraDecoder* pDecoder, Nv12Frame* pFrame)
+{
+    if (!pDecoder || !pFrame) {
+        return;
+    }
+    pDecoder->outstandingFrames--;
+    ReleaseNv12Frame(&pDecoder->framePool, pFrame);
+}
+
+void ShutdownH264IntraDecoder(H264IntraDecoder* pDecoder)
+{
+    if (!pDecoder) {
+        return;
+    }
+    FinishPicture(pDecoder);
+    {
+        std::lock_guard<std::mutex> lock(pDecoder->mutex);
+        pDecoder->shuttingDown = true;
+    }
+    pDecoder->jobAvailable.notify_all();
+    for (std::thread& worker : pDecoder->workers) {
+        worker.join();
+    }
+    pDecoder->workers.clear();
+
+    // 出力待ちのフレームをプールに戻してから解放する
+    while (!pDecoder->readyFrames.empty()) {
+        ReleaseNv12Frame(&pDecoder->framePool, pDecoder->readyFrames.front());
+        pDecoder->readyFrames.pop_front();
+    }
+    if (pDecoder->framePoolInitialized) {
+        FreeNv12FramePool(&pDecoder->framePool);
+        pDecoder->framePoolInitialized = false;
+    }
+    for (H264DecoderSlice* pSlice : pDecoder->slices) {
+        delete pSlice;
+    }
+    pDecoder->slices.clear();
+    pDecoder->macroblocks.clear();
+    pDecoder->deblockInfo.clear();
+    pDecoder->mbDecoded.clear();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include "nv12_frame_pool.h"
+#include "h264_intra_pred.h"
+#include "h264_deblock.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// イントラのみのH.264ソフトウェアデコーダー (CAVLCのIスライスとI_PCM)
+// - SPS/PPSはBaselineの範囲 (frame_mbs_only、4:2:0、8ビット、スライスグループなし) を扱う
+// - スライスは届いた順にワーカースレッドへ渡し、並列に復号する
+//   (イントラ予測はスライスをまたがないので、スライス同士は独立に復号できる)
+// - ピクチャーの全スライスがそろったら、デブロッキングしてから出力する
+// - 復号はフレームプールのNV12フレームに直接書き込む (出力順 = 復号順。Bフレームがないため)
+
+// パラメーターセットの数の上限 (seq_parameter_set_id / pic_parameter_set_id)
+#define H264_MAX_SPS_COUNT 32
+#define H264_MAX_PPS_COUNT 256
+
+// 出力待ちも含めたフレームプールの枚数
+#define H264_DECODER_POOL_SIZE 4
+
+// シーケンスパラメーターセット (復号に使う項目だけ)
+struct H264SequenceParameterSet {
+    bool valid;
+    UINT32 profileIdc;
+    UINT32 log2MaxFrameNum;
+    UINT32 pocType;                    // pic_order_cnt_type
+    UINT32 log2MaxPocLsb;              // pocType == 0のとき
+    bool deltaPicOrderAlwaysZero;      // pocType == 1のとき
+    UINT32 mbWidth;
+    UINT32 mbHeight;
+    UINT32 cropLeft;                   // 輝度の画素単位
+    UINT32 cropRight;
+    UINT32 cropTop;
+    UINT32 cropBottom;
+};
+
+// ピクチャーパラメーターセット (復号に使う項目だけ)
+struct H264PictureParameterSet {
+    bool valid;
+    UINT32 spsId;
+    bool bottomFieldPicOrderPresent;
+    int picInitQp;
+    int chromaQpIndexOffset;
+    bool deblockingFilterControlPresent;
+    bool redundantPicCntPresent;
+};
+
+// スライスヘッダー (ピクチャーの区切りの判定とデブロッキングに使う項目)
+struct H264SliceHeader {
+    UINT32 nalRefIdc;
+    bool idr;
+    UINT32 firstMb;                    // first_mb_in_slice
+    UINT32 sliceType;                  // slice_type % 5
+    UINT32 ppsId;
+    UINT32 frameNum;
+    UINT32 idrPicId;
+    UINT32 pocLsb;
+    int qp;                            // SliceQPY
+    UINT32 disableDeblockingIdc;
+    int alphaOffset;                   // FilterOffsetA
+    int betaOffset;                    // FilterOffsetB
+};
+
+// 復号待ちのスライス (ワーカースレッドが1つずつ処理する)
+struct H264DecoderSlice {
+    std::vector<BYTE> rbsp;            // エミュレーション防止バイトを除いたスライス
+    size_t dataBitPos;                 // slice_data()の先頭のビット位置
+    H264SliceHeader header;
+    const H264PictureParameterSet* pPps;
+    UINT16 index;                      // ピクチャー内のスライス番号
+    HRESULT result;
+    UINT32 decodedMbCount;
+};
+
+// イントラデコーダー構造体
+struct H264IntraDecoder {
+    H264SequenceParameterSet sps[H264_MAX_SPS_COUNT];
+    H264PictureParameterSet pps[H264_MAX_PPS_COUNT];
+
+    // 現在のシーケンス (最初のスライスで有効になったSPSから決まる)
+    UINT32 mbWidth;
+    UINT32 mbHeight;
+    Nv12FramePool framePool;
+    bool framePoolInitialized;
+    UINT32 outstandingFrames;          // 呼び出し側が持っている出力フレームの数
+
+    // 復号中のピクチャー
+    Nv12Frame* pPicture;
+    H264SliceHeader pictureHeader;     // 最初のスライスのヘッダー (ピクチャーの区切りの判定用)
+    std::vector<H264DecoderSlice*> slices; // スライスの作業領域 (使い回す)
+    size_t sliceCount;                 // 現在のピクチャーのスライス数
+    std::vector<H264MacroblockInfo> macroblocks;
+    std::vector<H264DeblockMacroblock> deblockInfo;
+    std::vector<BYTE> mbDecoded;       // 現在のピクチャーで復号できたマクロブロック (欠けた部分の補間に使う)
+    std::deque<Nv12Frame*> readyFrames; // 出力待ちのフレーム (復号順)
+
+    // スライスを復号するワーカースレッド (呼び出し元のスレッドも待つ間に手伝う)
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable jobDone;
+    std::deque<H264DecoderSlice*> jobs;
+    UINT32 pendingJobs;                // 未完了のスライス数 (キューにあるものと復号中のもの)
+    bool shuttingDown;
+
+    // 統計情報
+    UINT64 decodedFrames;
+    UINT64 decodedSlices;
+    UINT64 pcmMacroblocks;
+    UINT64 concealedFrames;            // マクロブロックが欠けていて補間したピクチャー数
+    UINT64 concealedMacroblocks;       // 補間したマクロブロック数
+    bool unsupportedReported;          // 未対応のストリームの警告を表示済みか
+};
+
+// デコーダーを初期化する関数 (threadCountは呼び出し元を含むスレッド数、0なら論理コア数)
+HRESULT InitializeH264IntraDecoder(H264IntraDecoder* pDecoder, UINT32 threadCount);
+
+// NALユニット (スタートコードなし、EBSP) を1つ入力する関数
+// 次のピクチャーの先頭スライスやSPS/PPSなどでピクチャーの終わりを検出し、そのピクチャーを出力待ちにする
+// Pスライス・Bスライス、CABAC、インターレースなどの未対応のストリームにはE_NOTIMPLを返す
+HRESULT DecodeH264Nal(H264IntraDecoder* pDecoder, const BYTE* pNal, size_t size);
+
+// 復号中のピクチャーを完了させて出力待ちにする関数 (ストリームの終わりで呼ぶ)
+// スライスの欠落や復号エラーでマクロブロックが欠けたピクチャーは、欠けた部分を灰色で補間して出力し、E_FAILを返す
+HRESULT FlushH264IntraDecoder(H264IntraDecoder* pDecoder);
+
+// 出力待ちのフレームを1つ取り出す関数 (なければNULL)
+// 取り出したフレームはプールのフレームなので、使い終わったらReleaseDecodedH264Frameで返すこと
+Nv12Frame* TakeDecodedH264Frame(H264IntraDecoder* pDecoder);
+
+// 取り出したフレームをプールに返す関数
+void ReleaseDecodedH264Frame(H264IntraDecoder* pDecoder, Nv12Frame* pFrame);
+
+// ワーカースレッドを止めてリソースを解放する関数 (出力フレームはすべて返却済みであること)
+void ShutdownH264IntraDecoder(H264IntraDecoder* pDecoder);
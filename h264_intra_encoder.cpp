@@ -0,0 +1,803 @@
+#include "h264_intra_encoder.h"
+#include "h264_transform.h"
+#include "h264_intra_pred.h"
+#include "nal_emulation.h"
+#include "pipeline_trace.h"
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+
+// 4x4ブロックの復号順 (luma4x4BlkIdx) -> マクロブロック内の位置 (4画素単位)
+static const BYTE BLOCK_X[16] = { 0, 1, 0, 1, 2, 3, 2, 3, 0, 1, 0, 1, 2, 3, 2, 3 };
+static const BYTE BLOCK_Y[16] = { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 3, 3, 2, 2, 3, 3 };
+
+// マクロブロック内のラスター位置 -> 復号順
+static const BYTE RASTER_TO_BLOCK[16] = { 0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15 };
+
+// coded_block_pattern -> me(v)のcodeNum (イントラ、表9-4)
+static const BYTE CBP_TO_CODE_NUM[48] = {
+     3, 29, 30, 17, 31, 18, 37,  8, 32, 38, 19,  9, 20, 10, 11,  2,
+    16, 33, 34, 21, 35, 22, 39,  4, 36, 40, 23,  5, 24,  6,  7,  1,
+    41, 42, 43, 25, 44, 26, 46, 12, 45, 47, 27, 13, 28, 14, 15,  0,
+};
+
+// NALヘッダー (nal_ref_idc = 3)
+#define NAL_HEADER_SLICE 0x61
+#define NAL_HEADER_IDR   0x65
+#define NAL_HEADER_SPS   0x67
+#define NAL_HEADER_PPS   0x68
+
+// SPS/PPSの固定値
+#define PIC_INIT_QP 26
+#define LOG2_MAX_FRAME_NUM 4
+
+// 1マクロブロック分の符号化結果 (モード選択と量子化の後、ビットストリームに書き込む前)
+struct MacroblockCoding {
+    int type;
+    int intra16x16Mode;
+    int chromaMode;
+    BYTE prevModeFlag[16];             // prev_intra4x4_pred_mode_flag (復号順)
+    BYTE remMode[16];                  // rem_intra4x4_pred_mode (復号順)
+    int cbpLuma;                       // 8x8ブロックごとのビット (Intra16x16では0か15)
+    int cbpChroma;                     // 0: 係数なし、1: DCのみ、2: DCとAC
+    INT16 lumaLevels[16][16];          // 4x4ブロックのレベル (ラスター位置、スキャン順)
+    INT16 lumaDcLevels[16];            // Intra16x16のDCレベル (スキャン順)
+    INT16 chromaDcLevels[2][4];
+    INT16 chromaAcLevels[2][4][16];    // 色差ACのレベル (スキャン順、[0]は使わない)
+};
+
+// マクロブロックの周囲の可用性 (スライスはマクロブロック行単位なので、左は常に同じスライス)
+struct MacroblockNeighbors {
+    bool left;
+    bool top;
+    bool topRight;
+    bool topLeft;
+    const H264MacroblockInfo* pLeft;
+    const H264MacroblockInfo* pTop;
+};
+
+static inline void ScatterZigzag(const INT16 raster[16], INT16 scan[16])
+{
+    for (int i = 0; i < 16; i++) {
+        scan[i] = raster[H264_ZIGZAG_4X4[i]];
+    }
+}
+
+// ---- モード選択と量子化・再構成 ----
+
+// Intra16x16の最良の予測モードとそのSATDを求める
+static UINT32 SearchIntra16x16(const BYTE* pSrc, UINT32 srcStride, const H264IntraNeighbors* pNeighbors, int* pMode)
+{
+    BYTE pred[256];
+    UINT32 bestCost = 0xFFFFFFFF;
+    for (int mode = 0; mode < 4; mode++) {
+        if (!H264IsIntra16x16ModeAvailable(pNeighbors, mode)) {
+            continue;
+        }
+        H264PredictIntra16x16(pNeighbors, mode, pred);
+        UINT32 cost = 0;
+        for (int i = 0; i < 16; i++) {
+            int x = (i & 3) * 4, y = (i >> 2) * 4;
+            cost += H264Satd4x4(pSrc + static_cast<size_t>(y) * srcStride + x, srcStride, pred + y * 16 + x, 16);
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            *pMode = mode;
+        }
+    }
+    return bestCost;
+}
+
+// Intra4x4で符号化する (ブロックごとにモードを選び、次のブロックの予測のために再構成する)
+// 途中でコストがcostLimitを超えたら打ち切ってUINT32の最大値を返す
+static UINT32 EncodeIntra4x4(H264IntraEncoder* pEncoder, const BYTE* pSrc, UINT32 srcStride, BYTE* pRecon,
+                             const MacroblockNeighbors& neighbors, H264MacroblockInfo* pInfo,
+                             MacroblockCoding* pMb, UINT32 costLimit)
+{
+    const UINT32 stride = pEncoder->reconStride;
+    const int qp = pEncoder->qp;
+    const UINT32 lambda = static_cast<UINT32>(pEncoder->lambda);
+    UINT32 totalCost = lambda;
+    pMb->cbpLuma = 0;
+
+    for (int blk = 0; blk < 16; blk++) {
+        int bx = BLOCK_X[blk], by = BLOCK_Y[blk];
+        int raster = by * 4 + bx;
+        bool hasLeft = bx > 0 || neighbors.left;
+        bool hasTop = by > 0 || neighbors.top;
+        bool hasTopLeft = (bx > 0 && by > 0) ? true : (by == 0 ? (bx > 0 ? neighbors.top : neighbors.topLeft) : neighbors.left);
+        bool hasTopRight;
+        if (by == 0) {
+            hasTopRight = (bx < 3) ? neighbors.top : neighbors.topRight;
+        } else {
+            hasTopRight = bx < 3 && RASTER_TO_BLOCK[raster - 3] < blk;
+        }
+
+        const BYTE* pBlockSrc = pSrc + static_cast<size_t>(by * 4) * srcStride + bx * 4;
+        BYTE* pBlockRecon = pRecon + static_cast<size_t>(by * 4) * stride + bx * 4;
+        H264IntraNeighbors n;
+        H264LoadIntraNeighbors(pBlockRecon, stride, 4, hasTop, hasLeft, hasTopLeft, hasTopRight, &n);
+
+        // 予測モードの予測値 (左と上のブロックの小さい方、どちらかがなければDC)
+        int modeA = -1, modeB = -1;
+        if (bx > 0) {
+            modeA = pInfo->intra4x4Modes[raster - 1];
+        } else if (neighbors.left) {
+            modeA = neighbors.pLeft->type == H264_MB_I4X4 ? static_cast<int>(neighbors.pLeft->intra4x4Modes[raster + 3])
+                                                          : static_cast<int>(H264_I4X4_DC);
+        }
+        if (by > 0) {
+            modeB = pInfo->intra4x4Modes[raster - 4];
+        } else if (neighbors.top) {
+            modeB = neighbors.pTop->type == H264_MB_I4X4 ? static_cast<int>(neighbors.pTop->intra4x4Modes[raster + 12])
+                                                        : static_cast<int>(H264_I4X4_DC);
+        }
+        int predictedMode = (modeA < 0 || modeB < 0) ? H264_I4X4_DC : (modeA < modeB ? modeA : modeB);
+
+        BYTE pred[16], bestPred[16];
+        UINT32 bestCost = 0xFFFFFFFF;
+        int bestMode = H264_I4X4_DC;
+        for (int mode = 0; mode < 9; mode++) {
+            if (!H264IsIntra4x4ModeAvailable(&n, mode)) {
+                continue;
+            }
+            H264PredictIntra4x4(&n, mode, pred);
+            UINT32 cost = H264Satd4x4(pBlockSrc, srcStride, pred, 4) + lambda * (mode == predictedMode ? 1 : 4);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestMode = mode;
+                memcpy(bestPred, pred, 16);
+            }
+        }
+        totalCost += bestCost;
+        if (totalCost > costLimit) {
+            return 0xFFFFFFFF;
+        }
+
+        pInfo->intra4x4Modes[raster] = static_cast<BYTE>(bestMode);
+        pMb->prevModeFlag[blk] = bestMode == predictedMode;
+        pMb->remMode[blk] = static_cast<BYTE>(bestMode < predictedMode ? bestMode : bestMode - 1);
+
+        // 予測を再構成画像に置き、残差を変換・量子化して足し戻す
+        for (int y = 0; y < 4; y++) {
+            memcpy(pBlockRecon + static_cast<size_t>(y) * stride, bestPred + y * 4, 4);
+        }
+        INT16 coeffs[16], levels[16];
+        H264ForwardTransform4x4(pBlockSrc, srcStride, bestPred, 4, coeffs);
+        if (H264Quantize4x4(coeffs, levels, qp, 0)) {
+            H264Dequantize4x4(levels, coeffs, qp, 0);
+            H264InverseTransformAdd4x4(coeffs, pBlockRecon, stride);
+            pMb->cbpLuma |= 1 << ((by >> 1) * 2 + (bx >> 1));
+        }
+        ScatterZigzag(levels, pMb->lumaLevels[raster]);
+    }
+    return totalCost;
+}
+
+// Intra16x16で符号化する
+static void EncodeIntra16x16(H264IntraEncoder* pEncoder, const BYTE* pSrc, UINT32 srcStride, BYTE* pRecon,
+                             const H264IntraNeighbors* pNeighbors, int mode, MacroblockCoding* pMb)
+{
+    const UINT32 stride = pEncoder->reconStride;
+    const int qp = pEncoder->qp;
+    BYTE pred[256];
+    H264PredictIntra16x16(pNeighbors, mode, pred);
+    for (int y = 0; y < 16; y++) {
+        memcpy(pRecon + static_cast<size_t>(y) * stride, pred + y * 16, 16);
+    }
+
+    INT16 coeffs[16][16], levels[16][16], dc[16], dcLevels[16];
+    int acCount = 0;
+    for (int i = 0; i < 16; i++) {
+        int x = (i & 3) * 4, y = (i >> 2) * 4;
+        H264ForwardTransform4x4(pSrc + static_cast<size_t>(y) * srcStride + x, srcStride, pred + y * 16 + x, 16, coeffs[i]);
+        dc[i] = coeffs[i][0];
+        acCount += H264Quantize4x4(coeffs[i], levels[i], qp, 1);
+    }
+    H264QuantizeLumaDc(dc, dcLevels, qp);
+    ScatterZigzag(dcLevels, pMb->lumaDcLevels);
+    pMb->type = H264_MB_I16X16;
+    pMb->intra16x16Mode = mode;
+    pMb->cbpLuma = acCount ? 15 : 0;
+
+    INT16 dcValues[16];
+    H264DequantizeLumaDc(dcLevels, dcValues, qp);
+    for (int i = 0; i < 16; i++) {
+        int x = (i & 3) * 4, y = (i >> 2) * 4;
+        if (acCount) {
+            H264Dequantize4x4(levels[i], coeffs[i], qp, 1);
+        } else {
+            memset(coeffs[i], 0, sizeof(coeffs[i]));
+        }
+        coeffs[i][0] = dcValues[i];
+        H264InverseTransformAdd4x4(coeffs[i], pRecon + static_cast<size_t>(y) * stride + x, stride);
+        ScatterZigzag(levels[i], pMb->lumaLevels[i]);
+    }
+}
+
+// 色差の予測モードを選び、Cb/Crを符号化する
+static void EncodeChroma(H264IntraEncoder* pEncoder, UINT32 mbX, UINT32 mbY, const MacroblockNeighbors& neighbors,
+                         MacroblockCoding* pMb)
+{
+    const Nv12Frame& frame = *pEncoder->pFrame;
+    const UINT32 stride = pEncoder->reconStride / 2;
+    const int qp = H264ChromaQp(pEncoder->qp);
+    const size_t offset = static_cast<size_t>(mbY) * 8 * stride + mbX * 8;
+    BYTE* pRecon[2] = { pEncoder->reconU.data() + offset, pEncoder->reconV.data() + offset };
+
+    // UVを分離する
+    BYTE src[2][64];
+    const BYTE* pUV = frame.pUV + static_cast<size_t>(mbY) * 8 * frame.stride + mbX * 16;
+    for (int y = 0; y < 8; y++) {
+        const BYTE* pRow = pUV + static_cast<size_t>(y) * frame.stride;
+        for (int x = 0; x < 8; x++) {
+            src[0][y * 8 + x] = pRow[x * 2];
+            src[1][y * 8 + x] = pRow[x * 2 + 1];
+        }
+    }
+
+    H264IntraNeighbors n[2];
+    for (int c = 0; c < 2; c++) {
+        H264LoadIntraNeighbors(pRecon[c], stride, 8, neighbors.top, neighbors.left, neighbors.topLeft, false, &n[c]);
+    }
+
+    // ue(v)の符号長 (0: 1ビット、1,2: 3ビット、3: 5ビット) をモードのコストに加える
+    static const UINT32 modeBits[4] = { 1, 3, 3, 5 };
+    BYTE pred[2][64];
+    UINT32 bestCost = 0xFFFFFFFF;
+    int bestMode = H264_CHROMA_DC;
+    for (int mode = 0; mode < 4; mode++) {
+        if (!H264IsIntraChromaModeAvailable(&n[0], mode)) {
+            continue;
+        }
+        UINT32 cost = modeBits[mode] * static_cast<UINT32>(pEncoder->lambda);
+        for (int c = 0; c < 2; c++) {
+            H264PredictIntraChroma(&n[c], mode, pred[c]);
+            for (int b = 0; b < 4; b++) {
+                int offsetInBlock = (b >> 1) * 32 + (b & 1) * 4;
+                cost += H264Satd4x4(src[c] + offsetInBlock, 8, pred[c] + offsetInBlock, 8);
+            }
+        }
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestMode = mode;
+        }
+    }
+    pMb->chromaMode = bestMode;
+
+    INT16 coeffs[2][4][16], acLevels[2][4][16];
+    int acCount = 0, dcCount = 0;
+    for (int c = 0; c < 2; c++) {
+        H264PredictIntraChroma(&n[c], bestMode, pred[c]);
+        for (int y = 0; y < 8; y++) {
+            memcpy(pRecon[c] + static_cast<size_t>(y) * stride, pred[c] + y * 8, 8);
+        }
+        INT16 dc[4];
+        for (int b = 0; b < 4; b++) {
+            int offsetInBlock = (b >> 1) * 32 + (b & 1) * 4;
+            H264ForwardTransform4x4(src[c] + offsetInBlock, 8, pred[c] + offsetInBlock, 8, coeffs[c][b]);
+            dc[b] = coeffs[c][b][0];
+            acCount += H264Quantize4x4(coeffs[c][b], acLevels[c][b], qp, 1);
+            ScatterZigzag(acLevels[c][b], pMb->chromaAcLevels[c][b]);
+        }
+        dcCount += H264QuantizeChromaDc(dc, pMb->chromaDcLevels[c], qp);
+    }
+    pMb->cbpChroma = acCount ? 2 : (dcCount ? 1 : 0);
+
+    for (int c = 0; c < 2; c++) {
+        INT16 dcValues[4];
+        H264DequantizeChromaDc(pMb->chromaDcLevels[c], dcValues, qp);
+        for (int b = 0; b < 4; b++) {
+            if (acCount) {
+                H264Dequantize4x4(acLevels[c][b], coeffs[c][b], qp, 1);
+            } else {
+                memset(coeffs[c][b], 0, sizeof(coeffs[c][b]));
+            }
+            coeffs[c][b][0] = dcValues[b];
+            H264InverseTransformAdd4x4(coeffs[c][b], pRecon[c] + static_cast<size_t>(b >> 1) * 4 * stride + (b & 1) * 4,
+                                       stride);
+        }
+    }
+}
+
+// ---- ビットストリームへの書き込み ----
+
+// nCを求める (nA/nBは周囲のブロックの非ゼロ係数の数、使えなければ-1)
+static inline int CombineNc(int nA, int nB)
+{
+    if (nA >= 0 && nB >= 0) {
+        return (nA + nB + 1) >> 1;
+    }
+    return nA >= 0 ? nA : (nB >= 0 ? nB : 0);
+}
+
+static int LumaNc(const MacroblockNeighbors& neighbors, const H264MacroblockInfo* pInfo, int raster)
+{
+    int nA = -1, nB = -1;
+    if (raster & 3) {
+        nA = pInfo->lumaCoeffCount[raster - 1];
+    } else if (neighbors.left) {
+        nA = neighbors.pLeft->lumaCoeffCount[raster + 3];
+    }
+    if (raster >= 4) {
+        nB = pInfo->lumaCoeffCount[raster - 4];
+    } else if (neighbors.top) {
+        nB = neighbors.pTop->lumaCoeffCount[raster + 12];
+    }
+    return CombineNc(nA, nB);
+}
+
+static int ChromaNc(const MacroblockNeighbors& neighbors, const H264MacroblockInfo* pInfo, int c, int b)
+{
+    int nA = -1, nB = -1;
+    if (b & 1) {
+        nA = pInfo->chromaCoeffCount[c][b - 1];
+    } else if (neighbors.left) {
+        nA = neighbors.pLeft->chromaCoeffCount[c][b + 1];
+    }
+    if (b >= 2) {
+        nB = pInfo->chromaCoeffCount[c][b - 2];
+    } else if (neighbors.top) {
+        nB = neighbors.pTop->chromaCoeffCount[c][b + 2];
+    }
+    return CombineNc(nA, nB);
+}
+
+static void WriteMacroblock(H264BitWriter* pWriter, const MacroblockNeighbors& neighbors, H264MacroblockInfo* pInfo,
+                            const MacroblockCoding* pMb)
+{
+    memset(pInfo->lumaCoeffCount, 0, sizeof(pInfo->lumaCoeffCount));
+    memset(pInfo->chromaCoeffCount, 0, sizeof(pInfo->chromaCoeffCount));
+
+    if (pMb->type == H264_MB_I4X4) {
+        H264WriteUe(pWriter, 0);  // I_NxN
+        for (int blk = 0; blk < 16; blk++) {
+            if (pMb->prevModeFlag[blk]) {
+                H264WriteBits(pWriter, 1, 1);
+            } else {
+                H264WriteBits(pWriter, pMb->remMode[blk], 4);  // 0と3ビットのrem_intra4x4_pred_mode
+            }
+        }
+        H264WriteUe(pWriter, pMb->chromaMode);
+        int cbp = pMb->cbpLuma | (pMb->cbpChroma << 4);
+        H264WriteUe(pWriter, CBP_TO_CODE_NUM[cbp]);
+        if (cbp) {
+            H264WriteSe(pWriter, 0);  // mb_qp_delta
+        }
+        for (int blk = 0; blk < 16; blk++) {
+            if (pMb->cbpLuma & (1 << (blk >> 2))) {
+                int raster = BLOCK_Y[blk] * 4 + BLOCK_X[blk];
+                int nC = LumaNc(neighbors, pInfo, raster);
+                pInfo->lumaCoeffCount[raster] = static_cast<BYTE>(
+                    H264WriteResidualBlock(pWriter, pMb->lumaLevels[raster], 16, nC));
+            }
+        }
+    } else {
+        H264WriteUe(pWriter, 1 + pMb->intra16x16Mode + 4 * pMb->cbpChroma + (pMb->cbpLuma ? 12 : 0));
+        H264WriteUe(pWriter, pMb->chromaMode);
+        H264WriteSe(pWriter, 0);  // mb_qp_delta
+        H264WriteResidualBlock(pWriter, pMb->lumaDcLevels, 16, LumaNc(neighbors, pInfo, 0));
+        if (pMb->cbpLuma) {
+            for (int blk = 0; blk < 16; blk++) {
+                int raster = BLOCK_Y[blk] * 4 + BLOCK_X[blk];
+                int nC = LumaNc(neighbors, pInfo, raster);
+                pInfo->lumaCoeffCount[raster] = static_cast<BYTE>(
+                    H264WriteResidualBlock(pWriter, pMb->lumaLevels[raster] + 1, 15, nC));
+            }
+        }
+    }
+
+    if (pMb->cbpChroma) {
+        for (int c = 0; c < 2; c++) {
+            H264WriteResidualBlock(pWriter, pMb->chromaDcLevels[c], 4, -1);
+        }
+    }
+    if (pMb->cbpChroma == 2) {
+        for (int c = 0; c < 2; c++) {
+            for (int b = 0; b < 4; b++) {
+                int nC = ChromaNc(neighbors, pInfo, c, b);
+                pInfo->chromaCoeffCount[c][b] = static_cast<BYTE>(
+                    H264WriteResidualBlock(pWriter, pMb->chromaAcLevels[c][b] + 1, 15, nC));
+            }
+        }
+    }
+}
+
+// 1マクロブロックを符号化してスライスに書き込む
+static void EncodeMacroblock(H264IntraEncoder* pEncoder, H264SliceContext* pSlice, UINT32 mbX, UINT32 mbY)
+{
+    const Nv12Frame& frame = *pEncoder->pFrame;
+    const UINT32 stride = pEncoder->reconStride;
+    H264MacroblockInfo* pInfo = &pEncoder->macroblocks[static_cast<size_t>(mbY) * pEncoder->mbWidth + mbX];
+
+    MacroblockNeighbors neighbors;
+    neighbors.left = mbX > 0;
+    neighbors.top = mbY > pSlice->firstMbRow;
+    neighbors.topRight = neighbors.top && mbX + 1 < pEncoder->mbWidth;
+    neighbors.topLeft = neighbors.top && mbX > 0;
+    neighbors.pLeft = neighbors.left ? pInfo - 1 : NULL;
+    neighbors.pTop = neighbors.top ? pInfo - pEncoder->mbWidth : NULL;
+
+    const BYTE* pSrc = frame.pY + static_cast<size_t>(mbY) * 16 * frame.stride + mbX * 16;
+    BYTE* pRecon = pEncoder->reconY.data() + static_cast<size_t>(mbY) * 16 * stride + mbX * 16;
+
+    MacroblockCoding mb;
+    H264IntraNeighbors n16;
+    H264LoadIntraNeighbors(pRecon, stride, 16, neighbors.top, neighbors.left, neighbors.topLeft, false, &n16);
+    int mode16 = H264_I16X16_DC;
+    UINT32 cost16 = SearchIntra16x16(pSrc, frame.stride, &n16, &mode16) + 5 * static_cast<UINT32>(pEncoder->lambda);
+
+    // 平坦なマクロブロック (1画素あたりのSATDが1未満) と劣化モードではIntra4x4を試さない
+    UINT32 cost4 = 0xFFFFFFFF;
+    if (cost16 >= 256 && !pEncoder->fastModeDecision) {
+        mb.type = H264_MB_I4X4;
+        cost4 = EncodeIntra4x4(pEncoder, pSrc, frame.stride, pRecon, neighbors, pInfo, &mb, cost16);
+    }
+    if (cost4 == 0xFFFFFFFF) {
+        EncodeIntra16x16(pEncoder, pSrc, frame.stride, pRecon, &n16, mode16, &mb);
+        memset(pInfo->intra4x4Modes, H264_I4X4_DC, sizeof(pInfo->intra4x4Modes));
+        pInfo->type = H264_MB_I16X16;
+        pSlice->intra16x16Count++;
+    } else {
+        pInfo->type = H264_MB_I4X4;
+        pSlice->intra4x4Count++;
+    }
+    EncodeChroma(pEncoder, mbX, mbY, neighbors, &mb);
+    WriteMacroblock(&pSlice->writer, neighbors, pInfo, &mb);
+}
+
+// ---- NALユニットの組み立て ----
+
+static void FinishNalUnit(const H264BitWriter* pWriter, BYTE header, std::vector<BYTE>& nal)
+{
+    nal.clear();
+    nal.reserve(pWriter->data.size() + pWriter->data.size() / 64 + 1);
+    nal.push_back(header);
+    RbspToEbsp(pWriter->data.data(), pWriter->data.size(), nal);
+}
+
+// 画面サイズとフレームレート (30fps想定) からlevel_idcを選ぶ
+static UINT32 SelectLevel(UINT32 mbWidth, UINT32 mbHeight)
+{
+    static const UINT32 levels[][3] = {
+        // MaxFS, MaxMBPS, level_idc
+        {   396,   11880, 20 }, {  1620,   40500, 30 }, {  3600,  108000, 31 }, {  5120,  216000, 32 },
+        {  8192,  245760, 40 }, {  8704,  522240, 42 }, { 22080,  589824, 50 }, { 36864,  983040, 51 },
+    };
+    UINT32 frameSize = mbWidth * mbHeight;
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (frameSize <= levels[i][0] && frameSize * 30 <= levels[i][1]) {
+            return levels[i][2];
+        }
+    }
+    return 52;
+}
+
+static void WriteParameterSets(H264IntraEncoder* pEncoder, std::vector<std::vector<BYTE>>& nalUnits)
+{
+    H264BitWriter writer;
+    H264ResetBitWriter(&writer);
+
+    // SPS (Constrained Baseline、POCタイプ2 = 出力順と復号順が同じ)
+    H264WriteBits(&writer, 66, 8);                 // profile_idc
+    H264WriteBits(&writer, 0xC0, 8);               // constraint_set0/1_flag
+    H264WriteBits(&writer, SelectLevel(pEncoder->mbWidth, pEncoder->mbHeight), 8);
+    H264WriteUe(&writer, 0);                       // seq_parameter_set_id
+    H264WriteUe(&writer, LOG2_MAX_FRAME_NUM - 4);
+    H264WriteUe(&writer, 2);                       // pic_order_cnt_type
+    H264WriteUe(&writer, 1);                       // max_num_ref_frames
+    H264WriteBits(&writer, 0, 1);                  // gaps_in_frame_num_value_allowed_flag
+    H264WriteUe(&writer, pEncoder->mbWidth - 1);
+    H264WriteUe(&writer, pEncoder->mbHeight - 1);
+    H264WriteBits(&writer, 1, 1);                  // frame_mbs_only_flag
+    H264WriteBits(&writer, 1, 1);                  // direct_8x8_inference_flag
+    UINT32 cropBottom = (pEncoder->mbHeight * 16 - pEncoder->height) / 2;
+    H264WriteBits(&writer, cropBottom ? 1 : 0, 1); // frame_cropping_flag
+    if (cropBottom) {
+        H264WriteUe(&writer, 0);
+        H264WriteUe(&writer, 0);
+        H264WriteUe(&writer, 0);
+        H264WriteUe(&writer, cropBottom);
+    }
+    H264WriteBits(&writer, 0, 1);                  // vui_parameters_present_flag
+    H264WriteTrailingBits(&writer);
+    nalUnits.push_back(std::vector<BYTE>());
+    FinishNalUnit(&writer, NAL_HEADER_SPS, nalUnits.back());
+
+    // PPS (CAVLC、デブロッキングの制御をスライスヘッダーで行う)
+    H264ResetBitWriter(&writer);
+    H264WriteUe(&writer, 0);                       // pic_parameter_set_id
+    H264WriteUe(&writer, 0);                       // seq_parameter_set_id
+    H264WriteBits(&writer, 0, 1);                  // entropy_coding_mode_flag
+    H264WriteBits(&writer, 0, 1);                  // bottom_field_pic_order_in_frame_present_flag
+    H264WriteUe(&writer, 0);                       // num_slice_groups_minus1
+    H264WriteUe(&writer, 0);                       // num_ref_idx_l0_default_active_minus1
+    H264WriteUe(&writer, 0);                       // num_ref_idx_l1_default_active_minus1
+    H264WriteBits(&writer, 0, 3);                  // weighted_pred_flag, weighted_bipred_idc
+    H264WriteSe(&writer, PIC_INIT_QP - 26);
+    H264WriteSe(&writer, 0);                       // pic_init_qs_minus26
+    H264WriteSe(&writer, 0);                       // chroma_qp_index_offset
+    H264WriteBits(&writer, 1, 1);                  // deblocking_filter_control_present_flag
+    H264WriteBits(&writer, 0, 1);                  // constrained_intra_pred_flag
+    H264WriteBits(&writer, 0, 1);                  // redundant_pic_cnt_present_flag
+    H264WriteTrailingBits(&writer);
+    nalUnits.push_back(std::vector<BYTE>());
+    FinishNalUnit(&writer, NAL_HEADER_PPS, nalUnits.back());
+}
+
+// 1スライスを符号化する (スレッドから呼ばれる)
+static void EncodeSlice(H264IntraEncoder* pEncoder, H264SliceContext* pSlice)
+{
+    TRACE_SPAN("EncodeSlice", PIPELINE_TRACE_NO_FRAME);
+    H264BitWriter* pWriter = &pSlice->writer;
+    H264ResetBitWriter(pWriter);
+
+    // スライスヘッダー (Iスライス)
+    H264WriteUe(pWriter, pSlice->firstMbRow * pEncoder->mbWidth);  // first_mb_in_slice
+    H264WriteUe(pWriter, 7);                                       // slice_type (I、全スライス共通)
+    H264WriteUe(pWriter, 0);                                       // pic_parameter_set_id
+    H264WriteBits(pWriter, pEncoder->frameNum, LOG2_MAX_FRAME_NUM);
+    if (pEncoder->idr) {
+        H264WriteUe(pWriter, pEncoder->idrPicId);
+        H264WriteBits(pWriter, 0, 2);  // no_output_of_prior_pics_flag, long_term_reference_flag
+    } else {
+        H264WriteBits(pWriter, 0, 1);  // adaptive_ref_pic_marking_mode_flag
+    }
+    H264WriteSe(pWriter, pEncoder->qp - PIC_INIT_QP);               // slice_qp_delta
+    H264WriteUe(pWriter, pEncoder->deblockingFilter ? 0 : 1);      // disable_deblocking_filter_idc
+    if (pEncoder->deblockingFilter) {
+        H264WriteSe(pWriter, 0);  // slice_alpha_c0_offset_div2
+        H264WriteSe(pWriter, 0);  // slice_beta_offset_div2
+    }
+
+    for (UINT32 mbY = pSlice->firstMbRow; mbY < pSlice->firstMbRow + pSlice->mbRowCount; mbY++) {
+        for (UINT32 mbX = 0; mbX < pEncoder->mbWidth; mbX++) {
+            EncodeMacroblock(pEncoder, pSlice, mbX, mbY);
+        }
+    }
+    H264WriteTrailingBits(pWriter);
+    FinishNalUnit(pWriter, pEncoder->idr ? NAL_HEADER_IDR : NAL_HEADER_SLICE, pSlice->nal);
+}
+
+// ワーカースレッド (スライス1以降を担当し、フレームごとに起こされる)
+static void SliceWorker(H264IntraEncoder* pEncoder, H264SliceContext* pSlice)
+{
+    TRACE_THREAD_NAME("encoder slice worker");
+    UINT64 seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pEncoder->mutex);
+            pEncoder->start.wait(lock, [pEncoder, seenGeneration] {
+                return pEncoder->shuttingDown || pEncoder->generation != seenGeneration;
+            });
+            if (pEncoder->shuttingDown) {
+                return;
+            }
+            seenGeneration = pEncoder->generation;
+        }
+
+        EncodeSlice(pEncoder, pSlice);
+
+        std::lock_guard<std::mutex> lock(pEncoder->mutex);
+        if (--pEncoder->pendingSlices == 0) {
+            pEncoder->done.notify_one();
+        }
+    }
+}
+
+HRESULT InitializeH264IntraEncoder(H264IntraEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 sliceCount)
+{
+    if (!pEncoder) {
+        return E_POINTER;
+    }
+    if (width == 0 || height == 0 || (width % 16) != 0 || (height % 2) != 0) {
+        return E_INVALIDARG;
+    }
+
+    pEncoder->width = width;
+    pEncoder->height = height;
+    pEncoder->mbWidth = width / 16;
+    pEncoder->mbHeight = AlignUp(height, 16) / 16;
+    if (sliceCount == 0) {
+        sliceCount = 1;
+    }
+    if (sliceCount > pEncoder->mbHeight) {
+        sliceCount = pEncoder->mbHeight;
+    }
+    if (sliceCount > H264_MAX_SLICES) {
+        sliceCount = H264_MAX_SLICES;
+    }
+    pEncoder->sliceCount = sliceCount;
+    pEncoder->deblockingFilter = TRUE;
+    pEncoder->fastModeDecision = FALSE;
+
+    pEncoder->macroblocks.assign(static_cast<size_t>(pEncoder->mbWidth) * pEncoder->mbHeight, H264MacroblockInfo());
+    pEncoder->reconStride = pEncoder->mbWidth * 16;
+    pEncoder->reconY.assign(static_cast<size_t>(pEncoder->reconStride) * pEncoder->mbHeight * 16, 0);
+    pEncoder->reconU.assign(pEncoder->reconY.size() / 4, 0);
+    pEncoder->reconV.assign(pEncoder->reconY.size() / 4, 0);
+
+    pEncoder->pFrame = NULL;
+    pEncoder->qp = PIC_INIT_QP;
+    pEncoder->idr = true;
+    pEncoder->frameNum = 0;
+    pEncoder->idrPicId = 0;
+    pEncoder->lambda = 1;
+    pEncoder->generation = 0;
+    pEncoder->pendingSlices = 0;
+    pEncoder->shuttingDown = false;
+
+    // マクロブロック行をスライスに均等に割り当てる
+    pEncoder->slices.clear();
+    for (UINT32 i = 0; i < sliceCount; i++) {
+        H264SliceContext* pSlice = new H264SliceContext();
+        pSlice->firstMbRow = pEncoder->mbHeight * i / sliceCount;
+        pSlice->mbRowCount = pEncoder->mbHeight * (i + 1) / sliceCount - pSlice->firstMbRow;
+        H264ResetBitWriter(&pSlice->writer);
+        pSlice->intra4x4Count = 0;
+        pSlice->intra16x16Count = 0;
+        pEncoder->slices.push_back(pSlice);
+    }
+    pEncoder->parameterSets.clear();
+    WriteParameterSets(pEncoder, pEncoder->parameterSets);
+
+    pEncoder->workers.clear();
+    for (UINT32 i = 1; i < sliceCount; i++) {
+        pEncoder->workers.push_back(std::thread(SliceWorker, pEncoder, pEncoder->slices[i]));
+    }
+    return S_OK;
+}
+
+// 全スライスを符号化する (結果は各スライスのnalに残る)
+static HRESULT EncodePicture(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr)
+{
+    if (!pEncoder || pEncoder->slices.empty()) {
+        return E_POINTER;
+    }
+    if (frame.width < pEncoder->mbWidth * 16 || frame.height < pEncoder->mbHeight * 16) {
+        return E_INVALIDARG;
+    }
+
+    pEncoder->pFrame = &frame;
+    pEncoder->qp = qp < 0 ? 0 : (qp > 51 ? 51 : qp);
+    pEncoder->lambda = static_cast<int>(pow(2.0, (pEncoder->qp - 12) / 6.0) + 0.5);
+    if (pEncoder->lambda < 1) {
+        pEncoder->lambda = 1;
+    }
+    pEncoder->idr = idr;
+    if (idr) {
+        pEncoder->frameNum = 0;
+    }
+
+    // スライス0は呼び出し元のスレッドで符号化し、残りはワーカーに任せる
+    {
+        std::lock_guard<std::mutex> lock(pEncoder->mutex);
+        pEncoder->generation++;
+        pEncoder->pendingSlices = pEncoder->sliceCount - 1;
+    }
+    pEncoder->start.notify_all();
+    EncodeSlice(pEncoder, pEncoder->slices[0]);
+    {
+        std::unique_lock<std::mutex> lock(pEncoder->mutex);
+        pEncoder->done.wait(lock, [pEncoder] { return pEncoder->pendingSlices == 0; });
+    }
+    return S_OK;
+}
+
+// 次のフレームのためにヘッダーの番号を進める
+static void FinishPicture(H264IntraEncoder* pEncoder, bool idr)
+{
+    // 全フレームを参照フレームとして扱う (POCタイプ2では非参照フレームを連続させられないため)
+    pEncoder->frameNum = (pEncoder->frameNum + 1) % (1 << LOG2_MAX_FRAME_NUM);
+    if (idr) {
+        pEncoder->idrPicId = (pEncoder->idrPicId + 1) & 0xFFFF;
+    }
+    pEncoder->pFrame = NULL;
+}
+
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr,
+                             std::vector<std::vector<BYTE>>& nalUnits)
+{
+    HRESULT hr = EncodePicture(pEncoder, frame, qp, idr);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (idr) {
+        nalUnits.insert(nalUnits.end(), pEncoder->parameterSets.begin(), pEncoder->parameterSets.end());
+    }
+    for (H264SliceContext* pSlice : pEncoder->slices) {
+        nalUnits.push_back(pSlice->nal);
+    }
+    FinishPicture(pEncoder, idr);
+    return S_OK;
+}
+
+// NALユニットをアリーナの末尾に追加する
+static void AppendNalToArena(const std::vector<BYTE>& nal, std::vector<BYTE>& data, std::vector<BatchNalRange>& nals)
+{
+    BatchNalRange range;
+    range.offset = data.size();
+    range.size = nal.size();
+    data.insert(data.end(), nal.begin(), nal.end());
+    nals.push_back(range);
+}
+
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr,
+                             std::vector<BYTE>& data, std::vector<BatchNalRange>& nals)
+{
+    HRESULT hr = EncodePicture(pEncoder, frame, qp, idr);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    if (idr) {
+        for (const std::vector<BYTE>& nal : pEncoder->parameterSets) {
+            AppendNalToArena(nal, data, nals);
+        }
+    }
+    for (H264SliceContext* pSlice : pEncoder->slices) {
+        AppendNalToArena(pSlice->nal, data, nals);
+    }
+    FinishPicture(pEncoder, idr);
+    return S_OK;
+}
+
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr, NalStore* pStore)
+{
+    HRESULT hr = EncodePicture(pEncoder, frame, qp, idr);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    for (size_t i = 0; idr && i < pEncoder->parameterSets.size() && SUCCEEDED(hr); i++) {
+        hr = AppendNalUnit(pStore, pEncoder->parameterSets[i].data(), pEncoder->parameterSets[i].size());
+    }
+    for (size_t i = 0; i < pEncoder->slices.size() && SUCCEEDED(hr); i++) {
+        hr = AppendNalUnit(pStore, pEncoder->slices[i]->nal.data(), pEncoder->slices[i]->nal.size());
+    }
+    FinishPicture(pEncoder, idr);
+    return hr;
+}
+
+double GetH264IntraReconPsnr(const H264IntraEncoder* pEncoder, const Nv12Frame& frame)
+{
+    UINT64 sse = 0;
+    for (UINT32 y = 0; y < pEncoder->height; y++) {
+        const BYTE* pSrc = frame.pY + static_cast<size_t>(y) * frame.stride;
+        const BYTE* pRecon = pEncoder->reconY.data() + static_cast<size_t>(y) * pEncoder->reconStride;
+        for (UINT32 x = 0; x < pEncoder->width; x++) {
+            int diff = pSrc[x] - pRecon[x];
+            sse += static_cast<UINT64>(diff * diff);
+        }
+    }
+    if (sse == 0) {
+        return 99.0;
+    }
+    double mse = static_cast<double>(sse) / (static_cast<double>(pEncoder->width) * pEncoder->height);
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+void ShutdownH264IntraEncoder(H264IntraEncoder* pEncoder)
+{
+    if (!pEncoder) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pEncoder->mutex);
+        pEncoder->shuttingDown = true;
+    }
+    pEncoder->start.notify_all();
+    for (std::thread& worker : pEncoder->workers) {
+        worker.join();
+    }
+    pEncoder->workers.clear();
+    for (H264SliceContext* pSlice : pEncoder->slices) {
+        delete pSlice;
+    }
+    pEncoder->slices.clear();
+    pEncoder->macroblocks.clear();
+    pEncoder->reconY.clear();
+    pEncoder->reconU.clear();
+    pEncoder->reconV.clear();
+}
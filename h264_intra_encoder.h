@@ -0,0 +1,90 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include "h264_cavlc.h"
+#include "h264_intra_pred.h"
+#include "codec_batch.h"
+#include "nal_store.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// イントラのみのH.264ソフトウェアエンコーダー (Constrained Baseline、CAVLC)
+// - マクロブロックはIntra4x4 (9モード) とIntra16x16 (4モード) からSATDで選ぶ
+// - スライスはマクロブロック行単位で分割し、スライスごとに別スレッドで符号化する
+//   (スライスをまたぐ予測はないので、スレッド間で共有するのは読み取り専用の入力だけ)
+// - QPはフレーム単位で固定 (mb_qp_deltaは常に0)。レート制御は呼び出し側で行う
+
+// 符号化できるスライス数の上限
+#define H264_MAX_SLICES 256
+
+// 1スライス分の作業領域 (担当スレッドだけが書き込む)
+struct H264SliceContext {
+    UINT32 firstMbRow;                 // 先頭のマクロブロック行
+    UINT32 mbRowCount;                 // マクロブロック行数
+    H264BitWriter writer;              // スライスのRBSP
+    std::vector<BYTE> nal;             // NALヘッダー付きのEBSP (符号化結果)
+    UINT64 intra4x4Count;              // Intra4x4を選んだマクロブロック数
+    UINT64 intra16x16Count;            // Intra16x16を選んだマクロブロック数
+};
+
+// イントラエンコーダー構造体
+struct H264IntraEncoder {
+    UINT32 width;                      // 表示サイズ
+    UINT32 height;
+    UINT32 mbWidth;                    // マクロブロック単位のサイズ
+    UINT32 mbHeight;
+    UINT32 sliceCount;
+    BOOL deblockingFilter;             // デブロッキングフィルターを有効にするか (FALSEならデコード結果 = 再構成画像)
+    BOOL fastModeDecision;             // TRUEならIntra4x4を試さない (リアルタイムで遅れたときの劣化モード)
+
+    std::vector<H264MacroblockInfo> macroblocks;
+    std::vector<BYTE> reconY;          // 再構成画像 (プレーン形式、予測に使う)
+    std::vector<BYTE> reconU;
+    std::vector<BYTE> reconV;
+    UINT32 reconStride;                // reconYの行ピッチ (reconU/Vはその半分)
+    std::vector<H264SliceContext*> slices;
+    std::vector<std::vector<BYTE>> parameterSets; // SPS/PPS (サイズで決まるので初期化時に1回だけ作る)
+
+    // 現在のフレーム (EncodeH264IntraFrameの間だけ有効)
+    const Nv12Frame* pFrame;
+    int qp;
+    bool idr;
+    UINT32 frameNum;                   // frame_num (IDRで0に戻る)
+    UINT32 idrPicId;                   // idr_pic_id (連続するIDRで値を変える)
+    int lambda;                        // モード選択のラムダ (SATD単位)
+
+    // スライス0以外を符号化するワーカースレッド
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;     // フレームの開始・終了を通知する
+    std::condition_variable done;      // ワーカーのスライスが終わったことを通知する
+    UINT64 generation;                 // 開始したフレームの通し番号
+    UINT32 pendingSlices;              // 符号化中のワーカーのスライス数
+    bool shuttingDown;
+};
+
+// エンコーダーを初期化する関数
+// 幅は16の倍数、高さは偶数であること (高さは16の倍数にパディングしてクロップで指定する)
+// sliceCountはマクロブロック行数で切り詰める (1ならスレッドは作らない)
+HRESULT InitializeH264IntraEncoder(H264IntraEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 sliceCount);
+
+// フレームを符号化する関数 (frameはwidth x 16の倍数の符号化サイズで、パディング行も読む)
+// idrならSPS/PPSとIDRスライス、そうでなければIスライスをnalUnitsの末尾に追加する (スタートコードなし)
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr,
+                             std::vector<std::vector<BYTE>>& nalUnits);
+
+// 同じく、NALユニットをdataの末尾に続けて詰め、その位置をnalsに追加する関数 (NALユニットごとの確保をしない)
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr,
+                             std::vector<BYTE>& data, std::vector<BatchNalRange>& nals);
+
+// 同じく、NALユニットをストアの末尾に追加する関数 (長いエンコードで結果を溜めていく用)
+HRESULT EncodeH264IntraFrame(H264IntraEncoder* pEncoder, const Nv12Frame& frame, int qp, bool idr, NalStore* pStore);
+
+// 再構成画像の輝度PSNRを返す関数 (直前に符号化したフレームとの比較、デブロッキング前)
+double GetH264IntraReconPsnr(const H264IntraEncoder* pEncoder, const Nv12Frame& frame);
+
+// ワーカースレッドを止めてリソースを解放する関数
+void ShutdownH264IntraEncoder(H264IntraEncoder* pEncoder);
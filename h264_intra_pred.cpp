@@ -0,0 +1,325 @@
+#include "h264_intra_pred.h"
+#include <string.h>
+
+static inline BYTE ClipPixel(int value)
+{
+    return static_cast<BYTE>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+void H264LoadIntraNeighbors(const BYTE* pBlock, UINT32 stride, int size, bool hasTop, bool hasLeft,
+                            bool hasTopLeft, bool hasTopRight, H264IntraNeighbors* pNeighbors)
+{
+    pNeighbors->hasTop = hasTop;
+    pNeighbors->hasLeft = hasLeft;
+    pNeighbors->hasTopLeft = hasTopLeft;
+    pNeighbors->topLeft = hasTopLeft ? pBlock[-static_cast<ptrdiff_t>(stride) - 1] : 128;
+    if (hasTop) {
+        const BYTE* pTop = pBlock - stride;
+        memcpy(pNeighbors->top, pTop, size);
+        if (size == 4) {
+            if (hasTopRight) {
+                memcpy(pNeighbors->top + 4, pTop + 4, 4);
+            } else {
+                memset(pNeighbors->top + 4, pTop[3], 4);
+            }
+        }
+    }
+    if (hasLeft) {
+        for (int y = 0; y < size; y++) {
+            pNeighbors->left[y] = pBlock[static_cast<size_t>(y) * stride - 1];
+        }
+    }
+}
+
+void H264LoadChromaNeighborsNv12(const BYTE* pBlockUV, UINT32 stride, int component, bool hasTop, bool hasLeft,
+                                 bool hasTopLeft, H264IntraNeighbors* pNeighbors)
+{
+    const BYTE* p = pBlockUV + component;
+    pNeighbors->hasTop = hasTop;
+    pNeighbors->hasLeft = hasLeft;
+    pNeighbors->hasTopLeft = hasTopLeft;
+    pNeighbors->topLeft = hasTopLeft ? p[-static_cast<ptrdiff_t>(stride) - 2] : 128;
+    if (hasTop) {
+        for (int x = 0; x < 8; x++) {
+            pNeighbors->top[x] = p[static_cast<ptrdiff_t>(x) * 2 - static_cast<ptrdiff_t>(stride)];
+        }
+    }
+    if (hasLeft) {
+        for (int y = 0; y < 8; y++) {
+            pNeighbors->left[y] = p[static_cast<size_t>(y) * stride - 2];
+        }
+    }
+}
+
+bool H264IsIntra4x4ModeAvailable(const H264IntraNeighbors* pNeighbors, int mode)
+{
+    switch (mode) {
+    case H264_I4X4_VERTICAL:
+    case H264_I4X4_DIAGONAL_DOWN_LEFT:
+    case H264_I4X4_VERTICAL_LEFT:
+        return pNeighbors->hasTop;
+    case H264_I4X4_HORIZONTAL:
+    case H264_I4X4_HORIZONTAL_UP:
+        return pNeighbors->hasLeft;
+    case H264_I4X4_DC:
+        return true;
+    default:
+        return pNeighbors->hasTop && pNeighbors->hasLeft && pNeighbors->hasTopLeft;
+    }
+}
+
+bool H264IsIntra16x16ModeAvailable(const H264IntraNeighbors* pNeighbors, int mode)
+{
+    switch (mode) {
+    case H264_I16X16_VERTICAL:
+        return pNeighbors->hasTop;
+    case H264_I16X16_HORIZONTAL:
+        return pNeighbors->hasLeft;
+    case H264_I16X16_DC:
+        return true;
+    default:
+        return pNeighbors->hasTop && pNeighbors->hasLeft && pNeighbors->hasTopLeft;
+    }
+}
+
+bool H264IsIntraChromaModeAvailable(const H264IntraNeighbors* pNeighbors, int mode)
+{
+    switch (mode) {
+    case H264_CHROMA_DC:
+        return true;
+    case H264_CHROMA_HORIZONTAL:
+        return pNeighbors->hasLeft;
+    case H264_CHROMA_VERTICAL:
+        return pNeighbors->hasTop;
+    default:
+        return pNeighbors->hasTop && pNeighbors->hasLeft && pNeighbors->hasTopLeft;
+    }
+}
+
+void H264PredictIntra4x4(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[16])
+{
+    // t[1 + x] = p[x, -1]、l[1 + y] = p[-1, y]、t[0] = l[0] = p[-1, -1]
+    int t[9], l[5];
+    t[0] = l[0] = pNeighbors->topLeft;
+    for (int i = 0; i < 8; i++) {
+        t[1 + i] = pNeighbors->top[i];
+    }
+    for (int i = 0; i < 4; i++) {
+        l[1 + i] = pNeighbors->left[i];
+    }
+#define T(x) t[1 + (x)]
+#define L(y) l[1 + (y)]
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            int value = 128;
+            switch (mode) {
+            case H264_I4X4_VERTICAL:
+                value = T(x);
+                break;
+            case H264_I4X4_HORIZONTAL:
+                value = L(y);
+                break;
+            case H264_I4X4_DC:
+                if (pNeighbors->hasTop && pNeighbors->hasLeft) {
+                    value = (T(0) + T(1) + T(2) + T(3) + L(0) + L(1) + L(2) + L(3) + 4) >> 3;
+                } else if (pNeighbors->hasLeft) {
+                    value = (L(0) + L(1) + L(2) + L(3) + 2) >> 2;
+                } else if (pNeighbors->hasTop) {
+                    value = (T(0) + T(1) + T(2) + T(3) + 2) >> 2;
+                }
+                break;
+            case H264_I4X4_DIAGONAL_DOWN_LEFT:
+                if (x == 3 && y == 3) {
+                    value = (T(6) + 3 * T(7) + 2) >> 2;
+                } else {
+                    value = (T(x + y) + 2 * T(x + y + 1) + T(x + y + 2) + 2) >> 2;
+                }
+                break;
+            case H264_I4X4_DIAGONAL_DOWN_RIGHT:
+                if (x > y) {
+                    value = (T(x - y - 2) + 2 * T(x - y - 1) + T(x - y) + 2) >> 2;
+                } else if (x < y) {
+                    value = (L(y - x - 2) + 2 * L(y - x - 1) + L(y - x) + 2) >> 2;
+                } else {
+                    value = (T(0) + 2 * T(-1) + L(0) + 2) >> 2;
+                }
+                break;
+            case H264_I4X4_VERTICAL_RIGHT: {
+                int z = 2 * x - y;
+                if (z >= 0 && (z & 1) == 0) {
+                    value = (T(x - (y >> 1) - 1) + T(x - (y >> 1)) + 1) >> 1;
+                } else if (z >= 0) {
+                    value = (T(x - (y >> 1) - 2) + 2 * T(x - (y >> 1) - 1) + T(x - (y >> 1)) + 2) >> 2;
+                } else if (z == -1) {
+                    value = (L(0) + 2 * L(-1) + T(0) + 2) >> 2;
+                } else {
+                    value = (L(y - 1) + 2 * L(y - 2) + L(y - 3) + 2) >> 2;
+                }
+                break;
+            }
+            case H264_I4X4_HORIZONTAL_DOWN: {
+                int z = 2 * y - x;
+                if (z >= 0 && (z & 1) == 0) {
+                    value = (L(y - (x >> 1) - 1) + L(y - (x >> 1)) + 1) >> 1;
+                } else if (z >= 0) {
+                    value = (L(y - (x >> 1) - 2) + 2 * L(y - (x >> 1) - 1) + L(y - (x >> 1)) + 2) >> 2;
+                } else if (z == -1) {
+                    value = (L(0) + 2 * L(-1) + T(0) + 2) >> 2;
+                } else {
+                    value = (T(x - 1) + 2 * T(x - 2) + T(x - 3) + 2) >> 2;
+                }
+                break;
+            }
+            case H264_I4X4_VERTICAL_LEFT:
+                if ((y & 1) == 0) {
+                    value = (T(x + (y >> 1)) + T(x + (y >> 1) + 1) + 1) >> 1;
+                } else {
+                    value = (T(x + (y >> 1)) + 2 * T(x + (y >> 1) + 1) + T(x + (y >> 1) + 2) + 2) >> 2;
+                }
+                break;
+            case H264_I4X4_HORIZONTAL_UP: {
+                int z = x + 2 * y;
+                if (z > 5) {
+                    value = L(3);
+                } else if (z == 5) {
+                    value = (L(2) + 3 * L(3) + 2) >> 2;
+                } else if ((z & 1) == 0) {
+                    value = (L(y + (x >> 1)) + L(y + (x >> 1) + 1) + 1) >> 1;
+                } else {
+                    value = (L(y + (x >> 1)) + 2 * L(y + (x >> 1) + 1) + L(y + (x >> 1) + 2) + 2) >> 2;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            pred[y * 4 + x] = static_cast<BYTE>(value);
+        }
+    }
+#undef T
+#undef L
+}
+
+// 平面予測 (16x16はsize = 16、色差はsize = 8)
+static void PredictPlane(const H264IntraNeighbors* pNeighbors, int size, BYTE* pred)
+{
+    int half = size / 2;
+    int h = 0, v = 0;
+    for (int i = 0; i < half; i++) {
+        int before = (half - 2 - i >= 0) ? pNeighbors->top[half - 2 - i] : pNeighbors->topLeft;
+        h += (i + 1) * (pNeighbors->top[half + i] - before);
+        before = (half - 2 - i >= 0) ? pNeighbors->left[half - 2 - i] : pNeighbors->topLeft;
+        v += (i + 1) * (pNeighbors->left[half + i] - before);
+    }
+    int a = 16 * (pNeighbors->left[size - 1] + pNeighbors->top[size - 1]);
+    int b = (size == 16) ? (5 * h + 32) >> 6 : (34 * h + 32) >> 6;
+    int c = (size == 16) ? (5 * v + 32) >> 6 : (34 * v + 32) >> 6;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            pred[y * size + x] = ClipPixel((a + b * (x - (half - 1)) + c * (y - (half - 1)) + 16) >> 5);
+        }
+    }
+}
+
+void H264PredictIntra16x16(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[256])
+{
+    switch (mode) {
+    case H264_I16X16_VERTICAL:
+        for (int y = 0; y < 16; y++) {
+            memcpy(pred + y * 16, pNeighbors->top, 16);
+        }
+        break;
+    case H264_I16X16_HORIZONTAL:
+        for (int y = 0; y < 16; y++) {
+            memset(pred + y * 16, pNeighbors->left[y], 16);
+        }
+        break;
+    case H264_I16X16_PLANE:
+        PredictPlane(pNeighbors, 16, pred);
+        break;
+    default: {
+        int sum = 0;
+        int value = 128;
+        if (pNeighbors->hasTop && pNeighbors->hasLeft) {
+            for (int i = 0; i < 16; i++) {
+                sum += pNeighbors->top[i] + pNeighbors->left[i];
+            }
+            value = (sum + 16) >> 5;
+        } else if (pNeighbors->hasLeft || pNeighbors->hasTop) {
+            const BYTE* p = pNeighbors->hasLeft ? pNeighbors->left : pNeighbors->top;
+            for (int i = 0; i < 16; i++) {
+                sum += p[i];
+            }
+            value = (sum + 8) >> 4;
+        }
+        memset(pred, value, 256);
+        break;
+    }
+    }
+}
+
+// 色差のDC予測 (4x4ブロックごとに、位置によって使う周囲の画素が変わる)
+static void PredictChromaDc(const H264IntraNeighbors* pNeighbors, BYTE pred[64])
+{
+    for (int blockY = 0; blockY < 2; blockY++) {
+        for (int blockX = 0; blockX < 2; blockX++) {
+            int sumTop = 0, sumLeft = 0;
+            for (int i = 0; i < 4; i++) {
+                sumTop += pNeighbors->top[blockX * 4 + i];
+                sumLeft += pNeighbors->left[blockY * 4 + i];
+            }
+            bool top = pNeighbors->hasTop;
+            bool left = pNeighbors->hasLeft;
+            int value = 128;
+            if (blockX == blockY) {
+                // 左上・右下のブロックは上と左の両方を使う
+                if (top && left) {
+                    value = (sumTop + sumLeft + 4) >> 3;
+                } else if (left) {
+                    value = (sumLeft + 2) >> 2;
+                } else if (top) {
+                    value = (sumTop + 2) >> 2;
+                }
+            } else if (blockY == 0) {
+                // 右上のブロックは上を優先する
+                if (top) {
+                    value = (sumTop + 2) >> 2;
+                } else if (left) {
+                    value = (sumLeft + 2) >> 2;
+                }
+            } else {
+                // 左下のブロックは左を優先する
+                if (left) {
+                    value = (sumLeft + 2) >> 2;
+                } else if (top) {
+                    value = (sumTop + 2) >> 2;
+                }
+            }
+            for (int y = 0; y < 4; y++) {
+                memset(pred + (blockY * 4 + y) * 8 + blockX * 4, value, 4);
+            }
+        }
+    }
+}
+
+void H264PredictIntraChroma(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[64])
+{
+    switch (mode) {
+    case H264_CHROMA_HORIZONTAL:
+        for (int y = 0; y < 8; y++) {
+            memset(pred + y * 8, pNeighbors->left[y], 8);
+        }
+        break;
+    case H264_CHROMA_VERTICAL:
+        for (int y = 0; y < 8; y++) {
+            memcpy(pred + y * 8, pNeighbors->top, 8);
+        }
+        break;
+    case H264_CHROMA_PLANE:
+        PredictPlane(pNeighbors, 8, pred);
+        break;
+    default:
+        PredictChromaDc(pNeighbors, pred);
+        break;
+    }
+}
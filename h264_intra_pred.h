@@ -0,0 +1,79 @@
+#pragma once
+
+#include "portable_types.h"
+
+// H.264のイントラ予測 (8.3)。エンコーダーとデコーダーで共用する
+
+// Intra4x4の予測モード
+enum H264Intra4x4Mode {
+    H264_I4X4_VERTICAL = 0,
+    H264_I4X4_HORIZONTAL = 1,
+    H264_I4X4_DC = 2,
+    H264_I4X4_DIAGONAL_DOWN_LEFT = 3,
+    H264_I4X4_DIAGONAL_DOWN_RIGHT = 4,
+    H264_I4X4_VERTICAL_RIGHT = 5,
+    H264_I4X4_HORIZONTAL_DOWN = 6,
+    H264_I4X4_VERTICAL_LEFT = 7,
+    H264_I4X4_HORIZONTAL_UP = 8
+};
+
+// Intra16x16の予測モード
+enum H264Intra16x16Mode {
+    H264_I16X16_VERTICAL = 0,
+    H264_I16X16_HORIZONTAL = 1,
+    H264_I16X16_DC = 2,
+    H264_I16X16_PLANE = 3
+};
+
+// 色差の予測モード (intra_chroma_pred_mode)
+enum H264IntraChromaMode {
+    H264_CHROMA_DC = 0,
+    H264_CHROMA_HORIZONTAL = 1,
+    H264_CHROMA_VERTICAL = 2,
+    H264_CHROMA_PLANE = 3
+};
+
+// マクロブロックの種類
+#define H264_MB_I4X4   0
+#define H264_MB_I16X16 1
+#define H264_MB_I_PCM  2
+
+// マクロブロックごとの情報 (周囲のマクロブロックの予測モードとnCの計算に使う)
+struct H264MacroblockInfo {
+    BYTE type;                         // H264_MB_I4X4 / H264_MB_I16X16 / H264_MB_I_PCM
+    BYTE intra4x4Modes[16];            // 4x4ブロックの予測モード (ラスター順、Intra4x4以外ではDC扱い)
+    BYTE lumaCoeffCount[16];           // 4x4ブロックの非ゼロ係数の数 (ラスター順、I_PCMは16)
+    BYTE chromaCoeffCount[2][4];       // 色差ACブロックの非ゼロ係数の数 (Cb/Cr、ラスター順)
+};
+
+// 予測に使う周囲の再構成画素
+// 4x4ではtopの0..3が上、4..7が右上 (使えなければ上の右端で埋める)
+struct H264IntraNeighbors {
+    BYTE top[16];
+    BYTE left[16];
+    BYTE topLeft;
+    bool hasTop;
+    bool hasLeft;
+    bool hasTopLeft;
+};
+
+// ブロック (size x size) の左上の画素pBlockから周囲の画素を読み込む関数
+// size == 4 のとき、hasTopRightがfalseなら右上を上の右端の画素で置き換える
+void H264LoadIntraNeighbors(const BYTE* pBlock, UINT32 stride, int size, bool hasTop, bool hasLeft,
+                            bool hasTopLeft, bool hasTopRight, H264IntraNeighbors* pNeighbors);
+
+// NV12のUVプレーンから色差ブロック (8x8) の周囲の画素を読み込む関数 (componentは0: Cb、1: Cr)
+void H264LoadChromaNeighborsNv12(const BYTE* pBlockUV, UINT32 stride, int component, bool hasTop, bool hasLeft,
+                                 bool hasTopLeft, H264IntraNeighbors* pNeighbors);
+
+// Intra4x4の予測モードが周囲の画素の有無で使えるかを返す関数
+bool H264IsIntra4x4ModeAvailable(const H264IntraNeighbors* pNeighbors, int mode);
+
+// Intra16x16・色差の予測モードが使えるかを返す関数 (色差はH264IntraChromaModeの値)
+bool H264IsIntra16x16ModeAvailable(const H264IntraNeighbors* pNeighbors, int mode);
+bool H264IsIntraChromaModeAvailable(const H264IntraNeighbors* pNeighbors, int mode);
+
+// 予測画像を作る関数 (predの行ピッチはそれぞれ4、16、8)
+void H264PredictIntra4x4(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[16]);
+void H264PredictIntra16x16(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[256]);
+void H264PredictIntraChroma(const H264IntraNeighbors* pNeighbors, int mode, BYTE pred[64]);
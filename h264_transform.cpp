@@ -0,0 +1,571 @@
+#include "h264_transform.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define H264_TRANSFORM_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define H264_TRANSFORM_USE_NEON 1
+#endif
+
+const BYTE H264_ZIGZAG_4X4[16] = { 0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15 };
+
+// 量子化の乗数 (qp % 6、ラスター位置ごと)
+static const INT16 QUANT_MF[6][16] = {
+    { 13107,  8066, 13107,  8066,  8066,  5243,  8066,  5243, 13107,  8066, 13107,  8066,  8066,  5243,  8066,  5243 },
+    { 11916,  7490, 11916,  7490,  7490,  4660,  7490,  4660, 11916,  7490, 11916,  7490,  7490,  4660,  7490,  4660 },
+    { 10082,  6554, 10082,  6554,  6554,  4194,  6554,  4194, 10082,  6554, 10082,  6554,  6554,  4194,  6554,  4194 },
+    {  9362,  5825,  9362,  5825,  5825,  3647,  5825,  3647,  9362,  5825,  9362,  5825,  5825,  3647,  5825,  3647 },
+    {  8192,  5243,  8192,  5243,  5243,  3355,  5243,  3355,  8192,  5243,  8192,  5243,  5243,  3355,  5243,  3355 },
+    {  7282,  4559,  7282,  4559,  4559,  2893,  4559,  2893,  7282,  4559,  7282,  4559,  4559,  2893,  4559,  2893 },
+};
+
+// 逆量子化のスケール (規格のnormAdjust4x4、qp % 6、ラスター位置ごと)
+static const INT16 DEQUANT_V[6][16] = {
+    { 10, 13, 10, 13, 13, 16, 13, 16, 10, 13, 10, 13, 13, 16, 13, 16 },
+    { 11, 14, 11, 14, 14, 18, 14, 18, 11, 14, 11, 14, 14, 18, 14, 18 },
+    { 13, 16, 13, 16, 16, 20, 16, 20, 13, 16, 13, 16, 16, 20, 16, 20 },
+    { 14, 18, 14, 18, 18, 23, 18, 23, 14, 18, 14, 18, 18, 23, 18, 23 },
+    { 16, 20, 16, 20, 20, 25, 20, 25, 16, 20, 16, 20, 20, 25, 20, 25 },
+    { 18, 23, 18, 23, 23, 29, 23, 29, 18, 23, 18, 23, 23, 29, 23, 29 },
+};
+
+// 色差QPの対応表 (qPI -> QPc)
+static const BYTE CHROMA_QP[52] = {
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,
+    26, 27, 28, 29, 29, 30, 31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38, 39, 39, 39, 39,
+};
+
+int H264ChromaQp(int qp)
+{
+    return CHROMA_QP[qp < 0 ? 0 : (qp > 51 ? 51 : qp)];
+}
+
+static inline BYTE ClipPixel(int value)
+{
+    return static_cast<BYTE>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline INT16 QuantizeValue(int coeff, int mf, int bias, int qbits)
+{
+    int magnitude = ((coeff < 0 ? -coeff : coeff) * mf + bias) >> qbits;
+    if (magnitude > H264_MAX_LEVEL) {
+        magnitude = H264_MAX_LEVEL;
+    }
+    return static_cast<INT16>(coeff < 0 ? -magnitude : magnitude);
+}
+
+// ---- スカラー版 ----
+
+void H264ForwardTransform4x4Scalar(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                                   INT16 coeffs[16])
+{
+    int temp[16];
+    for (int y = 0; y < 4; y++) {
+        const BYTE* s = pSrc + static_cast<size_t>(y) * srcStride;
+        const BYTE* p = pPred + static_cast<size_t>(y) * predStride;
+        int d0 = s[0] - p[0], d1 = s[1] - p[1], d2 = s[2] - p[2], d3 = s[3] - p[3];
+        int s03 = d0 + d3, d03 = d0 - d3, s12 = d1 + d2, d12 = d1 - d2;
+        temp[y * 4 + 0] = s03 + s12;
+        temp[y * 4 + 1] = 2 * d03 + d12;
+        temp[y * 4 + 2] = s03 - s12;
+        temp[y * 4 + 3] = d03 - 2 * d12;
+    }
+    for (int x = 0; x < 4; x++) {
+        int s03 = temp[x] + temp[12 + x], d03 = temp[x] - temp[12 + x];
+        int s12 = temp[4 + x] + temp[8 + x], d12 = temp[4 + x] - temp[8 + x];
+        coeffs[x] = static_cast<INT16>(s03 + s12);
+        coeffs[4 + x] = static_cast<INT16>(2 * d03 + d12);
+        coeffs[8 + x] = static_cast<INT16>(s03 - s12);
+        coeffs[12 + x] = static_cast<INT16>(d03 - 2 * d12);
+    }
+}
+
+int H264Quantize4x4Scalar(const INT16 coeffs[16], INT16 levels[16], int qp, int firstIndex)
+{
+    const INT16* mf = QUANT_MF[qp % 6];
+    int qbits = 15 + qp / 6;
+    int bias = (1 << qbits) / 3;
+    int nonZero = 0;
+    levels[0] = 0;
+    for (int i = firstIndex; i < 16; i++) {
+        levels[i] = QuantizeValue(coeffs[i], mf[i], bias, qbits);
+        nonZero += levels[i] != 0;
+    }
+    return nonZero;
+}
+
+void H264Dequantize4x4Scalar(const INT16 levels[16], INT16 coeffs[16], int qp, int firstIndex)
+{
+    const INT16* v = DEQUANT_V[qp % 6];
+    int shift = qp / 6;
+    for (int i = firstIndex; i < 16; i++) {
+        coeffs[i] = static_cast<INT16>((levels[i] * v[i]) << shift);
+    }
+}
+
+void H264InverseTransformAdd4x4Scalar(INT16 coeffs[16], BYTE* pDst, UINT32 dstStride)
+{
+    int temp[16];
+    for (int y = 0; y < 4; y++) {
+        const INT16* d = coeffs + y * 4;
+        int e0 = d[0] + d[2], e1 = d[0] - d[2];
+        int e2 = (d[1] >> 1) - d[3], e3 = d[1] + (d[3] >> 1);
+        temp[y * 4 + 0] = e0 + e3;
+        temp[y * 4 + 1] = e1 + e2;
+        temp[y * 4 + 2] = e1 - e2;
+        temp[y * 4 + 3] = e0 - e3;
+    }
+    for (int x = 0; x < 4; x++) {
+        int e0 = temp[x] + temp[8 + x], e1 = temp[x] - temp[8 + x];
+        int e2 = (temp[4 + x] >> 1) - temp[12 + x], e3 = temp[4 + x] + (temp[12 + x] >> 1);
+        int h[4] = { e0 + e3, e1 + e2, e1 - e2, e0 - e3 };
+        for (int y = 0; y < 4; y++) {
+            BYTE* p = pDst + static_cast<size_t>(y) * dstStride + x;
+            *p = ClipPixel(*p + ((h[y] + 32) >> 6));
+        }
+    }
+}
+
+UINT32 H264Satd4x4Scalar(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride)
+{
+    int temp[16];
+    for (int y = 0; y < 4; y++) {
+        const BYTE* s = pSrc + static_cast<size_t>(y) * srcStride;
+        const BYTE* p = pPred + static_cast<size_t>(y) * predStride;
+        int a0 = (s[0] - p[0]) + (s[1] - p[1]), a1 = (s[0] - p[0]) - (s[1] - p[1]);
+        int a2 = (s[2] - p[2]) + (s[3] - p[3]), a3 = (s[2] - p[2]) - (s[3] - p[3]);
+        temp[y * 4 + 0] = a0 + a2;
+        temp[y * 4 + 1] = a1 + a3;
+        temp[y * 4 + 2] = a0 - a2;
+        temp[y * 4 + 3] = a1 - a3;
+    }
+    UINT32 sum = 0;
+    for (int x = 0; x < 4; x++) {
+        int a0 = temp[x] + temp[4 + x], a1 = temp[x] - temp[4 + x];
+        int a2 = temp[8 + x] + temp[12 + x], a3 = temp[8 + x] - temp[12 + x];
+        int h[4] = { a0 + a2, a1 + a3, a0 - a2, a1 - a3 };
+        for (int i = 0; i < 4; i++) {
+            sum += static_cast<UINT32>(h[i] < 0 ? -h[i] : h[i]);
+        }
+    }
+    return (sum + 1) >> 1;
+}
+
+// ---- SIMD版 ----
+
+#if defined(H264_TRANSFORM_USE_SSE2)
+// 4バイトを読み込んで16ビットに広げる (下位4レーン)
+static inline __m128i LoadPixels4(const BYTE* p)
+{
+    int value;
+    memcpy(&value, p, 4);
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(value), _mm_setzero_si128());
+}
+
+// 下位4レーンに1行ずつ入った4本のレジスタを転置する
+static inline void Transpose4x4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    __m128i t0 = _mm_unpacklo_epi16(r0, r1);
+    __m128i t1 = _mm_unpacklo_epi16(r2, r3);
+    r0 = _mm_unpacklo_epi32(t0, t1);
+    r2 = _mm_unpackhi_epi32(t0, t1);
+    r1 = _mm_unpackhi_epi64(r0, r0);
+    r3 = _mm_unpackhi_epi64(r2, r2);
+}
+
+// 順変換のバタフライ (レジスタ間で4点を変換する)
+static inline void ForwardButterfly(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    __m128i s03 = _mm_add_epi16(r0, r3), d03 = _mm_sub_epi16(r0, r3);
+    __m128i s12 = _mm_add_epi16(r1, r2), d12 = _mm_sub_epi16(r1, r2);
+    r0 = _mm_add_epi16(s03, s12);
+    r1 = _mm_add_epi16(_mm_add_epi16(d03, d03), d12);
+    r2 = _mm_sub_epi16(s03, s12);
+    r3 = _mm_sub_epi16(d03, _mm_add_epi16(d12, d12));
+}
+
+// 逆変換のバタフライ
+static inline void InverseButterfly(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    __m128i e0 = _mm_add_epi16(r0, r2), e1 = _mm_sub_epi16(r0, r2);
+    __m128i e2 = _mm_sub_epi16(_mm_srai_epi16(r1, 1), r3), e3 = _mm_add_epi16(r1, _mm_srai_epi16(r3, 1));
+    r0 = _mm_add_epi16(e0, e3);
+    r1 = _mm_add_epi16(e1, e2);
+    r2 = _mm_sub_epi16(e1, e2);
+    r3 = _mm_sub_epi16(e0, e3);
+}
+
+// アダマール変換のバタフライ
+static inline void HadamardButterfly(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    __m128i a0 = _mm_add_epi16(r0, r1), a1 = _mm_sub_epi16(r0, r1);
+    __m128i a2 = _mm_add_epi16(r2, r3), a3 = _mm_sub_epi16(r2, r3);
+    r0 = _mm_add_epi16(a0, a2);
+    r1 = _mm_add_epi16(a1, a3);
+    r2 = _mm_sub_epi16(a0, a2);
+    r3 = _mm_sub_epi16(a1, a3);
+}
+
+static inline void LoadResidualRows(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                                    __m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+    r0 = _mm_sub_epi16(LoadPixels4(pSrc), LoadPixels4(pPred));
+    r1 = _mm_sub_epi16(LoadPixels4(pSrc + srcStride), LoadPixels4(pPred + predStride));
+    r2 = _mm_sub_epi16(LoadPixels4(pSrc + 2 * srcStride), LoadPixels4(pPred + 2 * predStride));
+    r3 = _mm_sub_epi16(LoadPixels4(pSrc + 3 * srcStride), LoadPixels4(pPred + 3 * predStride));
+}
+
+// 8係数分の量子化 (|c| * mf + bias >> qbits、符号を戻す)
+static inline __m128i QuantizeLanes(__m128i coeffs, __m128i mf, __m128i bias, __m128i shift)
+{
+    __m128i sign = _mm_srai_epi16(coeffs, 15);
+    __m128i magnitude = _mm_sub_epi16(_mm_xor_si128(coeffs, sign), sign);
+    __m128i lo = _mm_mullo_epi16(magnitude, mf);
+    __m128i hi = _mm_mulhi_epi16(magnitude, mf);
+    __m128i p0 = _mm_srl_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), bias), shift);
+    __m128i p1 = _mm_srl_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), bias), shift);
+    __m128i levels = _mm_min_epi16(_mm_packs_epi32(p0, p1), _mm_set1_epi16(H264_MAX_LEVEL));
+    return _mm_sub_epi16(_mm_xor_si128(levels, sign), sign);
+}
+#elif defined(H264_TRANSFORM_USE_NEON)
+static inline int16x4_t LoadPixels4(const BYTE* p)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return vreinterpret_s16_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(value)))));
+}
+
+static inline void Transpose4x4(int16x4_t& r0, int16x4_t& r1, int16x4_t& r2, int16x4_t& r3)
+{
+    int16x4x2_t t01 = vtrn_s16(r0, r1);
+    int16x4x2_t t23 = vtrn_s16(r2, r3);
+    int32x2x2_t even = vtrn_s32(vreinterpret_s32_s16(t01.val[0]), vreinterpret_s32_s16(t23.val[0]));
+    int32x2x2_t odd = vtrn_s32(vreinterpret_s32_s16(t01.val[1]), vreinterpret_s32_s16(t23.val[1]));
+    r0 = vreinterpret_s16_s32(even.val[0]);
+    r1 = vreinterpret_s16_s32(odd.val[0]);
+    r2 = vreinterpret_s16_s32(even.val[1]);
+    r3 = vreinterpret_s16_s32(odd.val[1]);
+}
+
+static inline void ForwardButterfly(int16x4_t& r0, int16x4_t& r1, int16x4_t& r2, int16x4_t& r3)
+{
+    int16x4_t s03 = vadd_s16(r0, r3), d03 = vsub_s16(r0, r3);
+    int16x4_t s12 = vadd_s16(r1, r2), d12 = vsub_s16(r1, r2);
+    r0 = vadd_s16(s03, s12);
+    r1 = vadd_s16(vshl_n_s16(d03, 1), d12);
+    r2 = vsub_s16(s03, s12);
+    r3 = vsub_s16(d03, vshl_n_s16(d12, 1));
+}
+
+static inline void InverseButterfly(int16x4_t& r0, int16x4_t& r1, int16x4_t& r2, int16x4_t& r3)
+{
+    int16x4_t e0 = vadd_s16(r0, r2), e1 = vsub_s16(r0, r2);
+    int16x4_t e2 = vsub_s16(vshr_n_s16(r1, 1), r3), e3 = vadd_s16(r1, vshr_n_s16(r3, 1));
+    r0 = vadd_s16(e0, e3);
+    r1 = vadd_s16(e1, e2);
+    r2 = vsub_s16(e1, e2);
+    r3 = vsub_s16(e0, e3);
+}
+
+static inline void HadamardButterfly(int16x4_t& r0, int16x4_t& r1, int16x4_t& r2, int16x4_t& r3)
+{
+    int16x4_t a0 = vadd_s16(r0, r1), a1 = vsub_s16(r0, r1);
+    int16x4_t a2 = vadd_s16(r2, r3), a3 = vsub_s16(r2, r3);
+    r0 = vadd_s16(a0, a2);
+    r1 = vadd_s16(a1, a3);
+    r2 = vsub_s16(a0, a2);
+    r3 = vsub_s16(a1, a3);
+}
+
+static inline void LoadResidualRows(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                                    int16x4_t& r0, int16x4_t& r1, int16x4_t& r2, int16x4_t& r3)
+{
+    r0 = vsub_s16(LoadPixels4(pSrc), LoadPixels4(pPred));
+    r1 = vsub_s16(LoadPixels4(pSrc + srcStride), LoadPixels4(pPred + predStride));
+    r2 = vsub_s16(LoadPixels4(pSrc + 2 * srcStride), LoadPixels4(pPred + 2 * predStride));
+    r3 = vsub_s16(LoadPixels4(pSrc + 3 * srcStride), LoadPixels4(pPred + 3 * predStride));
+}
+
+static inline int16x8_t QuantizeLanes(int16x8_t coeffs, uint16x8_t mf, uint32x4_t bias, int32x4_t shift)
+{
+    uint16x8_t magnitude = vreinterpretq_u16_s16(vabsq_s16(coeffs));
+    uint32x4_t p0 = vshlq_u32(vaddq_u32(vmull_u16(vget_low_u16(magnitude), vget_low_u16(mf)), bias), shift);
+    uint32x4_t p1 = vshlq_u32(vaddq_u32(vmull_u16(vget_high_u16(magnitude), vget_high_u16(mf)), bias), shift);
+    uint16x8_t levels = vminq_u16(vcombine_u16(vqmovn_u32(p0), vqmovn_u32(p1)), vdupq_n_u16(H264_MAX_LEVEL));
+    int16x8_t signedLevels = vreinterpretq_s16_u16(levels);
+    return vbslq_s16(vcltq_s16(coeffs, vdupq_n_s16(0)), vnegq_s16(signedLevels), signedLevels);
+}
+#endif
+
+void H264ForwardTransform4x4(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                             INT16 coeffs[16])
+{
+#if defined(H264_TRANSFORM_USE_SSE2)
+    __m128i r0, r1, r2, r3;
+    LoadResidualRows(pSrc, srcStride, pPred, predStride, r0, r1, r2, r3);
+    ForwardButterfly(r0, r1, r2, r3);  // 列方向
+    Transpose4x4(r0, r1, r2, r3);
+    ForwardButterfly(r0, r1, r2, r3);  // 行方向
+    Transpose4x4(r0, r1, r2, r3);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(coeffs), r0);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(coeffs + 4), r1);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(coeffs + 8), r2);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(coeffs + 12), r3);
+#elif defined(H264_TRANSFORM_USE_NEON)
+    int16x4_t r0, r1, r2, r3;
+    LoadResidualRows(pSrc, srcStride, pPred, predStride, r0, r1, r2, r3);
+    ForwardButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    ForwardButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    vst1_s16(coeffs, r0);
+    vst1_s16(coeffs + 4, r1);
+    vst1_s16(coeffs + 8, r2);
+    vst1_s16(coeffs + 12, r3);
+#else
+    H264ForwardTransform4x4Scalar(pSrc, srcStride, pPred, predStride, coeffs);
+#endif
+}
+
+int H264Quantize4x4(const INT16 coeffs[16], INT16 levels[16], int qp, int firstIndex)
+{
+#if defined(H264_TRANSFORM_USE_SSE2)
+    const INT16* mf = QUANT_MF[qp % 6];
+    int qbits = 15 + qp / 6;
+    __m128i bias = _mm_set1_epi32((1 << qbits) / 3);
+    __m128i shift = _mm_cvtsi32_si128(qbits);
+    __m128i l0 = QuantizeLanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(coeffs)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(mf)), bias, shift);
+    __m128i l1 = QuantizeLanes(_mm_loadu_si128(reinterpret_cast<const __m128i*>(coeffs + 8)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(mf + 8)), bias, shift);
+    if (firstIndex) {
+        l0 = _mm_and_si128(l0, _mm_setr_epi16(0, -1, -1, -1, -1, -1, -1, -1));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(levels), l0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(levels + 8), l1);
+
+    // ゼロのレーンを数える (1レーン = 2バイト)
+    const __m128i zero = _mm_setzero_si128();
+    int zeroMask = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(l0, zero), _mm_cmpeq_epi16(l1, zero)));
+    int zeros = 0;
+    for (; zeroMask; zeroMask &= zeroMask - 1) {
+        zeros++;
+    }
+    return 16 - zeros;
+#elif defined(H264_TRANSFORM_USE_NEON)
+    int qbits = 15 + qp / 6;
+    const UINT16* mf = reinterpret_cast<const UINT16*>(QUANT_MF[qp % 6]);
+    uint32x4_t bias = vdupq_n_u32((1u << qbits) / 3);
+    int32x4_t shift = vdupq_n_s32(-qbits);
+    vst1q_s16(levels, QuantizeLanes(vld1q_s16(coeffs), vld1q_u16(mf), bias, shift));
+    vst1q_s16(levels + 8, QuantizeLanes(vld1q_s16(coeffs + 8), vld1q_u16(mf + 8), bias, shift));
+    if (firstIndex) {
+        levels[0] = 0;
+    }
+    int nonZero = 0;
+    for (int i = 0; i < 16; i++) {
+        nonZero += levels[i] != 0;
+    }
+    return nonZero;
+#else
+    return H264Quantize4x4Scalar(coeffs, levels, qp, firstIndex);
+#endif
+}
+
+void H264Dequantize4x4(const INT16 levels[16], INT16 coeffs[16], int qp, int firstIndex)
+{
+#if defined(H264_TRANSFORM_USE_SSE2)
+    INT16 dc = coeffs[0];
+    const INT16* v = DEQUANT_V[qp % 6];
+    __m128i shift = _mm_cvtsi32_si128(qp / 6);
+    __m128i c0 = _mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(levels)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(v)));
+    __m128i c1 = _mm_mullo_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(levels + 8)),
+                                 _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + 8)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(coeffs), _mm_sll_epi16(c0, shift));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(coeffs + 8), _mm_sll_epi16(c1, shift));
+    if (firstIndex) {
+        coeffs[0] = dc;
+    }
+#elif defined(H264_TRANSFORM_USE_NEON)
+    INT16 dc = coeffs[0];
+    const INT16* v = DEQUANT_V[qp % 6];
+    int16x8_t shift = vdupq_n_s16(static_cast<INT16>(qp / 6));
+    vst1q_s16(coeffs, vshlq_s16(vmulq_s16(vld1q_s16(levels), vld1q_s16(v)), shift));
+    vst1q_s16(coeffs + 8, vshlq_s16(vmulq_s16(vld1q_s16(levels + 8), vld1q_s16(v + 8)), shift));
+    if (firstIndex) {
+        coeffs[0] = dc;
+    }
+#else
+    H264Dequantize4x4Scalar(levels, coeffs, qp, firstIndex);
+#endif
+}
+
+void H264InverseTransformAdd4x4(INT16 coeffs[16], BYTE* pDst, UINT32 dstStride)
+{
+#if defined(H264_TRANSFORM_USE_SSE2)
+    __m128i r0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coeffs));
+    __m128i r1 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coeffs + 4));
+    __m128i r2 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coeffs + 8));
+    __m128i r3 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(coeffs + 12));
+    // 規格どおり行方向を先に変換する (>>1 の丸めがあるため順序で結果が変わる)
+    Transpose4x4(r0, r1, r2, r3);
+    InverseButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    InverseButterfly(r0, r1, r2, r3);
+
+    const __m128i round = _mm_set1_epi16(32);
+    __m128i rows[4] = { r0, r1, r2, r3 };
+    for (int y = 0; y < 4; y++) {
+        BYTE* p = pDst + static_cast<size_t>(y) * dstStride;
+        __m128i residual = _mm_srai_epi16(_mm_add_epi16(rows[y], round), 6);
+        int value = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_add_epi16(LoadPixels4(p), residual), residual));
+        memcpy(p, &value, 4);
+    }
+#elif defined(H264_TRANSFORM_USE_NEON)
+    int16x4_t r0 = vld1_s16(coeffs), r1 = vld1_s16(coeffs + 4), r2 = vld1_s16(coeffs + 8), r3 = vld1_s16(coeffs + 12);
+    Transpose4x4(r0, r1, r2, r3);
+    InverseButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    InverseButterfly(r0, r1, r2, r3);
+
+    int16x4_t rows[4] = { r0, r1, r2, r3 };
+    for (int y = 0; y < 4; y++) {
+        BYTE* p = pDst + static_cast<size_t>(y) * dstStride;
+        int16x4_t sum = vadd_s16(LoadPixels4(p), vrshr_n_s16(rows[y], 6));
+        uint8x8_t pixels = vqmovun_s16(vcombine_s16(sum, sum));
+        uint32_t value = vget_lane_u32(vreinterpret_u32_u8(pixels), 0);
+        memcpy(p, &value, 4);
+    }
+#else
+    H264InverseTransformAdd4x4Scalar(coeffs, pDst, dstStride);
+#endif
+}
+
+UINT32 H264Satd4x4(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride)
+{
+#if defined(H264_TRANSFORM_USE_SSE2)
+    __m128i r0, r1, r2, r3;
+    LoadResidualRows(pSrc, srcStride, pPred, predStride, r0, r1, r2, r3);
+    HadamardButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    HadamardButterfly(r0, r1, r2, r3);
+
+    // 絶対値を取り、下位4レーンを32ビットに足し合わせる
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a01 = _mm_unpacklo_epi64(r0, r1), a23 = _mm_unpacklo_epi64(r2, r3);
+    a01 = _mm_max_epi16(a01, _mm_sub_epi16(zero, a01));
+    a23 = _mm_max_epi16(a23, _mm_sub_epi16(zero, a23));
+    __m128i sum = _mm_madd_epi16(_mm_add_epi16(a01, a23), _mm_set1_epi16(1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (static_cast<UINT32>(_mm_cvtsi128_si32(sum)) + 1) >> 1;
+#elif defined(H264_TRANSFORM_USE_NEON)
+    int16x4_t r0, r1, r2, r3;
+    LoadResidualRows(pSrc, srcStride, pPred, predStride, r0, r1, r2, r3);
+    HadamardButterfly(r0, r1, r2, r3);
+    Transpose4x4(r0, r1, r2, r3);
+    HadamardButterfly(r0, r1, r2, r3);
+
+    uint16x4_t sum = vadd_u16(vadd_u16(vreinterpret_u16_s16(vabs_s16(r0)), vreinterpret_u16_s16(vabs_s16(r1))),
+                              vadd_u16(vreinterpret_u16_s16(vabs_s16(r2)), vreinterpret_u16_s16(vabs_s16(r3))));
+    uint32x2_t pairs = vpaddl_u16(sum);
+    return (vget_lane_u32(pairs, 0) + vget_lane_u32(pairs, 1) + 1) >> 1;
+#else
+    return H264Satd4x4Scalar(pSrc, srcStride, pPred, predStride);
+#endif
+}
+
+// ---- DC係数 (スカラーのみ、マクロブロックごとに1回なので十分に軽い) ----
+
+// 4x4のアダマール変換 (行、列の順)
+static void Hadamard4x4(const int in[16], int out[16])
+{
+    int temp[16];
+    for (int y = 0; y < 4; y++) {
+        const int* d = in + y * 4;
+        int a0 = d[0] + d[1], a1 = d[0] - d[1], a2 = d[2] + d[3], a3 = d[2] - d[3];
+        temp[y * 4 + 0] = a0 + a2;
+        temp[y * 4 + 1] = a0 - a2;
+        temp[y * 4 + 2] = a1 - a3;
+        temp[y * 4 + 3] = a1 + a3;
+    }
+    for (int x = 0; x < 4; x++) {
+        int a0 = temp[x] + temp[4 + x], a1 = temp[x] - temp[4 + x];
+        int a2 = temp[8 + x] + temp[12 + x], a3 = temp[8 + x] - temp[12 + x];
+        out[x] = a0 + a2;
+        out[4 + x] = a0 - a2;
+        out[8 + x] = a1 - a3;
+        out[12 + x] = a1 + a3;
+    }
+}
+
+int H264QuantizeLumaDc(const INT16 dc[16], INT16 levels[16], int qp)
+{
+    int in[16], out[16];
+    for (int i = 0; i < 16; i++) {
+        in[i] = dc[i];
+    }
+    Hadamard4x4(in, out);
+
+    int qbits = 16 + qp / 6;
+    int bias = (1 << qbits) / 3;
+    int nonZero = 0;
+    for (int i = 0; i < 16; i++) {
+        levels[i] = QuantizeValue((out[i] + (out[i] > 0 ? 1 : 0)) >> 1, QUANT_MF[qp % 6][0], bias, qbits);
+        nonZero += levels[i] != 0;
+    }
+    return nonZero;
+}
+
+void H264DequantizeLumaDc(const INT16 levels[16], INT16 dc[16], int qp)
+{
+    int in[16], out[16];
+    for (int i = 0; i < 16; i++) {
+        in[i] = levels[i];
+    }
+    Hadamard4x4(in, out);
+
+    int scale = 16 * DEQUANT_V[qp % 6][0];
+    for (int i = 0; i < 16; i++) {
+        if (qp >= 36) {
+            dc[i] = static_cast<INT16>((out[i] * scale) << (qp / 6 - 6));
+        } else {
+            dc[i] = static_cast<INT16>((out[i] * scale + (1 << (5 - qp / 6))) >> (6 - qp / 6));
+        }
+    }
+}
+
+int H264QuantizeChromaDc(const INT16 dc[4], INT16 levels[4], int qp)
+{
+    int out[4] = {
+        dc[0] + dc[1] + dc[2] + dc[3],
+        dc[0] - dc[1] + dc[2] - dc[3],
+        dc[0] + dc[1] - dc[2] - dc[3],
+        dc[0] - dc[1] - dc[2] + dc[3],
+    };
+    int qbits = 16 + qp / 6;
+    int bias = (1 << qbits) / 3;
+    int nonZero = 0;
+    for (int i = 0; i < 4; i++) {
+        levels[i] = QuantizeValue(out[i], QUANT_MF[qp % 6][0], bias, qbits);
+        nonZero += levels[i] != 0;
+    }
+    return nonZero;
+}
+
+void H264DequantizeChromaDc(const INT16 levels[4], INT16 dc[4], int qp)
+{
+    int f[4] = {
+        levels[0] + levels[1] + levels[2] + levels[3],
+        levels[0] - levels[1] + levels[2] - levels[3],
+        levels[0] + levels[1] - levels[2] - levels[3],
+        levels[0] - levels[1] - levels[2] + levels[3],
+    };
+    int scale = 16 * DEQUANT_V[qp % 6][0];
+    for (int i = 0; i < 4; i++) {
+        dc[i] = static_cast<INT16>(((f[i] * scale) << (qp / 6)) >> 5);
+    }
+}
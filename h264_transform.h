@@ -0,0 +1,55 @@
+#pragma once
+
+#include "portable_types.h"
+
+// H.264の4x4整数変換・量子化・逆量子化 (フラットな量子化マトリクス、8ビット、4:2:0)
+// - 係数の並びはラスター順 (coeffs[y * 4 + x])
+// - 変換・量子化・逆変換・SATDはSIMD (SSE2/NEON) 版があり、ない環境ではスカラー版を使う
+// - 逆変換・逆量子化は規格 (8.5) の計算順どおりで、エンコーダーの再構成とデコーダーの出力が一致する
+
+// 4x4ブロックのジグザグスキャン順 (スキャン位置 -> ラスター位置)
+extern const BYTE H264_ZIGZAG_4X4[16];
+
+// 量子化レベルの絶対値の上限 (Baselineのlevel_prefixが15を超えない範囲)
+#define H264_MAX_LEVEL 2063
+
+// 輝度QPから色差QPを求める (chroma_qp_index_offset = 0)
+int H264ChromaQp(int qp);
+
+// 残差 (src - pred) を4x4整数変換する関数
+void H264ForwardTransform4x4(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                             INT16 coeffs[16]);
+
+// 変換係数を量子化する関数 (イントラの丸め、firstIndex = 1 ならDCを除く)
+// 戻り値は非ゼロのレベルの数
+int H264Quantize4x4(const INT16 coeffs[16], INT16 levels[16], int qp, int firstIndex);
+
+// レベルを逆量子化する関数 (firstIndex = 1 ならcoeffs[0]は書き換えない)
+void H264Dequantize4x4(const INT16 levels[16], INT16 coeffs[16], int qp, int firstIndex);
+
+// 逆変換した残差をpDstの予測値に加算する関数 (coeffsは作業領域として書き換える)
+void H264InverseTransformAdd4x4(INT16 coeffs[16], BYTE* pDst, UINT32 dstStride);
+
+// 4x4のSATD (アダマール変換後の絶対値和の1/2)。予測モードの選択に使う
+UINT32 H264Satd4x4(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride);
+
+// Intra16x16の輝度DC (16ブロックのDC係数、ブロック位置のラスター順) をアダマール変換して量子化する関数
+// 戻り値は非ゼロのレベルの数
+int H264QuantizeLumaDc(const INT16 dc[16], INT16 levels[16], int qp);
+
+// 輝度DCのレベルを逆アダマール変換・逆量子化する関数 (結果は各ブロックのcoeffs[0]に入れる値)
+void H264DequantizeLumaDc(const INT16 levels[16], INT16 dc[16], int qp);
+
+// 色差DC (2x2) をアダマール変換して量子化する関数 (qpは色差QP)
+int H264QuantizeChromaDc(const INT16 dc[4], INT16 levels[4], int qp);
+
+// 色差DCのレベルを逆アダマール変換・逆量子化する関数
+void H264DequantizeChromaDc(const INT16 levels[4], INT16 dc[4], int qp);
+
+// スカラー版 (検証用、SIMD版と同じ結果を返す)
+void H264ForwardTransform4x4Scalar(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride,
+                                   INT16 coeffs[16]);
+int H264Quantize4x4Scalar(const INT16 coeffs[16], INT16 levels[16], int qp, int firstIndex);
+void H264Dequantize4x4Scalar(const INT16 levels[16], INT16 coeffs[16], int qp, int firstIndex);
+void H264InverseTransformAdd4x4Scalar(INT16 coeffs[16], BYTE* pDst, UINT32 dstStride);
+UINT32 H264Satd4x4Scalar(const BYTE* pSrc, UINT32 srcStride, const BYTE* pPred, UINT32 predStride);
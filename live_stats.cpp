@@ -0,0 +1,115 @@
+#include "live_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <new>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// 別のプロセスと共有するので、アトミック変数がロックなしで実装されていること
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64-bit atomics must be lock-free to live in shared memory");
+
+LiveStatsBlock* g_liveStats = NULL;
+
+static UINT64 GetUnixTimeMs()
+{
+    return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// 共有メモリを作成する関数
+HRESULT CreateLiveStats(LiveStats* pStats, const char* name)
+{
+    if (!pStats || !name) {
+        return E_POINTER;
+    }
+    memset(pStats, 0, sizeof(*pStats));
+    const size_t size = sizeof(LiveStatsBlock);
+    // 読み手 (nal_stats) は別のユーザーでもよいので、読み取りは誰にでも許す
+    HRESULT hr = CreateSharedMemory(&pStats->memory, name, size, 0644, offsetof(LiveStatsBlock, pid));
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // カウンターを0で初期化してから、最後にmagicを書いて読み手に見せる
+    LiveStatsBlock* pBlock = new (pStats->memory.pData) LiveStatsBlock();
+    pBlock->version = LIVE_STATS_VERSION;
+    pBlock->size = static_cast<UINT32>(size);
+#ifdef _WIN32
+    pBlock->pid = GetCurrentProcessId();
+#else
+    pBlock->pid = static_cast<UINT32>(getpid());
+#endif
+    pBlock->startTimeMs.store(GetUnixTimeMs(), std::memory_order_relaxed);
+    pBlock->updateTimeMs.store(GetUnixTimeMs(), std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    pBlock->magic = LIVE_STATS_MAGIC;
+
+    pStats->pBlock = pBlock;
+    g_liveStats = pBlock;
+    printf("Live stats: %s (%zu bytes)\n", pStats->memory.name, size);
+    return S_OK;
+}
+
+// 既存の共有メモリを読み取り専用で開く関数
+HRESULT OpenLiveStats(LiveStats* pStats, const char* name)
+{
+    if (!pStats || !name) {
+        return E_POINTER;
+    }
+    memset(pStats, 0, sizeof(*pStats));
+    const size_t size = sizeof(LiveStatsBlock);
+    // 書き手を待つことはしないので、まだ作成されていなければ (S_FALSE) 見つからないのと同じ
+    HRESULT hr = OpenSharedMemory(&pStats->memory, name, size, false);
+    if (hr != S_OK) {
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+
+    pStats->pBlock = reinterpret_cast<LiveStatsBlock*>(pStats->memory.pData);
+    if (pStats->pBlock->magic != LIVE_STATS_MAGIC || pStats->pBlock->version != LIVE_STATS_VERSION ||
+        pStats->pBlock->size != size) {
+        printf("%s: unknown layout (version %u, %u bytes)\n", pStats->memory.name, pStats->pBlock->version,
+               pStats->pBlock->size);
+        CloseLiveStats(pStats);
+        return E_INVALIDARG;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return S_OK;
+}
+
+// 共有メモリを閉じる関数
+void CloseLiveStats(LiveStats* pStats)
+{
+    if (!pStats || !pStats->pBlock) {
+        return;
+    }
+    if (g_liveStats == pStats->pBlock) {
+        g_liveStats = NULL;
+    }
+    CloseSharedMemory(&pStats->memory);
+    pStats->pBlock = NULL;
+}
+
+// 計測を始める関数
+void StartLiveStatsRate(LiveStatsRateMeter* pMeter, UINT64 count)
+{
+    pMeter->lastTime = std::chrono::steady_clock::now();
+    pMeter->lastCount = count;
+}
+
+// 前回から500ms以上たっていれば、レートを書き込む関数
+void UpdateLiveStatsRate(LiveStatsRateMeter* pMeter, UINT64 count, std::atomic<UINT64>* pRate)
+{
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - pMeter->lastTime).count();
+    if (seconds < 0.5) {
+        return;
+    }
+    pRate->store(static_cast<UINT64>((count - pMeter->lastCount) * 1000.0 / seconds), std::memory_order_relaxed);
+    pMeter->lastTime = now;
+    pMeter->lastCount = count;
+    if (g_liveStats) {
+        g_liveStats->updateTimeMs.store(GetUnixTimeMs(), std::memory_order_relaxed);
+    }
+}
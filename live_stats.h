@@ -0,0 +1,97 @@
+#pragma once
+
+#include "portable_types.h"
+#include "shared_memory.h"
+#include <atomic>
+#include <chrono>
+
+// 外部の監視から読める、共有メモリ上のライブカウンター
+// - エンコード・デコードの経路からrelaxedのアトミック操作で更新するだけで、I/Oもロックもない
+// - 共有メモリの名前を知っていれば、別のプロセス (nal_stats) がいつでも読める
+// - 有効にしていないとき (g_liveStatsがNULL) は、更新はポインターの比較1回だけ
+
+// 共有メモリの既定の名前 (POSIXでは/dev/shm/nal_encoder_stats、WindowsではLocal\nal_encoder_stats)
+#define LIVE_STATS_DEFAULT_NAME "nal_encoder_stats"
+
+#define LIVE_STATS_MAGIC   0x5453564Cu  // "LVST"
+#define LIVE_STATS_VERSION 1
+
+// nal_unit_typeの数 (5ビット)
+#define LIVE_STATS_NAL_TYPES 32
+
+// 共有メモリのレイアウト (読み手と書き手で同じ定義を使う。項目を変えたらLIVE_STATS_VERSIONを上げる)
+// カウンターは単調増加、ゲージは現在の値
+struct LiveStatsBlock {
+    UINT32 magic;
+    UINT32 version;
+    UINT32 size;                       // sizeof(LiveStatsBlock)
+    UINT32 pid;                        // 書き手のプロセスID
+    std::atomic<UINT64> startTimeMs;   // 書き手が開始した時刻 (UNIX時間、ミリ秒)
+    std::atomic<UINT64> updateTimeMs;  // 最後にレートを更新した時刻 (UNIX時間、ミリ秒、止まっていないかの判定用)
+
+    // フレーム (カウンター)
+    std::atomic<UINT64> framesIn;      // 入力したフレーム (生成・取り込み)
+    std::atomic<UINT64> framesEncoded; // エンコーダーに渡したフレーム
+    std::atomic<UINT64> framesDropped; // 締め切りに間に合わず落としたフレーム
+    std::atomic<UINT64> framesSkipped; // 静止フレームとして間引いたフレーム
+    std::atomic<UINT64> samplesOut;    // エンコーダーが出力したサンプル
+    std::atomic<UINT64> framesDecoded; // デコードして出力したフレーム
+    std::atomic<UINT64> samplesCreated; // 作成したMedia Foundationのサンプル (入力・出力)
+
+    // NALユニット (カウンター、nal_unit_typeごと)
+    std::atomic<UINT64> nalCount[LIVE_STATS_NAL_TYPES];
+    std::atomic<UINT64> nalBytes[LIVE_STATS_NAL_TYPES];
+
+    // ゲージ
+    std::atomic<UINT64> encodeFpsMilli; // 直近のエンコードのフレームレート (x1000)
+    std::atomic<UINT64> decodeFpsMilli; // 直近のデコードのフレームレート (x1000)
+    std::atomic<UINT64> inputQueueDepth; // 生成済みでエンコード待ちのフレーム数
+    std::atomic<UINT64> inputPoolSize; // エンコーダーの入力プールのフレーム数
+    std::atomic<UINT64> inputPoolInUse; // 入力プールのうち、取得されて返却されていないフレーム数
+};
+
+// 共有メモリのハンドル
+struct LiveStats {
+    LiveStatsBlock* pBlock;
+    SharedMemory memory;
+};
+
+// 更新先 (有効にしていなければNULL)。更新はLIVE_STATS_ADD / LIVE_STATS_SETで行う
+extern LiveStatsBlock* g_liveStats;
+
+#define LIVE_STATS_ADD(field, value) \
+    do { if (g_liveStats) g_liveStats->field.fetch_add((value), std::memory_order_relaxed); } while (0)
+#define LIVE_STATS_SUB(field, value) \
+    do { if (g_liveStats) g_liveStats->field.fetch_sub((value), std::memory_order_relaxed); } while (0)
+#define LIVE_STATS_SET(field, value) \
+    do { if (g_liveStats) g_liveStats->field.store((value), std::memory_order_relaxed); } while (0)
+
+// NALユニット1つをタイプごとのカウンターに加える
+inline void LiveStatsAddNal(BYTE type, size_t size)
+{
+    if (g_liveStats) {
+        g_liveStats->nalCount[type & 0x1F].fetch_add(1, std::memory_order_relaxed);
+        g_liveStats->nalBytes[type & 0x1F].fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+// 共有メモリを作成し、g_liveStatsに設定する関数 (同じ名前が残っていれば、書き手が終了しているときだけ作り直す)
+HRESULT CreateLiveStats(LiveStats* pStats, const char* name);
+
+// 既存の共有メモリを読み取り専用で開く関数 (nal_statsから使う)
+HRESULT OpenLiveStats(LiveStats* pStats, const char* name);
+
+// 共有メモリを閉じる関数 (作成した側なら名前も削除し、g_liveStatsをNULLに戻す)
+void CloseLiveStats(LiveStats* pStats);
+
+// フレームレートの計測 (一定時間ごとにカウンターの増分からレートを求める)
+struct LiveStatsRateMeter {
+    std::chrono::steady_clock::time_point lastTime;
+    UINT64 lastCount;
+};
+
+// 計測を始める関数
+void StartLiveStatsRate(LiveStatsRateMeter* pMeter, UINT64 count);
+
+// 前回から500ms以上たっていれば、レート (x1000) をpRateに書き込む関数
+void UpdateLiveStatsRate(LiveStatsRateMeter* pMeter, UINT64 count, std::atomic<UINT64>* pRate);
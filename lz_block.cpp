@@ -0,0 +1,256 @@
+#include "lz_block.h"
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// LZ4のブロック形式の制約
+#define MIN_MATCH 4                    // 一致の最小長
+#define LAST_LITERALS 5                // 末尾のこのバイト数は必ずリテラルにする
+#define MF_LIMIT 12                    // 末尾からこのバイト数以内では一致を始めない
+#define MAX_OFFSET 65535               // オフセットの最大値 (16ビット)
+
+// 一致が見つからない区間では、(リテラル長 >> SKIP_SHIFT) + 1 バイトずつ飛ばして探す
+#define SKIP_SHIFT 6
+
+// 64ビット値の下位から連続する0ビットの数を返す (valueは0以外)
+static inline unsigned CountTrailingZeros64(UINT64 value)
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    if (_BitScanForward(&index, static_cast<unsigned long>(value))) {
+        return static_cast<unsigned>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    return static_cast<unsigned>(index) + 32;
+#endif
+#else
+    return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+}
+
+static inline UINT32 Read32(const BYTE* p)
+{
+    UINT32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline UINT64 Read64(const BYTE* p)
+{
+    UINT64 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// 4バイトのハッシュ (フィボナッチハッシュの上位ビット)
+static inline UINT32 HashSequence(UINT32 sequence)
+{
+    return (sequence * 2654435761u) >> (32 - 12);
+}
+
+// [ip, limit) と [ref, ...) が先頭から何バイト一致するかを返す (8バイトずつ比較する、リトルエンディアン前提)
+static size_t CountMatch(const BYTE* ip, const BYTE* ref, const BYTE* limit)
+{
+    const BYTE* start = ip;
+    while (ip + 8 <= limit) {
+        UINT64 diff = Read64(ip) ^ Read64(ref);
+        if (diff != 0) {
+            return static_cast<size_t>(ip - start) + CountTrailingZeros64(diff) / 8;
+        }
+        ip += 8;
+        ref += 8;
+    }
+    while (ip < limit && *ip == *ref) {
+        ip++;
+        ref++;
+    }
+    return static_cast<size_t>(ip - start);
+}
+
+// 15以上の長さの続き (255の並び + 残り) を書く
+static BYTE* WriteLength(BYTE* op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<BYTE>(length);
+    return op;
+}
+
+// シーケンスを1つ書く (matchLengthが0なら末尾のリテラルだけ)
+// dstに収まらなければNULLを返す
+static BYTE* WriteSequence(BYTE* op, const BYTE* opEnd, const BYTE* literals, size_t literalLength,
+                           size_t offset, size_t matchLength)
+{
+    size_t needed = 1 + literalLength / 255 + 1 + literalLength;
+    if (matchLength > 0) {
+        needed += 2 + matchLength / 255 + 1;
+    }
+    if (needed > static_cast<size_t>(opEnd - op)) {
+        return NULL;
+    }
+
+    BYTE* token = op++;
+    if (literalLength >= 15) {
+        *token = 15 << 4;
+        op = WriteLength(op, literalLength - 15);
+    } else {
+        *token = static_cast<BYTE>(literalLength << 4);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+
+    if (matchLength > 0) {
+        op[0] = static_cast<BYTE>(offset);
+        op[1] = static_cast<BYTE>(offset >> 8);
+        op += 2;
+        size_t code = matchLength - MIN_MATCH;
+        if (code >= 15) {
+            *token |= 15;
+            op = WriteLength(op, code - 15);
+        } else {
+            *token |= static_cast<BYTE>(code);
+        }
+    }
+    return op;
+}
+
+size_t CompressLzBlock(const BYTE* src, size_t srcSize, BYTE* dst, size_t dstCapacity, UINT32* pHashTable)
+{
+    if (!src || !dst || !pHashTable) {
+        return 0;
+    }
+
+    BYTE* op = dst;
+    const BYTE* opEnd = dst + dstCapacity;
+    const BYTE* anchor = src;
+    const BYTE* end = src + srcSize;
+
+    if (srcSize > MF_LIMIT) {
+        // ハッシュ表は位置 (srcからのオフセット) を持つ。古い候補は一致の確認で弾くので、0で埋めるだけでよい
+        memset(pHashTable, 0, sizeof(UINT32) * LZ_BLOCK_HASH_SIZE);
+        const BYTE* mfLimit = end - MF_LIMIT;
+        const BYTE* matchLimit = end - LAST_LITERALS;
+        const BYTE* ip = src + 1;
+
+        while (ip < mfLimit) {
+            UINT32 sequence = Read32(ip);
+            UINT32 hash = HashSequence(sequence);
+            const BYTE* ref = src + pHashTable[hash];
+            pHashTable[hash] = static_cast<UINT32>(ip - src);
+            if (ref >= ip || ip - ref > MAX_OFFSET || Read32(ref) != sequence) {
+                ip += 1 + (static_cast<size_t>(ip - anchor) >> SKIP_SHIFT);
+                continue;
+            }
+
+            // 一致を後ろ (リテラル側) にも伸ばす
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            size_t matchLength = MIN_MATCH + CountMatch(ip + MIN_MATCH, ref + MIN_MATCH, matchLimit);
+
+            op = WriteSequence(op, opEnd, anchor, static_cast<size_t>(ip - anchor),
+                               static_cast<size_t>(ip - ref), matchLength);
+            if (!op) {
+                return 0;
+            }
+            ip += matchLength;
+            anchor = ip;
+
+            // 一致の直前の位置も登録しておく (次の一致が見つかりやすくなる)
+            if (ip < mfLimit) {
+                pHashTable[HashSequence(Read32(ip - 2))] = static_cast<UINT32>(ip - 2 - src);
+            }
+        }
+    }
+
+    op = WriteSequence(op, opEnd, anchor, static_cast<size_t>(end - anchor), 0, 0);
+    if (!op) {
+        return 0;
+    }
+    return static_cast<size_t>(op - dst);
+}
+
+// 15以上の長さの続きを読む (入力の終わりを越えたらfalse)
+static bool ReadLength(const BYTE** pIp, const BYTE* ipEnd, size_t* pLength)
+{
+    const BYTE* ip = *pIp;
+    BYTE value;
+    do {
+        if (ip >= ipEnd) {
+            return false;
+        }
+        value = *ip++;
+        *pLength += value;
+    } while (value == 255);
+    *pIp = ip;
+    return true;
+}
+
+size_t DecompressLzBlock(const BYTE* src, size_t srcSize, BYTE* dst, size_t dstCapacity)
+{
+    const size_t ERROR_SIZE = static_cast<size_t>(-1);
+    if (!src || !dst) {
+        return ERROR_SIZE;
+    }
+
+    const BYTE* ip = src;
+    const BYTE* ipEnd = src + srcSize;
+    BYTE* op = dst;
+    BYTE* opEnd = dst + dstCapacity;
+
+    while (ip < ipEnd) {
+        BYTE token = *ip++;
+
+        // リテラル
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !ReadLength(&ip, ipEnd, &literalLength)) {
+            return ERROR_SIZE;
+        }
+        if (literalLength > static_cast<size_t>(ipEnd - ip) || literalLength > static_cast<size_t>(opEnd - op)) {
+            return ERROR_SIZE;
+        }
+        memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+        if (ip == ipEnd) {
+            break;                     // 最後のシーケンスはリテラルだけ
+        }
+
+        // 一致
+        if (ipEnd - ip < 2) {
+            return ERROR_SIZE;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(&ip, ipEnd, &matchLength)) {
+            return ERROR_SIZE;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst) || matchLength > static_cast<size_t>(opEnd - op)) {
+            return ERROR_SIZE;
+        }
+
+        const BYTE* ref = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, ref, matchLength);
+        } else if (offset == 1) {
+            memset(op, *ref, matchLength);   // 同じ値の連続 (差分が一定の領域で多い)
+        } else {
+            for (size_t i = 0; i < matchLength; i++) {
+                op[i] = ref[i];
+            }
+        }
+        op += matchLength;
+    }
+    return static_cast<size_t>(op - dst);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stddef.h>
+
+// LZ4のブロック形式と互換の高速な可逆圧縮
+// - シーケンス = トークン (リテラル長4ビット + 一致長4ビット) + リテラル + オフセット (16ビットLE) + 一致長の続き
+// - 圧縮は4バイトのハッシュ表で直近の一致候補を1つだけ探す貪欲法 (一致しない区間は飛ばし幅を広げる)
+// - 展開は入力と出力の範囲を検査するので、壊れたデータを渡してもバッファの外には書かない
+// フレームやスレッドの情報は持たないので、分割や並列化は呼び出し側で行う
+
+// ハッシュ表の要素数 (UINT32の配列として呼び出し側が用意する。16KB)
+#define LZ_BLOCK_HASH_SIZE (1 << 12)
+
+// srcSizeバイトを圧縮したときの最大サイズを返す
+inline size_t GetLzBlockBound(size_t srcSize)
+{
+    return srcSize + srcSize / 255 + 16;
+}
+
+// srcSizeバイトを圧縮してdstに書く関数
+// 戻り値は圧縮後のバイト数 (dstCapacityに収まらなければ0。容量をsrcSizeにすれば、縮まないデータを早く諦められる)
+size_t CompressLzBlock(const BYTE* src, size_t srcSize, BYTE* dst, size_t dstCapacity, UINT32* pHashTable);
+
+// 圧縮データを展開してdstに書く関数
+// 戻り値は展開後のバイト数 (データが壊れているか、dstCapacityに収まらなければ(size_t)-1)
+size_t DecompressLzBlock(const BYTE* src, size_t srcSize, BYTE* dst, size_t dstCapacity);
@@ -0,0 +1,112 @@
+#include "mapped_file.h"
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// ファイルを読み取り専用でメモリマップする関数
+HRESULT OpenMappedFile(MappedFile* pFile, const char* filename)
+{
+    if (!pFile || !filename) {
+        return E_POINTER;
+    }
+    pFile->pData = NULL;
+    pFile->size = 0;
+
+#ifdef _WIN32
+    pFile->hMapping = NULL;
+    pFile->hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (pFile->hFile == INVALID_HANDLE_VALUE) {
+        printf("Failed to open %s\n", filename);
+        return E_FAIL;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(pFile->hFile, &fileSize)) {
+        CloseHandle(pFile->hFile);
+        pFile->hFile = INVALID_HANDLE_VALUE;
+        return E_FAIL;
+    }
+    pFile->size = static_cast<size_t>(fileSize.QuadPart);
+    if (pFile->size == 0) {
+        return S_OK;
+    }
+    pFile->hMapping = CreateFileMappingA(pFile->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!pFile->hMapping) {
+        printf("CreateFileMapping failed for %s\n", filename);
+        CloseHandle(pFile->hFile);
+        pFile->hFile = INVALID_HANDLE_VALUE;
+        return E_FAIL;
+    }
+    pFile->pData = static_cast<const BYTE*>(MapViewOfFile(pFile->hMapping, FILE_MAP_READ, 0, 0, 0));
+    if (!pFile->pData) {
+        printf("MapViewOfFile failed for %s\n", filename);
+        CloseHandle(pFile->hMapping);
+        CloseHandle(pFile->hFile);
+        pFile->hMapping = NULL;
+        pFile->hFile = INVALID_HANDLE_VALUE;
+        return E_FAIL;
+    }
+#else
+    pFile->fd = open(filename, O_RDONLY);
+    if (pFile->fd < 0) {
+        printf("Failed to open %s\n", filename);
+        return E_FAIL;
+    }
+    struct stat st;
+    if (fstat(pFile->fd, &st) != 0) {
+        close(pFile->fd);
+        pFile->fd = -1;
+        return E_FAIL;
+    }
+    pFile->size = static_cast<size_t>(st.st_size);
+    if (pFile->size == 0) {
+        return S_OK;
+    }
+    void* pMapped = mmap(NULL, pFile->size, PROT_READ, MAP_PRIVATE, pFile->fd, 0);
+    if (pMapped == MAP_FAILED) {
+        printf("mmap failed for %s\n", filename);
+        close(pFile->fd);
+        pFile->fd = -1;
+        return E_FAIL;
+    }
+    // 先頭から1回だけ読むので先読みを強くする
+    madvise(pMapped, pFile->size, MADV_SEQUENTIAL);
+    pFile->pData = static_cast<const BYTE*>(pMapped);
+#endif
+    return S_OK;
+}
+
+// メモリマップを解除してファイルを閉じる関数
+void CloseMappedFile(MappedFile* pFile)
+{
+    if (!pFile) {
+        return;
+    }
+#ifdef _WIN32
+    if (pFile->pData) {
+        UnmapViewOfFile(pFile->pData);
+    }
+    if (pFile->hMapping) {
+        CloseHandle(pFile->hMapping);
+    }
+    if (pFile->hFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(pFile->hFile);
+    }
+    pFile->hMapping = NULL;
+    pFile->hFile = INVALID_HANDLE_VALUE;
+#else
+    if (pFile->pData) {
+        munmap(const_cast<BYTE*>(pFile->pData), pFile->size);
+    }
+    if (pFile->fd >= 0) {
+        close(pFile->fd);
+    }
+    pFile->fd = -1;
+#endif
+    pFile->pData = NULL;
+    pFile->size = 0;
+}
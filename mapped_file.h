@@ -0,0 +1,21 @@
+#pragma once
+
+#include "portable_types.h"
+
+// 読み取り専用でメモリマップしたファイル
+struct MappedFile {
+    const BYTE* pData;                 // ファイルの先頭 (空ファイルならNULL)
+    size_t size;                       // ファイルサイズ
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#else
+    int fd;
+#endif
+};
+
+// ファイルを読み取り専用でメモリマップする関数 (先頭から順に読む前提のヒントを与える)
+HRESULT OpenMappedFile(MappedFile* pFile, const char* filename);
+
+// メモリマップを解除してファイルを閉じる関数
+void CloseMappedFile(MappedFile* pFile);
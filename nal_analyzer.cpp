@@ -0,0 +1,100 @@
+// ビットストリーム解析ツール
+// 長さプレフィックス形式 (output.h264) またはAnnex Bのファイルをメモリマップして1回の走査で統計を取る
+#include "bitstream_analyzer.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s <input> [--format auto|annexb|length] [--fps <rate>] [--window <frames>]\n"
+           "          [--json <report.json>] [--csv <frames.csv>]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const char* inputFilename = argv[1];
+    const char* jsonFilename = NULL;
+    const char* csvFilename = NULL;
+    BitstreamFormat format = BITSTREAM_FORMAT_AUTO;
+    double frameRate = 30.0;           // エンコーダーの既定値に合わせる
+    UINT32 windowFrames = 0;           // 0なら1秒分
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (strcmp(name, "annexb") == 0) {
+                format = BITSTREAM_FORMAT_ANNEX_B;
+            } else if (strcmp(name, "length") == 0) {
+                format = BITSTREAM_FORMAT_LENGTH_PREFIXED;
+            } else if (strcmp(name, "auto") != 0) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            frameRate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            windowFrames = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonFilename = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csvFilename = argv[++i];
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (frameRate <= 0.0) {
+        printf("Invalid frame rate\n");
+        return 1;
+    }
+    if (windowFrames == 0) {
+        windowFrames = static_cast<UINT32>(frameRate + 0.5);
+        if (windowFrames == 0) {
+            windowFrames = 1;
+        }
+    }
+
+    MappedFile file;
+    HRESULT hr = OpenMappedFile(&file, inputFilename);
+    if (FAILED(hr)) {
+        return 1;
+    }
+
+    BitstreamStatistics stats;
+    auto start = std::chrono::steady_clock::now();
+    hr = AnalyzeBitstream(file.pData, file.size, format, frameRate, windowFrames, &stats);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CloseMappedFile(&file);
+    if (FAILED(hr)) {
+        printf("AnalyzeBitstream failed: 0x%08X\n", static_cast<unsigned int>(hr));
+        return 1;
+    }
+
+    PrintBitstreamSummary(&stats);
+    printf("Analyzed %s in %.3f s (%.1f MB/s)\n", inputFilename, elapsed,
+           elapsed > 0.0 ? stats.fileSize / elapsed / (1024.0 * 1024.0) : 0.0);
+
+    if (jsonFilename) {
+        hr = WriteBitstreamReportJson(&stats, jsonFilename);
+        if (FAILED(hr)) {
+            return 1;
+        }
+        printf("Wrote JSON report to %s\n", jsonFilename);
+    }
+    if (csvFilename) {
+        hr = WriteBitstreamReportCsv(&stats, csvFilename);
+        if (FAILED(hr)) {
+            return 1;
+        }
+        printf("Wrote per-frame CSV to %s\n", csvFilename);
+    }
+    return 0;
+}
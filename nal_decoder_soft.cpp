@@ -0,0 +1,250 @@
+#include "nal_decoder_soft.h"
+#include <string.h>
+
+// 簡素化されたエラーチェック用マクロ
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// デコーダーを初期化する関数
+HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height)
+{
+    HRESULT hr = S_OK;
+
+    pDecoder->pCore = NULL;
+    pDecoder->width = width;
+    pDecoder->height = height;
+    pDecoder->codedHeight = AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT);
+    pDecoder->frameCount = 0;
+
+    pDecoder->pCore = new H264IntraDecoder();
+    hr = InitializeH264IntraDecoder(pDecoder->pCore, 0);
+    if (FAILED(hr)) {
+        delete pDecoder->pCore;
+        pDecoder->pCore = NULL;
+    }
+    CHECK_HR(hr, "InitializeH264IntraDecoder");
+
+    printf("Software H.264 decoder: %dx%d\n", width, height);
+    return hr;
+}
+
+// 出力待ちのフレームがストリームのサイズと一致するか確認する
+static bool CheckFrameSize(NalDecoder* pDecoder, const Nv12Frame* pFrame)
+{
+    if (pFrame->width != pDecoder->width || pFrame->height != pDecoder->codedHeight) {
+        printf("Decoded frame size mismatch: %dx%d (expected %dx%d)\n",
+               pFrame->width, pFrame->height, pDecoder->width, pDecoder->codedHeight);
+        return false;
+    }
+    return true;
+}
+
+// 出力待ちのフレームを1つ、隙間なく詰めたNV12として追加する (なければS_FALSE)
+static HRESULT TakeFrameToBuffer(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData)
+{
+    Nv12Frame* pFrame = TakeDecodedH264Frame(pDecoder->pCore);
+    if (!pFrame) {
+        return S_FALSE;
+    }
+    HRESULT hr = S_OK;
+    if (CheckFrameSize(pDecoder, pFrame)) {
+        size_t currentSize = outputFrameData->size();
+        outputFrameData->resize(currentSize + GetNv12PackedSize(pFrame->width, pFrame->height));
+        CopyNv12FrameToBuffer(pFrame, outputFrameData->data() + currentSize, pFrame->width);
+        printf("Decoded frame %llu: %zu bytes of YUV data\n", static_cast<unsigned long long>(pDecoder->frameCount),
+               outputFrameData->size() - currentSize);
+        pDecoder->frameCount++;
+    } else {
+        hr = E_FAIL;
+    }
+    ReleaseDecodedH264Frame(pDecoder->pCore, pFrame);
+    return hr;
+}
+
+// 出力待ちのフレームを1つ、呼び出し側のフレームにコピーする (なければS_FALSE)
+static HRESULT TakeFrameToNv12Frame(NalDecoder* pDecoder, Nv12Frame* pOutputFrame)
+{
+    Nv12Frame* pFrame = TakeDecodedH264Frame(pDecoder->pCore);
+    if (!pFrame) {
+        return S_FALSE;
+    }
+    HRESULT hr = S_OK;
+    if (CheckFrameSize(pDecoder, pFrame)) {
+        CopyNv12Frame(pFrame, pOutputFrame);
+        pDecoder->frameCount++;
+    } else {
+        hr = E_FAIL;
+    }
+    ReleaseDecodedH264Frame(pDecoder->pCore, pFrame);
+    return hr;
+}
+
+// NALユニットをデコードして、YUVフレームデータとして返す
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, std::vector<BYTE>* outputFrameData)
+{
+    if (!outputFrameData) {
+        return E_INVALIDARG;
+    }
+    if (!pDecoder->pCore) {
+        return E_POINTER;
+    }
+
+    // NALデータが空の場合はFlush処理 (復号中のピクチャーを完了させる)
+    HRESULT hr = nalData.empty() ? FlushH264IntraDecoder(pDecoder->pCore)
+                                 : DecodeH264Nal(pDecoder->pCore, nalData.data(), nalData.size());
+
+    // 出力できたフレームをすべて追加する
+    HRESULT hrOut = S_OK;
+    while ((hrOut = TakeFrameToBuffer(pDecoder, outputFrameData)) == S_OK) {
+    }
+    return FAILED(hr) ? hr : hrOut;
+}
+
+// NALユニットをデコードして、ストライド付きフレームに直接書き込む
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded)
+{
+    return DecodeNalUnit(pDecoder, nalData.data(), nalData.size(), pOutputFrame, pFrameDecoded);
+}
+
+// NALユニットのポインターとサイズを受け取る版
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded)
+{
+    if (!pOutputFrame || !pFrameDecoded) {
+        return E_INVALIDARG;
+    }
+    if (!pDecoder->pCore) {
+        return E_POINTER;
+    }
+    if (pOutputFrame->width != pDecoder->width || pOutputFrame->height != pDecoder->codedHeight) {
+        printf("Output frame size mismatch: %dx%d\n", pOutputFrame->width, pOutputFrame->height);
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = (nalSize == 0) ? FlushH264IntraDecoder(pDecoder->pCore)
+                                : DecodeH264Nal(pDecoder->pCore, pNalData, nalSize);
+
+    // 復号に失敗しても、それまでに完了したフレームは出力する
+    HRESULT hrOut = TakeFrameToNv12Frame(pDecoder, pOutputFrame);
+    *pFrameDecoded = (hrOut == S_OK) ? TRUE : FALSE;
+    return FAILED(hr) ? hr : (FAILED(hrOut) ? hrOut : S_OK);
+}
+
+// 複数のNALユニットをまとめてデコードする関数
+HRESULT DecodeNalBatch(NalDecoder* pDecoder, const std::vector<BYTE>* pNals, size_t nalCount, DecodeBatchArena* pArena)
+{
+    if (!pArena) {
+        return E_INVALIDARG;
+    }
+    if (!pDecoder->pCore) {
+        return E_POINTER;
+    }
+    ResetDecodeBatchArena(pArena, pDecoder->width, pDecoder->height, pDecoder->codedHeight);
+
+    HRESULT hr = S_OK;
+    const size_t frameSize = GetNv12PackedSize(pDecoder->width, pDecoder->codedHeight);
+    for (size_t i = 0; i < nalCount && SUCCEEDED(hr); i++) {
+        const std::vector<BYTE>& nal = pNals[i];
+        hr = nal.empty() ? FlushH264IntraDecoder(pDecoder->pCore)
+                         : DecodeH264Nal(pDecoder->pCore, nal.data(), nal.size());
+
+        // 復号に失敗しても、それまでに完了したフレームは出力する
+        // (プールのフレームはすぐに返す。出力はフレームごとにログを出さない)
+        while (Nv12Frame* pFrame = TakeDecodedH264Frame(pDecoder->pCore)) {
+            if (CheckFrameSize(pDecoder, pFrame)) {
+                DecodeBatchItem item;
+                item.nalIndex = i;
+                item.offset = pArena->data.size();
+                item.size = frameSize;
+                pArena->data.resize(item.offset + frameSize);
+                CopyNv12FrameToBuffer(pFrame, pArena->data.data() + item.offset, pFrame->width);
+                pArena->frames.push_back(item);
+                pDecoder->frameCount++;
+            } else if (SUCCEEDED(hr)) {
+                hr = E_FAIL;
+            }
+            ReleaseDecodedH264Frame(pDecoder->pCore, pFrame);
+        }
+    }
+    return hr;
+}
+
+// デコーダーをFlushし、残りの出力フレームを取得する関数
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<std::vector<BYTE>>& flushedFrames)
+{
+    if (!pDecoder || !pDecoder->pCore) return E_POINTER;
+
+    flushedFrames.clear();
+    HRESULT hr = FlushH264IntraDecoder(pDecoder->pCore);
+    if (FAILED(hr)) {
+        printf("Decoder flush failed: 0x%08X\n", hr);
+    }
+
+    while (true) {
+        std::vector<BYTE> flushedFrameData;
+        if (TakeFrameToBuffer(pDecoder, &flushedFrameData) != S_OK) {
+            break;
+        }
+        flushedFrames.push_back(std::move(flushedFrameData));
+    }
+
+    printf("Flush completed, total %zu frames retrieved\n", flushedFrames.size());
+    return S_OK;
+}
+
+// デコーダーをFlushし、残りの出力フレームをストライド付きフレームとして取得する関数
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<Nv12Frame>& flushedFrames)
+{
+    if (!pDecoder || !pDecoder->pCore) return E_POINTER;
+    HRESULT hr = S_OK;
+
+    flushedFrames.clear();
+    hr = FlushH264IntraDecoder(pDecoder->pCore);
+    if (FAILED(hr)) {
+        printf("Decoder flush failed: 0x%08X\n", hr);
+    }
+
+    while (true) {
+        Nv12Frame frame = {0};
+        hr = AllocateNv12Frame(&frame, pDecoder->width, pDecoder->height);
+        CHECK_HR(hr, "AllocateNv12Frame for flushed frame");
+
+        if (TakeFrameToNv12Frame(pDecoder, &frame) != S_OK) {
+            FreeNv12Frame(&frame);
+            break;
+        }
+        flushedFrames.push_back(frame);
+    }
+
+    printf("Flush completed, total %zu frames retrieved\n", flushedFrames.size());
+    return S_OK;
+}
+
+// デコーダーリソースを解放する関数
+HRESULT ShutdownDecoder(NalDecoder* pDecoder)
+{
+    if (!pDecoder->pCore) {
+        return S_OK;
+    }
+
+    H264IntraDecoder* pCore = pDecoder->pCore;
+    if (pCore->decodedFrames > 0) {
+        printf("Software decoder: %llu frames, %llu slices, %llu I_PCM macroblocks\n",
+               static_cast<unsigned long long>(pCore->decodedFrames),
+               static_cast<unsigned long long>(pCore->decodedSlices),
+               static_cast<unsigned long long>(pCore->pcmMacroblocks));
+    }
+    if (pCore->concealedFrames > 0) {
+        printf("Software decoder: %llu frames concealed (%llu macroblocks)\n",
+               static_cast<unsigned long long>(pCore->concealedFrames),
+               static_cast<unsigned long long>(pCore->concealedMacroblocks));
+    }
+
+    ShutdownH264IntraDecoder(pCore);
+    delete pCore;
+    pDecoder->pCore = NULL;
+
+    printf("Decoder shutdown complete. Processed %llu frames.\n", static_cast<unsigned long long>(pDecoder->frameCount));
+    return S_OK;
+}
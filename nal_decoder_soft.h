@@ -0,0 +1,50 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stdio.h>
+#include <vector>
+#include "nv12_frame.h"
+#include "codec_batch.h"
+#include "h264_intra_decoder.h"
+
+// ソフトウェアデコーダー (イントラのみのH.264) によるNalDecoder
+// nal_decoder_win.hと同じ関数を提供するので、どちらか一方をリンクする (NAL_SOFTWARE_CODEC)
+// 対応するのはCAVLCのIスライスだけ (yuv_encoder_soft.cppの出力や、x264のイントラのみのBaselineなど)
+// ピクチャーの終わりは次のピクチャーの先頭で分かるので、出力は1ピクチャー遅れる (最後のピクチャーはFlushで出る)
+
+// NALデコーダー構造体
+struct NalDecoder {
+    H264IntraDecoder* pCore;           // イントラデコーダー本体 (スレッドを持つのでヒープに置く)
+
+    UINT32 width;                      // 映像幅
+    UINT32 height;                     // 映像高さ (表示サイズ)
+    UINT32 codedHeight;                // 符号化高さ (16の倍数にパディング)
+    UINT64 frameCount;                 // 処理したフレーム数
+};
+
+// デコーダーを初期化する関数 (heightは表示高さ、符号化高さは16の倍数に切り上げる)
+HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height);
+
+// NALユニットをデコードして、YUVフレームデータとして返す (出力できたフレームをすべて追加する)
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, std::vector<BYTE>* outputFrameData);
+
+// NALユニットをデコードして、ストライド付きフレームに直接書き込む
+// (1回の呼び出しで出力するのは最大1フレーム。残りは次の呼び出しかFlushで取得する)
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded);
+
+// 同じく、NALユニットをポインターとサイズで受け取る関数 (NalStoreのNALユニットをコピーせずに渡す用、サイズ0はFlush)
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded);
+
+// 複数のNALユニットをまとめてデコードする関数 (空のNALユニットはFlushとして扱う)
+// 出力できたフレームは隙間なく詰めたNV12としてアリーナに詰め、フレームごとに入力NALユニットの番号を付ける
+HRESULT DecodeNalBatch(NalDecoder* pDecoder, const std::vector<BYTE>* pNals, size_t nalCount, DecodeBatchArena* pArena);
+
+// デコーダーリソースを解放する関数
+HRESULT ShutdownDecoder(NalDecoder* pDecoder);
+
+// デコーダーをFlushし、残りの出力フレームを取得する関数
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<std::vector<BYTE>>& flushedFrames);
+
+// デコーダーをFlushし、残りの出力フレームをストライド付きフレームとして取得する関数
+// (取得したフレームは呼び出し側がFreeNv12Frameで解放する)
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<Nv12Frame>& flushedFrames);
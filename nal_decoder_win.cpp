@@ -24,6 +24,7 @@ HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height) {
     // パラメータ設定
     pDecoder->width = width;
     pDecoder->height = height;
+    pDecoder->codedHeight = AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT);
     
     // H.264デコーダートランスフォームの作成
     hr = CoCreateInstance(CLSID_CMSH264DecoderMFT, NULL, CLSCTX_INPROC_SERVER,
@@ -40,7 +41,7 @@ HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height) {
     hr = pDecoder->pInputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264);
     CHECK_HR(hr, "Set decoder input subtype");
     
-    hr = MFSetAttributeSize(pDecoder->pInputType, MF_MT_FRAME_SIZE, pDecoder->width, pDecoder->height);
+    hr = MFSetAttributeSize(pDecoder->pInputType, MF_MT_FRAME_SIZE, pDecoder->width, pDecoder->codedHeight);
     CHECK_HR(hr, "Set decoder input frame size");
     
     // 入力タイプをデコーダに設定
@@ -58,7 +59,7 @@ HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height) {
     hr = pDecoder->pOutputType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12);
     CHECK_HR(hr, "Set decoder output subtype");
     
-    hr = MFSetAttributeSize(pDecoder->pOutputType, MF_MT_FRAME_SIZE, pDecoder->width, pDecoder->height);
+    hr = MFSetAttributeSize(pDecoder->pOutputType, MF_MT_FRAME_SIZE, pDecoder->width, pDecoder->codedHeight);
     CHECK_HR(hr, "Set decoder output frame size");
     
     hr = pDecoder->pOutputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
@@ -72,13 +73,69 @@ HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height) {
     hr = pDecoder->pDecoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
     CHECK_HR(hr, "ProcessMessage BEGIN_STREAMING for decoder");
     
-    printf("Decoder initialized: %dx%d\n", pDecoder->width, pDecoder->height);
+    printf("Decoder initialized: %dx%d (coded %dx%d)\n", pDecoder->width, pDecoder->height,
+           pDecoder->width, pDecoder->codedHeight);
     
     return hr;
 }
 
+// デコード済みサンプルのYUVデータを出力先（ベクターまたはフレーム）に格納する内部関数
+static HRESULT StoreDecodedSample(NalDecoder* pDecoder, IMFSample* pOutSample,
+                                  std::vector<BYTE>* outputFrameData, Nv12Frame* pOutputFrame)
+{
+    HRESULT hr = S_OK;
+    IMFMediaBuffer* pBuffer = NULL;
+    hr = pOutSample->ConvertToContiguousBuffer(&pBuffer);
+    CHECK_HR(hr, "ConvertToContiguousBuffer for decoder output");
+
+    // フレームへの出力では、2Dバッファのピッチを使ってストライドの違いを吸収する
+    IMF2DBuffer* p2DBuffer = NULL;
+    if (pOutputFrame && SUCCEEDED(pBuffer->QueryInterface(IID_PPV_ARGS(&p2DBuffer)))) {
+        BYTE* pScanline0 = NULL;
+        LONG pitch = 0;
+        hr = p2DBuffer->Lock2D(&pScanline0, &pitch);
+        if (SUCCEEDED(hr)) {
+            CopyBufferToNv12Frame(pScanline0, static_cast<UINT32>(pitch), pDecoder->codedHeight, pOutputFrame);
+            printf("Decoded frame %llu: pitch %d\n", pDecoder->frameCount, pitch);
+            pDecoder->frameCount++;
+            hr = p2DBuffer->Unlock2D();
+        }
+        p2DBuffer->Release();
+        pBuffer->Release();
+        CHECK_HR(hr, "Lock2D decoder output buffer");
+        return hr;
+    }
+
+    BYTE* pYuvData = NULL;
+    DWORD yuvMaxLength = 0;
+    DWORD yuvCurrentLength = 0;
+    hr = pBuffer->Lock(&pYuvData, &yuvMaxLength, &yuvCurrentLength);
+    CHECK_HR(hr, "Lock decoder output buffer");
+
+    if (yuvCurrentLength > 0 && pYuvData != NULL) {
+        if (pOutputFrame) {
+            // 2Dバッファでなければ、幅と同じピッチで詰められている
+            CopyBufferToNv12Frame(pYuvData, pDecoder->width, pDecoder->codedHeight, pOutputFrame);
+        } else {
+            // 出力ベクターのサイズを設定（既存データがあれば追加）してYUVデータをコピー
+            size_t currentSize = outputFrameData->size();
+            outputFrameData->resize(currentSize + yuvCurrentLength);
+            memcpy(outputFrameData->data() + currentSize, pYuvData, yuvCurrentLength);
+        }
+        printf("Decoded frame %llu: %d bytes of YUV data\n", pDecoder->frameCount, yuvCurrentLength);
+        pDecoder->frameCount++;
+    }
+
+    hr = pBuffer->Unlock();
+    CHECK_HR(hr, "Unlock decoder output buffer");
+    if (pBuffer) {
+        pBuffer->Release();
+    }
+    return hr;
+}
+
 // 空のNALユニット（Flush時）を処理する内部関数
-HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData) {
+HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData, Nv12Frame* pOutputFrame) {
     HRESULT hr = S_OK;
     MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
     DWORD processOutputStatus = 0;
@@ -88,7 +145,7 @@ HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrame
     hr = MFCreateSample(&pOutSample);
     CHECK_HR(hr, "MFCreateSample for decoder output");
     IMFMediaBuffer* pOutBuffer = NULL;
-    UINT32 nv12Size = pDecoder->width * pDecoder->height * 3 / 2;
+    UINT32 nv12Size = pDecoder->width * pDecoder->codedHeight * 3 / 2;
     hr = MFCreateMemoryBuffer(nv12Size, &pOutBuffer);
     CHECK_HR(hr, "MFCreateMemoryBuffer for decoder output");
     hr = pOutSample->AddBuffer(pOutBuffer);
@@ -113,26 +170,7 @@ HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrame
         return hr;
     } else if (SUCCEEDED(hr)) {
         // 出力バッファからYUVデータを取得
-        IMFMediaBuffer* pBuffer = NULL;
-        hr = pOutSample->ConvertToContiguousBuffer(&pBuffer);
-        CHECK_HR(hr, "ConvertToContiguousBuffer for decoder output");
-        BYTE* pYuvData = NULL;
-        DWORD yuvMaxLength = 0;
-        DWORD yuvCurrentLength = 0;
-        hr = pBuffer->Lock(&pYuvData, &yuvMaxLength, &yuvCurrentLength);
-        CHECK_HR(hr, "Lock decoder output buffer");
-        if (yuvCurrentLength > 0 && pYuvData != NULL) {
-            size_t currentSize = outputFrameData->size();
-            outputFrameData->resize(currentSize + yuvCurrentLength);
-            memcpy(outputFrameData->data() + currentSize, pYuvData, yuvCurrentLength);
-            printf("Decoded frame %llu: %d bytes of YUV data\n", pDecoder->frameCount, yuvCurrentLength);
-            pDecoder->frameCount++;
-        }
-        hr = pBuffer->Unlock();
-        CHECK_HR(hr, "Unlock decoder output buffer");
-        if (pBuffer) {
-            pBuffer->Release();
-        }
+        hr = StoreDecodedSample(pDecoder, pOutSample, outputFrameData, pOutputFrame);
     } else {
         CHECK_HR(hr, "ProcessOutput for decoder");
     }
@@ -145,6 +183,10 @@ HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrame
 
 // NALデータを入力として処理する内部関数
 HRESULT ProcessNalInput(NalDecoder* pDecoder, const std::vector<BYTE>& nalData) {
+    return ProcessNalInput(pDecoder, nalData.data(), nalData.size());
+}
+
+HRESULT ProcessNalInput(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize) {
     HRESULT hr = S_OK;
     
     // 入力サンプルの作成
@@ -154,7 +196,7 @@ HRESULT ProcessNalInput(NalDecoder* pDecoder, const std::vector<BYTE>& nalData)
     hr = MFCreateSample(&pInSample);
     CHECK_HR(hr, "MFCreateSample for decoder input");
 
-    hr = MFCreateMemoryBuffer(static_cast<DWORD>(nalData.size()), &pInBuffer);
+    hr = MFCreateMemoryBuffer(static_cast<DWORD>(nalSize), &pInBuffer);
     CHECK_HR(hr, "MFCreateMemoryBuffer for decoder input");
 
     // NALデータをバッファにコピー
@@ -165,8 +207,8 @@ HRESULT ProcessNalInput(NalDecoder* pDecoder, const std::vector<BYTE>& nalData)
     hr = pInBuffer->Lock(&pData, &maxLength, &currentLength);
     CHECK_HR(hr, "Lock decoder input buffer");
 
-    memcpy(pData, nalData.data(), nalData.size());
-    hr = pInBuffer->SetCurrentLength(static_cast<DWORD>(nalData.size()));
+    memcpy(pData, pNalData, nalSize);
+    hr = pInBuffer->SetCurrentLength(static_cast<DWORD>(nalSize));
     CHECK_HR(hr, "SetCurrentLength for decoder input");
 
     hr = pInBuffer->Unlock();
@@ -198,7 +240,8 @@ HRESULT ProcessNalInput(NalDecoder* pDecoder, const std::vector<BYTE>& nalData)
 }
 
 // デコーダー出力を処理する内部関数
-HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData) {
+// pOutputFrameを指定した場合は、1フレーム取得した時点で終了する
+HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData, Nv12Frame* pOutputFrame) {
     HRESULT hr = S_OK;
     MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
     DWORD processOutputStatus = 0;
@@ -213,7 +256,7 @@ HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFram
 
         // 出力バッファを作成
         IMFMediaBuffer* pOutBuffer = NULL;
-        UINT32 nv12Size = pDecoder->width * pDecoder->height * 3 / 2; // NV12のサイズ
+        UINT32 nv12Size = pDecoder->width * pDecoder->codedHeight * 3 / 2; // NV12のサイズ
 
         hr = MFCreateMemoryBuffer(nv12Size, &pOutBuffer);
         CHECK_HR(hr, "MFCreateMemoryBuffer for decoder output");
@@ -246,37 +289,8 @@ HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFram
             break;
         } else if (SUCCEEDED(hr)) {
             // デコード成功、YUVデータを取得
-            IMFMediaBuffer* pBuffer = NULL;
-            hr = pOutSample->ConvertToContiguousBuffer(&pBuffer);
-            CHECK_HR(hr, "ConvertToContiguousBuffer for decoder output");
-
-            BYTE* pYuvData = NULL;
-            DWORD yuvMaxLength = 0;
-            DWORD yuvCurrentLength = 0;
-
-            hr = pBuffer->Lock(&pYuvData, &yuvMaxLength, &yuvCurrentLength);
-            CHECK_HR(hr, "Lock decoder output buffer");
-
-            // YUVデータを出力ベクターにコピー
-            if (yuvCurrentLength > 0 && pYuvData != NULL) {
-                // 出力ベクターのサイズを設定（既存データがあれば追加）
-                size_t currentSize = outputFrameData->size();
-                outputFrameData->resize(currentSize + yuvCurrentLength);
-
-                // YUVデータをコピー
-                memcpy(outputFrameData->data() + currentSize, pYuvData, yuvCurrentLength);
-
-                printf("Decoded frame %llu: %d bytes of YUV data\n", pDecoder->frameCount, yuvCurrentLength);
-                pDecoder->frameCount++;
-            }
-
-            hr = pBuffer->Unlock();
-            CHECK_HR(hr, "Unlock decoder output buffer");
-
-            if (pBuffer) {
-                pBuffer->Release();
-                pBuffer = NULL;
-            }
+            hr = StoreDecodedSample(pDecoder, pOutSample, outputFrameData, pOutputFrame);
+            CHECK_HR(hr, "StoreDecodedSample");
         } else {
             // その他のエラー
             CHECK_HR(hr, "ProcessOutput for decoder");
@@ -287,6 +301,11 @@ HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFram
             pOutSample->Release();
             pOutSample = NULL;
         }
+
+        // フレームへの出力は1回につき1フレームまで
+        if (pOutputFrame) {
+            break;
+        }
     } while (SUCCEEDED(hr));
 
     return hr;
@@ -301,7 +320,7 @@ HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, st
 
     // NALデータが空の場合はFlush処理（ProcessInputを呼ばず、ProcessOutputのみ実行）
     if (nalData.empty()) {
-        return ProcessEmptyNalUnit(pDecoder, outputFrameData);
+        return ProcessEmptyNalUnit(pDecoder, outputFrameData, NULL);
     }
 
     // 通常のNALデータ処理
@@ -311,7 +330,205 @@ HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, st
     }
 
     // デコード出力の処理
-    return ProcessDecoderOutput(pDecoder, outputFrameData);
+    return ProcessDecoderOutput(pDecoder, outputFrameData, NULL);
+}
+
+// NALユニットをデコードして、ストライド付きフレームに直接書き込む
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded) {
+    return DecodeNalUnit(pDecoder, nalData.data(), nalData.size(), pOutputFrame, pFrameDecoded);
+}
+
+// NALユニットのポインターとサイズを受け取る版
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded) {
+    // 出力パラメータの検証
+    if (!pOutputFrame || !pFrameDecoded) {
+        return E_INVALIDARG;
+    }
+    if (pOutputFrame->width != pDecoder->width || pOutputFrame->height != pDecoder->codedHeight) {
+        printf("Output frame size mismatch: %dx%d\n", pOutputFrame->width, pOutputFrame->height);
+        return E_INVALIDARG;
+    }
+
+    UINT64 frameCountBefore = pDecoder->frameCount;
+    HRESULT hr = S_OK;
+
+    // NALデータが空の場合はFlush処理（ProcessInputを呼ばず、ProcessOutputのみ実行）
+    if (nalSize == 0) {
+        hr = ProcessEmptyNalUnit(pDecoder, NULL, pOutputFrame);
+    } else {
+        hr = ProcessNalInput(pDecoder, pNalData, nalSize);
+        if (SUCCEEDED(hr)) {
+            hr = ProcessDecoderOutput(pDecoder, NULL, pOutputFrame);
+        }
+    }
+
+    *pFrameDecoded = (pDecoder->frameCount != frameCountBefore) ? TRUE : FALSE;
+    return hr;
+}
+
+// デコード済みサンプルのYUVデータをアリーナに追加する内部関数 (フレームごとのログは出さない)
+static HRESULT AppendDecodedSampleToArena(NalDecoder* pDecoder, IMFSample* pOutSample, DecodeBatchArena* pArena, size_t nalIndex)
+{
+    HRESULT hr = S_OK;
+    IMFMediaBuffer* pBuffer = NULL;
+    hr = pOutSample->ConvertToContiguousBuffer(&pBuffer);
+    CHECK_HR(hr, "ConvertToContiguousBuffer for decoder output");
+    
+    BYTE* pYuvData = NULL;
+    DWORD yuvMaxLength = 0;
+    DWORD yuvCurrentLength = 0;
+    hr = pBuffer->Lock(&pYuvData, &yuvMaxLength, &yuvCurrentLength);
+    if (SUCCEEDED(hr)) {
+        if (yuvCurrentLength > 0 && pYuvData != NULL) {
+            DecodeBatchItem item;
+            item.nalIndex = nalIndex;
+            item.offset = pArena->data.size();
+            item.size = yuvCurrentLength;
+            pArena->data.insert(pArena->data.end(), pYuvData, pYuvData + yuvCurrentLength);
+            pArena->frames.push_back(item);
+            pDecoder->frameCount++;
+        }
+        hr = pBuffer->Unlock();
+    }
+    pBuffer->Release();
+    CHECK_HR(hr, "Lock decoder output buffer");
+    return hr;
+}
+
+// 出力できるフレームをすべてアリーナに取り出す内部関数 (出力サンプルは使い回す)
+static HRESULT DrainDecoderToArena(NalDecoder* pDecoder, IMFSample* pOutSample, DecodeBatchArena* pArena, size_t nalIndex)
+{
+    HRESULT hr = S_OK;
+    while (true) {
+        IMFMediaBuffer* pOutBuffer = NULL;
+        if (SUCCEEDED(pOutSample->GetBufferByIndex(0, &pOutBuffer))) {
+            pOutBuffer->SetCurrentLength(0);
+            pOutBuffer->Release();
+        }
+        
+        MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
+        DWORD processOutputStatus = 0;
+        outputDataBuffer.dwStreamID = 0;
+        outputDataBuffer.pSample = pOutSample;
+        hr = pDecoder->pDecoder->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
+        if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+            return S_OK;
+        }
+        CHECK_HR(hr, "ProcessOutput for decoder");
+        
+        hr = AppendDecodedSampleToArena(pDecoder, pOutSample, pArena, nalIndex);
+        CHECK_HR(hr, "AppendDecodedSampleToArena");
+    }
+}
+
+// 複数のNALユニットをまとめてデコードする関数
+// NALユニットはバッチ全体で1つの入力バッファに詰め、NALユニットごとにその一部を指すラッパーを入力する
+// (入力データの確保はバッチで1回、出力サンプルもバッチ内で使い回す)
+HRESULT DecodeNalBatch(NalDecoder* pDecoder, const std::vector<BYTE>* pNals, size_t nalCount, DecodeBatchArena* pArena) {
+    HRESULT hr = S_OK;
+    if (!pArena) {
+        return E_INVALIDARG;
+    }
+    if (!pDecoder->pDecoder) {
+        return E_POINTER;
+    }
+    ResetDecodeBatchArena(pArena, pDecoder->width, pDecoder->height, pDecoder->codedHeight);
+    
+    // 入力バッファ（バッチの全NALユニットを続けて詰める）
+    size_t totalSize = 0;
+    for (size_t i = 0; i < nalCount; i++) {
+        totalSize += pNals[i].size();
+    }
+    IMFMediaBuffer* pBatchBuffer = NULL;
+    if (totalSize > 0) {
+        hr = MFCreateMemoryBuffer(static_cast<DWORD>(totalSize), &pBatchBuffer);
+        CHECK_HR(hr, "MFCreateMemoryBuffer for decoder batch input");
+        
+        BYTE* pData = NULL;
+        DWORD maxLength = 0;
+        hr = pBatchBuffer->Lock(&pData, &maxLength, NULL);
+        if (SUCCEEDED(hr)) {
+            for (size_t i = 0; i < nalCount; i++) {
+                if (!pNals[i].empty()) {
+                    memcpy(pData, pNals[i].data(), pNals[i].size());
+                    pData += pNals[i].size();
+                }
+            }
+            pBatchBuffer->SetCurrentLength(static_cast<DWORD>(totalSize));
+            pBatchBuffer->Unlock();
+        }
+        if (FAILED(hr)) {
+            pBatchBuffer->Release();
+        }
+        CHECK_HR(hr, "Lock decoder batch input");
+    }
+    
+    // 出力サンプル（バッチ内で使い回す）
+    IMFSample* pOutSample = NULL;
+    IMFMediaBuffer* pOutBuffer = NULL;
+    hr = MFCreateSample(&pOutSample);
+    if (SUCCEEDED(hr)) {
+        hr = MFCreateMemoryBuffer(pDecoder->width * pDecoder->codedHeight * 3 / 2, &pOutBuffer);
+        if (SUCCEEDED(hr)) {
+            hr = pOutSample->AddBuffer(pOutBuffer);
+            pOutBuffer->Release();
+        }
+        if (FAILED(hr)) {
+            pOutSample->Release();
+        }
+    }
+    if (FAILED(hr)) {
+        if (pBatchBuffer) {
+            pBatchBuffer->Release();
+        }
+        CHECK_HR(hr, "Create decoder output sample");
+    }
+    
+    DWORD offset = 0;
+    for (size_t i = 0; i < nalCount && SUCCEEDED(hr); i++) {
+        DWORD nalSize = static_cast<DWORD>(pNals[i].size());
+        
+        // NALデータが空の場合はFlush処理（ProcessInputを呼ばず、出力だけを取り出す）
+        if (nalSize > 0) {
+            IMFMediaBuffer* pWrapper = NULL;
+            IMFSample* pInSample = NULL;
+            hr = MFCreateMediaBufferWrapper(pBatchBuffer, offset, nalSize, &pWrapper);
+            if (SUCCEEDED(hr)) {
+                pWrapper->SetCurrentLength(nalSize);
+                hr = MFCreateSample(&pInSample);
+                if (SUCCEEDED(hr)) {
+                    hr = pInSample->AddBuffer(pWrapper);
+                }
+                pWrapper->Release();
+            }
+            if (SUCCEEDED(hr)) {
+                hr = pDecoder->pDecoder->ProcessInput(0, pInSample, 0);
+                if (hr == MF_E_NOTACCEPTING) {
+                    // 出力を取り出してから入れ直す
+                    hr = DrainDecoderToArena(pDecoder, pOutSample, pArena, i);
+                    if (SUCCEEDED(hr)) {
+                        hr = pDecoder->pDecoder->ProcessInput(0, pInSample, 0);
+                    }
+                }
+            }
+            if (pInSample) {
+                pInSample->Release();
+            }
+            if (FAILED(hr)) {
+                printf("Batch decode input %zu failed: 0x%08X\n", i, hr);
+                break;
+            }
+            offset += nalSize;
+        }
+        
+        hr = DrainDecoderToArena(pDecoder, pOutSample, pArena, i);
+    }
+    
+    pOutSample->Release();
+    if (pBatchBuffer) {
+        pBatchBuffer->Release();
+    }
+    return hr;
 }
 
 // デコーダーをFlushし、残りの出力フレームを取得する関数
@@ -352,6 +569,42 @@ HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<std::vector<BYTE>>& flush
     return S_OK;
 }
 
+// デコーダーをFlushし、残りの出力フレームをストライド付きフレームとして取得する関数
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<Nv12Frame>& flushedFrames) {
+    if (!pDecoder || !pDecoder->pDecoder) return E_POINTER;
+    HRESULT hr = S_OK;
+
+    flushedFrames.clear();
+
+    // Drainメッセージを送信
+    hr = pDecoder->pDecoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0);
+    if (FAILED(hr)) {
+        printf("Decoder drain command failed: 0x%08X\n", hr);
+        return hr;
+    }
+
+    // 残りの出力フレームを取得
+    while (true) {
+        Nv12Frame frame = {0};
+        hr = AllocateNv12Frame(&frame, pDecoder->width, pDecoder->height);
+        CHECK_HR(hr, "AllocateNv12Frame for flushed frame");
+
+        BOOL frameDecoded = FALSE;
+        HRESULT hrOut = DecodeNalUnit(pDecoder, std::vector<BYTE>(), &frame, &frameDecoded);
+        if (FAILED(hrOut) || !frameDecoded) {
+            FreeNv12Frame(&frame);
+            if (hrOut != MF_E_TRANSFORM_NEED_MORE_INPUT && FAILED(hrOut)) {
+                printf("Flush decode failed: 0x%08X\n", hrOut);
+            }
+            break;
+        }
+        flushedFrames.push_back(frame);
+    }
+
+    printf("Flush completed, total %zu frames retrieved\n", flushedFrames.size());
+    return S_OK;
+}
+
 // デコーダーリソースを解放する関数
 HRESULT ShutdownDecoder(NalDecoder* pDecoder) {
     HRESULT hr = S_OK;
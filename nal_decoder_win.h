@@ -9,6 +9,8 @@
 #include <vector>
 #include <fstream>
 #include <string>
+#include "nv12_frame.h"
+#include "codec_batch.h"
 
 // NALデコーダー構造体
 struct NalDecoder {
@@ -17,23 +19,40 @@ struct NalDecoder {
     IMFMediaType* pOutputType;         // 出力メディアタイプ
     
     UINT32 width;                      // 映像幅
-    UINT32 height;                     // 映像高さ
+    UINT32 height;                     // 映像高さ (表示サイズ)
+    UINT32 codedHeight;                // 符号化高さ (16の倍数にパディング)
     UINT64 frameCount;                 // 処理したフレーム数
 };
 
-// デコーダーを初期化する関数
+// デコーダーを初期化する関数 (heightは表示高さ、符号化高さは16の倍数に切り上げる)
 HRESULT InitializeDecoder(NalDecoder* pDecoder, UINT32 width, UINT32 height);
 
 // NALユニットをデコードして、YUVフレームデータとして返す
 HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, std::vector<BYTE>* outputFrameData);
 
+// NALユニットをデコードして、ストライド付きフレームに直接書き込む
+// (1回の呼び出しで出力するのは最大1フレーム。残りは次の呼び出しかFlushで取得する)
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const std::vector<BYTE>& nalData, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded);
+
+// 同じく、NALユニットをポインターとサイズで受け取る関数 (NalStoreのNALユニットをコピーせずに渡す用、サイズ0はFlush)
+HRESULT DecodeNalUnit(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize, Nv12Frame* pOutputFrame, BOOL* pFrameDecoded);
+
+// 複数のNALユニットをまとめてデコードする関数 (空のNALユニットはFlushとして扱う)
+// 出力できたフレームはYUVデータとしてアリーナに詰め、フレームごとに入力NALユニットの番号を付ける
+HRESULT DecodeNalBatch(NalDecoder* pDecoder, const std::vector<BYTE>* pNals, size_t nalCount, DecodeBatchArena* pArena);
+
 // デコーダーリソースを解放する関数
 HRESULT ShutdownDecoder(NalDecoder* pDecoder);
 
 // デコーダーをFlushし、残りの出力フレームを取得する関数
 HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<std::vector<BYTE>>& flushedFrames);
 
+// デコーダーをFlushし、残りの出力フレームをストライド付きフレームとして取得する関数
+// (取得したフレームは呼び出し側がFreeNv12Frameで解放する)
+HRESULT FlushDecoder(NalDecoder* pDecoder, std::vector<Nv12Frame>& flushedFrames);
+
 // リファクタリング用の内部関数（外部からは呼ばないでください）
-HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData);
+HRESULT ProcessEmptyNalUnit(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData, Nv12Frame* pOutputFrame);
 HRESULT ProcessNalInput(NalDecoder* pDecoder, const std::vector<BYTE>& nalData);
-HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData);
\ No newline at end of file
+HRESULT ProcessNalInput(NalDecoder* pDecoder, const BYTE* pNalData, size_t nalSize);
+HRESULT ProcessDecoderOutput(NalDecoder* pDecoder, std::vector<BYTE>* outputFrameData, Nv12Frame* pOutputFrame);
\ No newline at end of file
@@ -0,0 +1,260 @@
+#include "nal_emulation.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NAL_EMULATION_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NAL_EMULATION_USE_NEON 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 挿入位置が見つからなかったことを表す値
+static const size_t NO_POSITION = static_cast<size_t>(-1);
+
+// 64ビット値の下位から連続する0ビットの数を返す (valueは0以外)
+static inline unsigned CountTrailingZeros64(UINT64 value)
+{
+#ifdef _MSC_VER
+    unsigned long index = 0;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, value);
+    return static_cast<unsigned>(index);
+#else
+    if (_BitScanForward(&index, static_cast<unsigned long>(value))) {
+        return static_cast<unsigned>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    return static_cast<unsigned>(index) + 32;
+#endif
+#else
+    return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+}
+
+// [pos, size) の範囲で 00 00 が始まる最初の位置を返す (見つからなければsize)
+size_t FindZeroPair(const BYTE* data, size_t pos, size_t size)
+{
+#if defined(NAL_EMULATION_USE_SSE2)
+    // 64バイトずつ、data[i] == 0 && data[i+1] == 0 となるiをビットマスクで求める
+    const __m128i zero = _mm_setzero_si128();
+    while (pos + 65 <= size) {
+        UINT64 mask = 0;
+        for (int k = 0; k < 4; k++) {
+            const BYTE* p = data + pos + k * 16;
+            __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero);
+            __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), zero);
+            UINT64 bits = static_cast<UINT32>(_mm_movemask_epi8(_mm_and_si128(a, b)));
+            mask |= bits << (k * 16);
+        }
+        if (mask) {
+            return pos + CountTrailingZeros64(mask);
+        }
+        pos += 64;
+    }
+#elif defined(NAL_EMULATION_USE_NEON)
+    // 16バイトごとに比較結果を4ビット/バイトのマスクに縮めて判定する
+    const uint8x16_t zero = vdupq_n_u8(0);
+    while (pos + 65 <= size) {
+        for (int k = 0; k < 4; k++) {
+            const BYTE* p = data + pos + k * 16;
+            uint8x16_t a = vceqq_u8(vld1q_u8(p), zero);
+            uint8x16_t b = vceqq_u8(vld1q_u8(p + 1), zero);
+            uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(a, b)), 4);
+            UINT64 mask = vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+            if (mask) {
+                return pos + k * 16 + CountTrailingZeros64(mask) / 4;
+            }
+        }
+        pos += 64;
+    }
+#else
+    // 64ビット単位でゼロバイトの有無を調べ、ゼロを含む語だけスカラーで判定する
+    const UINT64 ones = 0x0101010101010101ULL;
+    const UINT64 highs = 0x8080808080808080ULL;
+    while (pos + 9 <= size) {
+        UINT64 word;
+        memcpy(&word, data + pos, sizeof(word));
+        if ((word - ones) & ~word & highs) {
+            for (size_t i = pos; i < pos + 8; i++) {
+                if (data[i] == 0 && data[i + 1] == 0) {
+                    return i;
+                }
+            }
+        }
+        pos += 8;
+    }
+#endif
+
+    // 末尾はスカラーで判定
+    for (size_t i = pos; i + 1 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// scan以降で、次にエミュレーション防止バイトを挿入すべき位置を返す (なければNO_POSITION)
+// 戻り値の位置 (00 00 の直後) に0x03を挿入する
+static size_t FindInsertionPoint(const BYTE* src, size_t scan, size_t size)
+{
+    while (true) {
+        size_t z = FindZeroPair(src, scan, size);
+        if (z >= size) {
+            return NO_POSITION;
+        }
+        // 00 00 に 00..03 が続くか、RBSPが 00 00 で終わる場合に挿入する
+        if (z + 2 == size || src[z + 2] <= 0x03) {
+            return z + 2;
+        }
+        scan = z + 1;
+    }
+}
+
+// EBSPをRBSPに変換する関数 (dst == src のインプレース変換も可)
+size_t EbspToRbsp(const BYTE* src, size_t size, BYTE* dst)
+{
+    size_t copyFrom = 0;
+    size_t written = 0;
+    size_t scan = 0;
+
+    while (true) {
+        size_t z = FindZeroPair(src, scan, size);
+        if (z + 2 >= size) {
+            break;
+        }
+        if (src[z + 2] == 0x03) {
+            // 00 00 までをまとめて移動し、0x03を読み飛ばす
+            size_t length = z + 2 - copyFrom;
+            memmove(dst + written, src + copyFrom, length);
+            written += length;
+            copyFrom = z + 3;
+            scan = z + 3;
+        } else {
+            scan = z + 1;
+        }
+    }
+
+    size_t rest = size - copyFrom;
+    memmove(dst + written, src + copyFrom, rest);
+    return written + rest;
+}
+
+// ベクター内のoffset以降をインプレースでRBSPに変換し、サイズを縮める関数
+size_t EbspToRbspInPlace(std::vector<BYTE>& nal, size_t offset)
+{
+    if (offset >= nal.size()) {
+        return 0;
+    }
+    BYTE* p = nal.data() + offset;
+    size_t size = nal.size() - offset;
+    size_t converted = EbspToRbsp(p, size, p);
+    nal.resize(offset + converted);
+    return size - converted;
+}
+
+// RBSPをEBSPに変換してebspの末尾に追加する関数
+size_t RbspToEbsp(const BYTE* src, size_t size, std::vector<BYTE>& ebsp)
+{
+    size_t inserted = 0;
+    size_t copyFrom = 0;
+    size_t position = FindInsertionPoint(src, 0, size);
+
+    // 挿入は数百バイトに1回程度なので、少し余裕を持って確保しておく
+    ebsp.reserve(ebsp.size() + size + size / 128 + 4);
+
+    while (position != NO_POSITION) {
+        ebsp.insert(ebsp.end(), src + copyFrom, src + position);
+        ebsp.push_back(0x03);
+        inserted++;
+        copyFrom = position;
+        if (position >= size) {
+            break;
+        }
+        position = FindInsertionPoint(src, position, size);
+    }
+
+    ebsp.insert(ebsp.end(), src + copyFrom, src + size);
+    return inserted;
+}
+
+// ベクター内のoffset以降をインプレースでEBSPに変換する関数
+size_t RbspToEbspInPlace(std::vector<BYTE>& nal, size_t offset)
+{
+    if (offset >= nal.size()) {
+        return 0;
+    }
+
+    // 1回目: 挿入位置を記録する
+    const size_t size = nal.size() - offset;
+    std::vector<size_t> positions;
+    size_t position = FindInsertionPoint(nal.data() + offset, 0, size);
+    while (position != NO_POSITION) {
+        positions.push_back(position);
+        if (position >= size) {
+            break;
+        }
+        position = FindInsertionPoint(nal.data() + offset, position, size);
+    }
+    if (positions.empty()) {
+        return 0;
+    }
+
+    // 2回目: 末尾から区間ごとに後ろへずらし、空いた位置に0x03を置く
+    nal.resize(nal.size() + positions.size());
+    BYTE* p = nal.data() + offset;
+    size_t srcEnd = size;
+    size_t dstEnd = size + positions.size();
+    for (size_t k = positions.size(); k-- > 0;) {
+        size_t length = srcEnd - positions[k];
+        memmove(p + dstEnd - length, p + positions[k], length);
+        dstEnd -= length;
+        p[--dstEnd] = 0x03;
+        srcEnd = positions[k];
+    }
+    return positions.size();
+}
+
+// 1バイトずつ処理する参照実装 (EBSP -> RBSP)
+size_t EbspToRbspScalar(const BYTE* src, size_t size, BYTE* dst)
+{
+    size_t written = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        BYTE b = src[i];
+        if (zeros >= 2 && b == 0x03) {
+            zeros = 0;
+            continue;
+        }
+        dst[written++] = b;
+        zeros = (b == 0) ? zeros + 1 : 0;
+    }
+    return written;
+}
+
+// 1バイトずつ処理する参照実装 (RBSP -> EBSP)
+size_t RbspToEbspScalar(const BYTE* src, size_t size, std::vector<BYTE>& ebsp)
+{
+    size_t inserted = 0;
+    int zeros = 0;
+    for (size_t i = 0; i < size; i++) {
+        BYTE b = src[i];
+        if (zeros >= 2 && b <= 0x03) {
+            ebsp.push_back(0x03);
+            inserted++;
+            zeros = 0;
+        }
+        ebsp.push_back(b);
+        zeros = (b == 0) ? zeros + 1 : 0;
+    }
+    if (zeros >= 2) {
+        ebsp.push_back(0x03);
+        inserted++;
+    }
+    return inserted;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stddef.h>
+#include <vector>
+
+// エミュレーション防止バイト (emulation_prevention_three_byte) の挿入と除去
+// - RBSP -> EBSP: 00 00 に 00/01/02/03 が続く箇所に 0x03 を挿入する
+// - EBSP -> RBSP: 00 00 03 の 0x03 を取り除く
+// 00 00 の候補探索はSIMD (SSE2/NEON、なければ64ビット単位) で64バイトずつ行い、
+// 候補の近くだけをスカラーで判定する
+
+// [pos, size) の範囲で 00 00 が始まる最初の位置を返す (見つからなければsize)
+size_t FindZeroPair(const BYTE* data, size_t pos, size_t size);
+
+// EBSPをRBSPに変換する関数 (dst == src のインプレース変換も可)
+// 戻り値は変換後のバイト数
+size_t EbspToRbsp(const BYTE* src, size_t size, BYTE* dst);
+
+// ベクター内のoffset以降をインプレースでRBSPに変換し、サイズを縮める関数
+// 戻り値は取り除いたバイト数
+size_t EbspToRbspInPlace(std::vector<BYTE>& nal, size_t offset = 0);
+
+// RBSPをEBSPに変換してebspの末尾に追加する関数
+// 戻り値は挿入したエミュレーション防止バイトの数
+size_t RbspToEbsp(const BYTE* src, size_t size, std::vector<BYTE>& ebsp);
+
+// ベクター内のoffset以降をインプレースでEBSPに変換する関数
+// (挿入位置を数えてから後ろ向きに詰め直すため、追加のバッファは挿入位置の記録だけ)
+// 戻り値は挿入したエミュレーション防止バイトの数
+size_t RbspToEbspInPlace(std::vector<BYTE>& nal, size_t offset = 0);
+
+// 1バイトずつ処理する参照実装 (検証とベンチマークの比較用)
+size_t EbspToRbspScalar(const BYTE* src, size_t size, BYTE* dst);
+size_t RbspToEbspScalar(const BYTE* src, size_t size, std::vector<BYTE>& ebsp);
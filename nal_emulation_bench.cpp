@@ -0,0 +1,125 @@
+// エミュレーション防止バイト変換のベンチマーク
+// 1080pイントラスライス相当のデータで、スカラー実装とSIMD実装の速度と結果を比較する
+#include "nal_emulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+// 再現性のある疑似乱数 (xorshift64)
+static UINT64 NextRandom(UINT64& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// CAVLCのイントラスライスに近いバイト列を生成する
+// (ほぼランダムだが、係数ゼロの多い平坦部ではゼロバイトの連続が現れる)
+static void GenerateSliceRbsp(std::vector<BYTE>& rbsp, size_t size, UINT64 seed)
+{
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    rbsp.resize(size);
+    size_t i = 0;
+    while (i < size) {
+        UINT64 r = NextRandom(state);
+        if ((r & 0x3FF) == 0) {
+            // 平坦なマクロブロック: 2〜8バイトのゼロの並び
+            size_t run = 2 + ((r >> 10) & 7);
+            for (size_t k = 0; k < run && i < size; k++) {
+                rbsp[i++] = 0;
+            }
+        } else {
+            rbsp[i++] = static_cast<BYTE>(r >> 24);
+        }
+    }
+    rbsp[size - 1] = 0x80; // rbsp_trailing_bits
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    // 1080pのイントラスライス1枚はおよそ100〜300KB
+    const size_t sliceSize = 200 * 1024;
+    const int sliceCount = (argc > 1) ? atoi(argv[1]) : 64;
+    const int iterations = 8;
+
+    std::vector<std::vector<BYTE>> slices(sliceCount);
+    size_t totalBytes = 0;
+    for (int i = 0; i < sliceCount; i++) {
+        GenerateSliceRbsp(slices[i], sliceSize - (i % 7) * 1024, i + 1);
+        totalBytes += slices[i].size();
+    }
+
+    // 変換結果がスカラー実装と一致することを確認する
+    std::vector<std::vector<BYTE>> ebspSlices(sliceCount);
+    size_t inserted = 0;
+    for (int i = 0; i < sliceCount; i++) {
+        std::vector<BYTE> reference;
+        RbspToEbspScalar(slices[i].data(), slices[i].size(), reference);
+        inserted += RbspToEbsp(slices[i].data(), slices[i].size(), ebspSlices[i]);
+
+        std::vector<BYTE> inPlace = slices[i];
+        RbspToEbspInPlace(inPlace);
+
+        std::vector<BYTE> rbsp(ebspSlices[i].size());
+        rbsp.resize(EbspToRbsp(ebspSlices[i].data(), ebspSlices[i].size(), rbsp.data()));
+
+        if (reference != ebspSlices[i] || inPlace != reference || rbsp != slices[i]) {
+            printf("Mismatch against scalar reference at slice %d\n", i);
+            return 1;
+        }
+    }
+    printf("Slices: %d x ~%zu KB, %zu emulation prevention bytes\n", sliceCount, sliceSize / 1024, inserted);
+
+    std::vector<BYTE> ebsp;
+    std::vector<BYTE> rbsp(sliceSize + sliceSize / 2);
+    ebsp.reserve(sliceSize * 2);
+    double mb = static_cast<double>(totalBytes) * iterations / (1024.0 * 1024.0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < sliceCount; i++) {
+            ebsp.clear();
+            RbspToEbspScalar(slices[i].data(), slices[i].size(), ebsp);
+        }
+    }
+    double scalarInsertMs = ElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < sliceCount; i++) {
+            ebsp.clear();
+            RbspToEbsp(slices[i].data(), slices[i].size(), ebsp);
+        }
+    }
+    double fastInsertMs = ElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < sliceCount; i++) {
+            EbspToRbspScalar(ebspSlices[i].data(), ebspSlices[i].size(), rbsp.data());
+        }
+    }
+    double scalarRemoveMs = ElapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+        for (int i = 0; i < sliceCount; i++) {
+            EbspToRbsp(ebspSlices[i].data(), ebspSlices[i].size(), rbsp.data());
+        }
+    }
+    double fastRemoveMs = ElapsedMs(start);
+
+    printf("RBSP->EBSP scalar: %8.1f MB/s\n", mb / (scalarInsertMs / 1000.0));
+    printf("RBSP->EBSP fast:   %8.1f MB/s\n", mb / (fastInsertMs / 1000.0));
+    printf("EBSP->RBSP scalar: %8.1f MB/s\n", mb / (scalarRemoveMs / 1000.0));
+    printf("EBSP->RBSP fast:   %8.1f MB/s\n", mb / (fastRemoveMs / 1000.0));
+    return 0;
+}
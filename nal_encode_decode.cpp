@@ -1,23 +1,55 @@
+#if defined(NAL_SOFTWARE_CODEC)
+#include "portable_types.h"
+#include "yuv_encoder_soft.h" // ソフトウェアエンコーダー (Media Foundationなしでビルドする場合)
+#include "nal_decoder_soft.h" // ソフトウェアデコーダー
+#else
 #include <windows.h>
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <mferror.h>
 #include <codecapi.h>
+#endif
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #define _CRT_SECURE_NO_WARNINGS
 #include <vector>
 #include <fstream>
 #include <string>
+#if !defined(NAL_SOFTWARE_CODEC)
 #include <dshow.h>
 #include "yuv_encoder_win.h"  // エンコーダー機能のヘッダ
 #include "nal_decoder_win.h"  // デコーダー機能のヘッダを追加
+#endif
+#include "fmp4_muxer.h"       // フラグメント化MP4の出力
+#include "rtp_packetizer.h"   // RTPパケット化
+#include "rtp_sink.h"         // RTPの送信先
+#include "pre_analysis.h"     // 先読み解析 (シーンチェンジ・静止フレーム)
+#include "realtime_pacer.h"   // リアルタイムのペーシングとフレームの間引き
+#include "nal_store.h"        // エンコード結果のNALユニットのストア
+#include "pipeline_trace.h"   // スパンのトレース (Chrome trace形式)
+#include "live_stats.h"       // 共有メモリのライブカウンター
+#include "yuv_archive.h"      // デコード結果の圧縮コンテナ
+#include "bitstream_cache.h"  // エンコード結果のディスクキャッシュ
+#include "shm_frame_ring.h"   // プロセス間の共有メモリのフレームリング
+#if !defined(NAL_SOFTWARE_CODEC)
+#include "rendition_ladder_win.h" // 複数解像度の同時エンコード
+#endif
+#include "nv12_scaler.h"
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Media Foundationライブラリをリンク
+#if !defined(NAL_SOFTWARE_CODEC)
 #pragma comment(lib, "mfplat.lib")
 #pragma comment(lib, "mfuuid.lib")
 #pragma comment(lib, "mfreadwrite.lib")
 #pragma comment(lib, "strmiids.lib")
+#endif
 
 // 簡素化されたエラーチェック用マクロ
 #define CHECK_HR(hr, msg) if (FAILED(hr)) { \
@@ -25,159 +57,977 @@
     return hr; \
 }
 
-int main()
+// エンコードする映像 (ビットストリームのキャッシュのキーにも使う)
+// フレームレートはエンコーダーが決める (ENCODER_FRAME_RATE_NUM / ENCODER_FRAME_RATE_DENOM)
+#define ENCODE_WIDTH 1920
+#define ENCODE_HEIGHT 1080
+#define ENCODE_BITRATE 1500000         // 1.5 Mbps
+#define ENCODE_FRAME_COUNT 61
+
+// --shm-inputで生産者がリングを作成するまで待つ時間
+#define SHM_INPUT_OPEN_TIMEOUT_MS 10000
+
+// コマンドラインオプション
+struct AppOptions {
+    const char* fmp4Filename;          // --fmp4: フラグメント化MP4の出力先 (NULLなら出力しない)
+    UINT32 fragmentDurationMs;         // --fragment-ms: フラグメント長 (0ならGOPごと)
+    const char* rtpPcapFilename;       // --rtp-pcap: RTPパケットをpcapに書き出す (NULLなら出力しない)
+    const char* rtpUdpAddress;         // --rtp-udp: RTPパケットをUDPで送信する宛先 (NULLなら送信しない)
+    UINT16 rtpPort;                    // --rtp-port: RTPの宛先ポート
+    UINT32 rtpMtu;                     // --rtp-mtu: RTPパケットの最大サイズ
+    bool rtpFixedIds;                  // --rtp-fixed-ids: SSRCと最初のシーケンス番号を固定する (出力を比較するテスト用)
+    bool preAnalysis;                  // --pre-analysis: シーンチェンジでキーフレームを強制する
+    bool skipStaticFrames;             // --skip-static: 静止フレームをエンコードしない (--pre-analysisを含む)
+    bool ladder;                       // --ladder: 1080p/720p/480p/360pを同時にエンコードする
+    Nv12ScaleFilter scaleFilter;       // --scale-filter: ラダーの縮小フィルター
+    UINT32 sliceCount;                 // --slices: ソフトウェアエンコーダーのスライス数 (0なら論理コア数)
+    bool realtime;                     // --realtime: フレームレートの時刻に合わせてフレームを取り込む
+    PacerPolicy dropPolicy;            // --drop-policy: 遅れたときのポリシー
+    UINT32 latencyFrames;              // --latency-frames: 許容する遅れ (フレーム数)
+    bool batchBench;                   // --batch-bench: バッチAPIのバッチの大きさごとのスループットを測る
+    const char* traceFilename;         // --trace: スパンのトレースをChrome trace形式で書き出す (NULLなら記録しない)
+    const char* liveStatsName;         // --live-stats: ライブカウンターの共有メモリの名前 (NULLなら作らない)
+    bool hugePages;                    // --no-huge-pages: フレームとビットストリームのバッファをヒュージページにしない
+    bool numaBinding;                  // --no-numa: バッファをセッションのスレッドのNUMAノードに置かない
+    const char* yuvArchiveFilename;    // --yuv-archive: デコード結果をoutput.yuvの代わりに圧縮コンテナに書く (NULLなら書かない)
+    const char* bitstreamCacheDirectory; // --bitstream-cache: エンコード結果のキャッシュのディレクトリ (NULLなら使わない)
+    const char* shmInputName;          // --shm-input: 入力フレームを共有メモリのリングから受け取る (NULLならテストパターン)
+};
+
+// コマンドラインオプションを解析する関数
+static bool ParseOptions(int argc, char* argv[], AppOptions* pOptions)
+{
+    pOptions->fmp4Filename = NULL;
+    pOptions->fragmentDurationMs = 0;
+    pOptions->rtpPcapFilename = NULL;
+    pOptions->rtpUdpAddress = NULL;
+    pOptions->rtpPort = 5004;
+    pOptions->rtpMtu = 1400;
+    pOptions->rtpFixedIds = false;
+    pOptions->preAnalysis = false;
+    pOptions->skipStaticFrames = false;
+    pOptions->ladder = false;
+    pOptions->scaleFilter = NV12_SCALE_AREA;
+    pOptions->sliceCount = 0;
+    pOptions->realtime = false;
+    pOptions->dropPolicy = PACER_DROP_OLDEST;
+    pOptions->latencyFrames = 3;
+    pOptions->batchBench = false;
+    pOptions->traceFilename = NULL;
+    pOptions->liveStatsName = NULL;
+    pOptions->hugePages = true;
+    pOptions->numaBinding = true;
+    pOptions->yuvArchiveFilename = NULL;
+    pOptions->bitstreamCacheDirectory = NULL;
+    pOptions->shmInputName = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fmp4") == 0 && i + 1 < argc) {
+            pOptions->fmp4Filename = argv[++i];
+        } else if (strcmp(argv[i], "--fragment-ms") == 0 && i + 1 < argc) {
+            pOptions->fragmentDurationMs = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--rtp-pcap") == 0 && i + 1 < argc) {
+            pOptions->rtpPcapFilename = argv[++i];
+        } else if (strcmp(argv[i], "--rtp-udp") == 0 && i + 1 < argc) {
+            pOptions->rtpUdpAddress = argv[++i];
+        } else if (strcmp(argv[i], "--rtp-port") == 0 && i + 1 < argc) {
+            pOptions->rtpPort = static_cast<UINT16>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--rtp-mtu") == 0 && i + 1 < argc) {
+            pOptions->rtpMtu = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--rtp-fixed-ids") == 0) {
+            pOptions->rtpFixedIds = true;
+        } else if (strcmp(argv[i], "--pre-analysis") == 0) {
+            pOptions->preAnalysis = true;
+        } else if (strcmp(argv[i], "--skip-static") == 0) {
+            pOptions->preAnalysis = true;
+            pOptions->skipStaticFrames = true;
+        } else if (strcmp(argv[i], "--ladder") == 0) {
+            pOptions->ladder = true;
+        } else if (strcmp(argv[i], "--scale-filter") == 0 && i + 1 < argc) {
+            const char* filter = argv[++i];
+            pOptions->scaleFilter = (strcmp(filter, "bilinear") == 0) ? NV12_SCALE_BILINEAR : NV12_SCALE_AREA;
+        } else if (strcmp(argv[i], "--slices") == 0 && i + 1 < argc) {
+            pOptions->sliceCount = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            pOptions->realtime = true;
+        } else if (strcmp(argv[i], "--drop-policy") == 0 && i + 1 < argc && ParsePacerPolicy(argv[i + 1], &pOptions->dropPolicy)) {
+            pOptions->realtime = true;
+            i++;
+        } else if (strcmp(argv[i], "--latency-frames") == 0 && i + 1 < argc) {
+            pOptions->realtime = true;
+            pOptions->latencyFrames = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--batch-bench") == 0) {
+            pOptions->batchBench = true;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            pOptions->traceFilename = argv[++i];
+        } else if (strcmp(argv[i], "--live-stats") == 0) {
+            // 名前は省略できる (次の引数がオプションでなければ名前として扱う)
+            pOptions->liveStatsName = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : LIVE_STATS_DEFAULT_NAME;
+        } else if (strcmp(argv[i], "--no-huge-pages") == 0) {
+            pOptions->hugePages = false;
+        } else if (strcmp(argv[i], "--no-numa") == 0) {
+            pOptions->numaBinding = false;
+        } else if (strcmp(argv[i], "--yuv-archive") == 0 && i + 1 < argc) {
+            pOptions->yuvArchiveFilename = argv[++i];
+        } else if (strcmp(argv[i], "--bitstream-cache") == 0) {
+            // ディレクトリは省略できる (次の引数がオプションでなければディレクトリとして扱う)
+            pOptions->bitstreamCacheDirectory = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : BITSTREAM_CACHE_DEFAULT_DIRECTORY;
+        } else if (strcmp(argv[i], "--shm-input") == 0) {
+            // 名前は省略できる (次の引数がオプションでなければ名前として扱う)
+            pOptions->shmInputName = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[++i] : SHM_FRAME_RING_DEFAULT_NAME;
+        } else {
+            printf("Usage: %s [--fmp4 <output.mp4>] [--fragment-ms <ms>]\n"
+                   "          [--rtp-pcap <output.pcap> | --rtp-udp <address>] [--rtp-port <port>] [--rtp-mtu <bytes>]\n"
+                   "          [--rtp-fixed-ids]\n"
+                   "          [--pre-analysis] [--skip-static] [--ladder [--scale-filter bilinear|area]]\n"
+                   "          [--slices <n>] [--batch-bench] [--trace <trace.json>] [--live-stats [<name>]]\n"
+                   "          [--no-huge-pages] [--no-numa] [--yuv-archive <output.yuvz>] [--bitstream-cache [<dir>]]\n"
+                   "          [--shm-input [<name>]]\n"
+                   "          [--realtime [--drop-policy oldest|non-reference|degrade] [--latency-frames <n>]]\n",
+                   argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// --traceが指定されていれば、スパンの記録を開始する
+static void StartTraceIfRequested(const AppOptions& options)
+{
+    if (!options.traceFilename) {
+        return;
+    }
+    if (!PIPELINE_TRACE_COMPILED) {
+        printf("--trace: tracing is not compiled in (configure with -DNAL_TRACING=ON)\n");
+        return;
+    }
+    TRACE_THREAD_NAME("main");
+    StartPipelineTrace();
+}
+
+// 記録を止めてトレースを書き出す
+static void FinishTraceIfRequested(const AppOptions& options)
+{
+    if (options.traceFilename && PIPELINE_TRACE_COMPILED) {
+        StopPipelineTrace();
+        WritePipelineTrace(options.traceFilename);
+    }
+}
+
+// 直前のCommitInputFrame/FlushEncoderの出力をライブカウンターに加える関数
+static void CountEncodedSamples(const NalEncoder& encoder, const NalStore& store)
+{
+    if (!g_liveStats) {
+        return;
+    }
+    for (const auto& info : encoder.outputSamples) {
+        for (size_t i = info.firstNalIndex; i < info.firstNalIndex + info.nalCount; i++) {
+            const NalStoreEntry& entry = store.entries[i];
+            LiveStatsAddNal(entry.type, entry.size);
+        }
+    }
+    LIVE_STATS_ADD(samplesOut, encoder.outputSamples.size());
+}
+
+// デコードしたフレームの表示領域を書き込む関数 (--yuv-archiveなら圧縮コンテナ、そうでなければoutput.yuv)
+static HRESULT WriteDecodedFrame(std::ofstream& yuvFile, YuvArchiveWriter* pArchive, const Nv12Frame* pFrame)
+{
+    if (pArchive) {
+        return WriteYuvArchiveFrame(pArchive, pFrame);
+    }
+    return WriteNv12FrameCropped(yuvFile, pFrame);
+}
+
+// COMの初期化・解放 (ソフトウェアエンコーダーでは不要)
+static HRESULT InitializeCom()
+{
+#if defined(NAL_SOFTWARE_CODEC)
+    return S_OK;
+#else
+    return CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+#endif
+}
+
+static void UninitializeCom()
+{
+#if !defined(NAL_SOFTWARE_CODEC)
+    CoUninitialize();
+#endif
+}
+
+// 直前のCommitInputFrame/FlushEncoderの出力サンプルをfMP4に書き込む関数
+// (NALユニットはストア内のデータを参照するので、コピーは発生しない。viewsは使い回す作業領域)
+static HRESULT WriteEncodedSamples(Fmp4Muxer* pMuxer, const NalEncoder& encoder, const NalStore& store,
+                                   std::vector<NalUnitView>& views)
 {
     HRESULT hr = S_OK;
-    // COMの初期化
-    hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+    for (const auto& info : encoder.outputSamples) {
+        if (info.nalCount == 0) {
+            continue;
+        }
+        views.clear();
+        GetNalStoreUnits(&store, info.firstNalIndex, info.nalCount, views);
+        hr = Fmp4WriteSample(pMuxer, views.data(), views.size(), info.sampleTime, info.duration, info.keyFrame);
+        CHECK_HR(hr, "Fmp4WriteSample");
+    }
+    return hr;
+}
+
+// 直前のCommitInputFrame/FlushEncoderの出力サンプルをRTPでパケット化する関数
+static HRESULT PacketizeEncodedSamples(RtpPacketizer* pPacketizer, const NalEncoder& encoder, const NalStore& store,
+                                       std::vector<NalUnitView>& views)
+{
+    HRESULT hr = S_OK;
+    for (const auto& info : encoder.outputSamples) {
+        if (info.nalCount == 0) {
+            continue;
+        }
+        views.clear();
+        GetNalStoreUnits(&store, info.firstNalIndex, info.nalCount, views);
+        hr = RtpPacketizeFrame(pPacketizer, views.data(), views.size(), info.sampleTime);
+        CHECK_HR(hr, "RtpPacketizeFrame");
+    }
+    return hr;
+}
+
+// テストフレームの生産者
+// 別スレッドでエンコーダーの入力プールのフレームを取得し、そこへ直接描画してキューに渡す
+// (プールの枚数だけ先行するので、次のフレームの描画と現在のフレームのエンコードが重なる)
+struct FrameProducer {
+    NalEncoder* pEncoder;
+    UINT32 frameCount;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;      // フレームの追加・終了を通知する
+    std::deque<Nv12Frame*> frames;     // 描画済みでエンコード待ちのフレーム (取り込み順)
+    bool stopping;                     // 途中で止める (エンコードのエラー時)
+    bool finished;                     // これ以上フレームが来ない
+    HRESULT result;
+};
+
+static void ProducerThread(FrameProducer* pProducer)
+{
+    TRACE_THREAD_NAME("frame producer");
+    HRESULT hr = S_OK;
+    for (UINT32 i = 0; i < pProducer->frameCount; i++) {
+        {
+            std::lock_guard<std::mutex> lock(pProducer->mutex);
+            if (pProducer->stopping) {
+                break;
+            }
+        }
+        
+        // 空きがなければエンコーダーがフレームを返却するまで待つ（これが先行の上限になる）
+        Nv12Frame* pFrame = NULL;
+        hr = AcquireInputFrame(pProducer->pEncoder, &pFrame);
+        if (FAILED(hr)) {
+            break;
+        }
+        
+        // テストフレームの生成（ライブ入力ではカメラからの取り込みに相当する）
+        {
+            TRACE_SPAN("GenerateTestFrame", i);
+            GenerateTestFrame(pFrame, i);
+        }
+        LIVE_STATS_ADD(framesIn, 1);
+        {
+            std::lock_guard<std::mutex> lock(pProducer->mutex);
+            pProducer->frames.push_back(pFrame);
+            LIVE_STATS_SET(inputQueueDepth, pProducer->frames.size());
+        }
+        pProducer->wake.notify_one();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(pProducer->mutex);
+        pProducer->finished = true;
+        pProducer->result = hr;
+    }
+    pProducer->wake.notify_one();
+}
+
+static void StartFrameProducer(FrameProducer* pProducer, NalEncoder* pEncoder, UINT32 frameCount)
+{
+    pProducer->pEncoder = pEncoder;
+    pProducer->frameCount = frameCount;
+    pProducer->stopping = false;
+    pProducer->finished = false;
+    pProducer->result = S_OK;
+    pProducer->thread = std::thread(ProducerThread, pProducer);
+}
+
+// 次のフレームを取り出す関数 (描画されるまで待つ。もうフレームがなければNULL)
+static Nv12Frame* TakeProducedFrame(FrameProducer* pProducer)
+{
+    std::unique_lock<std::mutex> lock(pProducer->mutex);
+    pProducer->wake.wait(lock, [pProducer] { return !pProducer->frames.empty() || pProducer->finished; });
+    if (pProducer->frames.empty()) {
+        return NULL;
+    }
+    Nv12Frame* pFrame = pProducer->frames.front();
+    pProducer->frames.pop_front();
+    LIVE_STATS_SET(inputQueueDepth, pProducer->frames.size());
+    return pFrame;
+}
+
+// 生産者を止める関数 (残りのフレームはエンコードせずに返却し、スレッドの終了を待つ)
+static HRESULT StopFrameProducer(FrameProducer* pProducer)
+{
+    {
+        std::lock_guard<std::mutex> lock(pProducer->mutex);
+        pProducer->stopping = true;
+    }
+    while (Nv12Frame* pFrame = TakeProducedFrame(pProducer)) {
+        DiscardInputFrame(pProducer->pEncoder, pFrame);
+    }
+    pProducer->thread.join();
+    return pProducer->result;
+}
+
+// エンコードの入力フレームの取り出し元
+// テストパターンの生産者スレッド (エンコーダーの入力プールに描画する)、または--shm-inputの共有メモリのリング
+// (リングのフレームは別のプロセスが書いたスロットのビューのままエンコードし、終わったらスロットを返却する)
+struct EncodeInput {
+    FrameProducer producer;
+    ShmFrameRing ring;
+    bool shared;                       // 共有メモリのリングから受け取る
+    Nv12Frame ringFrame;               // 受け取ったスロットのビュー
+    HRESULT result;                    // リングからの受け取りのエラー (生産者の終了など)
+};
+
+static HRESULT StartEncodeInput(EncodeInput* pInput, const AppOptions& options, NalEncoder* pEncoder, UINT32 frameCount)
+{
+    pInput->shared = options.shmInputName != NULL;
+    pInput->result = S_OK;
+    if (!pInput->shared) {
+        StartFrameProducer(&pInput->producer, pEncoder, frameCount);
+        return S_OK;
+    }
+    
+    HRESULT hr = OpenShmFrameRing(&pInput->ring, options.shmInputName, SHM_INPUT_OPEN_TIMEOUT_MS);
+    CHECK_HR(hr, "OpenShmFrameRing");
+    // スロットをそのままエンコードするので、符号化サイズがエンコーダーと同じであること (ストライドは違ってよい)
+    const ShmFrameRingHeader* pHeader = pInput->ring.pHeader;
+    if (pHeader->width != pEncoder->width || pHeader->height != pEncoder->height ||
+        pHeader->codedHeight != pEncoder->codedHeight) {
+        printf("Frame ring format %ux%u does not match the encoder (%ux%u)\n", pHeader->width, pHeader->height,
+               pEncoder->width, pEncoder->height);
+        CloseShmFrameRing(&pInput->ring);
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+// 次のフレームを取り出す関数 (もうフレームがなければNULL)
+static Nv12Frame* TakeInputFrame(EncodeInput* pInput)
+{
+    if (!pInput->shared) {
+        return TakeProducedFrame(&pInput->producer);
+    }
+    HRESULT hr = TakeShmFrame(&pInput->ring, &pInput->ringFrame, NULL);
+    if (hr != S_OK) {
+        pInput->result = FAILED(hr) ? hr : S_OK;
+        return NULL;
+    }
+    LIVE_STATS_ADD(framesIn, 1);
+    return &pInput->ringFrame;
+}
+
+// フレームをエンコードする関数 (NALユニットはストアの末尾に追加する)
+static HRESULT EncodeInputFrame(EncodeInput* pInput, NalEncoder* pEncoder, Nv12Frame* pFrame, NalStore* pStore)
+{
+    if (!pInput->shared) {
+        return CommitInputFrame(pEncoder, pFrame, pStore);
+    }
+    HRESULT hr = EncodeFrame(pEncoder, *pFrame, pStore);
+    ReleaseShmFrame(&pInput->ring);
+    return hr;
+}
+
+// フレームをエンコードせずに返す関数 (落としたフレーム・間引いたフレーム用)
+static void ReturnInputFrame(EncodeInput* pInput, NalEncoder* pEncoder, Nv12Frame* pFrame)
+{
+    if (!pInput->shared) {
+        DiscardInputFrame(pEncoder, pFrame);
+    } else {
+        ReleaseShmFrame(&pInput->ring);
+    }
+}
+
+// 入力を止める関数 (リングなら統計情報を表示して閉じる)
+static HRESULT StopEncodeInput(EncodeInput* pInput)
+{
+    if (!pInput->shared) {
+        return StopFrameProducer(&pInput->producer);
+    }
+    PrintShmFrameRingStatistics(&pInput->ring);
+    CloseShmFrameRing(&pInput->ring);
+    return pInput->result;
+}
+
+#if !defined(NAL_SOFTWARE_CODEC)
+// ラダーモード: ソースフレームを1回だけ生成し、全レンディションに縮小して並列にエンコードする
+static HRESULT RunLadder(const AppOptions& options, UINT32 frameCount)
+{
+    HRESULT hr = S_OK;
+    const RenditionConfig& source = DEFAULT_RENDITION_LADDER[0];
+    
+    Nv12Frame sourceFrame = {0};
+    hr = AllocateNv12Frame(&sourceFrame, source.width, source.height);
+    CHECK_HR(hr, "AllocateNv12Frame for ladder source");
+    
+    RenditionLadder ladder;
+    hr = InitializeRenditionLadder(&ladder, source.width, source.height, DEFAULT_RENDITION_LADDER,
+                                   sizeof(DEFAULT_RENDITION_LADDER) / sizeof(DEFAULT_RENDITION_LADDER[0]),
+                                   options.scaleFilter);
     if (FAILED(hr)) {
-        printf("CoInitializeEx failed: 0x%08X\n", hr);
-        return 1;
+        FreeNv12Frame(&sourceFrame);
+        return hr;
+    }
+    
+    for (UINT32 i = 0; i < frameCount; i++) {
+        GenerateTestFrame(&sourceFrame, i);
+        hr = LadderEncodeFrame(&ladder, sourceFrame);
+        if (FAILED(hr)) {
+            printf("Ladder encoding failed at frame %d: 0x%08X\n", i, hr);
+            break;
+        }
+    }
+    
+    HRESULT hrFinish = FinishRenditionLadder(&ladder);
+    FreeNv12Frame(&sourceFrame);
+    return FAILED(hr) ? hr : hrFinish;
+}
+#endif
+
+// バッチAPIのベンチマークの条件 (呼び出しの固定コストが目立つ小さい解像度)
+#define BATCH_BENCH_WIDTH  640
+#define BATCH_BENCH_HEIGHT 360
+#define BATCH_BENCH_FRAMES 120
+
+// バッチの大きさ1つ分の結果
+struct BatchBenchResult {
+    size_t batchSize;
+    double encodeFps;
+    double decodeFps;
+    size_t decodedFrames;
+    UINT64 totalBytes;
+};
+
+// バッチAPIのベンチマーク: バッチの大きさごとに同じフレームをエンコードし、その出力をデコードしてスループットを測る
+static HRESULT RunBatchBenchmark(const AppOptions& options)
+{
+    HRESULT hr = S_OK;
+    const size_t batchSizes[] = { 1, 2, 4, 8, 16 };
+    const UINT32 codedHeight = AlignUp(BATCH_BENCH_HEIGHT, NV12_FRAME_HEIGHT_ALIGNMENT);
+    
+    // 入力フレームは先に作っておき、エンコード・デコードの時間だけを測る
+    std::vector<Nv12Frame> frames(BATCH_BENCH_FRAMES);
+    for (UINT32 i = 0; i < BATCH_BENCH_FRAMES && SUCCEEDED(hr); i++) {
+        hr = AllocateNv12Frame(&frames[i], BATCH_BENCH_WIDTH, BATCH_BENCH_HEIGHT, codedHeight);
+        if (SUCCEEDED(hr)) {
+            GenerateTestFrame(&frames[i], i);
+        }
     }
     
+    std::vector<BatchBenchResult> results;
+    for (size_t batchSize : batchSizes) {
+        if (FAILED(hr)) {
+            break;
+        }
+        BatchBenchResult result = {};
+        result.batchSize = batchSize;
+        
+        NalEncoder encoder;
+#if defined(NAL_SOFTWARE_CODEC)
+        hr = InitializeEncoder(&encoder, BATCH_BENCH_WIDTH, BATCH_BENCH_HEIGHT, 500000, options.sliceCount);
+#else
+        (void)options;
+        hr = InitializeEncoder(&encoder, BATCH_BENCH_WIDTH, BATCH_BENCH_HEIGHT, 500000);
+#endif
+        if (FAILED(hr)) {
+            break;
+        }
+        
+        // エンコード（出力はデコードの入力として、フレームごとのNALユニットの区切りと一緒に取っておく）
+        EncodeBatchArena encodeArena;
+        std::vector<std::vector<BYTE>> nalUnits;
+        std::vector<size_t> frameNalEnd;
+        double encodeMs = 0.0;
+        for (size_t start = 0; start < frames.size() && SUCCEEDED(hr); start += batchSize) {
+            size_t count = (frames.size() - start < batchSize) ? frames.size() - start : batchSize;
+            auto batchStart = std::chrono::steady_clock::now();
+            hr = EncodeFrameBatch(&encoder, &frames[start], count, &encodeArena);
+            encodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+            
+            for (const EncodeBatchItem& item : encodeArena.items) {
+                for (size_t n = 0; n < item.sample.nalCount; n++) {
+                    const BatchNalRange& range = encodeArena.nals[item.sample.firstNalIndex + n];
+                    const BYTE* pNal = encodeArena.data.data() + range.offset;
+                    nalUnits.push_back(std::vector<BYTE>(pNal, pNal + range.size));
+                    result.totalBytes += range.size;
+                }
+                frameNalEnd.push_back(nalUnits.size());
+            }
+        }
+        ShutdownEncoder(&encoder);
+        if (FAILED(hr)) {
+            printf("EncodeFrameBatch failed: 0x%08X\n", hr);
+            break;
+        }
+        result.encodeFps = frames.size() / (encodeMs / 1000.0);
+        
+        // デコード（batchSizeフレーム分のNALユニットずつ入力し、最後に空のNALユニットでFlushする）
+        NalDecoder decoder;
+        hr = InitializeDecoder(&decoder, BATCH_BENCH_WIDTH, BATCH_BENCH_HEIGHT);
+        if (FAILED(hr)) {
+            break;
+        }
+        nalUnits.push_back(std::vector<BYTE>());
+        frameNalEnd.back() = nalUnits.size();
+        DecodeBatchArena decodeArena;
+        double decodeMs = 0.0;
+        size_t firstNal = 0;
+        for (size_t frame = 0; frame < frameNalEnd.size() && SUCCEEDED(hr); frame += batchSize) {
+            size_t lastFrame = (frame + batchSize < frameNalEnd.size()) ? frame + batchSize : frameNalEnd.size();
+            size_t endNal = frameNalEnd[lastFrame - 1];
+            auto batchStart = std::chrono::steady_clock::now();
+            hr = DecodeNalBatch(&decoder, &nalUnits[firstNal], endNal - firstNal, &decodeArena);
+            decodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+            result.decodedFrames += decodeArena.frames.size();
+            firstNal = endNal;
+        }
+        ShutdownDecoder(&decoder);
+        if (FAILED(hr)) {
+            printf("DecodeNalBatch failed: 0x%08X\n", hr);
+            break;
+        }
+        result.decodeFps = result.decodedFrames / (decodeMs / 1000.0);
+        results.push_back(result);
+    }
+    
+    for (auto& frame : frames) {
+        FreeNv12Frame(&frame);
+    }
+    
+    printf("\nBatch API throughput (%dx%d, %d frames)\n", BATCH_BENCH_WIDTH, BATCH_BENCH_HEIGHT, BATCH_BENCH_FRAMES);
+    printf(" batch   enc fps   dec fps   frames      bytes\n");
+    for (const BatchBenchResult& result : results) {
+        printf("%6zu %9.1f %9.1f %8zu %10llu\n", result.batchSize, result.encodeFps, result.decodeFps,
+               result.decodedFrames, static_cast<unsigned long long>(result.totalBytes));
+    }
+    return hr;
+}
+
+// テストシーケンスをエンコードし、NALユニットをnalStoreの末尾に追加する関数
+// (fMP4・RTPの出力、先読み解析、リアルタイムのペーシングもエンコードしながら行う)
+// --shm-inputでは、frameCountの代わりに生産者がストリームを終えるまでリングのフレームをエンコードする
+// 途中で失敗したときは最初のエラーを返す (それまでのNALユニットはストアに残る)
+static HRESULT EncodeTestSequence(const AppOptions& options, UINT32 frameCount, NalStore& nalStore)
+{
+    HRESULT hr = S_OK;
+    
     // エンコーダーオブジェクトの作成
     NalEncoder encoder;
     
     // エンコーダーの初期化
-    hr = InitializeEncoder(&encoder);
+#if defined(NAL_SOFTWARE_CODEC)
+    hr = InitializeEncoder(&encoder, ENCODE_WIDTH, ENCODE_HEIGHT, ENCODE_BITRATE, options.sliceCount);
+#else
+    hr = InitializeEncoder(&encoder, ENCODE_WIDTH, ENCODE_HEIGHT, ENCODE_BITRATE);
+#endif
     if (FAILED(hr)) {
         printf("Encoder initialization failed: 0x%08X\n", hr);
-        CoUninitialize();
-        return 1;
+        return hr;
     }
     
-    // テストフレームの生成とエンコード
-    std::vector<BYTE> frameBuffer;
-    const UINT32 frameCount = 61;
+    // テストフレームはエンコーダーの入力プールに直接描画し、コピーせずにコミットする
+    // (リングのフレームは別のプロセスが書いたスロットからコピーせずにエンコードする)
+    EncodeInput input;
+    hr = StartEncodeInput(&input, options, &encoder, frameCount);
+    if (FAILED(hr)) {
+        ShutdownEncoder(&encoder);
+        return hr;
+    }
     
-    // すべてのエンコード結果を格納するベクター
-    std::vector<std::vector<BYTE>> allNalUnits;
+    std::vector<NalUnitView> sampleNals;
     
-    for (UINT32 i = 0; i < frameCount; i++) {
-        // テストフレームの生成
-        GenerateTestFrame(frameBuffer, encoder.width, encoder.height, i);
+    // フラグメント化MP4の出力（エンコードしながらフラグメントを書き出す）
+    Fmp4Muxer muxer = {};
+    bool muxerEnabled = false;
+    if (options.fmp4Filename) {
+        Fmp4FragmentMode mode = options.fragmentDurationMs ? FMP4_FRAGMENT_PER_DURATION : FMP4_FRAGMENT_PER_GOP;
+        hr = InitializeFmp4Muxer(&muxer, options.fmp4Filename, encoder.width, encoder.height,
+                                 mode, options.fragmentDurationMs);
+        muxerEnabled = SUCCEEDED(hr);
+    }
+    
+    // RTPパケット化（pcapファイルまたはUDPへ、フレームごとにまとめて送信する）
+    RtpSink rtpSink = {};
+    RtpPacketizer packetizer;
+    bool rtpEnabled = false;
+    if (options.rtpPcapFilename) {
+        hr = OpenRtpPcapSink(&rtpSink, options.rtpPcapFilename, options.rtpPort);
+        rtpEnabled = SUCCEEDED(hr);
+    } else if (options.rtpUdpAddress) {
+        hr = OpenRtpUdpSink(&rtpSink, options.rtpUdpAddress, options.rtpPort);
+        rtpEnabled = SUCCEEDED(hr);
+    }
+    if (rtpEnabled) {
+        hr = InitializeRtpPacketizer(&packetizer, &rtpSink, options.rtpMtu, 96, RTP_MODE_NON_INTERLEAVED);
+        if (FAILED(hr)) {
+            rtpSink.Close(rtpSink.pContext);
+            rtpEnabled = false;
+        } else if (options.rtpFixedIds) {
+            SetRtpPacketizerFixedIds(&packetizer, 0x4E414C00, 0);
+        }
+    }
+    
+    // 先読み解析（エンコード前にフレーム間の差を調べ、シーンチェンジ・静止フレームを判定する）
+    PreAnalyzer preAnalyzer;
+    bool preAnalysisEnabled = false;
+    if (options.preAnalysis) {
+        preAnalysisEnabled = SUCCEEDED(InitializePreAnalyzer(&preAnalyzer, encoder.width, encoder.height));
+    }
+    
+    // リアルタイムのペーシング（フレームレートの時刻に取り込み、遅れたらポリシーに従って間引く）
+    RealtimePacer pacer;
+    bool pacingEnabled = false;
+    BOOL fastMode = FALSE;
+    if (options.realtime) {
+        pacingEnabled = SUCCEEDED(InitializeRealtimePacer(&pacer, encoder.frameRateNum, encoder.frameRateDenom,
+                                                          options.dropPolicy, options.latencyFrames));
+    }
+    auto encodeStart = std::chrono::steady_clock::now();
+    UINT64 liveEncodedFrames = 0;
+    LiveStatsRateMeter encodeRate;
+    StartLiveStatsRate(&encodeRate, 0);
+    HRESULT hrSequence = S_OK;         // 最初のエラー (エンコード・入力・フラッシュ)
+    
+    for (UINT32 i = 0; input.shared || i < frameCount; i++) {
+        Nv12Frame* pFrame = TakeInputFrame(&input);
+        if (!pFrame) {
+            break;
+        }
+        
+        PreAnalysisHints hints = {};
+        bool analyzed = preAnalysisEnabled && SUCCEEDED(PreAnalyzeFrame(&preAnalyzer, pFrame, &hints));
         
-        // フレームのエンコード
-        std::vector<std::vector<BYTE>> outputNalUnits;
-        hr = EncodeFrame(&encoder, frameBuffer, outputNalUnits);
+        // 取り込み時刻まで待ち、締め切りに間に合わないフレームは落とす
+        PacerDecision decision = {};
+        if (pacingEnabled) {
+            WaitForPacedFrame(&pacer, i, i == 0 || (analyzed && hints.sceneCut), &decision);
+            if (decision.drop) {
+                if (analyzed && hints.sceneCut) {
+                    ForceKeyFrame(&encoder);  // 落としたシーンチェンジの代わりに次のフレームをキーフレームにする
+                }
+                ReturnInputFrame(&input, &encoder, pFrame);
+                SkipFrame(&encoder);
+                LIVE_STATS_ADD(framesDropped, 1);
+                continue;
+            }
+            if (decision.degrade != fastMode && SUCCEEDED(SetEncoderFastMode(&encoder, decision.degrade))) {
+                fastMode = decision.degrade;
+                printf("Frame %d: %s fast mode (lag %.1f ms)\n", i, fastMode ? "entering" : "leaving", decision.lagMs);
+            }
+        }
+        
+        // 解析結果に応じてキーフレームを強制する、または静止フレームを間引く
+        if (analyzed) {
+            if (hints.staticFrame && options.skipStaticFrames) {
+                ReturnInputFrame(&input, &encoder, pFrame);
+                SkipFrame(&encoder);
+                LIVE_STATS_ADD(framesSkipped, 1);
+                continue;
+            }
+            if (hints.sceneCut) {
+                printf("Scene cut at frame %d (SAD %.1f, histogram %.2f), forcing key frame\n",
+                       i, hints.sadPerPixel, hints.histogramDistance);
+                ForceKeyFrame(&encoder);
+            }
+        }
+        
+        // フレームのエンコード（NALユニットはストアの末尾に直接追加される）
+        {
+            TRACE_SPAN("EncodeFrame", i);
+            hr = EncodeInputFrame(&input, &encoder, pFrame, &nalStore);
+        }
         if (FAILED(hr)) {
             printf("Frame encoding failed at frame %d: 0x%08X\n", i, hr);
+            hrSequence = hr;
             break;
         }
+        if (g_liveStats) {
+            LIVE_STATS_ADD(framesEncoded, 1);
+            CountEncodedSamples(encoder, nalStore);
+            UpdateLiveStatsRate(&encodeRate, ++liveEncodedFrames, &g_liveStats->encodeFpsMilli);
+        }
         
-        // エンコード結果を全体のリストに追加
-        allNalUnits.insert(allNalUnits.end(), outputNalUnits.begin(), outputNalUnits.end());
+        // fMP4へはストア内のNALユニットを参照して書き込む
+        if (muxerEnabled) {
+            TRACE_SPAN("WriteFmp4", i);
+            WriteEncodedSamples(&muxer, encoder, nalStore, sampleNals);
+        }
+        if (rtpEnabled) {
+            TRACE_SPAN("PacketizeRtp", i);
+            PacketizeEncodedSamples(&packetizer, encoder, nalStore, sampleNals);
+        }
+        if (pacingEnabled) {
+            CompletePacedFrame(&pacer, decision);
+        }
         
         // 進捗表示
         if (i % 10 == 0) {
-            printf("Encoded frame %d/%d\n", i, frameCount);
+            if (input.shared) {
+                printf("Encoded frame %d\n", i);
+            } else {
+                printf("Encoded frame %d/%d\n", i, frameCount);
+            }
+        }
+    }
+
+    HRESULT hrProducer = StopEncodeInput(&input);
+    if (FAILED(hrProducer)) {
+        printf("Frame producer failed: 0x%08X\n", hrProducer);
+        if (SUCCEEDED(hrSequence)) {
+            hrSequence = hrProducer;
         }
     }
+    if (preAnalysisEnabled) {
+        PrintPreAnalysisStatistics(&preAnalyzer);
+    }
+    if (pacingEnabled) {
+        PrintPacerStatistics(&pacer);
+    }
 
-    // FlushEncoderでflush後のNALユニットもallNalUnitsに追加
-    hr = FlushEncoder(&encoder, allNalUnits);
+    // FlushEncoderでflush後のNALユニットもストアに追加
+    {
+        TRACE_SPAN("FlushEncoder", PIPELINE_TRACE_NO_FRAME);
+        hr = FlushEncoder(&encoder, &nalStore);
+    }
     if (FAILED(hr)) {
         printf("FlushEncoder failed: 0x%08X\n", hr);
+        if (SUCCEEDED(hrSequence)) {
+            hrSequence = hr;
+        }
+    } else {
+        CountEncodedSamples(encoder, nalStore);
+    }
+    
+    // 残りのサンプルを書き出してfMP4を閉じる
+    if (muxerEnabled) {
+        WriteEncodedSamples(&muxer, encoder, nalStore, sampleNals);
+        CloseFmp4Muxer(&muxer);
+    }
+    
+    // 残りのサンプルをパケット化して統計を表示
+    if (rtpEnabled) {
+        PacketizeEncodedSamples(&packetizer, encoder, nalStore, sampleNals);
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count();
+        PrintRtpStatistics(&packetizer, elapsed);
+        ShutdownRtpPacketizer(&packetizer);
     }
     
     // 注意: H.264エンコーダはPフレーム混在時、全フレームでNALユニットが出力されるとは限りません。
     // 例: 100フレーム入力してもNALユニット数が92などになる場合があります（仕様通り）。
     // 全フレーム分のNALユニットが必要な場合は全てIDR出力にしてください。
+    
+    // エンコーダーのシャットダウン
+    hr = ShutdownEncoder(&encoder);
+    if (FAILED(hr)) {
+        printf("Encoder shutdown failed: 0x%08X\n", hr);
+    }
+    return hrSequence;
+}
 
-    // 全NALユニットをファイルに書き込む
-    printf("Writing %zu NAL units to file...\n", allNalUnits.size());
+// ビットストリームのキャッシュのキーを作る関数 (エンコード結果を変えるソースと設定をすべて含める)
+static void MakeBitstreamCacheKey(const AppOptions& options, UINT32 frameCount, BitstreamCacheKey* pKey)
+{
+    InitializeBitstreamCacheKey(pKey);
+    AddBitstreamCacheKeyField(pKey, "source", "nv12_test_pattern");  // GenerateTestFrameの模様
+    AddBitstreamCacheKeyField(pKey, "frames", static_cast<UINT64>(frameCount));
+    AddBitstreamCacheKeyField(pKey, "width", static_cast<UINT64>(ENCODE_WIDTH));
+    AddBitstreamCacheKeyField(pKey, "height", static_cast<UINT64>(ENCODE_HEIGHT));
+    AddBitstreamCacheKeyField(pKey, "bitrate", static_cast<UINT64>(ENCODE_BITRATE));
+    AddBitstreamCacheKeyField(pKey, "frame_rate_num", static_cast<UINT64>(ENCODER_FRAME_RATE_NUM));
+    AddBitstreamCacheKeyField(pKey, "frame_rate_denom", static_cast<UINT64>(ENCODER_FRAME_RATE_DENOM));
+#if defined(NAL_SOFTWARE_CODEC)
+    AddBitstreamCacheKeyField(pKey, "backend", "software");
+    // スライス数 (0ならエンコーダーと同じく論理コア数) でスライスの分け方が変わる
+    UINT32 sliceCount = options.sliceCount ? options.sliceCount : std::thread::hardware_concurrency();
+    AddBitstreamCacheKeyField(pKey, "slices", static_cast<UINT64>(sliceCount));
+#else
+    AddBitstreamCacheKeyField(pKey, "backend", "media_foundation");
+#endif
+    AddBitstreamCacheKeyField(pKey, "pre_analysis", static_cast<UINT64>(options.preAnalysis ? 1 : 0));
+    AddBitstreamCacheKeyField(pKey, "skip_static", static_cast<UINT64>(options.skipStaticFrames ? 1 : 0));
+    FinishBitstreamCacheKey(pKey);
+}
+
+// 全NALユニットをoutput.h264に書き込む関数 (長さ4バイト + NALユニットの並び)
+static HRESULT WriteBitstreamFile(NalStore* pNalStore, const BitstreamCacheEntry& cacheEntry, bool cacheHit)
+{
+    const size_t nalCount = cacheHit ? cacheEntry.nalUnits.size() : GetNalStoreCount(pNalStore);
+    printf("Writing %zu NAL units to file...\n", nalCount);
     // ファイルポインタを使用してNALユニットを保存
     FILE* nalFile = fopen("output.h264", "wb");
     if (!nalFile) {
         printf("Failed to open output.h264 for writing.\n");
-        return 1;
+        return E_FAIL;
     }
 
-    for (const auto& nalUnit : allNalUnits) {
-        // NALユニット長をファイルに書き込む (ビッグエンディアン 4バイト)
-        BYTE lengthBytes[4];
-        lengthBytes[0] = (nalUnit.size() >> 24) & 0xFF;
-        lengthBytes[1] = (nalUnit.size() >> 16) & 0xFF;
-        lengthBytes[2] = (nalUnit.size() >> 8) & 0xFF;
-        lengthBytes[3] = nalUnit.size() & 0xFF;
+    {
+        TRACE_SPAN("WriteBitstream", PIPELINE_TRACE_NO_FRAME);
+        if (cacheHit) {
+            // キャッシュのファイルはoutput.h264と同じ形式なので、そのまま書き込む
+            fwrite(cacheEntry.file.pData, 1, cacheEntry.file.size, nalFile);
+        } else {
+            for (size_t i = 0; i < nalCount; i++) {
+                NalUnitView nalUnit = GetNalStoreUnit(pNalStore, i);
+                // NALユニット長をファイルに書き込む (ビッグエンディアン 4バイト)
+                BYTE lengthBytes[4];
+                lengthBytes[0] = (nalUnit.size >> 24) & 0xFF;
+                lengthBytes[1] = (nalUnit.size >> 16) & 0xFF;
+                lengthBytes[2] = (nalUnit.size >> 8) & 0xFF;
+                lengthBytes[3] = nalUnit.size & 0xFF;
 
-        fwrite(lengthBytes, 1, 4, nalFile);
-        fwrite(nalUnit.data(), 1, nalUnit.size(), nalFile);
-    }
+                fwrite(lengthBytes, 1, 4, nalFile);
+                fwrite(nalUnit.pData, 1, nalUnit.size, nalFile);
+            }
+        }
 
-    fclose(nalFile);
-    
-    // エンコーダーのシャットダウン
-    hr = ShutdownEncoder(&encoder);
-    if (FAILED(hr)) {
-        printf("Encoder shutdown failed: 0x%08X\n", hr);
+        fclose(nalFile);
     }
-    
+    return S_OK;
+}
+
+// NALユニットをデコードし、表示領域をYUVファイル (--yuv-archiveなら圧縮コンテナ) に書き込む関数
+// デコードの済んだNALユニットのメモリは、その場で解放する
+static HRESULT DecodeBitstream(const AppOptions& options, NalStore* pNalStore, BitstreamCacheEntry* pCacheEntry,
+                               bool cacheHit)
+{
+    HRESULT hr = S_OK;
+    const size_t nalCount = cacheHit ? pCacheEntry->nalUnits.size() : GetNalStoreCount(pNalStore);
+
     // デコードプロセスの開始
     printf("\n--- Starting decoding process ---\n");
     
     // デコーダーオブジェクトの作成
     NalDecoder decoder;
     
-    // YUVファイルを開く（main関数で管理）
-    const char* outputYuvFilename = "output.yuv";
-    std::ofstream yuvFile(outputYuvFilename, std::ios::binary | std::ios::trunc);
-    if (!yuvFile.is_open()) {
-        printf("Failed to create output YUV file: %s\n", outputYuvFilename);
-        CoUninitialize();
-        return 1;
+    // YUVファイルを開く（この関数で管理）
+    // --yuv-archiveなら、output.yuvの代わりに圧縮コンテナに書く
+    const char* outputYuvFilename = options.yuvArchiveFilename ? options.yuvArchiveFilename : "output.yuv";
+    std::ofstream yuvFile;
+    YuvArchiveWriter yuvArchive;
+    YuvArchiveWriter* pYuvArchive = NULL;
+    if (options.yuvArchiveFilename) {
+        hr = OpenYuvArchive(&yuvArchive, options.yuvArchiveFilename);
+        if (FAILED(hr)) {
+            return hr;
+        }
+        pYuvArchive = &yuvArchive;
+    } else {
+        yuvFile.open(outputYuvFilename, std::ios::binary | std::ios::trunc);
+        if (!yuvFile.is_open()) {
+            printf("Failed to create output YUV file: %s\n", outputYuvFilename);
+            return E_FAIL;
+        }
     }
     
     // デコーダーの初期化（ファイル名を渡さない）
-    hr = InitializeDecoder(&decoder, encoder.width, encoder.height);
+    hr = InitializeDecoder(&decoder, ENCODE_WIDTH, ENCODE_HEIGHT);
     if (FAILED(hr)) {
         printf("Decoder initialization failed: 0x%08X\n", hr);
         yuvFile.close();
-        CoUninitialize();
-        return 1;
+        if (pYuvArchive) {
+            CloseYuvArchive(pYuvArchive);
+        }
+        return hr;
     }
     
     // NALユニットをデコード
-    printf("Decoding %zu NAL units...\n", allNalUnits.size());
+    printf("Decoding %zu NAL units...\n", nalCount);
     
     // 一部のNALユニット(SPS, PPS)は複数回送信する必要がある場合があるので、
     // IDRフレームの前にSPS/PPSを常に送るようにする
     std::vector<BYTE> spsData;
     std::vector<BYTE> ppsData;
     
-    for (const auto& nalUnit : allNalUnits) {
-        if (nalUnit.size() > 0) {
-            // NALユニットタイプの判定 (最初のバイトの下位5ビット)
-            BYTE nalType = nalUnit[0] & 0x1F;
-            
-            // デコードされたフレームデータを格納するためのベクター
-            std::vector<BYTE> decodedFrameData;
-            hr = DecodeNalUnit(&decoder, nalUnit, &decodedFrameData);
+    // デコード結果を受け取るフレーム（表示領域 = クロップ後のサイズ）
+    Nv12Frame decodedFrame = {0};
+    hr = AllocateNv12Frame(&decodedFrame, decoder.width, decoder.height);
+    if (FAILED(hr)) {
+        printf("Frame allocation failed: 0x%08X\n", hr);
+        ShutdownDecoder(&decoder);
+        yuvFile.close();
+        if (pYuvArchive) {
+            CloseYuvArchive(pYuvArchive);
+        }
+        return hr;
+    }
+    
+    UINT64 decodedFrameCount = 0;  // トレースのフレーム番号 (次に出力されるフレーム)
+    LiveStatsRateMeter decodeRate;
+    StartLiveStatsRate(&decodeRate, 0);
+    for (size_t i = 0; i < nalCount; i++) {
+        NalUnitView nalUnit = cacheHit ? pCacheEntry->nalUnits[i] : GetNalStoreUnit(pNalStore, i);
+        if (nalUnit.size > 0) {
+            BOOL frameDecoded = FALSE;
+            {
+                TRACE_SPAN("DecodeNalUnit", decodedFrameCount);
+                hr = DecodeNalUnit(&decoder, nalUnit.pData, nalUnit.size, &decodedFrame, &frameDecoded);
+            }
             if (FAILED(hr)) {
-                printf("Failed to decode NAL unit type %d: 0x%08X\n", nalType, hr);
+                printf("Failed to decode NAL unit type %d: 0x%08X\n", nalUnit.type, hr);
             }
             
-            // 有効なYUVデータが得られた場合はファイルに書き込む（main関数で実行）
-            if (!decodedFrameData.empty()) {
-                yuvFile.write(reinterpret_cast<const char*>(decodedFrameData.data()), decodedFrameData.size());
+            // 有効なYUVデータが得られた場合は表示領域だけをファイルに書き込む（この関数で実行）
+            if (frameDecoded) {
+                TRACE_SPAN("WriteYuvFrame", decodedFrameCount);
+                WriteDecodedFrame(yuvFile, pYuvArchive, &decodedFrame);
+                decodedFrameCount++;
+                if (g_liveStats) {
+                    LIVE_STATS_ADD(framesDecoded, 1);
+                    UpdateLiveStatsRate(&decodeRate, decodedFrameCount, &g_liveStats->decodeFpsMilli);
+                }
             }
         }
+        
+        // デコードの済んだNALユニットだけのチャンクは、その場で解放する
+        if (!cacheHit) {
+            ReleaseNalStoreChunks(pNalStore, i + 1);
+        }
     }
+    FreeNv12Frame(&decodedFrame);
+    FreeNalStore(pNalStore);
+    CloseBitstreamCacheEntry(pCacheEntry);
 
     // FlushDecoderで残りの出力フレームを取得
-    std::vector<std::vector<BYTE>> flushedFrames;
-    hr = FlushDecoder(&decoder, flushedFrames);
+    std::vector<Nv12Frame> flushedFrames;
+    {
+        TRACE_SPAN("FlushDecoder", PIPELINE_TRACE_NO_FRAME);
+        hr = FlushDecoder(&decoder, flushedFrames);
+    }
     if (FAILED(hr)) {
         printf("FlushDecoder failed: 0x%08X\n", hr);
     }
     
     // フラッシュで得られたフレームもYUVファイルに書き込む
-    for (const auto& frame : flushedFrames) {
-        yuvFile.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+    for (auto& frame : flushedFrames) {
+        TRACE_SPAN("WriteYuvFrame", decodedFrameCount);
+        WriteDecodedFrame(yuvFile, pYuvArchive, &frame);
+        FreeNv12Frame(&frame);
+        decodedFrameCount++;
+        LIVE_STATS_ADD(framesDecoded, 1);
     }
 
-    // YUVファイルを閉じる（main関数で管理）
+    // YUVファイルを閉じる（この関数で管理）
     yuvFile.close();
+    if (pYuvArchive) {
+        CloseYuvArchive(pYuvArchive);
+        PrintYuvArchiveStatistics(pYuvArchive);
+    }
     printf("YUV output file closed: %s\n", outputYuvFilename);
     
     // デコーダーのシャットダウン
@@ -185,11 +1035,117 @@ int main()
     if (FAILED(hr)) {
         printf("Decoder shutdown failed: 0x%08X\n", hr);
     }
+    return hr;
+}
+
+// エンコード (キャッシュにヒットすれば読み込み) からデコードまでを行う関数
+// 途中で失敗しても、NALユニットのストアとキャッシュのエントリーはここで解放する
+static HRESULT EncodeAndDecode(const AppOptions& options)
+{
+    // ビットストリームのキャッシュ (ヒットすればエンコーダーを起動せず、キャッシュのファイルをそのままデコードする)
+    // リアルタイムのペーシングでは間引くフレームが時刻で変わり、--shm-inputではフレームが別のプロセスから来るので使わない
+    // fMP4・RTPはエンコードしながら出力するので、キャッシュを探さずにエンコードする (結果はキャッシュに入れる)
+    const UINT32 frameCount = ENCODE_FRAME_COUNT;
+    const char* cacheDirectory = (options.realtime || options.shmInputName) ? NULL : options.bitstreamCacheDirectory;
+    if (options.bitstreamCacheDirectory && !cacheDirectory) {
+        printf("--bitstream-cache is ignored with --realtime and --shm-input\n");
+    }
+    BitstreamCacheKey cacheKey;
+    BitstreamCacheEntry cacheEntry;
+    bool cacheHit = false;
+    if (cacheDirectory) {
+        MakeBitstreamCacheKey(options, frameCount, &cacheKey);
+        if (!options.fmp4Filename && !options.rtpPcapFilename && !options.rtpUdpAddress) {
+            cacheHit = LookupBitstreamCache(cacheDirectory, &cacheKey, &cacheEntry) == S_OK;
+        }
+    }
     
-    // COMのクリーンアップ
-    CoUninitialize();
+    // すべてのエンコード結果を格納するストア（NALユニットは大きなチャンクに詰め、位置は小さな表で持つ）
+    NalStore nalStore;
+    InitializeNalStore(&nalStore);
+    // 途中で失敗したときは、それまでのNALユニットを書き出してデコードするが、キャッシュには入れない
+    HRESULT hrEncode = S_OK;
+    if (!cacheHit) {
+        hrEncode = EncodeTestSequence(options, frameCount, nalStore);
+        if (FAILED(hrEncode) && GetNalStoreCount(&nalStore) == 0) {
+            FreeNalStore(&nalStore);
+            return hrEncode;
+        }
+        if (FAILED(hrEncode)) {
+            printf("Encoding did not complete (0x%08X); the bitstream is partial\n", hrEncode);
+        }
+        PrintNalStoreStatistics(&nalStore);
+    }
+    
+    HRESULT hr = WriteBitstreamFile(&nalStore, cacheEntry, cacheHit);
+    if (SUCCEEDED(hr) && cacheDirectory && !cacheHit && SUCCEEDED(hrEncode)) {
+        StoreBitstreamCache(cacheDirectory, &cacheKey, &nalStore);
+    }
+    if (SUCCEEDED(hr)) {
+        hr = DecodeBitstream(options, &nalStore, &cacheEntry, cacheHit);
+    }
+    FreeNalStore(&nalStore);
+    CloseBitstreamCacheEntry(&cacheEntry);
+    return FAILED(hr) ? hr : hrEncode;
+}
+
+int main(int argc, char* argv[])
+{
+    HRESULT hr = S_OK;
+    AppOptions options;
+    if (!ParseOptions(argc, argv, &options)) {
+        return 1;
+    }
+    StartTraceIfRequested(options);
+    SetFrameMemoryOptions(options.hugePages, options.numaBinding);
+
+    // COMの初期化
+    hr = InitializeCom();
+    if (FAILED(hr)) {
+        printf("CoInitializeEx failed: 0x%08X\n", hr);
+        return 1;
+    }
     
-    printf("NAL encoding and decoding completed.\n");
+    // バッチAPIのベンチマークは単一エンコード・デコードの代わりに実行する
+    if (options.batchBench) {
+        hr = RunBatchBenchmark(options);
+        FinishTraceIfRequested(options);
+        UninitializeCom();
+        return FAILED(hr) ? 1 : 0;
+    }
     
+    // ラダーモードは単一エンコード・デコードの代わりに実行する
+    if (options.ladder) {
+#if defined(NAL_SOFTWARE_CODEC)
+        printf("--ladder requires the Media Foundation encoder\n");
+        hr = E_NOTIMPL;
+#else
+        hr = RunLadder(options, ENCODE_FRAME_COUNT);
+        PrintFrameMemoryStatistics();
+#endif
+        FinishTraceIfRequested(options);
+        UninitializeCom();
+        return FAILED(hr) ? 1 : 0;
+    }
+    
+    // ライブカウンター (エンコーダーの初期化で入力プールのサイズを書き込むので先に作る)
+    LiveStats liveStats = {};
+    if (options.liveStatsName && FAILED(CreateLiveStats(&liveStats, options.liveStatsName))) {
+        printf("Live stats disabled\n");
+    }
+    
+    // 途中で失敗しても、ライブカウンター・トレース・COMの後始末はここでまとめて行う
+    hr = EncodeAndDecode(options);
+    
+    PrintFrameMemoryStatistics();
+    FinishTraceIfRequested(options);
+    CloseLiveStats(&liveStats);
+    
+    // COMのクリーンアップ
+    UninitializeCom();
+    
+    if (SUCCEEDED(hr)) {
+        printf("NAL encoding and decoding completed.\n");
+    }
     return SUCCEEDED(hr) ? 0 : 1;
 }
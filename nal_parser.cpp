@@ -0,0 +1,82 @@
+#include "nal_parser.h"
+#include "nal_emulation.h"
+
+// [pos, size) で次のスタートコード (00 00 01 / 00 00 00 01) の位置を返す
+size_t FindStartCode(const BYTE* data, size_t pos, size_t size, size_t* pStartCodeLength)
+{
+    const size_t begin = pos;
+    while (pos < size) {
+        // 00 00 の候補はSIMDで探す
+        size_t z = FindZeroPair(data, pos, size);
+        if (z + 2 >= size) {
+            return size;
+        }
+        if (data[z + 2] == 0x01) {
+            // 直前にもう1つ00があれば4バイトのスタートコード
+            if (z > begin && data[z - 1] == 0x00) {
+                *pStartCodeLength = 4;
+                return z - 1;
+            }
+            *pStartCodeLength = 3;
+            return z;
+        }
+        pos = z + 1;
+    }
+    return size;
+}
+
+// バッファをNALユニットに分割してnalUnitsの末尾に追加する関数
+void SplitNalUnits(const BYTE* data, size_t size, std::vector<NalUnitView>& nalUnits)
+{
+    if (!data || size == 0) {
+        return;
+    }
+
+    size_t startCodeLength = 0;
+    size_t start = FindStartCode(data, 0, size, &startCodeLength);
+    if (start >= size) {
+        // スタートコードなし: 長さプレフィックス形式などでNALユニット1つ分が渡されている
+        NalUnitView view = { data, size, GetNalUnitType(data[0]) };
+        nalUnits.push_back(view);
+        return;
+    }
+
+    while (start < size) {
+        size_t nalStart = start + startCodeLength;
+        size_t nextLength = 0;
+        size_t next = FindStartCode(data, nalStart, size, &nextLength);
+
+        // 次のスタートコードまでの末尾のゼロ (trailing_zero_8bits) を除く
+        size_t nalEnd = next;
+        while (nalEnd > nalStart && data[nalEnd - 1] == 0x00) {
+            nalEnd--;
+        }
+        if (nalEnd > nalStart) {
+            NalUnitView view = { data + nalStart, nalEnd - nalStart, GetNalUnitType(data[nalStart]) };
+            nalUnits.push_back(view);
+        }
+
+        start = next;
+        startCodeLength = nextLength;
+    }
+}
+
+// nal_unit_typeの名前を返す (ログ・レポート用)
+const char* GetNalUnitTypeName(BYTE type)
+{
+    switch (type) {
+    case NAL_TYPE_SLICE: return "slice";
+    case NAL_TYPE_SLICE_DPA: return "slice_dpa";
+    case NAL_TYPE_SLICE_DPB: return "slice_dpb";
+    case NAL_TYPE_SLICE_DPC: return "slice_dpc";
+    case NAL_TYPE_IDR: return "idr";
+    case NAL_TYPE_SEI: return "sei";
+    case NAL_TYPE_SPS: return "sps";
+    case NAL_TYPE_PPS: return "pps";
+    case NAL_TYPE_AUD: return "aud";
+    case NAL_TYPE_END_OF_SEQUENCE: return "end_of_seq";
+    case NAL_TYPE_END_OF_STREAM: return "end_of_stream";
+    case NAL_TYPE_FILLER: return "filler";
+    default: return "other";
+    }
+}
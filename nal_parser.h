@@ -0,0 +1,54 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stddef.h>
+#include <vector>
+
+// H.264のNALユニットタイプ (nal_unit_type)
+enum NalUnitType {
+    NAL_TYPE_UNSPECIFIED = 0,
+    NAL_TYPE_SLICE = 1,                // 非IDRスライス
+    NAL_TYPE_SLICE_DPA = 2,            // データパーティションA
+    NAL_TYPE_SLICE_DPB = 3,            // データパーティションB
+    NAL_TYPE_SLICE_DPC = 4,            // データパーティションC
+    NAL_TYPE_IDR = 5,                  // IDRスライス
+    NAL_TYPE_SEI = 6,
+    NAL_TYPE_SPS = 7,
+    NAL_TYPE_PPS = 8,
+    NAL_TYPE_AUD = 9,                  // アクセスユニットデリミタ
+    NAL_TYPE_END_OF_SEQUENCE = 10,
+    NAL_TYPE_END_OF_STREAM = 11,
+    NAL_TYPE_FILLER = 12
+};
+
+// バッファ内のNALユニットを指すビュー (データはコピーしない)
+struct NalUnitView {
+    const BYTE* pData;                 // NALヘッダーから始まるデータ
+    size_t size;                       // NALユニットのサイズ (スタートコードを含まない)
+    BYTE type;                         // nal_unit_type
+};
+
+// NALヘッダーからnal_unit_typeを取り出す
+inline BYTE GetNalUnitType(BYTE header)
+{
+    return header & 0x1F;
+}
+
+// スライス (VCL NAL) かどうか
+inline bool IsSliceNalType(BYTE type)
+{
+    return type >= NAL_TYPE_SLICE && type <= NAL_TYPE_IDR;
+}
+
+// [pos, size) で次のスタートコード (00 00 01 / 00 00 00 01) の位置を返す
+// 見つからなければsizeを返す。pStartCodeLengthには3か4が入る
+size_t FindStartCode(const BYTE* data, size_t pos, size_t size, size_t* pStartCodeLength);
+
+// バッファをNALユニットに分割してnalUnitsの末尾に追加する関数
+// - スタートコードを含む場合 (Annex B) は、それを区切りとして分割する
+//   (最初のスタートコードより前のバイトと、各NAL末尾のゼロバイトは読み捨てる)
+// - スタートコードを含まない場合は、バッファ全体を1つのNALユニットとして扱う
+void SplitNalUnits(const BYTE* data, size_t size, std::vector<NalUnitView>& nalUnits);
+
+// nal_unit_typeの名前を返す (ログ・レポート用)
+const char* GetNalUnitTypeName(BYTE type);
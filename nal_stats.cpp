@@ -0,0 +1,140 @@
+// ライブカウンターの読み取りツール
+// nal_encode_decode --live-stats が作成した共有メモリを読み、表またはPrometheusのテキスト形式で表示する
+#include "live_stats.h"
+#include "nal_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [--name <shm name>] [--prometheus] [--watch <ms>]\n", program);
+}
+
+static UINT64 Load(const std::atomic<UINT64>& value)
+{
+    return value.load(std::memory_order_relaxed);
+}
+
+// 人が読む表
+static void PrintTable(const LiveStatsBlock* pBlock)
+{
+    printf("pid %u, frames in %llu, encoded %llu, dropped %llu, skipped %llu, samples out %llu, decoded %llu\n",
+           pBlock->pid, static_cast<unsigned long long>(Load(pBlock->framesIn)),
+           static_cast<unsigned long long>(Load(pBlock->framesEncoded)),
+           static_cast<unsigned long long>(Load(pBlock->framesDropped)),
+           static_cast<unsigned long long>(Load(pBlock->framesSkipped)),
+           static_cast<unsigned long long>(Load(pBlock->samplesOut)),
+           static_cast<unsigned long long>(Load(pBlock->framesDecoded)));
+    printf("encode %.1f fps, decode %.1f fps, input queue %llu, input pool %llu/%llu in use, MF samples created %llu\n",
+           Load(pBlock->encodeFpsMilli) / 1000.0, Load(pBlock->decodeFpsMilli) / 1000.0,
+           static_cast<unsigned long long>(Load(pBlock->inputQueueDepth)),
+           static_cast<unsigned long long>(Load(pBlock->inputPoolInUse)),
+           static_cast<unsigned long long>(Load(pBlock->inputPoolSize)),
+           static_cast<unsigned long long>(Load(pBlock->samplesCreated)));
+    printf("type  name                              count         bytes\n");
+    for (int type = 0; type < LIVE_STATS_NAL_TYPES; type++) {
+        UINT64 count = Load(pBlock->nalCount[type]);
+        if (count == 0) {
+            continue;
+        }
+        printf("%4d  %-28s %10llu %13llu\n", type, GetNalUnitTypeName(static_cast<BYTE>(type)),
+               static_cast<unsigned long long>(count), static_cast<unsigned long long>(Load(pBlock->nalBytes[type])));
+    }
+}
+
+// Prometheusのテキスト形式 (1つのメトリクス)
+static void PrintMetric(const char* name, const char* type, const char* help, UINT32 pid, double value)
+{
+    printf("# HELP %s %s\n# TYPE %s %s\n%s{pid=\"%u\"} %.15g\n", name, help, name, type, name, pid, value);
+}
+
+static void PrintPrometheus(const LiveStatsBlock* pBlock)
+{
+    const UINT32 pid = pBlock->pid;
+    PrintMetric("nal_frames_in_total", "counter", "Frames captured or generated.", pid,
+                static_cast<double>(Load(pBlock->framesIn)));
+    PrintMetric("nal_frames_encoded_total", "counter", "Frames submitted to the encoder.", pid,
+                static_cast<double>(Load(pBlock->framesEncoded)));
+    PrintMetric("nal_frames_dropped_total", "counter", "Frames dropped for missing their deadline.", pid,
+                static_cast<double>(Load(pBlock->framesDropped)));
+    PrintMetric("nal_frames_skipped_total", "counter", "Static frames skipped by pre-analysis.", pid,
+                static_cast<double>(Load(pBlock->framesSkipped)));
+    PrintMetric("nal_samples_out_total", "counter", "Samples produced by the encoder.", pid,
+                static_cast<double>(Load(pBlock->samplesOut)));
+    PrintMetric("nal_frames_decoded_total", "counter", "Frames output by the decoder.", pid,
+                static_cast<double>(Load(pBlock->framesDecoded)));
+    PrintMetric("nal_mf_samples_created_total", "counter", "Media Foundation samples created.", pid,
+                static_cast<double>(Load(pBlock->samplesCreated)));
+    PrintMetric("nal_encode_fps", "gauge", "Recent encode frame rate.", pid, Load(pBlock->encodeFpsMilli) / 1000.0);
+    PrintMetric("nal_decode_fps", "gauge", "Recent decode frame rate.", pid, Load(pBlock->decodeFpsMilli) / 1000.0);
+    PrintMetric("nal_input_queue_depth", "gauge", "Frames generated and waiting for the encoder.", pid,
+                static_cast<double>(Load(pBlock->inputQueueDepth)));
+    PrintMetric("nal_input_pool_size", "gauge", "Frames in the encoder input pool.", pid,
+                static_cast<double>(Load(pBlock->inputPoolSize)));
+    PrintMetric("nal_input_pool_in_use", "gauge", "Encoder input pool frames currently acquired.", pid,
+                static_cast<double>(Load(pBlock->inputPoolInUse)));
+    PrintMetric("nal_last_update_timestamp_seconds", "gauge", "Time the writer last refreshed its rates.", pid,
+                Load(pBlock->updateTimeMs) / 1000.0);
+
+    printf("# HELP nal_units_total NAL units produced by the encoder.\n# TYPE nal_units_total counter\n");
+    for (int type = 0; type < LIVE_STATS_NAL_TYPES; type++) {
+        UINT64 count = Load(pBlock->nalCount[type]);
+        if (count > 0) {
+            printf("nal_units_total{pid=\"%u\",nal_type=\"%d\"} %llu\n", pid, type,
+                   static_cast<unsigned long long>(count));
+        }
+    }
+    printf("# HELP nal_bytes_total NAL unit payload bytes produced by the encoder.\n# TYPE nal_bytes_total counter\n");
+    for (int type = 0; type < LIVE_STATS_NAL_TYPES; type++) {
+        if (Load(pBlock->nalCount[type]) > 0) {
+            printf("nal_bytes_total{pid=\"%u\",nal_type=\"%d\"} %llu\n", pid, type,
+                   static_cast<unsigned long long>(Load(pBlock->nalBytes[type])));
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = LIVE_STATS_DEFAULT_NAME;
+    bool prometheus = false;
+    int watchMs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--prometheus") == 0) {
+            prometheus = true;
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            watchMs = atoi(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    LiveStats stats;
+    HRESULT hr = OpenLiveStats(&stats, name);
+    if (FAILED(hr)) {
+        printf("No live stats found: %s (is nal_encode_decode running with --live-stats?)\n", name);
+        return 1;
+    }
+
+    // --watchなら、書き手が終了して共有メモリが消えても最後の値を表示し続ける
+    do {
+        if (prometheus) {
+            PrintPrometheus(stats.pBlock);
+        } else {
+            PrintTable(stats.pBlock);
+        }
+        fflush(stdout);
+        if (watchMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(watchMs));
+            printf("\n");
+        }
+    } while (watchMs > 0);
+
+    CloseLiveStats(&stats);
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "nal_store.h"
+#include <stdio.h>
+#include <string.h>
+
+// ストアを初期化する関数
+HRESULT InitializeNalStore(NalStore* pStore, size_t chunkSize)
+{
+    if (!pStore) {
+        return E_POINTER;
+    }
+    if (chunkSize == 0 || chunkSize > 0xFFFFFFFFu) {
+        return E_INVALIDARG;
+    }
+
+    pStore->chunks.clear();
+    pStore->spareChunks.clear();
+    pStore->entries.clear();
+    GetThreadFrameMemoryPolicy(&pStore->memoryPolicy);
+    pStore->chunkSize = chunkSize;
+    pStore->releasedChunks = 0;
+    pStore->firstLiveEntry = 0;
+    pStore->totalBytes = 0;
+    pStore->chunkAllocations = 0;
+    return S_OK;
+}
+
+// チャンクのメモリを解放する
+static void FreeChunk(NalStoreChunk* pChunk)
+{
+    FreeFrameMemory(pChunk->pData, pChunk->capacity, pChunk->memoryKind);
+    pChunk->pData = NULL;
+    pChunk->capacity = 0;
+}
+
+// sizeバイトが入るチャンクを末尾に用意する (確保できなければNULL)
+static NalStoreChunk* PrepareChunk(NalStore* pStore, size_t size)
+{
+    if (!pStore->chunks.empty()) {
+        NalStoreChunk& last = pStore->chunks.back();
+        if (last.capacity - last.used >= size) {
+            return &last;
+        }
+    }
+
+    // 通常のサイズなら解放済みのチャンクを使い回し、大きなNALユニットには専用のチャンクを確保する
+    NalStoreChunk chunk = {};
+    if (size <= pStore->chunkSize && !pStore->spareChunks.empty()) {
+        chunk = pStore->spareChunks.back();
+        pStore->spareChunks.pop_back();
+    } else {
+        chunk.capacity = size > pStore->chunkSize ? size : pStore->chunkSize;
+        if (FAILED(AllocateFrameMemory(chunk.capacity, &pStore->memoryPolicy, &chunk.pData, &chunk.memoryKind))) {
+            return NULL;
+        }
+        pStore->chunkAllocations++;
+    }
+    chunk.used = 0;
+    pStore->chunks.push_back(chunk);
+    return &pStore->chunks.back();
+}
+
+// NALユニットを末尾に追加する関数
+HRESULT AppendNalUnit(NalStore* pStore, const BYTE* pData, size_t size, size_t* pIndex)
+{
+    if (!pStore || (!pData && size > 0)) {
+        return E_POINTER;
+    }
+    if (size > 0xFFFFFFFFu) {
+        return E_INVALIDARG;
+    }
+
+    NalStoreChunk* pChunk = PrepareChunk(pStore, size);
+    if (!pChunk) {
+        return E_OUTOFMEMORY;
+    }
+    NalStoreEntry entry;
+    entry.chunk = pStore->releasedChunks + static_cast<UINT32>(pStore->chunks.size() - 1);
+    entry.offset = static_cast<UINT32>(pChunk->used);
+    entry.size = static_cast<UINT32>(size);
+    entry.type = size > 0 ? GetNalUnitType(pData[0]) : 0;
+    if (size > 0) {
+        memcpy(pChunk->pData + pChunk->used, pData, size);
+    }
+    pChunk->used += size;
+
+    if (pIndex) {
+        *pIndex = pStore->entries.size();
+    }
+    pStore->entries.push_back(entry);
+    pStore->totalBytes += size;
+    return S_OK;
+}
+
+// NALユニットを指すビューを返す関数
+NalUnitView GetNalStoreUnit(const NalStore* pStore, size_t index)
+{
+    const NalStoreEntry& entry = pStore->entries[index];
+    const NalStoreChunk& chunk = pStore->chunks[entry.chunk - pStore->releasedChunks];
+    NalUnitView view;
+    view.pData = chunk.pData + entry.offset;
+    view.size = entry.size;
+    view.type = entry.type;
+    return view;
+}
+
+// 範囲のNALユニットのビューを追加する関数
+void GetNalStoreUnits(const NalStore* pStore, size_t first, size_t count, std::vector<NalUnitView>& views)
+{
+    for (size_t i = first; i < first + count; i++) {
+        views.push_back(GetNalStoreUnit(pStore, i));
+    }
+}
+
+// endIndexより前のNALユニットだけを含むチャンクを解放する関数
+void ReleaseNalStoreChunks(NalStore* pStore, size_t endIndex)
+{
+    if (endIndex > pStore->entries.size()) {
+        endIndex = pStore->entries.size();
+    }
+    if (endIndex <= pStore->firstLiveEntry) {
+        return;
+    }
+
+    // endIndexのNALユニットがあるチャンクより前を解放する (最後まで使い終わったなら全部)
+    UINT32 endChunk = (endIndex < pStore->entries.size()) ? pStore->entries[endIndex].chunk
+                                                          : pStore->releasedChunks + static_cast<UINT32>(pStore->chunks.size());
+    size_t releaseCount = endChunk - pStore->releasedChunks;
+    for (size_t i = 0; i < releaseCount; i++) {
+        NalStoreChunk& chunk = pStore->chunks[i];
+        if (chunk.capacity == pStore->chunkSize && pStore->spareChunks.size() < NAL_STORE_MAX_SPARE_CHUNKS) {
+            pStore->spareChunks.push_back(chunk);
+        } else {
+            FreeChunk(&chunk);
+        }
+    }
+    pStore->chunks.erase(pStore->chunks.begin(), pStore->chunks.begin() + releaseCount);
+    pStore->releasedChunks = endChunk;
+    pStore->firstLiveEntry = endIndex;
+}
+
+// すべてのチャンクと表を解放する関数
+void FreeNalStore(NalStore* pStore)
+{
+    if (!pStore) {
+        return;
+    }
+    for (NalStoreChunk& chunk : pStore->chunks) {
+        FreeChunk(&chunk);
+    }
+    for (NalStoreChunk& chunk : pStore->spareChunks) {
+        FreeChunk(&chunk);
+    }
+    std::vector<NalStoreChunk>().swap(pStore->chunks);
+    std::vector<NalStoreChunk>().swap(pStore->spareChunks);
+    std::vector<NalStoreEntry>().swap(pStore->entries);
+    pStore->releasedChunks = 0;
+    pStore->firstLiveEntry = 0;
+}
+
+// 統計情報を表示する関数
+void PrintNalStoreStatistics(const NalStore* pStore)
+{
+    printf("NAL store: %zu NAL units, %.1f KB, %llu chunk allocations (%zu KB chunks)\n",
+           pStore->entries.size(), pStore->totalBytes / 1024.0,
+           static_cast<unsigned long long>(pStore->chunkAllocations), pStore->chunkSize / 1024);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nal_parser.h"
+#include "frame_memory.h"
+#include <stddef.h>
+#include <vector>
+
+// エンコード結果のNALユニットを大きなチャンクに詰めて保持するストア
+// - ペイロードは固定容量のチャンクに続けて詰め、位置・長さ・タイプは小さな表で持つ
+//   (NALユニットごとの確保も、外側の配列の再確保に伴うペイロードのコピーもない)
+// - チャンクは再確保しないので、追加したNALユニットを指すポインターはそのチャンクを解放するまで有効
+//   (fMP4のマルチプレクサーのように、フラグメントを書き出すまで参照を持つ使い方ができる)
+// - 使い終わった先頭側のチャンクはまとめて解放でき、解放したチャンクは次の追加で再利用する
+// - チャンクはフレームメモリ (ヒュージページ、初期化したスレッドのNUMAノード) から確保する
+
+// 既定のチャンクサイズ
+#define NAL_STORE_DEFAULT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// 再利用のために取っておくチャンクの上限
+#define NAL_STORE_MAX_SPARE_CHUNKS 2
+
+// NALユニット1つ分の位置 (16バイト)
+struct NalStoreEntry {
+    UINT32 chunk;                      // チャンクの通し番号 (解放しても番号は変わらない)
+    UINT32 offset;                     // チャンク内の先頭
+    UINT32 size;                       // バイト数 (スタートコードなし)
+    BYTE type;                         // nal_unit_type
+};
+
+// ペイロードを詰めるチャンク
+struct NalStoreChunk {
+    BYTE* pData;                       // 確保時に容量いっぱいまで確保し、以降はサイズを変えない
+    size_t capacity;                   // 容量
+    UINT32 memoryKind;                 // 確保方法 (FrameMemoryKind)
+    size_t used;                       // 詰めたバイト数
+};
+
+// NALストア構造体
+struct NalStore {
+    std::vector<NalStoreChunk> chunks; // 解放されていないチャンク (chunks[0]の通し番号がreleasedChunks)
+    std::vector<NalStoreChunk> spareChunks; // 解放して再利用を待つチャンク
+    std::vector<NalStoreEntry> entries; // 追加したすべてのNALユニット (追加順)
+    size_t chunkSize;                  // チャンクの容量 (これより大きいNALユニットは専用のチャンクにする)
+    UINT32 releasedChunks;             // 解放したチャンク数
+    size_t firstLiveEntry;             // 解放されていない最初のNALユニット
+    FrameMemoryPolicy memoryPolicy;    // チャンクの確保に使うポリシー
+
+    // 統計情報
+    UINT64 totalBytes;                 // 追加したペイロードの合計
+    UINT64 chunkAllocations;           // チャンクを確保した回数 (再利用は含まない)
+};
+
+// ストアを初期化する関数 (チャンクは最初の追加で確保する)
+HRESULT InitializeNalStore(NalStore* pStore, size_t chunkSize = NAL_STORE_DEFAULT_CHUNK_SIZE);
+
+// NALユニット (スタートコードなし) を末尾に追加する関数 (pIndexには追加したNALユニットの番号が入る)
+HRESULT AppendNalUnit(NalStore* pStore, const BYTE* pData, size_t size, size_t* pIndex = NULL);
+
+// 追加したNALユニットの数を返す (解放したものも含む通し番号の上限)
+inline size_t GetNalStoreCount(const NalStore* pStore)
+{
+    return pStore->entries.size();
+}
+
+// NALユニットを指すビューを返す関数 (indexはfirstLiveEntry以上であること)
+NalUnitView GetNalStoreUnit(const NalStore* pStore, size_t index);
+
+// [first, first + count) のNALユニットのビューをviewsの末尾に追加する関数
+void GetNalStoreUnits(const NalStore* pStore, size_t first, size_t count, std::vector<NalUnitView>& views);
+
+// endIndexより前のNALユニットだけを含むチャンクを解放する関数
+// (endIndexのNALユニットと同じチャンクにあるものは、チャンクごと残る)
+void ReleaseNalStoreChunks(NalStore* pStore, size_t endIndex);
+
+// すべてのチャンクと表を解放する関数
+void FreeNalStore(NalStore* pStore);
+
+// 統計情報を表示する関数
+void PrintNalStoreStatistics(const NalStore* pStore);
@@ -0,0 +1,190 @@
+#include "nv12_frame.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// 表示サイズwidth x heightのフレームを確保する関数
+HRESULT AllocateNv12Frame(Nv12Frame* pFrame, UINT32 width, UINT32 height,
+                          UINT32 paddedHeight, UINT32 stride, const FrameMemoryPolicy* pPolicy)
+{
+    if (!pFrame || width == 0 || height == 0 || (width & 1) || (height & 1)) {
+        return E_INVALIDARG;
+    }
+    if (paddedHeight == 0) {
+        paddedHeight = AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT);
+    }
+    if (stride == 0) {
+        stride = AlignUp(width, NV12_FRAME_ALIGNMENT);
+    }
+    if (paddedHeight < height || (paddedHeight & 1) || stride < width) {
+        return E_INVALIDARG;
+    }
+
+    // UVプレーンの先頭もアラインされるように、Yプレーンのサイズを切り上げる
+    size_t ySize = static_cast<size_t>(stride) * paddedHeight;
+    size_t uvOffset = (ySize + NV12_FRAME_ALIGNMENT - 1) & ~static_cast<size_t>(NV12_FRAME_ALIGNMENT - 1);
+    size_t totalSize = uvOffset + static_cast<size_t>(stride) * (paddedHeight / 2);
+
+    BYTE* pBuffer = NULL;
+    UINT32 memoryKind = FRAME_MEMORY_HEAP;
+    HRESULT hr = AllocateFrameMemory(totalSize, pPolicy, &pBuffer, &memoryKind);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    pFrame->pBuffer = pBuffer;
+    pFrame->bufferSize = totalSize;
+    pFrame->memoryKind = memoryKind;
+    pFrame->pY = pBuffer;
+    pFrame->pUV = pBuffer + uvOffset;
+    pFrame->width = width;
+    pFrame->height = paddedHeight;
+    pFrame->stride = stride;
+    pFrame->cropLeft = 0;
+    pFrame->cropTop = 0;
+    pFrame->cropWidth = width;
+    pFrame->cropHeight = height;
+
+    return S_OK;
+}
+
+// フレームのバッファを解放する関数
+void FreeNv12Frame(Nv12Frame* pFrame)
+{
+    if (!pFrame) {
+        return;
+    }
+    if (pFrame->pBuffer) {
+        FreeFrameMemory(pFrame->pBuffer, pFrame->bufferSize, pFrame->memoryKind);
+    }
+    memset(pFrame, 0, sizeof(*pFrame));
+}
+
+// 隙間なく詰めたNV12 (width x height) のサイズを返す
+size_t GetNv12PackedSize(UINT32 width, UINT32 height)
+{
+    return static_cast<size_t>(width) * height * 3 / 2;
+}
+
+// ピッチの異なるプレーン間で行をコピーする
+static void CopyPlane(BYTE* dst, size_t dstStride, const BYTE* src, size_t srcStride,
+                      size_t rowBytes, UINT32 rows)
+{
+    if (dstStride == srcStride && rowBytes == srcStride) {
+        memcpy(dst, src, rowBytes * rows);
+        return;
+    }
+    for (UINT32 y = 0; y < rows; y++) {
+        memcpy(dst + y * dstStride, src + y * srcStride, rowBytes);
+    }
+}
+
+// フレームの符号化領域を、ピッチdstStrideのNV12バッファにコピーする関数
+void CopyNv12FrameToBuffer(const Nv12Frame* pFrame, BYTE* dst, UINT32 dstStride)
+{
+    BYTE* dstUV = dst + static_cast<size_t>(dstStride) * pFrame->height;
+    CopyPlane(dst, dstStride, pFrame->pY, pFrame->stride, pFrame->width, pFrame->height);
+    CopyPlane(dstUV, dstStride, pFrame->pUV, pFrame->stride, pFrame->width, pFrame->height / 2);
+}
+
+// ピッチsrcStride・高さsrcHeightのNV12バッファから、フレームの符号化領域にコピーする関数
+void CopyBufferToNv12Frame(const BYTE* src, UINT32 srcStride, UINT32 srcHeight, Nv12Frame* pFrame)
+{
+    UINT32 rows = (srcHeight < pFrame->height) ? srcHeight : pFrame->height;
+    UINT32 rowBytes = (srcStride < pFrame->width) ? srcStride : pFrame->width;
+    const BYTE* srcUV = src + static_cast<size_t>(srcStride) * srcHeight;
+    CopyPlane(pFrame->pY, pFrame->stride, src, srcStride, rowBytes, rows);
+    CopyPlane(pFrame->pUV, pFrame->stride, srcUV, srcStride, rowBytes, rows / 2);
+}
+
+// フレームの符号化領域を別のフレームにコピーする関数
+void CopyNv12Frame(const Nv12Frame* pSrc, Nv12Frame* pDst)
+{
+    UINT32 rows = (pSrc->height < pDst->height) ? pSrc->height : pDst->height;
+    UINT32 rowBytes = (pSrc->width < pDst->width) ? pSrc->width : pDst->width;
+    CopyPlane(pDst->pY, pDst->stride, pSrc->pY, pSrc->stride, rowBytes, rows);
+    CopyPlane(pDst->pUV, pDst->stride, pSrc->pUV, pSrc->stride, rowBytes, rows / 2);
+    pDst->cropLeft = pSrc->cropLeft;
+    pDst->cropTop = pSrc->cropTop;
+    pDst->cropWidth = pSrc->cropWidth;
+    pDst->cropHeight = pSrc->cropHeight;
+}
+
+// プレーンの表示領域を書き込む
+static bool WriteCroppedPlane(std::ofstream& file, const BYTE* plane, UINT32 stride,
+                              UINT32 left, UINT32 top, UINT32 rowBytes, UINT32 rows)
+{
+    const BYTE* p = plane + static_cast<size_t>(top) * stride + left;
+    if (rowBytes == stride) {
+        // 行間に隙間がなければプレーンをまとめて書き込む
+        file.write(reinterpret_cast<const char*>(p), static_cast<std::streamsize>(rowBytes) * rows);
+    } else {
+        for (UINT32 y = 0; y < rows; y++) {
+            file.write(reinterpret_cast<const char*>(p + static_cast<size_t>(y) * stride), rowBytes);
+        }
+    }
+    return file.good();
+}
+
+// フレームの表示領域だけをNV12としてファイルに書き込む関数
+HRESULT WriteNv12FrameCropped(std::ofstream& file, const Nv12Frame* pFrame)
+{
+    if (!pFrame || !pFrame->pBuffer) {
+        return E_INVALIDARG;
+    }
+
+    // NV12のクロマは2x2サブサンプリングなので、偶数位置に揃える
+    UINT32 left = pFrame->cropLeft & ~1u;
+    UINT32 top = pFrame->cropTop & ~1u;
+    UINT32 cropWidth = pFrame->cropWidth & ~1u;
+    UINT32 cropHeight = pFrame->cropHeight & ~1u;
+
+    if (!WriteCroppedPlane(file, pFrame->pY, pFrame->stride, left, top, cropWidth, cropHeight)) {
+        printf("Failed to write Y plane\n");
+        return E_FAIL;
+    }
+    if (!WriteCroppedPlane(file, pFrame->pUV, pFrame->stride, left, top / 2, cropWidth, cropHeight / 2)) {
+        printf("Failed to write UV plane\n");
+        return E_FAIL;
+    }
+    return S_OK;
+}
+
+// 1行分のYパターンを生成する
+static void GenerateLumaRow(BYTE* row, UINT32 width, UINT32 y, UINT32 frameIndex)
+{
+    // フレーム番号に基づいて変化するパターン
+    for (UINT32 x = 0; x < width; x++) {
+        row[x] = static_cast<BYTE>((x + y + frameIndex * 5) % 256);
+    }
+}
+
+// GenerateTestFrameメソッドをNV12形式に修正
+void GenerateTestFrame(std::vector<BYTE>& buffer, UINT32 width, UINT32 height, UINT32 frameIndex)
+{
+    // NV12形式のサイズを計算 (YプレーンとUVプレーン)
+    UINT32 ySize = width * height;
+    buffer.resize(ySize + (ySize / 2)); // Y + UV
+
+    // Yプレーン（輝度）- 動くグラデーションパターン
+    for (UINT32 y = 0; y < height; y++) {
+        GenerateLumaRow(buffer.data() + y * width, width, y, frameIndex);
+    }
+
+    // UVプレーン (交互にUとV) - 固定値で灰色設定 (128 = 無彩色)
+    memset(buffer.data() + ySize, 128, ySize / 2);
+}
+
+// テストフレームをフレームの符号化領域全体に生成する関数
+void GenerateTestFrame(Nv12Frame* pFrame, UINT32 frameIndex)
+{
+    // パディング行も含めて生成する（エンコーダーは符号化サイズ全体を読むため）
+    for (UINT32 y = 0; y < pFrame->height; y++) {
+        GenerateLumaRow(pFrame->pY + static_cast<size_t>(y) * pFrame->stride, pFrame->width, y, frameIndex);
+    }
+
+    // UVプレーンは固定値で灰色
+    for (UINT32 y = 0; y < pFrame->height / 2; y++) {
+        memset(pFrame->pUV + static_cast<size_t>(y) * pFrame->stride, 128, pFrame->width);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "portable_types.h"
+#include "frame_memory.h"
+#include <stddef.h>
+#include <vector>
+#include <fstream>
+
+// プレーン先頭と各行のアライメント (SIMDカーネルがアラインドロードを使えるように)
+#define NV12_FRAME_ALIGNMENT 64
+
+// 符号化サイズのアライメント (H.264のマクロブロックは16x16)
+#define NV12_FRAME_HEIGHT_ALIGNMENT 16
+
+// ストライドとパディングを持つNV12フレーム
+// - width x height が符号化サイズ (heightは16の倍数にパディング済み)
+// - stride はY/UV共通の行ピッチ (64の倍数)
+// - crop* は表示領域 (例: 1920x1088 のうち 1920x1080)
+// 構造体のコピーは同じバッファを指すビューになるため、FreeNv12Frameは所有者だけが呼ぶこと
+struct Nv12Frame {
+    BYTE* pBuffer;                     // 確保したバッファ先頭 (64バイトアライン)
+    size_t bufferSize;                 // 確保サイズ
+    UINT32 memoryKind;                 // 確保方法 (FrameMemoryKind、解放に使う)
+    BYTE* pY;                          // Yプレーン先頭
+    BYTE* pUV;                         // UVプレーン先頭 (UとVが交互)
+
+    UINT32 width;                      // 符号化幅
+    UINT32 height;                     // 符号化高さ (パディング込み)
+    UINT32 stride;                     // 行ピッチ (バイト)
+
+    UINT32 cropLeft;                   // 表示領域の左端
+    UINT32 cropTop;                    // 表示領域の上端
+    UINT32 cropWidth;                  // 表示幅
+    UINT32 cropHeight;                 // 表示高さ
+};
+
+// valueをalignmentの倍数に切り上げる (alignmentは2のべき乗)
+inline UINT32 AlignUp(UINT32 value, UINT32 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// 表示サイズwidth x heightのフレームを確保する関数
+// paddedHeight/strideに0を渡すと、それぞれ16/64の倍数に自動で切り上げる
+// pPolicyを渡すと、ヒュージページやNUMAノードを指定して確保する (NULLならヒープから確保する)
+HRESULT AllocateNv12Frame(Nv12Frame* pFrame, UINT32 width, UINT32 height,
+                          UINT32 paddedHeight = 0, UINT32 stride = 0, const FrameMemoryPolicy* pPolicy = NULL);
+
+// フレームのバッファを解放する関数
+void FreeNv12Frame(Nv12Frame* pFrame);
+
+// 隙間なく詰めたNV12 (width x height) のサイズを返す
+size_t GetNv12PackedSize(UINT32 width, UINT32 height);
+
+// フレームの符号化領域を、ピッチdstStrideのNV12バッファにコピーする関数
+// (dstはY (dstStride x height) の直後にUVが続くレイアウト)
+void CopyNv12FrameToBuffer(const Nv12Frame* pFrame, BYTE* dst, UINT32 dstStride);
+
+// ピッチsrcStride・高さsrcHeightのNV12バッファから、フレームの符号化領域にコピーする関数
+void CopyBufferToNv12Frame(const BYTE* src, UINT32 srcStride, UINT32 srcHeight, Nv12Frame* pFrame);
+
+// フレームの符号化領域を別のフレームにコピーする関数 (ストライドは異なってもよい、表示領域も引き継ぐ)
+// 幅・高さは小さい方に合わせる
+void CopyNv12Frame(const Nv12Frame* pSrc, Nv12Frame* pDst);
+
+// フレームの表示領域だけをNV12としてファイルに書き込む関数
+// (ストライド=表示幅ならプレーンごとに1回の書き込みで済む)
+HRESULT WriteNv12FrameCropped(std::ofstream& file, const Nv12Frame* pFrame);
+
+// テストフレームをNV12形式で生成する関数
+void GenerateTestFrame(std::vector<BYTE>& buffer, UINT32 width, UINT32 height, UINT32 frameIndex);
+
+// テストフレームをフレームの符号化領域全体に生成する関数
+void GenerateTestFrame(Nv12Frame* pFrame, UINT32 frameIndex);
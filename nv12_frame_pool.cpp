@@ -0,0 +1,91 @@
+#include "nv12_frame_pool.h"
+
+// count枚のフレームを確保する関数
+HRESULT InitializeNv12FramePool(Nv12FramePool* pPool, size_t count, UINT32 width, UINT32 height,
+                                UINT32 paddedHeight, UINT32 stride, const FrameMemoryPolicy* pPolicy)
+{
+    if (!pPool) {
+        return E_POINTER;
+    }
+    if (count == 0) {
+        return E_INVALIDARG;
+    }
+
+    pPool->frames.assign(count, Nv12Frame());
+    pPool->freeFrames.clear();
+    pPool->freeFrames.reserve(count);
+    pPool->acquireCount = 0;
+    pPool->waitCount = 0;
+
+    FrameMemoryPolicy threadPolicy;
+    if (!pPolicy) {
+        GetThreadFrameMemoryPolicy(&threadPolicy);
+        pPolicy = &threadPolicy;
+    }
+    for (size_t i = 0; i < count; i++) {
+        HRESULT hr = AllocateNv12Frame(&pPool->frames[i], width, height, paddedHeight, stride, pPolicy);
+        if (FAILED(hr)) {
+            for (size_t j = 0; j < i; j++) {
+                FreeNv12Frame(&pPool->frames[j]);
+            }
+            pPool->frames.clear();
+            pPool->freeFrames.clear();
+            return hr;
+        }
+        pPool->freeFrames.push_back(&pPool->frames[i]);
+    }
+    return S_OK;
+}
+
+// フレームを取得する関数 (空きがなければ返却されるまで待つ)
+Nv12Frame* AcquireNv12Frame(Nv12FramePool* pPool)
+{
+    std::unique_lock<std::mutex> lock(pPool->mutex);
+    if (pPool->freeFrames.empty()) {
+        pPool->waitCount++;
+        pPool->available.wait(lock, [pPool] { return !pPool->freeFrames.empty(); });
+    }
+    Nv12Frame* pFrame = pPool->freeFrames.back();
+    pPool->freeFrames.pop_back();
+    pPool->acquireCount++;
+    return pFrame;
+}
+
+// フレームを取得する関数 (空きがなければNULLを返す)
+Nv12Frame* TryAcquireNv12Frame(Nv12FramePool* pPool)
+{
+    std::lock_guard<std::mutex> lock(pPool->mutex);
+    if (pPool->freeFrames.empty()) {
+        return NULL;
+    }
+    Nv12Frame* pFrame = pPool->freeFrames.back();
+    pPool->freeFrames.pop_back();
+    pPool->acquireCount++;
+    return pFrame;
+}
+
+// フレームをプールに返す関数
+void ReleaseNv12Frame(Nv12FramePool* pPool, Nv12Frame* pFrame)
+{
+    if (!pFrame) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pPool->mutex);
+        pPool->freeFrames.push_back(pFrame);
+    }
+    pPool->available.notify_one();
+}
+
+// プールのフレームをすべて解放する関数
+void FreeNv12FramePool(Nv12FramePool* pPool)
+{
+    if (!pPool) {
+        return;
+    }
+    for (size_t i = 0; i < pPool->frames.size(); i++) {
+        FreeNv12Frame(&pPool->frames[i]);
+    }
+    pPool->frames.clear();
+    pPool->freeFrames.clear();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "nv12_frame.h"
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// 同じサイズのNV12フレームを使い回すプール
+// フレームは初期化時にまとめて確保し、以降はAcquire/Releaseでやり取りするだけで確保は発生しない
+// Acquire/Releaseはスレッドセーフ (生産者と消費者が別スレッドでもよい)
+struct Nv12FramePool {
+    std::vector<Nv12Frame> frames;     // 確保したフレーム (所有者)
+    std::vector<Nv12Frame*> freeFrames; // 空いているフレーム
+    std::mutex mutex;
+    std::condition_variable available; // フレームが返却されたときに通知する
+    UINT64 acquireCount;               // 取得回数
+    UINT64 waitCount;                  // 空きがなく待った回数
+};
+
+// count枚のフレームを確保する関数 (サイズの指定はAllocateNv12Frameと同じ)
+// pPolicyがNULLなら、呼び出し元のスレッドの既定のポリシー (ヒュージページ、スレッドのNUMAノード) で確保する
+HRESULT InitializeNv12FramePool(Nv12FramePool* pPool, size_t count, UINT32 width, UINT32 height,
+                                UINT32 paddedHeight = 0, UINT32 stride = 0, const FrameMemoryPolicy* pPolicy = NULL);
+
+// フレームを取得する関数 (空きがなければ返却されるまで待つ)
+Nv12Frame* AcquireNv12Frame(Nv12FramePool* pPool);
+
+// フレームを取得する関数 (空きがなければNULLを返す)
+Nv12Frame* TryAcquireNv12Frame(Nv12FramePool* pPool);
+
+// フレームをプールに返す関数
+void ReleaseNv12Frame(Nv12FramePool* pPool, Nv12Frame* pFrame);
+
+// プールのフレームをすべて解放する関数 (すべて返却済みであること)
+void FreeNv12FramePool(Nv12FramePool* pPool);
@@ -0,0 +1,335 @@
+#include "nv12_scaler.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NV12_SCALER_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define NV12_SCALER_USE_NEON 1
+#endif
+
+// 重みの合計 (8ビット固定小数点の1.0)
+static const UINT32 WEIGHT_ONE = 256;
+
+// 1方向のタップ数の上限 (面積平均で約30分の1までの縮小)
+#define NV12_SCALER_MAX_TAPS 32
+
+// 双線形補間の係数表を作る (画素中心を合わせる)
+static void BuildBilinearTaps(Nv12ScaleTaps* pTaps, UINT32 srcSize, UINT32 dstSize)
+{
+    pTaps->tapCount = (srcSize >= 2) ? 2 : 1;
+    pTaps->start.assign(dstSize, 0);
+    pTaps->weights.assign(static_cast<size_t>(dstSize) * pTaps->tapCount, 0);
+
+    double scale = static_cast<double>(srcSize) / dstSize;
+    for (UINT32 i = 0; i < dstSize; i++) {
+        UINT16* pWeights = &pTaps->weights[static_cast<size_t>(i) * pTaps->tapCount];
+        if (pTaps->tapCount == 1) {
+            pWeights[0] = WEIGHT_ONE;
+            continue;
+        }
+        double position = (i + 0.5) * scale - 0.5;
+        if (position < 0.0) {
+            position = 0.0;
+        }
+        UINT32 first = static_cast<UINT32>(position);
+        if (first > srcSize - 2) {
+            first = srcSize - 2;
+        }
+        double fraction = position - first;
+        if (fraction > 1.0) {
+            fraction = 1.0;
+        }
+        UINT16 second = static_cast<UINT16>(fraction * WEIGHT_ONE + 0.5);
+        pTaps->start[i] = first;
+        pWeights[0] = static_cast<UINT16>(WEIGHT_ONE - second);
+        pWeights[1] = second;
+    }
+}
+
+// 面積平均の係数表を作る (出力画素が覆う入力画素の面積で重み付けする)
+static void BuildAreaTaps(Nv12ScaleTaps* pTaps, UINT32 srcSize, UINT32 dstSize)
+{
+    double scale = static_cast<double>(srcSize) / dstSize;
+    UINT32 tapCount = static_cast<UINT32>(ceil(scale)) + 1;
+    if (tapCount > srcSize) {
+        tapCount = srcSize;
+    }
+    pTaps->tapCount = tapCount;
+    pTaps->start.assign(dstSize, 0);
+    pTaps->weights.assign(static_cast<size_t>(dstSize) * tapCount, 0);
+
+    for (UINT32 i = 0; i < dstSize; i++) {
+        double left = i * scale;
+        double right = left + scale;
+        UINT32 first = static_cast<UINT32>(left);
+        UINT32 start = (first + tapCount > srcSize) ? srcSize - tapCount : first;
+        pTaps->start[i] = start;
+
+        // 累積値を丸めてから差を取り、重みの合計をちょうど256にする
+        UINT16* pWeights = &pTaps->weights[static_cast<size_t>(i) * tapCount];
+        double covered = 0.0;
+        UINT32 assigned = 0;
+        for (UINT32 pixel = first; pixel < srcSize && pixel < right; pixel++) {
+            double overlap = ((right < pixel + 1.0) ? right : pixel + 1.0) - ((left > pixel) ? left : pixel);
+            if (overlap <= 0.0) {
+                continue;
+            }
+            covered += overlap / scale;
+            UINT32 cumulative = static_cast<UINT32>(covered * WEIGHT_ONE + 0.5);
+            if (cumulative > WEIGHT_ONE) {
+                cumulative = WEIGHT_ONE;
+            }
+            pWeights[pixel - start] = static_cast<UINT16>(cumulative - assigned);
+            assigned = cumulative;
+        }
+        // 浮動小数点の誤差で合計が256に届かなかった分は最後の画素に足す
+        if (assigned < WEIGHT_ONE) {
+            UINT32 last = ((right > srcSize) ? srcSize : static_cast<UINT32>(ceil(right))) - 1;
+            pWeights[last - start] = static_cast<UINT16>(pWeights[last - start] + WEIGHT_ONE - assigned);
+        }
+    }
+}
+
+static void BuildTaps(Nv12ScaleTaps* pTaps, UINT32 srcSize, UINT32 dstSize, Nv12ScaleFilter filter)
+{
+    // 拡大では面積平均は双線形補間と同じ意味になるので、双線形補間を使う
+    if (filter == NV12_SCALE_AREA && srcSize > dstSize) {
+        BuildAreaTaps(pTaps, srcSize, dstSize);
+    } else {
+        BuildBilinearTaps(pTaps, srcSize, dstSize);
+    }
+}
+
+// スケーラーを初期化する関数
+HRESULT InitializeNv12Scaler(Nv12Scaler* pScaler, UINT32 srcWidth, UINT32 srcHeight,
+                             UINT32 dstWidth, UINT32 dstHeight, Nv12ScaleFilter filter)
+{
+    if (!pScaler) {
+        return E_POINTER;
+    }
+    if (srcWidth < 2 || srcHeight < 2 || dstWidth < 2 || dstHeight < 2 ||
+        (srcWidth | srcHeight | dstWidth | dstHeight) & 1) {
+        return E_INVALIDARG;
+    }
+
+    pScaler->srcWidth = srcWidth;
+    pScaler->srcHeight = srcHeight;
+    pScaler->dstWidth = dstWidth;
+    pScaler->dstHeight = dstHeight;
+    pScaler->filter = filter;
+    BuildTaps(&pScaler->lumaX, srcWidth, dstWidth, filter);
+    BuildTaps(&pScaler->lumaY, srcHeight, dstHeight, filter);
+    BuildTaps(&pScaler->chromaX, srcWidth / 2, dstWidth / 2, filter);
+    BuildTaps(&pScaler->chromaY, srcHeight / 2, dstHeight / 2, filter);
+    if (pScaler->lumaX.tapCount > NV12_SCALER_MAX_TAPS || pScaler->lumaY.tapCount > NV12_SCALER_MAX_TAPS) {
+        return E_INVALIDARG;
+    }
+    pScaler->rowBuffer.assign(srcWidth, 0);
+    return S_OK;
+}
+
+// 垂直方向: tapCount行を重み付けして1行にする (スカラー版)
+static void FilterRowsScalar(const BYTE* const* ppRows, const UINT16* pWeights, UINT32 tapCount,
+                             BYTE* pDst, UINT32 size)
+{
+    for (UINT32 x = 0; x < size; x++) {
+        UINT32 sum = WEIGHT_ONE / 2;
+        for (UINT32 k = 0; k < tapCount; k++) {
+            sum += ppRows[k][x] * pWeights[k];
+        }
+        pDst[x] = static_cast<BYTE>(sum >> 8);
+    }
+}
+
+// 垂直方向: tapCount行を重み付けして1行にする (16バイトずつSIMDで処理する)
+// 重みの合計が256なので、255 * 256 + 128 は16ビットの符号なし整数に収まる
+static void FilterRows(const BYTE* const* ppRows, const UINT16* pWeights, UINT32 tapCount,
+                       BYTE* pDst, UINT32 size)
+{
+    UINT32 x = 0;
+#if defined(NV12_SCALER_USE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(WEIGHT_ONE / 2);
+    for (; x + 16 <= size; x += 16) {
+        __m128i low = rounding;
+        __m128i high = rounding;
+        for (UINT32 k = 0; k < tapCount; k++) {
+            __m128i weight = _mm_set1_epi16(static_cast<short>(pWeights[k]));
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ppRows[k] + x));
+            low = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), weight));
+            high = _mm_add_epi16(high, _mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), weight));
+        }
+        __m128i result = _mm_packus_epi16(_mm_srli_epi16(low, 8), _mm_srli_epi16(high, 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x), result);
+    }
+#elif defined(NV12_SCALER_USE_NEON)
+    for (; x + 16 <= size; x += 16) {
+        uint16x8_t low = vdupq_n_u16(WEIGHT_ONE / 2);
+        uint16x8_t high = low;
+        for (UINT32 k = 0; k < tapCount; k++) {
+            uint8x16_t v = vld1q_u8(ppRows[k] + x);
+            uint16x8_t weight = vdupq_n_u16(pWeights[k]);
+            low = vmlaq_u16(low, vmovl_u8(vget_low_u8(v)), weight);
+            high = vmlaq_u16(high, vmovl_u8(vget_high_u8(v)), weight);
+        }
+        vst1q_u8(pDst + x, vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8)));
+    }
+#endif
+    if (x < size) {
+        // 16バイトに満たない残りはスカラーで処理する
+        const BYTE* tailRows[NV12_SCALER_MAX_TAPS];
+        for (UINT32 k = 0; k < tapCount; k++) {
+            tailRows[k] = ppRows[k] + x;
+        }
+        FilterRowsScalar(tailRows, pWeights, tapCount, pDst + x, size - x);
+    }
+}
+
+// 水平方向: 係数表を引いて1行を縮小する (CHANNELS = 1: 輝度、2: UVペア)
+// タップ数が定数になるようテンプレートにして、内側のループを展開させる
+template <UINT32 CHANNELS, UINT32 TAPS>
+static void FilterColumnsFixed(const BYTE* pSrc, const Nv12ScaleTaps* pTaps, BYTE* pDst, UINT32 dstSize)
+{
+    const UINT32* pStart = pTaps->start.data();
+    const UINT16* pWeights = pTaps->weights.data();
+    for (UINT32 i = 0; i < dstSize; i++, pWeights += TAPS) {
+        const BYTE* p = pSrc + static_cast<size_t>(pStart[i]) * CHANNELS;
+        for (UINT32 c = 0; c < CHANNELS; c++) {
+            UINT32 sum = WEIGHT_ONE / 2;
+            for (UINT32 k = 0; k < TAPS; k++) {
+                sum += p[k * CHANNELS + c] * pWeights[k];
+            }
+            pDst[i * CHANNELS + c] = static_cast<BYTE>(sum >> 8);
+        }
+    }
+}
+
+template <UINT32 CHANNELS>
+static void FilterColumnsGeneric(const BYTE* pSrc, const Nv12ScaleTaps* pTaps, BYTE* pDst, UINT32 dstSize)
+{
+    const UINT32 tapCount = pTaps->tapCount;
+    for (UINT32 i = 0; i < dstSize; i++) {
+        const BYTE* p = pSrc + static_cast<size_t>(pTaps->start[i]) * CHANNELS;
+        const UINT16* pWeights = &pTaps->weights[static_cast<size_t>(i) * tapCount];
+        for (UINT32 c = 0; c < CHANNELS; c++) {
+            UINT32 sum = WEIGHT_ONE / 2;
+            for (UINT32 k = 0; k < tapCount; k++) {
+                sum += p[k * CHANNELS + c] * pWeights[k];
+            }
+            pDst[i * CHANNELS + c] = static_cast<BYTE>(sum >> 8);
+        }
+    }
+}
+
+template <UINT32 CHANNELS>
+static void FilterColumns(const BYTE* pSrc, const Nv12ScaleTaps* pTaps, BYTE* pDst, UINT32 dstSize)
+{
+    switch (pTaps->tapCount) {
+    case 2: FilterColumnsFixed<CHANNELS, 2>(pSrc, pTaps, pDst, dstSize); break;
+    case 3: FilterColumnsFixed<CHANNELS, 3>(pSrc, pTaps, pDst, dstSize); break;
+    case 4: FilterColumnsFixed<CHANNELS, 4>(pSrc, pTaps, pDst, dstSize); break;
+    case 5: FilterColumnsFixed<CHANNELS, 5>(pSrc, pTaps, pDst, dstSize); break;
+    default: FilterColumnsGeneric<CHANNELS>(pSrc, pTaps, pDst, dstSize); break;
+    }
+}
+
+// 1プレーンを縮小・拡大する
+static void ScalePlane(Nv12Scaler* pScaler, const BYTE* pSrc, UINT32 srcStride, UINT32 srcRowBytes,
+                       const Nv12ScaleTaps* pTapsX, const Nv12ScaleTaps* pTapsY, UINT32 channels,
+                       BYTE* pDst, UINT32 dstStride, UINT32 dstRows, bool useSimd)
+{
+    const BYTE* rows[NV12_SCALER_MAX_TAPS];
+    const UINT32 tapCount = pTapsY->tapCount;
+    BYTE* pRow = pScaler->rowBuffer.data();
+    for (UINT32 y = 0; y < dstRows; y++) {
+        const UINT16* pWeights = &pTapsY->weights[static_cast<size_t>(y) * tapCount];
+        for (UINT32 k = 0; k < tapCount; k++) {
+            rows[k] = pSrc + static_cast<size_t>(pTapsY->start[y] + k) * srcStride;
+        }
+        if (useSimd) {
+            FilterRows(rows, pWeights, tapCount, pRow, srcRowBytes);
+        } else {
+            FilterRowsScalar(rows, pWeights, tapCount, pRow, srcRowBytes);
+        }
+        BYTE* pDstRow = pDst + static_cast<size_t>(y) * dstStride;
+        UINT32 dstSize = static_cast<UINT32>(pTapsX->start.size());
+        if (channels == 1) {
+            FilterColumns<1>(pRow, pTapsX, pDstRow, dstSize);
+        } else {
+            FilterColumns<2>(pRow, pTapsX, pDstRow, dstSize);
+        }
+    }
+}
+
+// 表示領域の下のパディング行を最終行の複製で埋める
+static void FillPaddingRows(Nv12Frame* pFrame)
+{
+    UINT32 lastRow = pFrame->cropTop + pFrame->cropHeight - 1;
+    for (UINT32 y = lastRow + 1; y < pFrame->height; y++) {
+        memcpy(pFrame->pY + static_cast<size_t>(y) * pFrame->stride,
+               pFrame->pY + static_cast<size_t>(lastRow) * pFrame->stride, pFrame->width);
+    }
+    UINT32 lastUvRow = lastRow / 2;
+    for (UINT32 y = lastUvRow + 1; y < pFrame->height / 2; y++) {
+        memcpy(pFrame->pUV + static_cast<size_t>(y) * pFrame->stride,
+               pFrame->pUV + static_cast<size_t>(lastUvRow) * pFrame->stride, pFrame->width);
+    }
+}
+
+static HRESULT ScaleNv12FrameInternal(Nv12Scaler* pScaler, const Nv12Frame* pSrc, Nv12Frame* pDst, bool useSimd)
+{
+    if (!pScaler || !pSrc || !pDst) {
+        return E_POINTER;
+    }
+    if (pSrc->cropWidth != pScaler->srcWidth || pSrc->cropHeight != pScaler->srcHeight ||
+        pDst->cropWidth != pScaler->dstWidth || pDst->cropHeight != pScaler->dstHeight ||
+        ((pSrc->cropLeft | pSrc->cropTop | pDst->cropLeft | pDst->cropTop) & 1)) {
+        return E_INVALIDARG;
+    }
+
+    const BYTE* pSrcY = pSrc->pY + static_cast<size_t>(pSrc->cropTop) * pSrc->stride + pSrc->cropLeft;
+    const BYTE* pSrcUV = pSrc->pUV + static_cast<size_t>(pSrc->cropTop / 2) * pSrc->stride + pSrc->cropLeft;
+    BYTE* pDstY = pDst->pY + static_cast<size_t>(pDst->cropTop) * pDst->stride + pDst->cropLeft;
+    BYTE* pDstUV = pDst->pUV + static_cast<size_t>(pDst->cropTop / 2) * pDst->stride + pDst->cropLeft;
+
+    if (pScaler->srcWidth == pScaler->dstWidth && pScaler->srcHeight == pScaler->dstHeight) {
+        // 同じサイズなら行単位でコピーするだけ
+        for (UINT32 y = 0; y < pScaler->dstHeight; y++) {
+            memcpy(pDstY + static_cast<size_t>(y) * pDst->stride, pSrcY + static_cast<size_t>(y) * pSrc->stride,
+                   pScaler->dstWidth);
+        }
+        for (UINT32 y = 0; y < pScaler->dstHeight / 2; y++) {
+            memcpy(pDstUV + static_cast<size_t>(y) * pDst->stride, pSrcUV + static_cast<size_t>(y) * pSrc->stride,
+                   pScaler->dstWidth);
+        }
+    } else {
+        ScalePlane(pScaler, pSrcY, pSrc->stride, pScaler->srcWidth, &pScaler->lumaX, &pScaler->lumaY, 1,
+                   pDstY, pDst->stride, pScaler->dstHeight, useSimd);
+        ScalePlane(pScaler, pSrcUV, pSrc->stride, pScaler->srcWidth, &pScaler->chromaX, &pScaler->chromaY, 2,
+                   pDstUV, pDst->stride, pScaler->dstHeight / 2, useSimd);
+    }
+
+    FillPaddingRows(pDst);
+    return S_OK;
+}
+
+// pSrcの表示領域をpDstの表示領域に縮小・拡大する関数
+HRESULT ScaleNv12Frame(Nv12Scaler* pScaler, const Nv12Frame* pSrc, Nv12Frame* pDst)
+{
+    return ScaleNv12FrameInternal(pScaler, pSrc, pDst, true);
+}
+
+// スカラー版 (検証用)
+HRESULT ScaleNv12FrameScalar(Nv12Scaler* pScaler, const Nv12Frame* pSrc, Nv12Frame* pDst)
+{
+    return ScaleNv12FrameInternal(pScaler, pSrc, pDst, false);
+}
+
+// フィルターの名前を返す (ログ用)
+const char* GetNv12ScaleFilterName(Nv12ScaleFilter filter)
+{
+    return (filter == NV12_SCALE_AREA) ? "area" : "bilinear";
+}
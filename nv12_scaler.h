@@ -0,0 +1,49 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include <vector>
+
+// 縮小・拡大のフィルター
+enum Nv12ScaleFilter {
+    NV12_SCALE_BILINEAR = 0,           // 双線形補間 (2タップ、軽い。2倍を超える縮小ではエイリアスが出る)
+    NV12_SCALE_AREA = 1                // 面積平均 (縮小率に応じたタップ数、縮小向き)
+};
+
+// 1方向分のフィルター係数表
+// 出力画素iは src[start[i] + k] (k = 0..tapCount-1) を weights[i * tapCount + k] で重み付けした和
+// 重みの合計は常に256 (8ビット固定小数点) なので、16ビットで飽和せずに累積できる
+struct Nv12ScaleTaps {
+    std::vector<UINT32> start;
+    std::vector<UINT16> weights;
+    UINT32 tapCount;
+};
+
+// NV12スケーラー構造体 (サイズとフィルターごとに係数表を事前計算して使い回す)
+struct Nv12Scaler {
+    UINT32 srcWidth;                   // 入力の表示サイズ
+    UINT32 srcHeight;
+    UINT32 dstWidth;                   // 出力の表示サイズ
+    UINT32 dstHeight;
+    Nv12ScaleFilter filter;
+    Nv12ScaleTaps lumaX;               // 輝度の水平方向
+    Nv12ScaleTaps lumaY;               // 輝度の垂直方向
+    Nv12ScaleTaps chromaX;             // 色差の水平方向 (UVペア単位)
+    Nv12ScaleTaps chromaY;             // 色差の垂直方向
+    std::vector<BYTE> rowBuffer;       // 垂直方向のフィルター結果 (1行分)
+};
+
+// スケーラーを初期化する関数 (サイズはすべて表示サイズで、偶数であること)
+HRESULT InitializeNv12Scaler(Nv12Scaler* pScaler, UINT32 srcWidth, UINT32 srcHeight,
+                             UINT32 dstWidth, UINT32 dstHeight, Nv12ScaleFilter filter);
+
+// pSrcの表示領域をpDstの表示領域に縮小・拡大する関数
+// 垂直方向のフィルターは入力の行全体に対してSIMD (SSE2/NEON) で行い、水平方向は係数表を引いて行う
+// pDstの表示領域の下にパディング行があれば、最終行を複製して埋める (エンコード時のビットを減らすため)
+HRESULT ScaleNv12Frame(Nv12Scaler* pScaler, const Nv12Frame* pSrc, Nv12Frame* pDst);
+
+// スカラー版 (検証用、ScaleNv12Frameと同じ結果を返す)
+HRESULT ScaleNv12FrameScalar(Nv12Scaler* pScaler, const Nv12Frame* pSrc, Nv12Frame* pDst);
+
+// フィルターの名前を返す (ログ用)
+const char* GetNv12ScaleFilterName(Nv12ScaleFilter filter);
@@ -0,0 +1,642 @@
+// パイプラインの回帰テスト (CTestから実行する。ソフトウェアコーデック専用)
+// mainと同じ順に、テストフレームの生成 → エンコード (NALユニットの取り出し) → 長さプレフィックス形式の書き込み
+// → メモリマップでの読み込み → デコード → YUVファイルへの書き込み を行い、次の3つを検査する
+// - フレームごとのビットストリームと復号結果のハッシュが、ゴールデンファイルと一致すること
+// - パイプライン全体のスループット (fps) が、ベースラインから許容幅を超えて下がっていないこと
+// - フレームあたりの確保回数 (operator newとフレーム・ビットストリームのバッファ) が、ベースラインから許容幅を超えて増えていないこと
+// ハッシュは環境によらず同じになるのでリポジトリに置き、ベースラインは計測した環境ごとに持つ
+// --check outputは出力 (ハッシュとアーカイブ) だけ、--check perfは性能だけを検査する (CTestでは別のテストにする)
+// ベースラインがなければ性能の検査はスキップ扱い (終了コード77) にする。CIでは保存しておいたファイルを渡すこと
+// 計測のあとで、復号結果をYUVアーカイブに書いて読み戻し、復号結果と同じハッシュになることも確かめる (計測には含めない)
+#include "yuv_encoder_soft.h"
+#include "nal_decoder_soft.h"
+#include "nal_store.h"
+#include "mapped_file.h"
+#include "frame_memory.h"
+#include "yuv_archive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// ベースラインがないときの終了コード (CMakeのSKIP_RETURN_CODEと同じ値)
+#define SKIP_EXIT_CODE 77
+
+// YUVアーカイブの検査に使うキーフレーム間隔とチャンクサイズ
+// (どのケースでも差分フレームとキーフレームをまたぐ範囲、1フレームに複数のチャンクができるように小さめにする)
+#define ARCHIVE_TEST_KEY_INTERVAL 8
+#define ARCHIVE_TEST_CHUNK_SIZE (32 * 1024)
+
+// ヒープ確保の回数 (このプログラムのoperator newを置き換えて数える)
+static std::atomic<UINT64> g_allocationCount(0);
+
+void* operator new(size_t size)
+{
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+// 確保回数 (operator newと、NALストアのチャンクやフレームプールが使うAllocateFrameMemoryの合計)
+static UINT64 GetAllocationCount()
+{
+    return g_allocationCount.load() + GetFrameMemoryAllocationCount();
+}
+
+// テストケース (解像度・レート制御・スライス数の組み合わせ)
+struct PipelineTestCase {
+    const char* name;
+    UINT32 width;
+    UINT32 height;                     // 16の倍数でなければクロップの経路も通る
+    UINT32 bitrate;                    // 0ならQP固定
+    UINT32 sliceCount;
+    UINT32 frameCount;
+};
+
+static const PipelineTestCase g_testCases[] = {
+    { "cif_fixed_qp",        352,  288,       0, 1, 30 },
+    { "nhd_crop_ratecontrol", 640,  360,  800000, 2, 30 },
+    { "hd_slices",           1280,  720, 1500000, 4, 20 },
+};
+
+// 1回の実行の結果
+struct PipelineResult {
+    std::vector<UINT64> bitstreamHashes;   // フレームごとのNALユニット (長さプレフィックスを含む) のハッシュ
+    std::vector<UINT64> yuvHashes;         // フレームごとの復号結果 (表示領域) のハッシュ
+    double encodeMs;                       // 生成・エンコード・書き込み
+    double decodeMs;                       // 読み込み・デコード・YUVの書き込み
+    UINT64 allocations;                    // フレームのループ中の確保回数 (GetAllocationCount)
+};
+
+// FNV-1a (64ビット)
+static UINT64 HashBytes(UINT64 hash, const BYTE* pData, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= pData[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static const UINT64 HASH_SEED = 0xCBF29CE484222325ULL;
+
+// 表示領域 (クロップ後) のNV12をハッシュする関数 (WriteNv12FrameCroppedが書き出す範囲と同じ)
+static UINT64 HashNv12FrameCropped(const Nv12Frame* pFrame)
+{
+    // WriteNv12FrameCroppedと同じく、クロマに合わせて偶数位置に揃える
+    UINT32 left = pFrame->cropLeft & ~1u;
+    UINT32 top = pFrame->cropTop & ~1u;
+    UINT32 cropWidth = pFrame->cropWidth & ~1u;
+    UINT32 cropHeight = pFrame->cropHeight & ~1u;
+
+    UINT64 hash = HASH_SEED;
+    for (UINT32 y = 0; y < cropHeight; y++) {
+        hash = HashBytes(hash, pFrame->pY + static_cast<size_t>(top + y) * pFrame->stride + left, cropWidth);
+    }
+    for (UINT32 y = 0; y < cropHeight / 2; y++) {
+        hash = HashBytes(hash, pFrame->pUV + static_cast<size_t>(top / 2 + y) * pFrame->stride + left, cropWidth);
+    }
+    return hash;
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// NALユニットを長さプレフィックス形式 (ビッグエンディアン4バイト) で書き込む関数 (mainのoutput.h264と同じ形式)
+static void WriteLengthPrefixed(FILE* pFile, const BYTE* pData, UINT32 size, UINT64* pHash)
+{
+    BYTE lengthBytes[4];
+    lengthBytes[0] = (size >> 24) & 0xFF;
+    lengthBytes[1] = (size >> 16) & 0xFF;
+    lengthBytes[2] = (size >> 8) & 0xFF;
+    lengthBytes[3] = size & 0xFF;
+    fwrite(lengthBytes, 1, 4, pFile);
+    fwrite(pData, 1, size, pFile);
+    *pHash = HashBytes(HashBytes(*pHash, lengthBytes, 4), pData, size);
+}
+
+// 直前のCommitInputFrame/FlushEncoderの出力をフレームごとにハッシュし、書き込む関数
+static void WriteEncodedSamples(const NalEncoder& encoder, NalStore* pStore, FILE* pFile, PipelineResult* pResult)
+{
+    size_t writtenNals = 0;
+    for (const auto& info : encoder.outputSamples) {
+        UINT64 hash = HASH_SEED;
+        for (size_t n = info.firstNalIndex; n < info.firstNalIndex + info.nalCount; n++) {
+            NalUnitView nalUnit = GetNalStoreUnit(pStore, n);
+            WriteLengthPrefixed(pFile, nalUnit.pData, static_cast<UINT32>(nalUnit.size), &hash);
+        }
+        pResult->bitstreamHashes.push_back(hash);
+        writtenNals = info.firstNalIndex + info.nalCount;
+    }
+    if (writtenNals > 0) {
+        ReleaseNalStoreChunks(pStore, writtenNals);
+    }
+}
+
+// エンコードして長さプレフィックス形式のファイルに書き込む関数
+static HRESULT EncodeToFile(const PipelineTestCase& testCase, const char* bitstreamFilename, PipelineResult* pResult)
+{
+    NalEncoder encoder;
+    HRESULT hr = InitializeEncoder(&encoder, testCase.width, testCase.height, testCase.bitrate, testCase.sliceCount);
+    CHECK_HR(hr, "InitializeEncoder");
+
+    FILE* pFile = fopen(bitstreamFilename, "wb");
+    if (!pFile) {
+        printf("Failed to open %s for writing\n", bitstreamFilename);
+        ShutdownEncoder(&encoder);
+        return E_FAIL;
+    }
+
+    NalStore store;
+    InitializeNalStore(&store);
+
+    UINT64 allocationsBefore = GetAllocationCount();
+    auto start = std::chrono::steady_clock::now();
+    for (UINT32 i = 0; i < testCase.frameCount && SUCCEEDED(hr); i++) {
+        Nv12Frame* pFrame = NULL;
+        hr = AcquireInputFrame(&encoder, &pFrame);
+        if (FAILED(hr)) {
+            break;
+        }
+        GenerateTestFrame(pFrame, i);
+        hr = CommitInputFrame(&encoder, pFrame, &store);
+        if (SUCCEEDED(hr)) {
+            WriteEncodedSamples(encoder, &store, pFile, pResult);
+        }
+    }
+    if (SUCCEEDED(hr)) {
+        hr = FlushEncoder(&encoder, &store);
+        WriteEncodedSamples(encoder, &store, pFile, pResult);
+    }
+    pResult->encodeMs = ElapsedMs(start);
+    pResult->allocations += GetAllocationCount() - allocationsBefore;
+
+    fclose(pFile);
+    FreeNalStore(&store);
+    HRESULT hrShutdown = ShutdownEncoder(&encoder);
+    CHECK_HR(hr, "Encode");
+    return hrShutdown;
+}
+
+// 長さプレフィックス形式のファイルを読み込んでデコードし、YUVファイルに書き込む関数
+static HRESULT DecodeFromFile(const PipelineTestCase& testCase, const char* bitstreamFilename,
+                              const char* yuvFilename, PipelineResult* pResult)
+{
+    MappedFile bitstream;
+    HRESULT hr = OpenMappedFile(&bitstream, bitstreamFilename);
+    CHECK_HR(hr, "OpenMappedFile");
+
+    std::ofstream yuvFile(yuvFilename, std::ios::binary | std::ios::trunc);
+    NalDecoder decoder;
+    hr = InitializeDecoder(&decoder, testCase.width, testCase.height);
+    if (FAILED(hr) || !yuvFile.is_open()) {
+        CloseMappedFile(&bitstream);
+        printf("Failed to set up decoding: 0x%08X\n", hr);
+        return FAILED(hr) ? hr : E_FAIL;
+    }
+    Nv12Frame decodedFrame = {0};
+    hr = AllocateNv12Frame(&decodedFrame, decoder.width, decoder.height);
+    std::vector<Nv12Frame> flushedFrames;
+    flushedFrames.reserve(H264_DECODER_POOL_SIZE);
+
+    UINT64 allocationsBefore = GetAllocationCount();
+    auto start = std::chrono::steady_clock::now();
+    size_t pos = 0;
+    while (SUCCEEDED(hr) && pos < bitstream.size) {
+        if (bitstream.size - pos < 4) {
+            printf("Truncated length prefix at offset %zu\n", pos);
+            hr = E_FAIL;
+            break;
+        }
+        const BYTE* p = bitstream.pData + pos;
+        size_t size = (static_cast<size_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        pos += 4;
+        if (size > bitstream.size - pos) {
+            printf("Truncated NAL unit at offset %zu\n", pos);
+            hr = E_FAIL;
+            break;
+        }
+        BOOL frameDecoded = FALSE;
+        hr = DecodeNalUnit(&decoder, bitstream.pData + pos, size, &decodedFrame, &frameDecoded);
+        pos += size;
+        if (SUCCEEDED(hr) && frameDecoded) {
+            WriteNv12FrameCropped(yuvFile, &decodedFrame);
+            pResult->yuvHashes.push_back(HashNv12FrameCropped(&decodedFrame));
+        }
+    }
+    if (SUCCEEDED(hr)) {
+        hr = FlushDecoder(&decoder, flushedFrames);
+    }
+    for (auto& frame : flushedFrames) {
+        WriteNv12FrameCropped(yuvFile, &frame);
+        pResult->yuvHashes.push_back(HashNv12FrameCropped(&frame));
+        FreeNv12Frame(&frame);
+    }
+    pResult->decodeMs = ElapsedMs(start);
+    pResult->allocations += GetAllocationCount() - allocationsBefore;
+
+    yuvFile.close();
+    FreeNv12Frame(&decodedFrame);
+    CloseMappedFile(&bitstream);
+    HRESULT hrShutdown = ShutdownDecoder(&decoder);
+    CHECK_HR(hr, "Decode");
+    return hrShutdown;
+}
+
+// パイプラインを1回実行する関数
+static HRESULT RunPipeline(const PipelineTestCase& testCase, PipelineResult* pResult)
+{
+    std::string bitstreamFilename = std::string("pipeline_") + testCase.name + ".h264";
+    std::string yuvFilename = std::string("pipeline_") + testCase.name + ".yuv";
+
+    pResult->bitstreamHashes.clear();
+    pResult->yuvHashes.clear();
+    pResult->bitstreamHashes.reserve(testCase.frameCount);
+    pResult->yuvHashes.reserve(testCase.frameCount);
+    pResult->allocations = 0;
+
+    HRESULT hr = EncodeToFile(testCase, bitstreamFilename.c_str(), pResult);
+    if (SUCCEEDED(hr)) {
+        hr = DecodeFromFile(testCase, bitstreamFilename.c_str(), yuvFilename.c_str(), pResult);
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    // YUVファイルは表示サイズのフレームがちょうどframeCount枚
+    std::ifstream yuvFile(yuvFilename.c_str(), std::ios::binary | std::ios::ate);
+    UINT64 expectedSize = static_cast<UINT64>(testCase.frameCount) * testCase.width * testCase.height * 3 / 2;
+    UINT64 actualSize = yuvFile.is_open() ? static_cast<UINT64>(yuvFile.tellg()) : 0;
+    if (actualSize != expectedSize) {
+        printf("%s: %llu bytes, expected %llu\n", yuvFilename.c_str(), static_cast<unsigned long long>(actualSize),
+               static_cast<unsigned long long>(expectedSize));
+        return E_FAIL;
+    }
+    return S_OK;
+}
+
+// YUVアーカイブのframeIndex番目からcount枚を読み、復号結果のハッシュと比べる関数
+// (yuv_unpackと同じく、開いたばかりのリーダーで指定の範囲を順に読む)
+static bool CheckArchiveRange(const char* archiveFilename, const PipelineTestCase& testCase,
+                              const std::vector<UINT64>& yuvHashes, UINT32 firstFrame, UINT32 count)
+{
+    YuvArchiveReader reader;
+    HRESULT hr = OpenYuvArchiveReader(&reader, archiveFilename);
+    if (FAILED(hr)) {
+        printf("FAIL: cannot open %s: 0x%08X\n", archiveFilename, hr);
+        return false;
+    }
+    bool passed = true;
+    if (reader.width != testCase.width || reader.height != testCase.height ||
+        GetYuvArchiveFrameCount(&reader) != yuvHashes.size()) {
+        printf("FAIL: archive has %u frames of %ux%u, expected %zu of %ux%u\n", GetYuvArchiveFrameCount(&reader),
+               reader.width, reader.height, yuvHashes.size(), testCase.width, testCase.height);
+        passed = false;
+    }
+    const size_t frameSize = GetYuvArchiveFrameSize(&reader);
+    for (UINT32 i = firstFrame; passed && i < firstFrame + count; i++) {
+        const BYTE* pFrame = NULL;
+        hr = ReadYuvArchiveFrame(&reader, i, &pFrame);
+        if (FAILED(hr)) {
+            printf("FAIL: cannot read archive frame %u: 0x%08X\n", i, hr);
+            passed = false;
+        } else if (HashBytes(HASH_SEED, pFrame, frameSize) != yuvHashes[i]) {
+            printf("FAIL: archive frame %u differs from the decoded frame (read from frame %u)\n", i, firstFrame);
+            passed = false;
+        }
+    }
+    CloseYuvArchiveReader(&reader);
+    return passed;
+}
+
+// 復号結果のYUVファイルをYUVアーカイブに書いて読み戻す関数
+// 全体と、キーフレームの途中から次のキーフレームをまたぐ範囲 (yuv_unpack --first/--count) を、復号結果のハッシュと比べる
+static bool CheckArchiveRoundTrip(const PipelineTestCase& testCase, const std::vector<UINT64>& yuvHashes)
+{
+    std::string yuvFilename = std::string("pipeline_") + testCase.name + ".yuv";
+    std::string archiveFilename = std::string("pipeline_") + testCase.name + ".yuvz";
+    const size_t frameSize = GetNv12PackedSize(testCase.width, testCase.height);
+
+    MappedFile yuv;
+    HRESULT hr = OpenMappedFile(&yuv, yuvFilename.c_str());
+    if (FAILED(hr) || yuv.size != frameSize * yuvHashes.size()) {
+        printf("FAIL: cannot read %s for the archive check\n", yuvFilename.c_str());
+        if (SUCCEEDED(hr)) {
+            CloseMappedFile(&yuv);
+        }
+        return false;
+    }
+    Nv12Frame frame = {0};
+    hr = AllocateNv12Frame(&frame, testCase.width, testCase.height);
+    YuvArchiveWriter writer;
+    if (SUCCEEDED(hr)) {
+        hr = OpenYuvArchive(&writer, archiveFilename.c_str(), 2, ARCHIVE_TEST_KEY_INTERVAL, ARCHIVE_TEST_CHUNK_SIZE);
+        if (SUCCEEDED(hr)) {
+            for (size_t i = 0; i < yuvHashes.size() && SUCCEEDED(hr); i++) {
+                CopyBufferToNv12Frame(yuv.pData + i * frameSize, testCase.width, testCase.height, &frame);
+                hr = WriteYuvArchiveFrame(&writer, &frame);
+            }
+            HRESULT hrClose = CloseYuvArchive(&writer);
+            if (SUCCEEDED(hr)) {
+                hr = hrClose;
+            }
+        }
+    }
+    FreeNv12Frame(&frame);
+    CloseMappedFile(&yuv);
+    if (FAILED(hr)) {
+        printf("FAIL: cannot write %s: 0x%08X\n", archiveFilename.c_str(), hr);
+        return false;
+    }
+
+    const UINT32 frameCount = static_cast<UINT32>(yuvHashes.size());
+    const UINT32 firstFrame = ARCHIVE_TEST_KEY_INTERVAL + ARCHIVE_TEST_KEY_INTERVAL / 2;
+    const UINT32 count = (frameCount > firstFrame + ARCHIVE_TEST_KEY_INTERVAL) ? ARCHIVE_TEST_KEY_INTERVAL
+                                                                               : frameCount - firstFrame;
+    if (!CheckArchiveRange(archiveFilename.c_str(), testCase, yuvHashes, 0, frameCount) ||
+        !CheckArchiveRange(archiveFilename.c_str(), testCase, yuvHashes, firstFrame, count)) {
+        return false;
+    }
+    printf("Archive round trip: %u frames and frames %u-%u match (key interval %u)\n", frameCount, firstFrame,
+           firstFrame + count - 1, ARCHIVE_TEST_KEY_INTERVAL);
+    return true;
+}
+
+// "<ケース名> <値>..." の行からなるテキストファイル (ゴールデンとベースラインに使う)
+// 更新するときは、そのケースの行だけを置き換えて他のケースの行は残す
+static bool LoadCaseLines(const char* filename, const char* caseName, std::vector<std::string>* pAllLines,
+                          std::vector<std::string>* pCaseLines)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+    const size_t nameLength = strlen(caseName);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+        if (line.compare(0, nameLength, caseName) == 0 && line.size() > nameLength && line[nameLength] == ' ') {
+            pCaseLines->push_back(line.substr(nameLength + 1));
+        } else {
+            pAllLines->push_back(line);
+        }
+    }
+    return true;
+}
+
+static bool SaveCaseLines(const char* filename, const char* caseName, const std::vector<std::string>& otherLines,
+                          const std::vector<std::string>& caseLines)
+{
+    FILE* pFile = fopen(filename, "wb");
+    if (!pFile) {
+        printf("Failed to open %s for writing\n", filename);
+        return false;
+    }
+    for (const auto& line : otherLines) {
+        fprintf(pFile, "%s\n", line.c_str());
+    }
+    for (const auto& line : caseLines) {
+        fprintf(pFile, "%s %s\n", caseName, line.c_str());
+    }
+    fclose(pFile);
+    return true;
+}
+
+// ゴールデンの行 ("<フレーム番号> <ビットストリームのハッシュ> <YUVのハッシュ>") を作る関数
+static std::vector<std::string> FormatGoldenLines(const PipelineResult& result)
+{
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < result.bitstreamHashes.size() || i < result.yuvHashes.size(); i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "%zu %016llx %016llx", i,
+                 i < result.bitstreamHashes.size() ? result.bitstreamHashes[i] : 0ULL,
+                 i < result.yuvHashes.size() ? result.yuvHashes[i] : 0ULL);
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// ゴールデンと比べる関数 (最初に食い違ったフレームを表示する)
+static bool CheckGolden(const char* filename, const PipelineTestCase& testCase, const PipelineResult& result, bool update)
+{
+    std::vector<std::string> otherLines;
+    std::vector<std::string> goldenLines;
+    bool loaded = LoadCaseLines(filename, testCase.name, &otherLines, &goldenLines);
+    std::vector<std::string> actualLines = FormatGoldenLines(result);
+
+    if (update) {
+        if (!loaded) {
+            otherLines.push_back("# <case> <frame> <bitstream FNV-1a> <decoded YUV FNV-1a> (pipeline_test --update-golden)");
+        }
+        printf("Golden hashes updated: %s (%zu frames)\n", filename, actualLines.size());
+        return SaveCaseLines(filename, testCase.name, otherLines, actualLines);
+    }
+    if (goldenLines.empty()) {
+        printf("FAIL: no golden hashes for %s in %s (run with --update-golden)\n", testCase.name, filename);
+        return false;
+    }
+    if (result.bitstreamHashes.size() != testCase.frameCount || result.yuvHashes.size() != testCase.frameCount) {
+        printf("FAIL: %zu encoded / %zu decoded frames, expected %u\n",
+               result.bitstreamHashes.size(), result.yuvHashes.size(), testCase.frameCount);
+        return false;
+    }
+    for (size_t i = 0; i < actualLines.size() || i < goldenLines.size(); i++) {
+        const char* pActual = i < actualLines.size() ? actualLines[i].c_str() : "(missing)";
+        const char* pGolden = i < goldenLines.size() ? goldenLines[i].c_str() : "(missing)";
+        if (strcmp(pActual, pGolden) != 0) {
+            printf("FAIL: frame hash mismatch\n  golden: %s\n  actual: %s\n", pGolden, pActual);
+            return false;
+        }
+    }
+    printf("Golden hashes: %zu frames match\n", actualLines.size());
+    return true;
+}
+
+// ベースライン ("<fps> <フレームあたりの確保回数>") と比べる関数
+// ベースラインがなければ比べられないので、*pMissingをtrueにする (--update-baselineなら今回の結果を記録する)
+static bool CheckBaseline(const char* filename, const PipelineTestCase& testCase, double fps, double allocationsPerFrame,
+                          double margin, bool update, bool* pMissing)
+{
+    *pMissing = false;
+    std::vector<std::string> otherLines;
+    std::vector<std::string> baselineLines;
+    bool loaded = LoadCaseLines(filename, testCase.name, &otherLines, &baselineLines);
+
+    double baselineFps = 0.0;
+    double baselineAllocations = 0.0;
+    bool found = !baselineLines.empty() &&
+                 sscanf(baselineLines.back().c_str(), "%lf %lf", &baselineFps, &baselineAllocations) == 2;
+    if (update) {
+        if (!loaded) {
+            otherLines.push_back("# <case> <frames/s> <allocations/frame> (pipeline_test --update-baseline)");
+        }
+        char line[64];
+        snprintf(line, sizeof(line), "%.1f %.2f", fps, allocationsPerFrame);
+        printf("Baseline updated: %s (%s)\n", filename, line);
+        return SaveCaseLines(filename, testCase.name, otherLines, std::vector<std::string>(1, line));
+    }
+    if (!found) {
+        printf("Throughput: %.1f fps, allocations: %.2f per frame\n", fps, allocationsPerFrame);
+        printf("SKIP: no baseline for %s in %s (record one with --update-baseline)\n", testCase.name, filename);
+        *pMissing = true;
+        return true;
+    }
+
+    double minFps = baselineFps * (1.0 - margin);
+    double maxAllocations = baselineAllocations * (1.0 + margin);
+    printf("Throughput: %.1f fps (baseline %.1f, minimum %.1f)\n", fps, baselineFps, minFps);
+    printf("Allocations: %.2f per frame (baseline %.2f, maximum %.2f)\n",
+           allocationsPerFrame, baselineAllocations, maxAllocations);
+    bool passed = true;
+    if (fps < minFps) {
+        printf("FAIL: throughput dropped more than %.0f%%\n", margin * 100.0);
+        passed = false;
+    }
+    if (allocationsPerFrame > maxAllocations) {
+        printf("FAIL: allocations per frame rose more than %.0f%%\n", margin * 100.0);
+        passed = false;
+    }
+    return passed;
+}
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s --case <name> [--check output|perf|all] [--golden <file>] [--baseline <file>]\n"
+           "          [--margin <fraction>] [--runs <n>] [--update-golden] [--update-baseline]\n", program);
+    printf("Cases:");
+    for (const auto& testCase : g_testCases) {
+        printf(" %s", testCase.name);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* caseName = NULL;
+    const char* goldenFilename = "pipeline_test_golden.txt";
+    const char* baselineFilename = NULL;   // NULLならスループットと確保回数を検査しない
+    double margin = 0.25;                  // ベースラインからの許容幅 (割合)
+    int runs = 3;                          // スループットは最も速かった回で比べる
+    bool updateGolden = false;
+    bool updateBaseline = false;
+    bool checkOutput = true;               // ゴールデンのハッシュとアーカイブの読み戻し
+    bool checkPerformance = true;          // スループットと確保回数 (--baselineがあるとき)
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--case") == 0 && i + 1 < argc) {
+            caseName = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            const char* check = argv[++i];
+            if (strcmp(check, "output") != 0 && strcmp(check, "perf") != 0 && strcmp(check, "all") != 0) {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+            checkOutput = strcmp(check, "perf") != 0;
+            checkPerformance = strcmp(check, "output") != 0;
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            goldenFilename = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baselineFilename = argv[++i];
+        } else if (strcmp(argv[i], "--margin") == 0 && i + 1 < argc) {
+            margin = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--update-golden") == 0) {
+            updateGolden = true;
+        } else if (strcmp(argv[i], "--update-baseline") == 0) {
+            updateBaseline = true;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const PipelineTestCase* pCase = NULL;
+    for (const auto& testCase : g_testCases) {
+        if (caseName && strcmp(testCase.name, caseName) == 0) {
+            pCase = &testCase;
+        }
+    }
+    if (!pCase || runs < 1 || margin < 0.0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    printf("Case %s: %ux%u, %s, %u slices, %u frames\n", pCase->name, pCase->width, pCase->height,
+           pCase->bitrate ? "rate control" : "fixed QP", pCase->sliceCount, pCase->frameCount);
+
+    // 毎回ハッシュを比べ、実行ごとに出力が変わらないことも確かめる
+    PipelineResult result;
+    PipelineResult bestResult;
+    double bestMs = 0.0;
+    for (int run = 0; run < runs; run++) {
+        HRESULT hr = RunPipeline(*pCase, &result);
+        if (FAILED(hr)) {
+            printf("FAIL: pipeline failed: 0x%08X\n", hr);
+            return 1;
+        }
+        double totalMs = result.encodeMs + result.decodeMs;
+        printf("Run %d: encode %.1f fps, decode %.1f fps, pipeline %.1f fps, %llu allocations\n", run + 1,
+               pCase->frameCount * 1000.0 / result.encodeMs, pCase->frameCount * 1000.0 / result.decodeMs,
+               pCase->frameCount * 1000.0 / totalMs, static_cast<unsigned long long>(result.allocations));
+        if (run > 0 && (result.bitstreamHashes != bestResult.bitstreamHashes || result.yuvHashes != bestResult.yuvHashes)) {
+            printf("FAIL: output differs between runs\n");
+            return 1;
+        }
+        if (run == 0 || totalMs < bestMs) {
+            bestMs = totalMs;
+            bestResult = result;
+        }
+    }
+
+    bool passed = true;
+    if (checkOutput) {
+        passed = CheckGolden(goldenFilename, *pCase, bestResult, updateGolden);
+        passed = CheckArchiveRoundTrip(*pCase, bestResult.yuvHashes) && passed;
+    }
+    bool baselineMissing = false;
+    if (checkPerformance && baselineFilename) {
+        double fps = pCase->frameCount * 1000.0 / bestMs;
+        double allocationsPerFrame = static_cast<double>(bestResult.allocations) / pCase->frameCount;
+        passed = CheckBaseline(baselineFilename, *pCase, fps, allocationsPerFrame, margin, updateBaseline,
+                               &baselineMissing) && passed;
+    }
+    // 性能を検査するテストでは、ベースラインがなければ合格にはしない (出力の検査は別のテストで合否が出る)
+    if (passed && baselineMissing) {
+        printf("SKIP\n");
+        return SKIP_EXIT_CODE;
+    }
+    printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#include "pipeline_trace.h"
+#include <stdio.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifndef _WIN32
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> g_pipelineTraceEnabled(false);
+
+// 1つのスパン
+struct TraceEvent {
+    const char* name;
+    LONGLONG frame;
+    UINT64 startNs;
+    UINT64 durationNs;
+};
+
+// スレッドごとのバッファ
+// 書き込むのは持ち主のスレッドだけで、countをreleaseで進めてから書き出し側がacquireで読む
+struct TraceThreadBuffer {
+    UINT64 threadId;
+    const char* threadName;
+    std::unique_ptr<TraceEvent[]> events;
+    std::atomic<size_t> count;
+    std::atomic<UINT64> dropped;
+    std::atomic<UINT32> generation;    // StartPipelineTraceの回数 (古い記録を捨てる判定用)
+};
+
+// バッファの登録簿 (登録と書き出しのときだけロックする)
+static std::mutex g_registryMutex;
+static std::vector<std::unique_ptr<TraceThreadBuffer>> g_registry;
+static std::atomic<UINT32> g_generation(0);
+static UINT64 g_originNs = 0;
+
+static thread_local TraceThreadBuffer* t_buffer = NULL;
+static thread_local const char* t_threadName = NULL;
+
+UINT64 GetTraceTimestampNs()
+{
+    return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// OSのスレッドID (Perfettoで他のツールの記録と突き合わせられるように)
+static UINT64 GetCurrentThreadIdForTrace()
+{
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return static_cast<UINT64>(syscall(SYS_gettid));
+#endif
+}
+
+// 呼び出し元のスレッドのバッファを返す (最初の記録で確保して登録する)
+static TraceThreadBuffer* GetThreadBuffer()
+{
+    if (!t_buffer) {
+        std::unique_ptr<TraceThreadBuffer> buffer(new TraceThreadBuffer());
+        buffer->threadId = GetCurrentThreadIdForTrace();
+        buffer->threadName = t_threadName;
+        buffer->events.reset(new TraceEvent[PIPELINE_TRACE_EVENTS_PER_THREAD]);
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->generation.store(g_generation.load(std::memory_order_acquire), std::memory_order_relaxed);
+        t_buffer = buffer.get();
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        g_registry.push_back(std::move(buffer));
+    }
+    return t_buffer;
+}
+
+void RecordTraceSpan(const char* name, LONGLONG frame, UINT64 startNs, UINT64 endNs)
+{
+    TraceThreadBuffer* pBuffer = GetThreadBuffer();
+
+    // StartPipelineTraceがやり直されたら、このスレッドの古い記録を捨てる
+    UINT32 generation = g_generation.load(std::memory_order_acquire);
+    if (pBuffer->generation.load(std::memory_order_relaxed) != generation) {
+        pBuffer->count.store(0, std::memory_order_release);
+        pBuffer->dropped.store(0, std::memory_order_relaxed);
+        pBuffer->generation.store(generation, std::memory_order_relaxed);
+    }
+
+    size_t index = pBuffer->count.load(std::memory_order_relaxed);
+    if (index >= PIPELINE_TRACE_EVENTS_PER_THREAD) {
+        pBuffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceEvent& event = pBuffer->events[index];
+    event.name = name;
+    event.frame = frame;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    pBuffer->count.store(index + 1, std::memory_order_release);
+}
+
+void SetTraceThreadName(const char* name)
+{
+    t_threadName = name;
+    if (t_buffer) {
+        std::lock_guard<std::mutex> lock(g_registryMutex);
+        t_buffer->threadName = name;
+    }
+}
+
+void StartPipelineTrace()
+{
+    g_originNs = GetTraceTimestampNs();
+    g_generation.fetch_add(1, std::memory_order_release);
+    g_pipelineTraceEnabled.store(true, std::memory_order_release);
+}
+
+void StopPipelineTrace()
+{
+    g_pipelineTraceEnabled.store(false, std::memory_order_release);
+}
+
+// JSONの文字列として書き出す (名前はリテラルだが、念のため引用符とバックスラッシュをエスケープする)
+static void WriteJsonString(FILE* pFile, const char* text)
+{
+    fputc('"', pFile);
+    for (const char* p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fputc('\\', pFile);
+        }
+        fputc(*p, pFile);
+    }
+    fputc('"', pFile);
+}
+
+HRESULT WritePipelineTrace(const char* filename)
+{
+    FILE* pFile = fopen(filename, "wb");
+    if (!pFile) {
+        printf("Failed to open trace file: %s\n", filename);
+        return E_FAIL;
+    }
+
+    std::lock_guard<std::mutex> lock(g_registryMutex);
+    UINT32 generation = g_generation.load(std::memory_order_acquire);
+    size_t spanCount = 0;
+    UINT64 droppedCount = 0;
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(pFile, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"nal_encode_decode\"}}");
+    for (const auto& buffer : g_registry) {
+        if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+            continue;
+        }
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        droppedCount += buffer->dropped.load(std::memory_order_relaxed);
+        if (buffer->threadName) {
+            fprintf(pFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":",
+                    static_cast<unsigned long long>(buffer->threadId));
+            WriteJsonString(pFile, buffer->threadName);
+            fprintf(pFile, "}}");
+        }
+        for (size_t i = 0; i < count; i++) {
+            const TraceEvent& event = buffer->events[i];
+            // 時刻はマイクロ秒 (小数点以下3桁でナノ秒まで残す)
+            UINT64 startNs = (event.startNs > g_originNs) ? event.startNs - g_originNs : 0;
+            fprintf(pFile, ",\n{\"name\":");
+            WriteJsonString(pFile, event.name);
+            fprintf(pFile, ",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+                    static_cast<unsigned long long>(buffer->threadId),
+                    static_cast<unsigned long long>(startNs / 1000), static_cast<unsigned long long>(startNs % 1000),
+                    static_cast<unsigned long long>(event.durationNs / 1000),
+                    static_cast<unsigned long long>(event.durationNs % 1000));
+            if (event.frame != PIPELINE_TRACE_NO_FRAME) {
+                fprintf(pFile, ",\"args\":{\"frame\":%lld}", static_cast<long long>(event.frame));
+            }
+            fprintf(pFile, "}");
+            spanCount++;
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+
+    bool writeFailed = ferror(pFile) != 0;
+    fclose(pFile);
+    if (writeFailed) {
+        printf("Failed to write trace file: %s\n", filename);
+        return E_FAIL;
+    }
+    printf("Trace written: %s (%zu spans, %llu dropped)\n", filename, spanCount,
+           static_cast<unsigned long long>(droppedCount));
+    return S_OK;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "portable_types.h"
+#include <atomic>
+
+// パイプラインのスパン (区間) を記録し、Chrome trace形式のJSONに書き出すトレース
+// - TRACE_SPANを置いたスコープの開始・終了時刻を、フレーム番号とスレッドIDとともに記録する
+// - 記録はスレッドごとのバッファに追記するだけで、ロックは取らない (バッファの登録時だけロックする)
+// - 書き出したJSONはPerfetto (ui.perfetto.dev) や chrome://tracing で開ける
+// - NAL_TRACINGを定義しない場合、マクロは何もしない。定義していても、
+//   StartPipelineTraceを呼ぶまではフラグを1回読むだけで時刻も取らない
+
+// スレッドごとのバッファに記録できるスパンの数 (超えた分は捨てて数だけ数える)
+#define PIPELINE_TRACE_EVENTS_PER_THREAD 65536
+
+// フレーム番号を持たないスパン
+#define PIPELINE_TRACE_NO_FRAME (-1)
+
+// トレースが有効かどうか (TraceSpanScopeが毎回読むのでヘッダーに置く)
+extern std::atomic<bool> g_pipelineTraceEnabled;
+
+// 現在時刻 (ナノ秒、単調増加)
+UINT64 GetTraceTimestampNs();
+
+// 終わったスパンを呼び出し元のスレッドのバッファに記録する関数 (nameは文字列リテラルであること)
+void RecordTraceSpan(const char* name, LONGLONG frame, UINT64 startNs, UINT64 endNs);
+
+// 呼び出し元のスレッドの名前を設定する関数 (nameは文字列リテラルであること)
+void SetTraceThreadName(const char* name);
+
+// スコープの開始から終了までを1つのスパンとして記録する
+struct TraceSpanScope {
+    const char* name;                  // 無効なときはNULL
+    LONGLONG frame;
+    UINT64 startNs;
+
+    TraceSpanScope(const char* spanName, LONGLONG spanFrame) : name(NULL), frame(spanFrame), startNs(0)
+    {
+        if (g_pipelineTraceEnabled.load(std::memory_order_relaxed)) {
+            name = spanName;
+            startNs = GetTraceTimestampNs();
+        }
+    }
+    ~TraceSpanScope()
+    {
+        if (name) {
+            RecordTraceSpan(name, frame, startNs, GetTraceTimestampNs());
+        }
+    }
+};
+
+#ifdef NAL_TRACING
+#define PIPELINE_TRACE_CONCAT2(a, b) a##b
+#define PIPELINE_TRACE_CONCAT(a, b) PIPELINE_TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(name, frame) TraceSpanScope PIPELINE_TRACE_CONCAT(traceSpan, __LINE__)((name), static_cast<LONGLONG>(frame))
+#define TRACE_THREAD_NAME(name) SetTraceThreadName(name)
+#define PIPELINE_TRACE_COMPILED 1
+#else
+#define TRACE_SPAN(name, frame) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define PIPELINE_TRACE_COMPILED 0
+#endif
+
+// 記録を開始する関数 (それまでの記録は捨て、時刻の原点をここにする)
+void StartPipelineTrace();
+
+// 記録を止める関数 (記録済みのスパンは書き出すまで残る)
+void StopPipelineTrace();
+
+// 記録したスパンをChrome trace形式のJSONとして書き出す関数
+HRESULT WritePipelineTrace(const char* filename);
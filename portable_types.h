@@ -0,0 +1,46 @@
+#pragma once
+
+// Windows以外の環境でも、Win32の基本型とHRESULTをそのまま使えるようにするヘッダ
+// (Media Foundationに依存しないモジュールはこのヘッダだけをincludeする)
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t  BYTE;
+typedef int16_t  INT16;
+typedef uint16_t WORD;
+typedef uint16_t UINT16;
+typedef int32_t  INT32;
+typedef uint32_t UINT32;
+typedef uint64_t UINT64;
+typedef uint32_t DWORD;
+typedef uint32_t ULONG;
+typedef int32_t  LONG;
+typedef int64_t  LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef int      BOOL;
+typedef int32_t  HRESULT;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK           ((HRESULT)0)
+#define S_FALSE        ((HRESULT)1)
+#define E_NOTIMPL      ((HRESULT)0x80004001L)
+#define E_POINTER      ((HRESULT)0x80004003L)
+#define E_ABORT        ((HRESULT)0x80004004L)
+#define E_FAIL         ((HRESULT)0x80004005L)
+#define E_UNEXPECTED   ((HRESULT)0x8000FFFFL)
+#define E_OUTOFMEMORY  ((HRESULT)0x8007000EL)
+#define E_INVALIDARG   ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)    (((HRESULT)(hr)) < 0)
+#endif
@@ -0,0 +1,279 @@
+#include "pre_analysis.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PRE_ANALYSIS_USE_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PRE_ANALYSIS_USE_NEON 1
+#endif
+
+// 丸め付き平均 (SSE2のpavgb、NEONのvrhaddと同じ)
+static inline BYTE Average(BYTE a, BYTE b)
+{
+    return static_cast<BYTE>((a + b + 1) >> 1);
+}
+
+// 4x4画素を1画素に縮小する (縦に2段、横に2段の丸め付き平均)
+static inline BYTE Downsample4x4Pixel(const BYTE* r0, const BYTE* r1, const BYTE* r2, const BYTE* r3)
+{
+    BYTE column[4];
+    for (int c = 0; c < 4; c++) {
+        column[c] = Average(Average(r0[c], r1[c]), Average(r2[c], r3[c]));
+    }
+    return Average(Average(column[0], column[1]), Average(column[2], column[3]));
+}
+
+void DownsampleLuma4x4Scalar(const BYTE* pSrc, UINT32 srcStride, BYTE* pDst, UINT32 dstWidth, UINT32 dstHeight)
+{
+    for (UINT32 y = 0; y < dstHeight; y++) {
+        const BYTE* r0 = pSrc + static_cast<size_t>(y) * 4 * srcStride;
+        const BYTE* r1 = r0 + srcStride;
+        const BYTE* r2 = r1 + srcStride;
+        const BYTE* r3 = r2 + srcStride;
+        BYTE* pRow = pDst + static_cast<size_t>(y) * dstWidth;
+        for (UINT32 x = 0; x < dstWidth; x++) {
+            pRow[x] = Downsample4x4Pixel(r0 + x * 4, r1 + x * 4, r2 + x * 4, r3 + x * 4);
+        }
+    }
+}
+
+#if defined(PRE_ANALYSIS_USE_SSE2)
+// 隣り合う2バイトの丸め付き平均を取り、2つのベクトルの結果を16バイトにまとめる
+static inline __m128i AveragePairs(__m128i a, __m128i b)
+{
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    __m128i pairA = _mm_avg_epu16(_mm_and_si128(a, lowMask), _mm_srli_epi16(a, 8));
+    __m128i pairB = _mm_avg_epu16(_mm_and_si128(b, lowMask), _mm_srli_epi16(b, 8));
+    return _mm_packus_epi16(pairA, pairB);
+}
+
+static inline __m128i AverageRows(const BYTE* r0, const BYTE* r1, const BYTE* r2, const BYTE* r3)
+{
+    __m128i a = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r0)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1)));
+    __m128i b = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(r2)),
+                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(r3)));
+    return _mm_avg_epu8(a, b);
+}
+#endif
+
+// 4x4画素を1画素に縮小する (64入力バイト -> 16出力バイトずつSIMDで処理する)
+void DownsampleLuma4x4(const BYTE* pSrc, UINT32 srcStride, BYTE* pDst, UINT32 dstWidth, UINT32 dstHeight)
+{
+    for (UINT32 y = 0; y < dstHeight; y++) {
+        const BYTE* r0 = pSrc + static_cast<size_t>(y) * 4 * srcStride;
+        const BYTE* r1 = r0 + srcStride;
+        const BYTE* r2 = r1 + srcStride;
+        const BYTE* r3 = r2 + srcStride;
+        BYTE* pRow = pDst + static_cast<size_t>(y) * dstWidth;
+        UINT32 x = 0;
+#if defined(PRE_ANALYSIS_USE_SSE2)
+        for (; x + 16 <= dstWidth; x += 16) {
+            size_t s = static_cast<size_t>(x) * 4;
+            __m128i v0 = AverageRows(r0 + s, r1 + s, r2 + s, r3 + s);
+            __m128i v1 = AverageRows(r0 + s + 16, r1 + s + 16, r2 + s + 16, r3 + s + 16);
+            __m128i v2 = AverageRows(r0 + s + 32, r1 + s + 32, r2 + s + 32, r3 + s + 32);
+            __m128i v3 = AverageRows(r0 + s + 48, r1 + s + 48, r2 + s + 48, r3 + s + 48);
+            __m128i result = AveragePairs(AveragePairs(v0, v1), AveragePairs(v2, v3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pRow + x), result);
+        }
+#elif defined(PRE_ANALYSIS_USE_NEON)
+        for (; x + 16 <= dstWidth; x += 16) {
+            size_t s = static_cast<size_t>(x) * 4;
+            uint8x16_t v[4];
+            for (int k = 0; k < 4; k++) {
+                size_t o = s + k * 16;
+                v[k] = vrhaddq_u8(vrhaddq_u8(vld1q_u8(r0 + o), vld1q_u8(r1 + o)),
+                                  vrhaddq_u8(vld1q_u8(r2 + o), vld1q_u8(r3 + o)));
+            }
+            // 偶数・奇数バイトに分けて平均する
+            uint8x16x2_t p01 = vuzpq_u8(v[0], v[1]);
+            uint8x16x2_t p23 = vuzpq_u8(v[2], v[3]);
+            uint8x16_t h01 = vrhaddq_u8(p01.val[0], p01.val[1]);
+            uint8x16_t h23 = vrhaddq_u8(p23.val[0], p23.val[1]);
+            uint8x16x2_t q = vuzpq_u8(h01, h23);
+            vst1q_u8(pRow + x, vrhaddq_u8(q.val[0], q.val[1]));
+        }
+#endif
+        for (; x < dstWidth; x++) {
+            pRow[x] = Downsample4x4Pixel(r0 + x * 4, r1 + x * 4, r2 + x * 4, r3 + x * 4);
+        }
+    }
+}
+
+UINT64 SumAbsDiffScalar(const BYTE* pA, const BYTE* pB, size_t size)
+{
+    UINT64 sum = 0;
+    for (size_t i = 0; i < size; i++) {
+        sum += (pA[i] > pB[i]) ? pA[i] - pB[i] : pB[i] - pA[i];
+    }
+    return sum;
+}
+
+// 2つのバイト列の絶対差の合計 (SSE2のpsadbw、NEONのvabdで16バイトずつ)
+UINT64 SumAbsDiff(const BYTE* pA, const BYTE* pB, size_t size)
+{
+    UINT64 sum = 0;
+    size_t i = 0;
+#if defined(PRE_ANALYSIS_USE_SSE2)
+    __m128i accumulator = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pA + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pB + i));
+        accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(a, b));
+    }
+    UINT64 lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+    sum = lanes[0] + lanes[1];
+#elif defined(PRE_ANALYSIS_USE_NEON)
+    uint64x2_t accumulator = vdupq_n_u64(0);
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t diff = vabdq_u8(vld1q_u8(pA + i), vld1q_u8(pB + i));
+        accumulator = vpadalq_u32(accumulator, vpaddlq_u16(vpaddlq_u8(diff)));
+    }
+    sum = vgetq_lane_u64(accumulator, 0) + vgetq_lane_u64(accumulator, 1);
+#endif
+    return sum + SumAbsDiffScalar(pA + i, pB + i, size - i);
+}
+
+// 解析器を初期化する関数
+HRESULT InitializePreAnalyzer(PreAnalyzer* pAnalyzer, UINT32 width, UINT32 height)
+{
+    if (!pAnalyzer) {
+        return E_POINTER;
+    }
+    if (width < PRE_ANALYSIS_SCALE || height < PRE_ANALYSIS_SCALE) {
+        return E_INVALIDARG;
+    }
+
+    pAnalyzer->width = width;
+    pAnalyzer->height = height;
+    pAnalyzer->downWidth = width / PRE_ANALYSIS_SCALE;
+    pAnalyzer->downHeight = height / PRE_ANALYSIS_SCALE;
+    size_t downSize = static_cast<size_t>(pAnalyzer->downWidth) * pAnalyzer->downHeight;
+    pAnalyzer->downBuffers[0].assign(downSize, 0);
+    pAnalyzer->downBuffers[1].assign(downSize, 0);
+    memset(pAnalyzer->histograms, 0, sizeof(pAnalyzer->histograms));
+    pAnalyzer->currentIndex = 0;
+    pAnalyzer->hasPrevious = false;
+
+    // 既定のしきい値 (カメラ映像の動きではヒストグラムがあまり変わらないので両方を条件にする)
+    pAnalyzer->thresholds.sceneCutSad = 10.0;
+    pAnalyzer->thresholds.sceneCutHistogram = 0.30;
+    pAnalyzer->thresholds.staticSad = 0.25;
+    pAnalyzer->thresholds.minSceneCutInterval = 6;
+
+    pAnalyzer->frameCount = 0;
+    pAnalyzer->sceneCutCount = 0;
+    pAnalyzer->staticFrameCount = 0;
+    pAnalyzer->framesSinceSceneCut = 0;
+    pAnalyzer->totalTimeUs = 0.0;
+
+    printf("Pre-analyzer initialized: %dx%d -> %dx%d luma\n",
+           width, height, pAnalyzer->downWidth, pAnalyzer->downHeight);
+    return S_OK;
+}
+
+// フレームを解析してヒントを返す関数
+HRESULT PreAnalyzeFrame(PreAnalyzer* pAnalyzer, const Nv12Frame* pFrame, PreAnalysisHints* pHints)
+{
+    if (!pAnalyzer || !pFrame || !pHints || !pFrame->pY) {
+        return E_POINTER;
+    }
+    if (pFrame->cropWidth != pAnalyzer->width || pFrame->cropHeight != pAnalyzer->height) {
+        return E_INVALIDARG;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    const UINT32 downWidth = pAnalyzer->downWidth;
+    const UINT32 downHeight = pAnalyzer->downHeight;
+    const size_t downSize = static_cast<size_t>(downWidth) * downHeight;
+    int current = pAnalyzer->currentIndex;
+    BYTE* pCurrent = pAnalyzer->downBuffers[current].data();
+    const BYTE* pPrevious = pAnalyzer->downBuffers[current ^ 1].data();
+
+    // 表示領域の輝度を縮小する
+    const BYTE* pSrc = pFrame->pY + static_cast<size_t>(pFrame->cropTop) * pFrame->stride + pFrame->cropLeft;
+    DownsampleLuma4x4(pSrc, pFrame->stride, pCurrent, downWidth, downHeight);
+
+    // 輝度ヒストグラム (依存関係を減らすため4本に分けて数える)
+    UINT32 partial[4][PRE_ANALYSIS_HISTOGRAM_BINS];
+    memset(partial, 0, sizeof(partial));
+    const int binShift = 2; // 256 / 64
+    size_t i = 0;
+    for (; i + 4 <= downSize; i += 4) {
+        partial[0][pCurrent[i] >> binShift]++;
+        partial[1][pCurrent[i + 1] >> binShift]++;
+        partial[2][pCurrent[i + 2] >> binShift]++;
+        partial[3][pCurrent[i + 3] >> binShift]++;
+    }
+    for (; i < downSize; i++) {
+        partial[0][pCurrent[i] >> binShift]++;
+    }
+    UINT32* pHistogram = pAnalyzer->histograms[current];
+    for (int bin = 0; bin < PRE_ANALYSIS_HISTOGRAM_BINS; bin++) {
+        pHistogram[bin] = partial[0][bin] + partial[1][bin] + partial[2][bin] + partial[3][bin];
+    }
+
+    // 空間的な複雑さ (隣接画素との差の平均)
+    UINT64 gradient = 0;
+    if (downHeight > 1) {
+        gradient += SumAbsDiff(pCurrent, pCurrent + downWidth, downSize - downWidth);
+    }
+    for (UINT32 y = 0; y < downHeight; y++) {
+        const BYTE* pRow = pCurrent + static_cast<size_t>(y) * downWidth;
+        gradient += SumAbsDiff(pRow, pRow + 1, downWidth - 1);
+    }
+
+    memset(pHints, 0, sizeof(*pHints));
+    pHints->frameIndex = pAnalyzer->frameCount;
+    pHints->complexity = static_cast<double>(gradient) / downSize;
+
+    if (pAnalyzer->hasPrevious) {
+        // 前フレームとの差
+        pHints->sadPerPixel = static_cast<double>(SumAbsDiff(pCurrent, pPrevious, downSize)) / downSize;
+        const UINT32* pPreviousHistogram = pAnalyzer->histograms[current ^ 1];
+        UINT64 distance = 0;
+        for (int bin = 0; bin < PRE_ANALYSIS_HISTOGRAM_BINS; bin++) {
+            distance += (pHistogram[bin] > pPreviousHistogram[bin]) ? pHistogram[bin] - pPreviousHistogram[bin]
+                                                                    : pPreviousHistogram[bin] - pHistogram[bin];
+        }
+        pHints->histogramDistance = static_cast<double>(distance) / (2.0 * downSize);
+
+        const PreAnalysisThresholds& t = pAnalyzer->thresholds;
+        pAnalyzer->framesSinceSceneCut++;
+        if (pHints->sadPerPixel >= t.sceneCutSad && pHints->histogramDistance >= t.sceneCutHistogram &&
+            pAnalyzer->framesSinceSceneCut >= t.minSceneCutInterval) {
+            pHints->sceneCut = TRUE;
+            pAnalyzer->sceneCutCount++;
+            pAnalyzer->framesSinceSceneCut = 0;
+        } else if (pHints->sadPerPixel <= t.staticSad) {
+            pHints->staticFrame = TRUE;
+            pAnalyzer->staticFrameCount++;
+        }
+    }
+
+    pAnalyzer->currentIndex = current ^ 1;
+    pAnalyzer->hasPrevious = true;
+    pAnalyzer->frameCount++;
+    pAnalyzer->totalTimeUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    return S_OK;
+}
+
+// 統計情報を表示する関数
+void PrintPreAnalysisStatistics(const PreAnalyzer* pAnalyzer)
+{
+    if (!pAnalyzer || pAnalyzer->frameCount == 0) {
+        return;
+    }
+    double averageUs = pAnalyzer->totalTimeUs / pAnalyzer->frameCount;
+    printf("Pre-analysis: %llu frames, %llu scene cuts, %llu static frames, avg %.1f us/frame (%.0f fps)\n",
+           static_cast<unsigned long long>(pAnalyzer->frameCount),
+           static_cast<unsigned long long>(pAnalyzer->sceneCutCount),
+           static_cast<unsigned long long>(pAnalyzer->staticFrameCount),
+           averageUs, averageUs > 0.0 ? 1000000.0 / averageUs : 0.0);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include <vector>
+
+// 縮小率 (輝度の4x4画素を1画素にする。1080pなら480x270)
+#define PRE_ANALYSIS_SCALE 4
+
+// 輝度ヒストグラムのビン数
+#define PRE_ANALYSIS_HISTOGRAM_BINS 64
+
+// 1フレーム分の解析結果 (エンコーダーへのヒント)
+struct PreAnalysisHints {
+    UINT64 frameIndex;                 // 解析したフレームの番号
+    double sadPerPixel;                // 縮小輝度の前フレームとの平均絶対差 (0〜255)
+    double histogramDistance;          // 輝度ヒストグラムの差 (0: 同一 〜 1: 重なりなし)
+    double complexity;                 // 縮小輝度の水平・垂直勾配の平均 (空間的な複雑さ)
+    BOOL sceneCut;                     // シーンチェンジ (キーフレームにするべき)
+    BOOL staticFrame;                  // 前フレームとほぼ同じ (スキップしてよい)
+};
+
+// 判定のしきい値
+struct PreAnalysisThresholds {
+    double sceneCutSad;                // シーンチェンジとみなすSADの下限
+    double sceneCutHistogram;          // シーンチェンジとみなすヒストグラム差の下限
+    double staticSad;                  // 静止フレームとみなすSADの上限
+    UINT32 minSceneCutInterval;        // シーンチェンジの最小間隔 (フレーム数、フラッシュでの連発を防ぐ)
+};
+
+// 先読み解析器構造体
+// 縮小した輝度を2フレーム分 (現在と直前) 保持し、フレーム間の差と空間的な複雑さを求める
+struct PreAnalyzer {
+    UINT32 width;                      // 入力の表示幅
+    UINT32 height;                     // 入力の表示高さ
+    UINT32 downWidth;                  // 縮小後の幅
+    UINT32 downHeight;                 // 縮小後の高さ
+    std::vector<BYTE> downBuffers[2];  // 縮小輝度 (downWidth x downHeight、現在と直前を交互に使う)
+    UINT32 histograms[2][PRE_ANALYSIS_HISTOGRAM_BINS];
+    int currentIndex;                  // downBuffers/histogramsの現在側
+    bool hasPrevious;                  // 直前のフレームがあるか
+    PreAnalysisThresholds thresholds;
+
+    // 統計情報
+    UINT64 frameCount;                 // 解析したフレーム数
+    UINT64 sceneCutCount;              // シーンチェンジの数
+    UINT64 staticFrameCount;           // 静止フレームの数
+    UINT64 framesSinceSceneCut;        // 直前のシーンチェンジからのフレーム数
+    double totalTimeUs;                // 解析にかかった時間の合計
+};
+
+// 解析器を初期化する関数 (width/heightは表示サイズ、しきい値は既定値になる)
+HRESULT InitializePreAnalyzer(PreAnalyzer* pAnalyzer, UINT32 width, UINT32 height);
+
+// フレームを解析してヒントを返す関数 (フレームは表示領域 (クロップ) だけを見る)
+HRESULT PreAnalyzeFrame(PreAnalyzer* pAnalyzer, const Nv12Frame* pFrame, PreAnalysisHints* pHints);
+
+// 統計情報を表示する関数
+void PrintPreAnalysisStatistics(const PreAnalyzer* pAnalyzer);
+
+// SIMDカーネル (検証用にスカラー版と同じ結果を返す)
+// 4x4画素を丸め付き平均の入れ子 ((a+b+1)>>1) で1画素に縮小する
+void DownsampleLuma4x4(const BYTE* pSrc, UINT32 srcStride, BYTE* pDst, UINT32 dstWidth, UINT32 dstHeight);
+void DownsampleLuma4x4Scalar(const BYTE* pSrc, UINT32 srcStride, BYTE* pDst, UINT32 dstWidth, UINT32 dstHeight);
+
+// 2つのバイト列の絶対差の合計
+UINT64 SumAbsDiff(const BYTE* pA, const BYTE* pB, size_t size);
+UINT64 SumAbsDiffScalar(const BYTE* pA, const BYTE* pB, size_t size);
@@ -0,0 +1,174 @@
+#include "realtime_pacer.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// 劣化モードを抜ける遅れ (周期に対する割合)。入る遅れ (1周期) より小さくしてモードの振動を防ぐ
+#define PACER_DEGRADE_EXIT_RATIO 0.5
+
+// 処理時間の移動平均の重み (新しい値の割合)
+#define PACER_PROCESS_TIME_WEIGHT 0.125
+
+// フレームiの取り込み時刻 (開始からのマイクロ秒)
+static UINT64 CaptureTimeUs(const RealtimePacer* pPacer, UINT64 frameIndex)
+{
+    return frameIndex * 1000000ULL * pPacer->frameRateDenom / pPacer->frameRateNum;
+}
+
+static double ElapsedUs(const RealtimePacer* pPacer)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - pPacer->startTime).count();
+}
+
+// ペーサーを初期化する関数
+HRESULT InitializeRealtimePacer(RealtimePacer* pPacer, UINT32 frameRateNum, UINT32 frameRateDenom,
+                                PacerPolicy policy, UINT32 maxLatencyFrames)
+{
+    if (!pPacer) {
+        return E_POINTER;
+    }
+    if (frameRateNum == 0 || frameRateDenom == 0) {
+        return E_INVALIDARG;
+    }
+    pPacer->frameRateNum = frameRateNum;
+    pPacer->frameRateDenom = frameRateDenom;
+    pPacer->policy = policy;
+    pPacer->maxLatencyFrames = maxLatencyFrames ? maxLatencyFrames : 1;
+    pPacer->started = false;
+    pPacer->degraded = false;
+    pPacer->averageProcessUs = 0.0;
+    pPacer->releasedFrames = 0;
+    pPacer->encodedFrames = 0;
+    pPacer->lateFrames = 0;
+    pPacer->droppedFrames = 0;
+    pPacer->degradedFrames = 0;
+    pPacer->waitCount = 0;
+    pPacer->totalLatencyMs = 0.0;
+    pPacer->maxLatencyMs = 0.0;
+    return S_OK;
+}
+
+// フレームの取り込み時刻まで待ち、エンコードするか落とすかを決める関数
+HRESULT WaitForPacedFrame(RealtimePacer* pPacer, UINT64 frameIndex, bool keyFrame, PacerDecision* pDecision)
+{
+    if (!pPacer || !pDecision) {
+        return E_POINTER;
+    }
+    if (!pPacer->started) {
+        pPacer->startTime = std::chrono::steady_clock::now();
+        pPacer->started = true;
+    }
+
+    // 取り込み時刻より前なら待つ (ライブ入力ではフレームはまだ届いていない)
+    const UINT64 captureUs = CaptureTimeUs(pPacer, frameIndex);
+    double nowUs = ElapsedUs(pPacer);
+    if (nowUs < captureUs) {
+        std::this_thread::sleep_until(pPacer->startTime + std::chrono::microseconds(captureUs));
+        nowUs = ElapsedUs(pPacer);
+        pPacer->waitCount++;
+    }
+
+    const double periodUs = 1000000.0 * pPacer->frameRateDenom / pPacer->frameRateNum;
+    const double deadlineUs = captureUs + periodUs * pPacer->maxLatencyFrames;
+    const double lagUs = nowUs - captureUs;
+    const bool nextFrameArrived = nowUs >= CaptureTimeUs(pPacer, frameIndex + 1);
+    const bool missesDeadline = nextFrameArrived && nowUs + pPacer->averageProcessUs > deadlineUs;
+
+    pDecision->frameIndex = frameIndex;
+    pDecision->lagMs = lagUs / 1000.0;
+    pDecision->decisionUs = nowUs;
+    pDecision->drop = FALSE;
+    pDecision->degrade = FALSE;
+    switch (pPacer->policy) {
+    case PACER_DROP_OLDEST:
+        // 後ろのフレームが届いているので、間に合わないこのフレームが最も古い
+        pDecision->drop = missesDeadline ? TRUE : FALSE;
+        break;
+    case PACER_DROP_NON_REFERENCE:
+        // キーフレームは後続のフレームの起点になるので、遅れても落とさない
+        pDecision->drop = (missesDeadline && !keyFrame) ? TRUE : FALSE;
+        break;
+    case PACER_DEGRADE:
+        if (lagUs > periodUs) {
+            pPacer->degraded = true;
+        } else if (lagUs < periodUs * PACER_DEGRADE_EXIT_RATIO) {
+            pPacer->degraded = false;
+        }
+        pDecision->drop = missesDeadline ? TRUE : FALSE;
+        pDecision->degrade = pPacer->degraded ? TRUE : FALSE;
+        break;
+    }
+
+    pPacer->releasedFrames++;
+    if (pDecision->drop) {
+        pPacer->droppedFrames++;
+    } else if (pDecision->degrade) {
+        pPacer->degradedFrames++;
+    }
+    return S_OK;
+}
+
+// フレームのエンコードが完了したことを通知する関数
+void CompletePacedFrame(RealtimePacer* pPacer, const PacerDecision& decision)
+{
+    if (!pPacer || !pPacer->started || decision.drop) {
+        return;
+    }
+    const UINT64 captureUs = CaptureTimeUs(pPacer, decision.frameIndex);
+    const double periodUs = 1000000.0 * pPacer->frameRateDenom / pPacer->frameRateNum;
+    const double nowUs = ElapsedUs(pPacer);
+    const double latencyMs = (nowUs - captureUs) / 1000.0;
+
+    // 劣化モードの切り替え直後は処理時間が変わるが、移動平均なので数フレームで追従する
+    double processUs = nowUs - decision.decisionUs;
+    pPacer->averageProcessUs = (pPacer->encodedFrames == 0)
+        ? processUs
+        : pPacer->averageProcessUs + (processUs - pPacer->averageProcessUs) * PACER_PROCESS_TIME_WEIGHT;
+
+    pPacer->encodedFrames++;
+    pPacer->totalLatencyMs += latencyMs;
+    if (latencyMs > pPacer->maxLatencyMs) {
+        pPacer->maxLatencyMs = latencyMs;
+    }
+    if (nowUs > captureUs + periodUs * pPacer->maxLatencyFrames) {
+        pPacer->lateFrames++;
+    }
+}
+
+// ポリシー名を解析する関数
+bool ParsePacerPolicy(const char* name, PacerPolicy* pPolicy)
+{
+    if (strcmp(name, "oldest") == 0) {
+        *pPolicy = PACER_DROP_OLDEST;
+    } else if (strcmp(name, "non-reference") == 0) {
+        *pPolicy = PACER_DROP_NON_REFERENCE;
+    } else if (strcmp(name, "degrade") == 0) {
+        *pPolicy = PACER_DEGRADE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 統計情報を表示する関数
+void PrintPacerStatistics(const RealtimePacer* pPacer)
+{
+    if (!pPacer || pPacer->releasedFrames == 0) {
+        return;
+    }
+    static const char* const POLICY_NAMES[] = { "drop-oldest", "drop-non-reference", "degrade" };
+    printf("Realtime pacing (%s, %.2f fps, budget %u frames): %llu frames, %llu encoded, %llu late, %llu dropped, "
+           "%llu degraded, %llu waited for capture\n",
+           POLICY_NAMES[pPacer->policy], static_cast<double>(pPacer->frameRateNum) / pPacer->frameRateDenom,
+           pPacer->maxLatencyFrames,
+           static_cast<unsigned long long>(pPacer->releasedFrames),
+           static_cast<unsigned long long>(pPacer->encodedFrames),
+           static_cast<unsigned long long>(pPacer->lateFrames),
+           static_cast<unsigned long long>(pPacer->droppedFrames),
+           static_cast<unsigned long long>(pPacer->degradedFrames),
+           static_cast<unsigned long long>(pPacer->waitCount));
+    if (pPacer->encodedFrames > 0) {
+        printf("Capture-to-bitstream latency: avg %.1f ms, max %.1f ms\n",
+               pPacer->totalLatencyMs / pPacer->encodedFrames, pPacer->maxLatencyMs);
+    }
+}
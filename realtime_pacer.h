@@ -0,0 +1,68 @@
+#pragma once
+
+#include "portable_types.h"
+#include <chrono>
+
+// リアルタイムのペーシング (ライブ入力を想定したフレームの取り込みと締め切りの管理)
+// - フレームiはフレームレートに従って、開始から i * 周期 の時刻に取り込まれる (単調増加の時計を使う)
+// - 各フレームの締め切りは 取り込み時刻 + maxLatencyFrames * 周期
+// - 締め切りに間に合わないフレームは、ポリシーに従って落とすか、エンコードを軽くする
+//   (間に合うかはこれまでの処理時間の移動平均で見積もる。遅れたフレームを溜めないので、
+//    取り込みからビットストリームまでの遅延に上限ができる)
+// - 次のフレームがまだ届いていなければ、間に合わなくても落とさない (落としても代わりのフレームがない)
+
+// 遅れたときのポリシー
+enum PacerPolicy {
+    PACER_DROP_OLDEST = 0,             // 間に合わないフレームを古い順に落とす
+    PACER_DROP_NON_REFERENCE = 1,      // キーフレーム (IDR・シーンチェンジ) 以外の間に合わないフレームを落とす
+    PACER_DEGRADE = 2                  // 1周期より遅れている間はエンコードを軽くする (それでも間に合わなければ落とす)
+};
+
+// 1フレーム分の判断
+struct PacerDecision {
+    UINT64 frameIndex;                 // フレーム番号
+    BOOL drop;                         // エンコードせずに落とす (呼び出し側はSkipFrameで時刻だけ進める)
+    BOOL degrade;                      // エンコードを軽くする (PACER_DEGRADEのときだけ)
+    double lagMs;                      // 取り込み時刻からの遅れ (判断した時点)
+    double decisionUs;                 // 判断した時刻 (時計の開始からのマイクロ秒)
+};
+
+// ペーサー構造体
+struct RealtimePacer {
+    UINT32 frameRateNum;               // フレームレート分子
+    UINT32 frameRateDenom;             // フレームレート分母
+    PacerPolicy policy;
+    UINT32 maxLatencyFrames;           // 許容する遅れ (フレーム数)
+    std::chrono::steady_clock::time_point startTime; // フレーム0の取り込み時刻
+    bool started;
+    bool degraded;                     // 劣化モード中か (PACER_DEGRADE)
+    double averageProcessUs;           // 判断から完了までの時間の移動平均 (締め切りの見積もり用)
+
+    // 統計情報
+    UINT64 releasedFrames;             // 取り込んだフレーム数 (落としたものを含む)
+    UINT64 encodedFrames;              // エンコードを完了したフレーム数
+    UINT64 lateFrames;                 // 締め切りを過ぎて完了したフレーム数
+    UINT64 droppedFrames;              // 落としたフレーム数
+    UINT64 degradedFrames;             // 劣化モードでエンコードしたフレーム数
+    UINT64 waitCount;                  // 取り込み時刻まで待ったフレーム数 (エンコードが間に合っている)
+    double totalLatencyMs;             // 取り込みから完了までの時間の合計
+    double maxLatencyMs;               // 取り込みから完了までの時間の最大値
+};
+
+// ペーサーを初期化する関数 (時計はフレーム0のWaitForPacedFrameで開始する)
+HRESULT InitializeRealtimePacer(RealtimePacer* pPacer, UINT32 frameRateNum, UINT32 frameRateDenom,
+                                PacerPolicy policy, UINT32 maxLatencyFrames);
+
+// フレームの取り込み時刻まで待ち、エンコードするか落とすかを決める関数
+// フレーム番号は0から1ずつ増やすこと (落としたフレームも番号を使う)
+// keyFrameはキーフレームにする予定のフレーム (PACER_DROP_NON_REFERENCEでは落とさない)
+HRESULT WaitForPacedFrame(RealtimePacer* pPacer, UINT64 frameIndex, bool keyFrame, PacerDecision* pDecision);
+
+// フレームのエンコード (出力まで) が完了したことを通知する関数 (遅延と締め切りの判定を行う)
+void CompletePacedFrame(RealtimePacer* pPacer, const PacerDecision& decision);
+
+// ポリシー名を解析する関数 (oldest / non-reference / degrade)
+bool ParsePacerPolicy(const char* name, PacerPolicy* pPolicy);
+
+// 統計情報を表示する関数
+void PrintPacerStatistics(const RealtimePacer* pPacer);
@@ -0,0 +1,259 @@
+#include "rendition_ladder_win.h"
+#include <chrono>
+
+// 簡素化されたエラーチェック用マクロ
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// 既定のラダー (幅はマクロブロック境界に合わせて16の倍数にしている)
+const RenditionConfig DEFAULT_RENDITION_LADDER[4] = {
+    { 1920, 1080, 1500000 },
+    { 1280,  720,  900000 },
+    {  848,  480,  500000 },
+    {  640,  360,  300000 },
+};
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// NALユニットを長さプレフィックス形式 (ビッグエンディアン4バイト) で書き出す
+static void WriteNalUnits(RenditionSession* pSession, const std::vector<std::vector<BYTE>>& nalUnits)
+{
+    for (const auto& nalUnit : nalUnits) {
+        BYTE lengthBytes[4];
+        lengthBytes[0] = (nalUnit.size() >> 24) & 0xFF;
+        lengthBytes[1] = (nalUnit.size() >> 16) & 0xFF;
+        lengthBytes[2] = (nalUnit.size() >> 8) & 0xFF;
+        lengthBytes[3] = nalUnit.size() & 0xFF;
+        fwrite(lengthBytes, 1, 4, pSession->pOutput);
+        fwrite(nalUnit.data(), 1, nalUnit.size(), pSession->pOutput);
+        pSession->nalUnitsWritten++;
+        pSession->bytesWritten += 4 + nalUnit.size();
+    }
+}
+
+// セッションのワーカースレッド
+// Media Foundationのエンコーダーはこのスレッドで作成・使用・解放する
+static void RenditionWorker(RenditionSession* pSession)
+{
+    const RenditionConfig& config = pSession->config;
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    bool comInitialized = SUCCEEDED(hr);
+    bool encoderInitialized = false;
+    bool poolInitialized = false;
+
+    if (SUCCEEDED(hr)) {
+        hr = InitializeEncoder(&pSession->encoder, config.width, config.height, config.bitrate);
+        encoderInitialized = true;
+    }
+    if (SUCCEEDED(hr)) {
+        // エンコーダーの入力と同じストライド・符号化高さでプールを作る (コピー時に行単位の変換が不要)
+        hr = InitializeNv12FramePool(&pSession->pool, RENDITION_POOL_FRAMES, config.width, config.height,
+                                     pSession->encoder.codedHeight, pSession->encoder.stride);
+        poolInitialized = SUCCEEDED(hr);
+    }
+    if (SUCCEEDED(hr)) {
+        pSession->pOutput = fopen(pSession->filename, "wb");
+        if (!pSession->pOutput) {
+            printf("Failed to open %s for writing.\n", pSession->filename);
+            hr = E_FAIL;
+        }
+    }
+
+    // 初期化の完了を生産者に知らせる
+    {
+        std::lock_guard<std::mutex> lock(pSession->mutex);
+        pSession->ready = true;
+        pSession->result = hr;
+    }
+    pSession->wake.notify_all();
+
+    std::vector<std::vector<BYTE>> nalUnits;
+    if (SUCCEEDED(hr)) {
+        while (true) {
+            Nv12Frame* pFrame = NULL;
+            {
+                std::unique_lock<std::mutex> lock(pSession->mutex);
+                pSession->wake.wait(lock, [pSession] { return !pSession->queue.empty() || pSession->finishing; });
+                if (pSession->queue.empty()) {
+                    break;
+                }
+                pFrame = pSession->queue.front();
+                pSession->queue.pop_front();
+            }
+
+            // 失敗した後も、生産者が待たないようにフレームは返却し続ける
+            if (SUCCEEDED(hr)) {
+                auto start = std::chrono::steady_clock::now();
+                hr = EncodeFrame(&pSession->encoder, *pFrame, nalUnits);
+                pSession->encodeTimeMs += ElapsedMs(start);
+                if (SUCCEEDED(hr)) {
+                    WriteNalUnits(pSession, nalUnits);
+                    pSession->framesEncoded++;
+                } else {
+                    printf("Rendition %dx%d: EncodeFrame failed: 0x%08X\n", config.width, config.height, hr);
+                }
+            }
+            ReleaseNv12Frame(&pSession->pool, pFrame);
+        }
+
+        if (SUCCEEDED(hr)) {
+            nalUnits.clear();
+            hr = FlushEncoder(&pSession->encoder, nalUnits);
+            WriteNalUnits(pSession, nalUnits);
+        }
+    }
+
+    if (pSession->pOutput) {
+        fclose(pSession->pOutput);
+        pSession->pOutput = NULL;
+    }
+    if (encoderInitialized) {
+        ShutdownEncoder(&pSession->encoder);
+    }
+    if (poolInitialized) {
+        FreeNv12FramePool(&pSession->pool);
+    }
+    if (comInitialized) {
+        CoUninitialize();
+    }
+
+    std::lock_guard<std::mutex> lock(pSession->mutex);
+    pSession->result = hr;
+}
+
+// ワーカーに終了を知らせてスレッドの終了を待つ
+static void StopSession(RenditionSession* pSession)
+{
+    {
+        std::lock_guard<std::mutex> lock(pSession->mutex);
+        pSession->finishing = true;
+    }
+    pSession->wake.notify_all();
+    if (pSession->worker.joinable()) {
+        pSession->worker.join();
+    }
+}
+
+// ラダーを初期化する関数
+HRESULT InitializeRenditionLadder(RenditionLadder* pLadder, UINT32 sourceWidth, UINT32 sourceHeight,
+                                  const RenditionConfig* pConfigs, size_t configCount, Nv12ScaleFilter filter)
+{
+    HRESULT hr = S_OK;
+    if (!pLadder || !pConfigs) {
+        return E_POINTER;
+    }
+    pLadder->sessions.clear();
+    pLadder->sourceWidth = sourceWidth;
+    pLadder->sourceHeight = sourceHeight;
+    pLadder->filter = filter;
+    pLadder->sourceFrames = 0;
+
+    for (size_t i = 0; i < configCount; i++) {
+        RenditionSession* pSession = new RenditionSession();
+        pSession->config = pConfigs[i];
+        pSession->ready = false;
+        pSession->finishing = false;
+        pSession->result = S_OK;
+        pSession->pOutput = NULL;
+        pSession->framesEncoded = 0;
+        pSession->nalUnitsWritten = 0;
+        pSession->bytesWritten = 0;
+        pSession->scaleTimeMs = 0.0;
+        pSession->encodeTimeMs = 0.0;
+        snprintf(pSession->filename, sizeof(pSession->filename), "output_%up.h264", pConfigs[i].height);
+        pLadder->sessions.push_back(pSession);
+
+        hr = InitializeNv12Scaler(&pSession->scaler, sourceWidth, sourceHeight,
+                                  pConfigs[i].width, pConfigs[i].height, filter);
+        if (FAILED(hr)) {
+            printf("Invalid rendition size %dx%d\n", pConfigs[i].width, pConfigs[i].height);
+            break;
+        }
+        pSession->worker = std::thread(RenditionWorker, pSession);
+    }
+
+    // すべてのセッションのエンコーダー初期化を待つ
+    for (RenditionSession* pSession : pLadder->sessions) {
+        if (!pSession->worker.joinable()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pSession->mutex);
+        pSession->wake.wait(lock, [pSession] { return pSession->ready; });
+        if (FAILED(pSession->result) && SUCCEEDED(hr)) {
+            hr = pSession->result;
+        }
+    }
+
+    if (FAILED(hr)) {
+        for (RenditionSession* pSession : pLadder->sessions) {
+            StopSession(pSession);
+            delete pSession;
+        }
+        pLadder->sessions.clear();
+        CHECK_HR(hr, "InitializeRenditionLadder");
+    }
+
+    printf("Rendition ladder initialized: %zu renditions from %dx%d (%s scaler)\n",
+           pLadder->sessions.size(), sourceWidth, sourceHeight, GetNv12ScaleFilterName(filter));
+    return hr;
+}
+
+// ソースフレームを各レンディションにスケールしてエンコードキューに渡す関数
+HRESULT LadderEncodeFrame(RenditionLadder* pLadder, const Nv12Frame& source)
+{
+    HRESULT hr = S_OK;
+    for (RenditionSession* pSession : pLadder->sessions) {
+        // プールに空きがなければ、ワーカーがエンコードを終えて返却するまで待つ
+        Nv12Frame* pFrame = AcquireNv12Frame(&pSession->pool);
+
+        auto start = std::chrono::steady_clock::now();
+        hr = ScaleNv12Frame(&pSession->scaler, &source, pFrame);
+        pSession->scaleTimeMs += ElapsedMs(start);
+        if (FAILED(hr)) {
+            ReleaseNv12Frame(&pSession->pool, pFrame);
+            CHECK_HR(hr, "ScaleNv12Frame");
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pSession->mutex);
+            pSession->queue.push_back(pFrame);
+        }
+        pSession->wake.notify_one();
+    }
+    pLadder->sourceFrames++;
+    return hr;
+}
+
+// 残りのフレームをエンコード・フラッシュしてセッションを終了する関数
+HRESULT FinishRenditionLadder(RenditionLadder* pLadder)
+{
+    HRESULT hr = S_OK;
+    for (RenditionSession* pSession : pLadder->sessions) {
+        StopSession(pSession);
+    }
+
+    printf("\n--- Rendition ladder results (%llu source frames) ---\n", pLadder->sourceFrames);
+    for (RenditionSession* pSession : pLadder->sessions) {
+        const NalEncoder& encoder = pSession->encoder;
+        double seconds = static_cast<double>(pLadder->sourceFrames) * encoder.frameRateDenom / encoder.frameRateNum;
+        double frames = pLadder->sourceFrames ? static_cast<double>(pLadder->sourceFrames) : 1.0;
+        printf("%4dx%-4d: %llu frames, %llu NAL units, %llu bytes (%.0f kbps), scale %.2f ms/frame, "
+               "encode %.2f ms/frame -> %s%s\n",
+               pSession->config.width, pSession->config.height, pSession->framesEncoded,
+               pSession->nalUnitsWritten, pSession->bytesWritten,
+               seconds > 0.0 ? pSession->bytesWritten * 8.0 / seconds / 1000.0 : 0.0,
+               pSession->scaleTimeMs / frames, pSession->encodeTimeMs / frames, pSession->filename,
+               SUCCEEDED(pSession->result) ? "" : " (failed)");
+        if (FAILED(pSession->result) && SUCCEEDED(hr)) {
+            hr = pSession->result;
+        }
+        delete pSession;
+    }
+    pLadder->sessions.clear();
+    return hr;
+}
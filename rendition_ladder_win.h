@@ -0,0 +1,67 @@
+#pragma once
+
+#include "yuv_encoder_win.h"
+#include "nv12_frame_pool.h"
+#include "nv12_scaler.h"
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// 1レンディションの設定
+struct RenditionConfig {
+    UINT32 width;                      // 表示幅 (16の倍数)
+    UINT32 height;                     // 表示高さ (偶数)
+    UINT32 bitrate;                    // ビットレート (bps)
+};
+
+// レンディションごとのプール内フレーム数 (スケール済みでエンコード待ちのフレームの上限)
+#define RENDITION_POOL_FRAMES 4
+
+// 1レンディション分のエンコーダーセッション
+// エンコーダーは専用スレッドで初期化・実行し、生産者はスケール済みフレームをキューに渡すだけ
+struct RenditionSession {
+    RenditionConfig config;
+    NalEncoder encoder;
+    Nv12Scaler scaler;                 // ソース -> このレンディションのスケーラー
+    Nv12FramePool pool;                // スケール済みフレームのプール
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;      // キューへの追加・終了・初期化完了を通知する
+    std::deque<Nv12Frame*> queue;      // エンコード待ちのフレーム
+    bool ready;                        // エンコーダーの初期化が終わったか
+    bool finishing;                    // これ以上フレームが来ない
+    HRESULT result;                    // ワーカーの結果
+
+    char filename[64];                 // 出力ファイル名 (output_<高さ>p.h264)
+    FILE* pOutput;
+    UINT64 framesEncoded;
+    UINT64 nalUnitsWritten;
+    UINT64 bytesWritten;
+    double scaleTimeMs;                // スケールにかかった時間の合計 (生産者側)
+    double encodeTimeMs;               // エンコードにかかった時間の合計 (ワーカー側)
+};
+
+// レンディションラダー構造体 (1つのソースから複数のエンコーダーセッションに供給する)
+struct RenditionLadder {
+    std::vector<RenditionSession*> sessions;
+    UINT32 sourceWidth;                // ソースの表示サイズ
+    UINT32 sourceHeight;
+    Nv12ScaleFilter filter;
+    UINT64 sourceFrames;               // 供給したソースフレーム数
+};
+
+// 既定のラダー (1080p / 720p / 480p / 360p)
+extern const RenditionConfig DEFAULT_RENDITION_LADDER[4];
+
+// ラダーを初期化する関数 (各セッションのスレッドを起動し、エンコーダーの初期化を待つ)
+HRESULT InitializeRenditionLadder(RenditionLadder* pLadder, UINT32 sourceWidth, UINT32 sourceHeight,
+                                  const RenditionConfig* pConfigs, size_t configCount, Nv12ScaleFilter filter);
+
+// ソースフレームを1回だけ読み、各レンディションにスケールしてエンコードキューに渡す関数
+// スケール後はソースを参照しないので、戻ったらソースのバッファを再利用してよい
+HRESULT LadderEncodeFrame(RenditionLadder* pLadder, const Nv12Frame& source);
+
+// 残りのフレームをエンコード・フラッシュしてセッションを終了する関数
+HRESULT FinishRenditionLadder(RenditionLadder* pLadder);
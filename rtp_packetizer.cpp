@@ -0,0 +1,369 @@
+#include "rtp_packetizer.h"
+#include <stdio.h>
+#include <chrono>
+#include <random>
+
+// RTPヘッダーのサイズ (CSRCなし)
+static const size_t RTP_HEADER_SIZE = 12;
+
+// STAP-Aで1つのNALユニットに書ける最大サイズ (NALU sizeは16ビット)
+static const size_t RTP_MAX_PAYLOAD_SIZE = 65535;
+
+// RFC 6184のペイロード構造のタイプ
+static const BYTE RTP_NAL_TYPE_STAP_A = 24;
+static const BYTE RTP_NAL_TYPE_FU_A = 28;
+
+// パケッタイザーを初期化する関数
+HRESULT InitializeRtpPacketizer(RtpPacketizer* pPacketizer, RtpSink* pSink, UINT32 mtu,
+                                BYTE payloadType, RtpPacketizationMode mode, size_t batchCapacity)
+{
+    if (!pPacketizer || !pSink || !pSink->SendBatch || batchCapacity == 0) {
+        return E_INVALIDARG;
+    }
+    // FU-Aで最低1バイトは運べるサイズが必要
+    if (mtu < RTP_HEADER_SIZE + 3) {
+        return E_INVALIDARG;
+    }
+    // ペイロードがNALU sizeに収まらないと、STAP-Aの長さがあふれる
+    if (mtu - RTP_HEADER_SIZE > RTP_MAX_PAYLOAD_SIZE) {
+        printf("RTP MTU %u is too large (payload must fit in %zu bytes)\n", mtu, RTP_MAX_PAYLOAD_SIZE);
+        return E_INVALIDARG;
+    }
+
+    // 同じ送信先の別のストリームと重ならず、平文の推測を難しくするため、SSRCと最初のシーケンス番号は乱数にする
+    std::random_device random;
+    pPacketizer->pSink = pSink;
+    pPacketizer->mtu = mtu;
+    pPacketizer->ssrc = static_cast<UINT32>(random());
+    pPacketizer->payloadType = payloadType & 0x7F;
+    pPacketizer->mode = mode;
+    pPacketizer->sequenceNumber = static_cast<UINT16>(random());
+
+    // 送信中に再確保が起きないよう、ヘッダー領域とチャンクを最大数まで確保しておく
+    pPacketizer->batchCapacity = batchCapacity;
+    pPacketizer->headerRing.assign(batchCapacity * RTP_HEADER_SLOT_SIZE, 0);
+    pPacketizer->packets.clear();
+    pPacketizer->packets.reserve(batchCapacity);
+    pPacketizer->chunks.clear();
+    pPacketizer->chunks.reserve(batchCapacity * (1 + 2 * RTP_MAX_AGGREGATED_NALS));
+    pPacketizer->frameNals.clear();
+
+    pPacketizer->packetCount = 0;
+    pPacketizer->byteCount = 0;
+    pPacketizer->frameCount = 0;
+    pPacketizer->batchCount = 0;
+    pPacketizer->singleNalCount = 0;
+    pPacketizer->stapACount = 0;
+    pPacketizer->fuACount = 0;
+    pPacketizer->totalLatencyUs = 0.0;
+    pPacketizer->maxLatencyUs = 0.0;
+
+    printf("RTP packetizer initialized: MTU %u, SSRC 0x%08X, PT %u, mode %d\n",
+           mtu, pPacketizer->ssrc, pPacketizer->payloadType, static_cast<int>(mode));
+    return S_OK;
+}
+
+// SSRCと最初のシーケンス番号を固定する関数
+void SetRtpPacketizerFixedIds(RtpPacketizer* pPacketizer, UINT32 ssrc, UINT16 firstSequenceNumber)
+{
+    pPacketizer->ssrc = ssrc;
+    pPacketizer->sequenceNumber = firstSequenceNumber;
+    printf("RTP SSRC 0x%08X and first sequence number %u are fixed for testing\n", ssrc, firstSequenceNumber);
+}
+
+// 送信待ちのパケットを送信先に渡す
+static HRESULT SendPendingPackets(RtpPacketizer* pPacketizer)
+{
+    if (pPacketizer->packets.empty()) {
+        return S_OK;
+    }
+
+    HRESULT hr = pPacketizer->pSink->SendBatch(pPacketizer->pSink->pContext,
+                                               pPacketizer->packets.data(), pPacketizer->packets.size(),
+                                               pPacketizer->chunks.data());
+    pPacketizer->packetCount += pPacketizer->packets.size();
+    for (size_t i = 0; i < pPacketizer->packets.size(); i++) {
+        pPacketizer->byteCount += pPacketizer->packets[i].size;
+    }
+    pPacketizer->batchCount++;
+
+    pPacketizer->packets.clear();
+    pPacketizer->chunks.clear();
+    return hr;
+}
+
+// 新しいパケットを開始してRTPヘッダーを書き込み、ヘッダー領域の先頭を返す
+static BYTE* BeginPacket(RtpPacketizer* pPacketizer, LONGLONG sampleTime, HRESULT* pHr)
+{
+    *pHr = S_OK;
+    if (pPacketizer->packets.size() >= pPacketizer->batchCapacity) {
+        *pHr = SendPendingPackets(pPacketizer);
+        if (FAILED(*pHr)) {
+            return NULL;
+        }
+    }
+
+    BYTE* slot = pPacketizer->headerRing.data() + pPacketizer->packets.size() * RTP_HEADER_SLOT_SIZE;
+
+    // 90kHzのRTPタイムスタンプ
+    UINT32 timestamp = static_cast<UINT32>(static_cast<UINT64>(sampleTime) * 9 / 1000);
+    UINT16 sequence = pPacketizer->sequenceNumber++;
+
+    slot[0] = 0x80;                    // V=2, P=0, X=0, CC=0
+    slot[1] = pPacketizer->payloadType; // M=0 (最後のパケットで後から立てる)
+    slot[2] = static_cast<BYTE>(sequence >> 8);
+    slot[3] = static_cast<BYTE>(sequence);
+    slot[4] = static_cast<BYTE>(timestamp >> 24);
+    slot[5] = static_cast<BYTE>(timestamp >> 16);
+    slot[6] = static_cast<BYTE>(timestamp >> 8);
+    slot[7] = static_cast<BYTE>(timestamp);
+    slot[8] = static_cast<BYTE>(pPacketizer->ssrc >> 24);
+    slot[9] = static_cast<BYTE>(pPacketizer->ssrc >> 16);
+    slot[10] = static_cast<BYTE>(pPacketizer->ssrc >> 8);
+    slot[11] = static_cast<BYTE>(pPacketizer->ssrc);
+
+    RtpPacket packet;
+    packet.firstChunk = pPacketizer->chunks.size();
+    packet.chunkCount = 0;
+    packet.size = 0;
+    packet.sampleTime = sampleTime;
+    pPacketizer->packets.push_back(packet);
+    return slot;
+}
+
+// 現在のパケットにチャンクを追加する
+static void AddChunk(RtpPacketizer* pPacketizer, const BYTE* pData, size_t size)
+{
+    RtpIoChunk chunk = { pData, size };
+    pPacketizer->chunks.push_back(chunk);
+    RtpPacket& packet = pPacketizer->packets.back();
+    packet.chunkCount++;
+    packet.size += size;
+}
+
+// NALユニット1つをSingle NAL unitパケットとして送る
+static HRESULT PacketizeSingleNal(RtpPacketizer* pPacketizer, const NalUnitView& nal, LONGLONG sampleTime)
+{
+    HRESULT hr = S_OK;
+    BYTE* slot = BeginPacket(pPacketizer, sampleTime, &hr);
+    if (!slot) {
+        return hr;
+    }
+    AddChunk(pPacketizer, slot, RTP_HEADER_SIZE);
+    AddChunk(pPacketizer, nal.pData, nal.size);
+    pPacketizer->singleNalCount++;
+    return hr;
+}
+
+// 連続する小さなNALユニットをSTAP-Aパケットにまとめて送る
+static HRESULT PacketizeStapA(RtpPacketizer* pPacketizer, const NalUnitView* pNals, size_t count, LONGLONG sampleTime)
+{
+    HRESULT hr = S_OK;
+    BYTE* slot = BeginPacket(pPacketizer, sampleTime, &hr);
+    if (!slot) {
+        return hr;
+    }
+
+    // STAP-AヘッダーのFはOR、NRIは最大値を取る
+    BYTE forbidden = 0;
+    BYTE nri = 0;
+    for (size_t i = 0; i < count; i++) {
+        forbidden |= pNals[i].pData[0] & 0x80;
+        BYTE n = pNals[i].pData[0] & 0x60;
+        nri = (n > nri) ? n : nri;
+    }
+    slot[RTP_HEADER_SIZE] = forbidden | nri | RTP_NAL_TYPE_STAP_A;
+
+    // ヘッダー領域: RTPヘッダー, STAP-Aヘッダー, 各NALの長さ (2バイト)
+    BYTE* sizeField = slot + RTP_HEADER_SIZE + 1;
+    for (size_t i = 0; i < count; i++) {
+        sizeField[0] = static_cast<BYTE>(pNals[i].size >> 8);
+        sizeField[1] = static_cast<BYTE>(pNals[i].size);
+        if (i == 0) {
+            AddChunk(pPacketizer, slot, RTP_HEADER_SIZE + 1 + 2);
+        } else {
+            AddChunk(pPacketizer, sizeField, 2);
+        }
+        AddChunk(pPacketizer, pNals[i].pData, pNals[i].size);
+        sizeField += 2;
+    }
+    pPacketizer->stapACount++;
+    return hr;
+}
+
+// MTUを超えるNALユニットをFU-Aで分割して送る
+static HRESULT PacketizeFuA(RtpPacketizer* pPacketizer, const NalUnitView& nal, LONGLONG sampleTime)
+{
+    HRESULT hr = S_OK;
+    const size_t maxFragment = pPacketizer->mtu - RTP_HEADER_SIZE - 2;
+    const BYTE header = nal.pData[0];
+
+    // NALヘッダーの1バイトはFUインジケーターとFUヘッダーで表すので、ペイロードに含めない
+    const BYTE* p = nal.pData + 1;
+    size_t remaining = nal.size - 1;
+    bool first = true;
+    while (remaining > 0) {
+        size_t fragment = (remaining > maxFragment) ? maxFragment : remaining;
+        BYTE* slot = BeginPacket(pPacketizer, sampleTime, &hr);
+        if (!slot) {
+            return hr;
+        }
+        bool last = (fragment == remaining);
+        slot[RTP_HEADER_SIZE] = (header & 0xE0) | RTP_NAL_TYPE_FU_A;
+        slot[RTP_HEADER_SIZE + 1] = (first ? 0x80 : 0x00) | (last ? 0x40 : 0x00) | (header & 0x1F);
+        AddChunk(pPacketizer, slot, RTP_HEADER_SIZE + 2);
+        AddChunk(pPacketizer, p, fragment);
+        pPacketizer->fuACount++;
+
+        p += fragment;
+        remaining -= fragment;
+        first = false;
+    }
+    return hr;
+}
+
+// frameNalsに分割済みの1フレーム分のNALユニットをパケット化して送信する
+static HRESULT PacketizeFrameNals(RtpPacketizer* pPacketizer, LONGLONG sampleTime,
+                                  std::chrono::steady_clock::time_point start)
+{
+    HRESULT hr = S_OK;
+
+    // アクセスユニットデリミタは送らない
+    std::vector<NalUnitView>& nals = pPacketizer->frameNals;
+    size_t kept = 0;
+    for (size_t i = 0; i < nals.size(); i++) {
+        if (nals[i].type != NAL_TYPE_AUD && nals[i].size > 0) {
+            nals[kept++] = nals[i];
+        }
+    }
+    nals.resize(kept);
+    if (nals.empty()) {
+        return S_OK;
+    }
+
+    const size_t maxPayload = pPacketizer->mtu - RTP_HEADER_SIZE;
+    size_t index = 0;
+    while (index < nals.size() && SUCCEEDED(hr)) {
+        const NalUnitView& nal = nals[index];
+
+        if (nal.size > maxPayload) {
+            if (pPacketizer->mode == RTP_MODE_SINGLE_NAL) {
+                printf("RTP: NAL unit of %zu bytes exceeds MTU in single NAL mode, dropped\n", nal.size);
+            } else {
+                hr = PacketizeFuA(pPacketizer, nal, sampleTime);
+            }
+            index++;
+            continue;
+        }
+
+        // 後続の小さなNALユニットをまとめられるだけまとめる
+        size_t count = 1;
+        if (pPacketizer->mode == RTP_MODE_NON_INTERLEAVED) {
+            size_t aggregated = 1 + 2 + nal.size;
+            while (index + count < nals.size() && count < RTP_MAX_AGGREGATED_NALS) {
+                size_t next = 2 + nals[index + count].size;
+                if (aggregated + next > maxPayload) {
+                    break;
+                }
+                aggregated += next;
+                count++;
+            }
+        }
+
+        if (count == 1) {
+            hr = PacketizeSingleNal(pPacketizer, nal, sampleTime);
+        } else {
+            hr = PacketizeStapA(pPacketizer, &nals[index], count, sampleTime);
+        }
+        index += count;
+    }
+
+    // アクセスユニットの最後のパケットにマーカービットを立てて送信する
+    if (!pPacketizer->packets.empty()) {
+        const RtpPacket& last = pPacketizer->packets.back();
+        BYTE* slot = const_cast<BYTE*>(pPacketizer->chunks[last.firstChunk].pData);
+        slot[1] |= 0x80;
+    }
+    HRESULT hrSend = SendPendingPackets(pPacketizer);
+    if (SUCCEEDED(hr)) {
+        hr = hrSend;
+    }
+
+    double latencyUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    pPacketizer->totalLatencyUs += latencyUs;
+    if (latencyUs > pPacketizer->maxLatencyUs) {
+        pPacketizer->maxLatencyUs = latencyUs;
+    }
+    pPacketizer->frameCount++;
+    return hr;
+}
+
+// 1フレーム (アクセスユニット) 分のNALユニットをパケット化して送信する関数
+HRESULT RtpPacketizeFrame(RtpPacketizer* pPacketizer, const std::vector<BYTE>* pNalUnits, size_t nalCount,
+                          LONGLONG sampleTime)
+{
+    if (!pPacketizer || !pPacketizer->pSink) {
+        return E_POINTER;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    pPacketizer->frameNals.clear();
+    for (size_t i = 0; i < nalCount; i++) {
+        SplitNalUnits(pNalUnits[i].data(), pNalUnits[i].size(), pPacketizer->frameNals);
+    }
+    return PacketizeFrameNals(pPacketizer, sampleTime, start);
+}
+
+// NALユニットのビューの配列を受け取る版
+HRESULT RtpPacketizeFrame(RtpPacketizer* pPacketizer, const NalUnitView* pNalUnits, size_t nalCount,
+                          LONGLONG sampleTime)
+{
+    if (!pPacketizer || !pPacketizer->pSink) {
+        return E_POINTER;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    pPacketizer->frameNals.clear();
+    for (size_t i = 0; i < nalCount; i++) {
+        SplitNalUnits(pNalUnits[i].pData, pNalUnits[i].size, pPacketizer->frameNals);
+    }
+    return PacketizeFrameNals(pPacketizer, sampleTime, start);
+}
+
+// 統計情報を表示する関数
+void PrintRtpStatistics(const RtpPacketizer* pPacketizer, double elapsedSeconds)
+{
+    if (!pPacketizer || pPacketizer->frameCount == 0) {
+        return;
+    }
+    double busySeconds = pPacketizer->totalLatencyUs / 1000000.0;
+    printf("RTP statistics: %llu frames, %llu packets (single %llu, STAP-A %llu, FU-A %llu), %llu bytes, %llu batches\n",
+           static_cast<unsigned long long>(pPacketizer->frameCount),
+           static_cast<unsigned long long>(pPacketizer->packetCount),
+           static_cast<unsigned long long>(pPacketizer->singleNalCount),
+           static_cast<unsigned long long>(pPacketizer->stapACount),
+           static_cast<unsigned long long>(pPacketizer->fuACount),
+           static_cast<unsigned long long>(pPacketizer->byteCount),
+           static_cast<unsigned long long>(pPacketizer->batchCount));
+    printf("RTP packetization latency per frame: avg %.1f us, max %.1f us\n",
+           pPacketizer->totalLatencyUs / pPacketizer->frameCount, pPacketizer->maxLatencyUs);
+    if (busySeconds > 0.0) {
+        printf("RTP packetizer throughput: %.0f packets/s\n", pPacketizer->packetCount / busySeconds);
+    }
+    if (elapsedSeconds > 0.0) {
+        printf("RTP session rate: %.0f packets/s over %.2f s\n", pPacketizer->packetCount / elapsedSeconds, elapsedSeconds);
+    }
+}
+
+// パケッタイザーを終了して送信先を閉じる関数
+void ShutdownRtpPacketizer(RtpPacketizer* pPacketizer)
+{
+    if (!pPacketizer || !pPacketizer->pSink) {
+        return;
+    }
+    SendPendingPackets(pPacketizer);
+    if (pPacketizer->pSink->Close) {
+        pPacketizer->pSink->Close(pPacketizer->pSink->pContext);
+    }
+    pPacketizer->pSink = NULL;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nal_parser.h"
+#include <vector>
+
+// RTPのギャザー送信の1要素 (ヘッダーはリング内、ペイロードはNALユニットを直接参照する)
+struct RtpIoChunk {
+    const BYTE* pData;
+    size_t size;
+};
+
+// 送信待ちのRTPパケット1つ分
+struct RtpPacket {
+    size_t firstChunk;                 // チャンク配列内の先頭インデックス
+    size_t chunkCount;                 // チャンク数
+    size_t size;                       // RTPヘッダーを含むパケットサイズ
+    LONGLONG sampleTime;               // 元のフレームのサンプル時刻 (100ns単位)
+};
+
+// RTPパケットの送信先 (メモリ、pcapファイル、UDPなどを差し替えられる)
+struct RtpSink {
+    void* pContext;                    // 送信先ごとの状態
+    // パケットのまとまりを送信する (チャンクは呼び出しが戻るまでの間だけ有効)
+    HRESULT (*SendBatch)(void* pContext, const RtpPacket* pPackets, size_t packetCount, const RtpIoChunk* pChunks);
+    // 送信先を閉じる
+    void (*Close)(void* pContext);
+};
+
+// パケット化モード (RFC 6184 packetization-mode)
+enum RtpPacketizationMode {
+    RTP_MODE_SINGLE_NAL = 0,           // Single NAL unitのみ (MTUを超えるNALは送れない)
+    RTP_MODE_NON_INTERLEAVED = 1       // Single NAL unit + STAP-A + FU-A
+};
+
+// 1パケットのヘッダー領域のサイズ (RTPヘッダー12 + STAP-A 1 + 長さ2 x 集約数)
+#define RTP_HEADER_SLOT_SIZE 64
+
+// STAP-Aで1パケットにまとめるNALユニットの最大数
+#define RTP_MAX_AGGREGATED_NALS 16
+
+// RFC 6184 RTPパケッタイザー構造体
+// ヘッダーは事前確保したリングに作り、ペイロードはコピーせずに参照する
+// 1フレーム分 (またはリングが一杯になった時点) でまとめて送信先に渡す
+struct RtpPacketizer {
+    RtpSink* pSink;                    // 送信先
+    UINT32 mtu;                        // RTPパケット (RTPヘッダー込み) の最大サイズ
+    UINT32 ssrc;                       // 同期ソース識別子
+    BYTE payloadType;                  // ペイロードタイプ (動的: 96〜127)
+    RtpPacketizationMode mode;         // パケット化モード
+    UINT16 sequenceNumber;             // 次のシーケンス番号
+
+    // 事前確保したバッファ (送信ごとに先頭から再利用する)
+    std::vector<BYTE> headerRing;      // RTP_HEADER_SLOT_SIZE x batchCapacity
+    std::vector<RtpPacket> packets;    // 送信待ちのパケット
+    std::vector<RtpIoChunk> chunks;    // 送信待ちのチャンク
+    size_t batchCapacity;              // 1回の送信でまとめる最大パケット数
+    std::vector<NalUnitView> frameNals; // フレーム内のNALユニット (作業用)
+
+    // 統計情報
+    UINT64 packetCount;                // 送信したパケット数
+    UINT64 byteCount;                  // 送信したバイト数 (RTPヘッダー込み)
+    UINT64 frameCount;                 // パケット化したフレーム数
+    UINT64 batchCount;                 // 送信先に渡した回数
+    UINT64 singleNalCount;             // Single NAL unitパケット数
+    UINT64 stapACount;                 // STAP-Aパケット数
+    UINT64 fuACount;                   // FU-Aパケット数
+    double totalLatencyUs;             // フレームごとのパケット化時間の合計 (送信完了まで)
+    double maxLatencyUs;               // フレームごとのパケット化時間の最大
+};
+
+// パケッタイザーを初期化する関数
+// SSRCと最初のシーケンス番号は乱数で決める (RFC 3550 5.1, 8.1)
+// STAP-Aの長さのフィールドは16ビットなので、mtu - 12 (RTPヘッダー) は65535以下であること
+HRESULT InitializeRtpPacketizer(RtpPacketizer* pPacketizer, RtpSink* pSink, UINT32 mtu,
+                                BYTE payloadType, RtpPacketizationMode mode, size_t batchCapacity = 64);
+
+// SSRCと最初のシーケンス番号を固定する関数 (出力を比較するテスト用。最初のフレームの前に呼ぶ)
+void SetRtpPacketizerFixedIds(RtpPacketizer* pPacketizer, UINT32 ssrc, UINT16 firstSequenceNumber);
+
+// 1フレーム (アクセスユニット) 分のNALユニットをパケット化して送信する関数
+// 最後のパケットにはマーカービットを立てる。戻った時点でNALユニットのデータは参照されない
+HRESULT RtpPacketizeFrame(RtpPacketizer* pPacketizer, const std::vector<BYTE>* pNalUnits, size_t nalCount,
+                          LONGLONG sampleTime);
+
+// 同じく、NALユニットのビュー (NalStoreのNALユニットなど) の配列を受け取る関数
+HRESULT RtpPacketizeFrame(RtpPacketizer* pPacketizer, const NalUnitView* pNalUnits, size_t nalCount,
+                          LONGLONG sampleTime);
+
+// 統計情報を表示する関数 (elapsedSecondsはパケット/秒の計算に使う経過時間)
+void PrintRtpStatistics(const RtpPacketizer* pPacketizer, double elapsedSeconds);
+
+// パケッタイザーを終了して送信先を閉じる関数
+void ShutdownRtpPacketizer(RtpPacketizer* pPacketizer);
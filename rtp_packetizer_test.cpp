@@ -0,0 +1,346 @@
+// RTPパケッタイザーのオフラインテスト (CTestから実行する。コーデックもネットワークも使わない)
+// 合成したアクセスユニットをメモリ送信先にパケット化し、受信側と同じ手順で組み立て直して次を検査する
+// - Single NAL unit / STAP-A / FU-Aから、入力と同じNALユニットが同じ順に復元できること
+// - どのパケットもMTUを超えないこと
+// - シーケンス番号が連続し (65535から0への折り返しを含む)、タイムスタンプ・SSRC・ペイロードタイプがフレームと一致すること
+// - マーカービットが各フレームの最後のパケットにだけ立っていること
+// - SSRCと最初のシーケンス番号が乱数で決まり、STAP-Aの長さに収まらないMTUを受け付けないこと
+#include "rtp_sink.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+static const size_t RTP_HEADER_SIZE = 12;
+static const UINT32 TEST_SSRC = 0x12345678;
+static const UINT16 TEST_FIRST_SEQUENCE = 0xFFF0;  // すぐに折り返す
+static const BYTE TEST_PAYLOAD_TYPE = 96;
+
+// 再現性のある疑似乱数 (xorshift64)
+static UINT64 NextRandom(UINT64& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// 指定のヘッダーとサイズのNALユニットを作る
+// (ペイロードにゼロを含めないので、SplitNalUnitsがスタートコードと誤認することはない)
+static void GenerateNal(std::vector<BYTE>& nal, BYTE header, size_t size, UINT64& state)
+{
+    nal.resize(size);
+    nal[0] = header;
+    for (size_t i = 1; i < size; i++) {
+        nal[i] = static_cast<BYTE>(1 + NextRandom(state) % 255);
+    }
+}
+
+// テスト用のアクセスユニット列を作る
+// 先頭はAUD (送られない) + SPS/PPS/SEI (STAP-Aにまとまる) + 大きなIDR (FU-Aに分かれる)、
+// 以降はAUD + 大きさがばらばらの非IDRスライス (Single NAL unit・STAP-A・FU-Aが混ざる)
+static void GenerateFrames(std::vector<std::vector<std::vector<BYTE>>>& frames, size_t frameCount, UINT64 seed)
+{
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    frames.assign(frameCount, std::vector<std::vector<BYTE>>());
+    for (size_t f = 0; f < frameCount; f++) {
+        std::vector<std::vector<BYTE>>& nals = frames[f];
+        nals.push_back(std::vector<BYTE>());
+        GenerateNal(nals.back(), 0x09, 2, state);
+        if (f == 0) {
+            nals.push_back(std::vector<BYTE>());
+            GenerateNal(nals.back(), 0x67, 12, state);
+            nals.push_back(std::vector<BYTE>());
+            GenerateNal(nals.back(), 0x68, 4, state);
+            nals.push_back(std::vector<BYTE>());
+            GenerateNal(nals.back(), 0x06, 24, state);
+            nals.push_back(std::vector<BYTE>());
+            GenerateNal(nals.back(), 0x65, 20000, state);
+        } else {
+            size_t sliceCount = 1 + NextRandom(state) % 6;
+            for (size_t s = 0; s < sliceCount; s++) {
+                // 数バイトからMTUの数倍まで
+                size_t size = 2 + NextRandom(state) % ((NextRandom(state) & 1) ? 100 : 5000);
+                nals.push_back(std::vector<BYTE>());
+                GenerateNal(nals.back(), 0x41, size, state);
+            }
+        }
+    }
+}
+
+// パケット化したフレームの範囲 (メモリ送信先のパケット番号)
+struct FrameRange {
+    size_t firstPacket;
+    size_t packetCount;
+    LONGLONG sampleTime;
+};
+
+// パケット列を組み立て直してNALユニットを復元し、ヘッダーとサイズを検査する関数
+// 検査に失敗した箇所は表示して数える
+static size_t Depacketize(const RtpMemorySink& memory, const std::vector<FrameRange>& ranges, UINT32 mtu,
+                          std::vector<std::vector<BYTE>>& nals)
+{
+    size_t errors = 0;
+    std::vector<BYTE> fragment;
+    bool inFragment = false;
+    UINT16 expectedSequence = TEST_FIRST_SEQUENCE;
+
+    for (size_t f = 0; f < ranges.size(); f++) {
+        const FrameRange& range = ranges[f];
+        UINT32 expectedTimestamp = static_cast<UINT32>(static_cast<UINT64>(range.sampleTime) * 9 / 1000);
+
+        for (size_t p = range.firstPacket; p < range.firstPacket + range.packetCount; p++) {
+            const BYTE* packet = memory.data.data() + memory.packetOffsets[p];
+            size_t size = memory.packetSizes[p];
+
+            if (size > mtu) {
+                printf("Packet %zu: %zu bytes exceeds MTU %u\n", p, size, mtu);
+                errors++;
+            }
+            if (size <= RTP_HEADER_SIZE) {
+                printf("Packet %zu: no payload (%zu bytes)\n", p, size);
+                errors++;
+                continue;
+            }
+
+            UINT16 sequence = static_cast<UINT16>((packet[2] << 8) | packet[3]);
+            UINT32 timestamp = (static_cast<UINT32>(packet[4]) << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+            UINT32 ssrc = (static_cast<UINT32>(packet[8]) << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11];
+            bool marker = (packet[1] & 0x80) != 0;
+            bool lastOfFrame = (p + 1 == range.firstPacket + range.packetCount);
+
+            if (packet[0] != 0x80 || (packet[1] & 0x7F) != TEST_PAYLOAD_TYPE || ssrc != TEST_SSRC) {
+                printf("Packet %zu: unexpected RTP header %02X %02X, SSRC 0x%08X\n", p, packet[0], packet[1], ssrc);
+                errors++;
+            }
+            if (sequence != expectedSequence) {
+                printf("Packet %zu: sequence %u, expected %u\n", p, sequence, expectedSequence);
+                errors++;
+            }
+            expectedSequence = static_cast<UINT16>(sequence + 1);
+            if (timestamp != expectedTimestamp) {
+                printf("Packet %zu: timestamp %u, expected %u\n", p, timestamp, expectedTimestamp);
+                errors++;
+            }
+            if (marker != lastOfFrame) {
+                printf("Packet %zu: marker %d on %s packet of frame %zu\n", p, marker ? 1 : 0,
+                       lastOfFrame ? "the last" : "a non-last", f);
+                errors++;
+            }
+
+            const BYTE* payload = packet + RTP_HEADER_SIZE;
+            size_t payloadSize = size - RTP_HEADER_SIZE;
+            BYTE type = GetNalUnitType(payload[0]);
+
+            if (type != 28 && inFragment) {
+                printf("Packet %zu: FU-A fragment interrupted\n", p);
+                errors++;
+                inFragment = false;
+            }
+
+            if (type >= 1 && type <= 23) {
+                nals.push_back(std::vector<BYTE>(payload, payload + payloadSize));
+            } else if (type == 24) {
+                // STAP-A: 長さ (2バイト) + NALユニットの並び
+                size_t pos = 1;
+                while (pos < payloadSize) {
+                    if (pos + 2 > payloadSize) {
+                        printf("Packet %zu: truncated STAP-A length\n", p);
+                        errors++;
+                        break;
+                    }
+                    size_t nalSize = (payload[pos] << 8) | payload[pos + 1];
+                    pos += 2;
+                    if (nalSize == 0 || pos + nalSize > payloadSize) {
+                        printf("Packet %zu: bad STAP-A unit size %zu\n", p, nalSize);
+                        errors++;
+                        break;
+                    }
+                    nals.push_back(std::vector<BYTE>(payload + pos, payload + pos + nalSize));
+                    pos += nalSize;
+                }
+            } else if (type == 28 && payloadSize > 2) {
+                // FU-A: FUインジケーター + FUヘッダー + 断片
+                bool start = (payload[1] & 0x80) != 0;
+                bool end = (payload[1] & 0x40) != 0;
+                if (start) {
+                    if (inFragment) {
+                        printf("Packet %zu: FU-A start inside a fragmented NAL unit\n", p);
+                        errors++;
+                    }
+                    fragment.assign(1, static_cast<BYTE>((payload[0] & 0xE0) | (payload[1] & 0x1F)));
+                    inFragment = true;
+                } else if (!inFragment) {
+                    printf("Packet %zu: FU-A continuation without a start\n", p);
+                    errors++;
+                    continue;
+                }
+                fragment.insert(fragment.end(), payload + 2, payload + payloadSize);
+                if (end) {
+                    nals.push_back(fragment);
+                    inFragment = false;
+                }
+            } else {
+                printf("Packet %zu: unexpected payload type %u\n", p, type);
+                errors++;
+            }
+        }
+        if (inFragment) {
+            printf("Frame %zu: ends inside a fragmented NAL unit\n", f);
+            errors++;
+            inFragment = false;
+        }
+    }
+    return errors;
+}
+
+// 1つの設定 (MTU・モード・バッチ数) でパケット化と復元を行い、検査に失敗した数を返す関数
+static HRESULT RunCase(const std::vector<std::vector<std::vector<BYTE>>>& frames, UINT32 mtu,
+                       RtpPacketizationMode mode, size_t batchCapacity, size_t* pErrors)
+{
+    RtpMemorySink memory;
+    RtpSink sink;
+    InitializeRtpMemorySink(&sink, &memory);
+
+    RtpPacketizer packetizer;
+    HRESULT hr = InitializeRtpPacketizer(&packetizer, &sink, mtu, TEST_PAYLOAD_TYPE, mode, batchCapacity);
+    CHECK_HR(hr, "InitializeRtpPacketizer");
+    SetRtpPacketizerFixedIds(&packetizer, TEST_SSRC, TEST_FIRST_SEQUENCE);
+
+    // 送られるはずのNALユニット (AUDと、Single NAL unitモードでMTUに収まらないものは送られない)
+    std::vector<std::vector<BYTE>> expected;
+    std::vector<FrameRange> ranges;
+    for (size_t f = 0; f < frames.size(); f++) {
+        FrameRange range;
+        range.firstPacket = memory.packetSizes.size();
+        range.sampleTime = static_cast<LONGLONG>(f) * 333333;
+        hr = RtpPacketizeFrame(&packetizer, frames[f].data(), frames[f].size(), range.sampleTime);
+        if (FAILED(hr)) {
+            ShutdownRtpPacketizer(&packetizer);
+        }
+        CHECK_HR(hr, "RtpPacketizeFrame");
+        range.packetCount = memory.packetSizes.size() - range.firstPacket;
+        ranges.push_back(range);
+
+        for (size_t i = 0; i < frames[f].size(); i++) {
+            const std::vector<BYTE>& nal = frames[f][i];
+            if (GetNalUnitType(nal[0]) == NAL_TYPE_AUD) {
+                continue;
+            }
+            if (mode == RTP_MODE_SINGLE_NAL && nal.size() > mtu - RTP_HEADER_SIZE) {
+                continue;
+            }
+            expected.push_back(nal);
+        }
+    }
+
+    std::vector<std::vector<BYTE>> rebuilt;
+    size_t errors = Depacketize(memory, ranges, mtu, rebuilt);
+    if (rebuilt.size() != expected.size()) {
+        printf("Rebuilt %zu NAL units, expected %zu\n", rebuilt.size(), expected.size());
+        errors++;
+    }
+    for (size_t i = 0; i < rebuilt.size() && i < expected.size(); i++) {
+        if (rebuilt[i] != expected[i]) {
+            printf("NAL unit %zu differs after depacketization (%zu bytes, expected %zu)\n",
+                   i, rebuilt[i].size(), expected[i].size());
+            errors++;
+            break;
+        }
+    }
+
+    // 非インターリーブモードでは3種類のパケットをすべて通っていること (テストデータがそうなるように作ってある)
+    if (mode == RTP_MODE_NON_INTERLEAVED &&
+        (packetizer.singleNalCount == 0 || packetizer.stapACount == 0 || packetizer.fuACount == 0)) {
+        printf("Packet types not all exercised (single %llu, STAP-A %llu, FU-A %llu)\n",
+               static_cast<unsigned long long>(packetizer.singleNalCount),
+               static_cast<unsigned long long>(packetizer.stapACount),
+               static_cast<unsigned long long>(packetizer.fuACount));
+        errors++;
+    }
+    if (packetizer.packetCount != memory.packetSizes.size()) {
+        printf("Packetizer counted %llu packets, sink received %zu\n",
+               static_cast<unsigned long long>(packetizer.packetCount), memory.packetSizes.size());
+        errors++;
+    }
+
+    printf("MTU %4u, mode %d, batch %2zu: %zu frames, %zu packets (single %llu, STAP-A %llu, FU-A %llu), %zu NAL units: %s\n",
+           mtu, static_cast<int>(mode), batchCapacity, frames.size(), memory.packetSizes.size(),
+           static_cast<unsigned long long>(packetizer.singleNalCount),
+           static_cast<unsigned long long>(packetizer.stapACount),
+           static_cast<unsigned long long>(packetizer.fuACount),
+           rebuilt.size(), errors == 0 ? "OK" : "FAILED");
+
+    ShutdownRtpPacketizer(&packetizer);
+    *pErrors = errors;
+    return S_OK;
+}
+
+// 初期化の検査 (SSRCと最初のシーケンス番号が乱数であること、MTUの上限)。失敗した数を返す
+static size_t CheckInitialization()
+{
+    RtpMemorySink memory;
+    RtpSink sink;
+    InitializeRtpMemorySink(&sink, &memory);
+    size_t errors = 0;
+
+    // 2つのパケッタイザーでSSRCとシーケンス番号の両方が一致する確率は2^-48
+    RtpPacketizer first;
+    RtpPacketizer second;
+    HRESULT hrFirst = InitializeRtpPacketizer(&first, &sink, 1400, TEST_PAYLOAD_TYPE, RTP_MODE_NON_INTERLEAVED);
+    HRESULT hrSecond = InitializeRtpPacketizer(&second, &sink, 1400, TEST_PAYLOAD_TYPE, RTP_MODE_NON_INTERLEAVED);
+    if (FAILED(hrFirst) || FAILED(hrSecond)) {
+        printf("InitializeRtpPacketizer failed: 0x%08X, 0x%08X\n", hrFirst, hrSecond);
+        errors++;
+    } else if (first.ssrc == second.ssrc && first.sequenceNumber == second.sequenceNumber) {
+        printf("SSRC 0x%08X and first sequence number %u were not randomized\n", first.ssrc, first.sequenceNumber);
+        errors++;
+    }
+
+    // ペイロードが65535バイトまでなら受け付け、それを超えれば断る
+    RtpPacketizer packetizer;
+    const UINT32 largestMtu = static_cast<UINT32>(RTP_HEADER_SIZE + 65535);
+    if (FAILED(InitializeRtpPacketizer(&packetizer, &sink, largestMtu, TEST_PAYLOAD_TYPE, RTP_MODE_NON_INTERLEAVED))) {
+        printf("MTU %u was rejected\n", largestMtu);
+        errors++;
+    }
+    if (SUCCEEDED(InitializeRtpPacketizer(&packetizer, &sink, largestMtu + 1, TEST_PAYLOAD_TYPE, RTP_MODE_NON_INTERLEAVED))) {
+        printf("MTU %u was accepted although STAP-A sizes are 16 bits\n", largestMtu + 1);
+        errors++;
+    }
+    printf("Initialization: %s\n", errors == 0 ? "OK" : "FAILED");
+    return errors;
+}
+
+int main()
+{
+    std::vector<std::vector<std::vector<BYTE>>> frames;
+    GenerateFrames(frames, 40, 1);
+
+    // MTUは最小に近い値からイーサネットの値まで。バッチ数が小さいとフレームの途中で送信先に渡る
+    static const UINT32 mtus[] = { 200, 576, 1200, 1500 };
+    static const size_t batchCapacities[] = { 1, 3, 64 };
+    size_t failures = CheckInitialization() > 0 ? 1 : 0;
+    for (size_t m = 0; m < sizeof(mtus) / sizeof(mtus[0]); m++) {
+        for (size_t b = 0; b < sizeof(batchCapacities) / sizeof(batchCapacities[0]); b++) {
+            for (int mode = RTP_MODE_SINGLE_NAL; mode <= RTP_MODE_NON_INTERLEAVED; mode++) {
+                size_t errors = 0;
+                HRESULT hr = RunCase(frames, mtus[m], static_cast<RtpPacketizationMode>(mode), batchCapacities[b], &errors);
+                if (FAILED(hr) || errors > 0) {
+                    failures++;
+                }
+            }
+        }
+    }
+
+    if (failures > 0) {
+        printf("RTP packetizer test FAILED: %zu cases\n", failures);
+        return 1;
+    }
+    printf("RTP packetizer test passed\n");
+    return 0;
+}
@@ -0,0 +1,339 @@
+#ifdef _WIN32
+// windows.hより先にwinsock2.hをincludeする
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#include "rtp_sink.h"
+#include <stdio.h>
+#include <string.h>
+
+// ---- メモリ送信先 ----
+
+static HRESULT MemorySinkSendBatch(void* pContext, const RtpPacket* pPackets, size_t packetCount, const RtpIoChunk* pChunks)
+{
+    RtpMemorySink* pMemory = static_cast<RtpMemorySink*>(pContext);
+    for (size_t i = 0; i < packetCount; i++) {
+        const RtpPacket& packet = pPackets[i];
+        pMemory->packetOffsets.push_back(pMemory->data.size());
+        pMemory->packetSizes.push_back(packet.size);
+        for (size_t c = 0; c < packet.chunkCount; c++) {
+            const RtpIoChunk& chunk = pChunks[packet.firstChunk + c];
+            pMemory->data.insert(pMemory->data.end(), chunk.pData, chunk.pData + chunk.size);
+        }
+    }
+    return S_OK;
+}
+
+static void MemorySinkClose(void* pContext)
+{
+    (void)pContext;
+}
+
+// メモリ送信先をRtpSinkに結び付ける関数
+void InitializeRtpMemorySink(RtpSink* pSink, RtpMemorySink* pMemory)
+{
+    pMemory->data.clear();
+    pMemory->packetOffsets.clear();
+    pMemory->packetSizes.clear();
+    pSink->pContext = pMemory;
+    pSink->SendBatch = MemorySinkSendBatch;
+    pSink->Close = MemorySinkClose;
+}
+
+// ---- pcapファイル送信先 ----
+
+// Ethernet (14) + IPv4 (20) + UDP (8)
+static const size_t PCAP_ENCAPSULATION_SIZE = 42;
+
+struct RtpPcapContext {
+    FILE* pFile;
+    UINT16 destinationPort;
+    UINT16 ipIdentification;
+    UINT64 packetCount;
+};
+
+static void PutLe32(BYTE* p, UINT32 value)
+{
+    p[0] = static_cast<BYTE>(value);
+    p[1] = static_cast<BYTE>(value >> 8);
+    p[2] = static_cast<BYTE>(value >> 16);
+    p[3] = static_cast<BYTE>(value >> 24);
+}
+
+static void PutBe16(BYTE* p, UINT32 value)
+{
+    p[0] = static_cast<BYTE>(value >> 8);
+    p[1] = static_cast<BYTE>(value);
+}
+
+// IPv4ヘッダーのチェックサム
+static UINT16 IpChecksum(const BYTE* header, size_t size)
+{
+    UINT32 sum = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        sum += (static_cast<UINT32>(header[i]) << 8) | header[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return static_cast<UINT16>(~sum);
+}
+
+static HRESULT PcapSinkSendBatch(void* pContext, const RtpPacket* pPackets, size_t packetCount, const RtpIoChunk* pChunks)
+{
+    RtpPcapContext* pPcap = static_cast<RtpPcapContext*>(pContext);
+    BYTE header[16 + PCAP_ENCAPSULATION_SIZE];
+
+    for (size_t i = 0; i < packetCount; i++) {
+        const RtpPacket& packet = pPackets[i];
+        UINT32 frameSize = static_cast<UINT32>(PCAP_ENCAPSULATION_SIZE + packet.size);
+        memset(header, 0, sizeof(header));
+
+        // pcapレコードヘッダー (時刻はサンプル時刻、100ns -> 秒/マイクロ秒)
+        UINT64 time100ns = static_cast<UINT64>(packet.sampleTime);
+        PutLe32(header + 0, static_cast<UINT32>(time100ns / 10000000));
+        PutLe32(header + 4, static_cast<UINT32>((time100ns % 10000000) / 10));
+        PutLe32(header + 8, frameSize);
+        PutLe32(header + 12, frameSize);
+
+        // Ethernet (MACアドレスは0、IPv4)
+        BYTE* eth = header + 16;
+        PutBe16(eth + 12, 0x0800);
+
+        // IPv4 (127.0.0.1 -> 127.0.0.1)
+        BYTE* ip = eth + 14;
+        ip[0] = 0x45;
+        PutBe16(ip + 2, 20 + 8 + static_cast<UINT32>(packet.size));
+        PutBe16(ip + 4, pPcap->ipIdentification++);
+        PutBe16(ip + 6, 0x4000);       // Don't Fragment
+        ip[8] = 64;                    // TTL
+        ip[9] = 17;                    // UDP
+        ip[12] = 127; ip[15] = 1;
+        ip[16] = 127; ip[19] = 1;
+        PutBe16(ip + 10, IpChecksum(ip, 20));
+
+        // UDP (チェックサムは省略可能なので0)
+        BYTE* udp = ip + 20;
+        PutBe16(udp + 0, pPcap->destinationPort);
+        PutBe16(udp + 2, pPcap->destinationPort);
+        PutBe16(udp + 4, 8 + static_cast<UINT32>(packet.size));
+
+        if (fwrite(header, 1, sizeof(header), pPcap->pFile) != sizeof(header)) {
+            return E_FAIL;
+        }
+        for (size_t c = 0; c < packet.chunkCount; c++) {
+            const RtpIoChunk& chunk = pChunks[packet.firstChunk + c];
+            if (fwrite(chunk.pData, 1, chunk.size, pPcap->pFile) != chunk.size) {
+                return E_FAIL;
+            }
+        }
+        pPcap->packetCount++;
+    }
+    return S_OK;
+}
+
+static void PcapSinkClose(void* pContext)
+{
+    RtpPcapContext* pPcap = static_cast<RtpPcapContext*>(pContext);
+    if (pPcap->pFile) {
+        fclose(pPcap->pFile);
+    }
+    printf("RTP pcap sink closed: %llu packets\n", static_cast<unsigned long long>(pPcap->packetCount));
+    delete pPcap;
+}
+
+// pcapファイルに書き出す送信先を開く関数
+HRESULT OpenRtpPcapSink(RtpSink* pSink, const char* filename, UINT16 destinationPort)
+{
+    FILE* pFile = fopen(filename, "wb");
+    if (!pFile) {
+        printf("Failed to open %s for writing.\n", filename);
+        return E_FAIL;
+    }
+
+    // pcapグローバルヘッダー (リトルエンディアン、マイクロ秒、Ethernet)
+    BYTE globalHeader[24] = {0};
+    PutLe32(globalHeader + 0, 0xA1B2C3D4);
+    globalHeader[4] = 2;               // version_major
+    globalHeader[6] = 4;               // version_minor
+    PutLe32(globalHeader + 16, 65535); // snaplen
+    PutLe32(globalHeader + 20, 1);     // LINKTYPE_ETHERNET
+    if (fwrite(globalHeader, 1, sizeof(globalHeader), pFile) != sizeof(globalHeader)) {
+        fclose(pFile);
+        return E_FAIL;
+    }
+
+    RtpPcapContext* pPcap = new RtpPcapContext();
+    pPcap->pFile = pFile;
+    pPcap->destinationPort = destinationPort;
+    pPcap->ipIdentification = 0;
+    pPcap->packetCount = 0;
+
+    pSink->pContext = pPcap;
+    pSink->SendBatch = PcapSinkSendBatch;
+    pSink->Close = PcapSinkClose;
+    printf("RTP pcap sink opened: %s (UDP port %u)\n", filename, destinationPort);
+    return S_OK;
+}
+
+// ---- UDP送信先 ----
+
+struct RtpUdpContext {
+#ifdef _WIN32
+    SOCKET socket;
+    std::vector<WSABUF> buffers;
+#else
+    int socket;
+    std::vector<struct iovec> iovecs;
+#ifdef __linux__
+    std::vector<struct mmsghdr> messages;
+#endif
+#endif
+    struct sockaddr_in address;
+    UINT64 packetCount;
+    UINT64 sendCalls;
+};
+
+static HRESULT UdpSinkSendBatch(void* pContext, const RtpPacket* pPackets, size_t packetCount, const RtpIoChunk* pChunks)
+{
+    RtpUdpContext* pUdp = static_cast<RtpUdpContext*>(pContext);
+    if (packetCount == 0) {
+        return S_OK;
+    }
+    const RtpPacket& lastPacket = pPackets[packetCount - 1];
+    size_t chunkCount = lastPacket.firstChunk + lastPacket.chunkCount - pPackets[0].firstChunk;
+    const RtpIoChunk* pFirstChunk = pChunks + pPackets[0].firstChunk;
+
+#ifdef _WIN32
+    // パケットごとにWSABUFの配列でギャザー送信する
+    pUdp->buffers.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; c++) {
+        pUdp->buffers[c].buf = reinterpret_cast<CHAR*>(const_cast<BYTE*>(pFirstChunk[c].pData));
+        pUdp->buffers[c].len = static_cast<ULONG>(pFirstChunk[c].size);
+    }
+    for (size_t i = 0; i < packetCount; i++) {
+        DWORD sent = 0;
+        WSABUF* pBuffers = &pUdp->buffers[pPackets[i].firstChunk - pPackets[0].firstChunk];
+        if (WSASendTo(pUdp->socket, pBuffers, static_cast<DWORD>(pPackets[i].chunkCount), &sent, 0,
+                      reinterpret_cast<const sockaddr*>(&pUdp->address), sizeof(pUdp->address), NULL, NULL) != 0) {
+            printf("WSASendTo failed: %d\n", WSAGetLastError());
+            return E_FAIL;
+        }
+        pUdp->sendCalls++;
+    }
+#else
+    pUdp->iovecs.resize(chunkCount);
+    for (size_t c = 0; c < chunkCount; c++) {
+        pUdp->iovecs[c].iov_base = const_cast<BYTE*>(pFirstChunk[c].pData);
+        pUdp->iovecs[c].iov_len = pFirstChunk[c].size;
+    }
+#ifdef __linux__
+    // sendmmsgで1回のシステムコールにまとめて送る
+    pUdp->messages.resize(packetCount);
+    for (size_t i = 0; i < packetCount; i++) {
+        struct msghdr& header = pUdp->messages[i].msg_hdr;
+        memset(&pUdp->messages[i], 0, sizeof(pUdp->messages[i]));
+        header.msg_name = &pUdp->address;
+        header.msg_namelen = sizeof(pUdp->address);
+        header.msg_iov = &pUdp->iovecs[pPackets[i].firstChunk - pPackets[0].firstChunk];
+        header.msg_iovlen = pPackets[i].chunkCount;
+    }
+    size_t sent = 0;
+    while (sent < packetCount) {
+        int result = sendmmsg(pUdp->socket, &pUdp->messages[sent], static_cast<unsigned int>(packetCount - sent), 0);
+        pUdp->sendCalls++;
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("sendmmsg failed: %d\n", errno);
+            return E_FAIL;
+        }
+        sent += static_cast<size_t>(result);
+    }
+#else
+    for (size_t i = 0; i < packetCount; i++) {
+        struct msghdr header;
+        memset(&header, 0, sizeof(header));
+        header.msg_name = &pUdp->address;
+        header.msg_namelen = sizeof(pUdp->address);
+        header.msg_iov = &pUdp->iovecs[pPackets[i].firstChunk - pPackets[0].firstChunk];
+        header.msg_iovlen = static_cast<int>(pPackets[i].chunkCount);
+        if (sendmsg(pUdp->socket, &header, 0) < 0) {
+            printf("sendmsg failed: %d\n", errno);
+            return E_FAIL;
+        }
+        pUdp->sendCalls++;
+    }
+#endif
+#endif
+    pUdp->packetCount += packetCount;
+    return S_OK;
+}
+
+static void UdpSinkClose(void* pContext)
+{
+    RtpUdpContext* pUdp = static_cast<RtpUdpContext*>(pContext);
+#ifdef _WIN32
+    closesocket(pUdp->socket);
+    WSACleanup();
+#else
+    close(pUdp->socket);
+#endif
+    printf("RTP UDP sink closed: %llu packets in %llu send calls\n",
+           static_cast<unsigned long long>(pUdp->packetCount),
+           static_cast<unsigned long long>(pUdp->sendCalls));
+    delete pUdp;
+}
+
+// UDPで送信する送信先を開く関数
+HRESULT OpenRtpUdpSink(RtpSink* pSink, const char* address, UINT16 port)
+{
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("WSAStartup failed\n");
+        return E_FAIL;
+    }
+#endif
+
+    RtpUdpContext* pUdp = new RtpUdpContext();
+    pUdp->packetCount = 0;
+    pUdp->sendCalls = 0;
+    memset(&pUdp->address, 0, sizeof(pUdp->address));
+    pUdp->address.sin_family = AF_INET;
+    pUdp->address.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &pUdp->address.sin_addr) != 1) {
+        printf("Invalid UDP address: %s\n", address);
+        delete pUdp;
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return E_INVALIDARG;
+    }
+
+    pUdp->socket = socket(AF_INET, SOCK_DGRAM, 0);
+#ifdef _WIN32
+    if (pUdp->socket == INVALID_SOCKET) {
+        WSACleanup();
+#else
+    if (pUdp->socket < 0) {
+#endif
+        printf("Failed to create UDP socket\n");
+        delete pUdp;
+        return E_FAIL;
+    }
+
+    pSink->pContext = pUdp;
+    pSink->SendBatch = UdpSinkSendBatch;
+    pSink->Close = UdpSinkClose;
+    printf("RTP UDP sink opened: %s:%u\n", address, port);
+    return S_OK;
+}
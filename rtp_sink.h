@@ -0,0 +1,21 @@
+#pragma once
+
+#include "rtp_packetizer.h"
+#include <vector>
+
+// メモリ上にパケットを蓄積する送信先 (オフラインでの検証用)
+struct RtpMemorySink {
+    std::vector<BYTE> data;            // 全パケットを連結したデータ
+    std::vector<size_t> packetOffsets; // 各パケットの先頭位置
+    std::vector<size_t> packetSizes;   // 各パケットのサイズ
+};
+
+// メモリ送信先をRtpSinkに結び付ける関数 (pMemoryは送信先を閉じるまで保持すること)
+void InitializeRtpMemorySink(RtpSink* pSink, RtpMemorySink* pMemory);
+
+// pcapファイル (Ethernet/IPv4/UDPでカプセル化) に書き出す送信先を開く関数
+// パケットの時刻にはフレームのサンプル時刻を使うので、同じ入力なら同じファイルになる
+HRESULT OpenRtpPcapSink(RtpSink* pSink, const char* filename, UINT16 destinationPort);
+
+// UDPで送信する送信先を開く関数 (Linuxではsendmmsgで1回にまとめて送る)
+HRESULT OpenRtpUdpSink(RtpSink* pSink, const char* address, UINT16 port);
@@ -0,0 +1,246 @@
+#include "shared_memory.h"
+#include <stdio.h>
+#include <string.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#endif
+
+// 名前をプラットフォームの形式にする関数
+void MakeSharedMemoryName(const char* name, char* pOut, size_t outSize)
+{
+#ifdef _WIN32
+    snprintf(pOut, outSize, "Local\\%s", name);
+#else
+    snprintf(pOut, outSize, "/%s", name);
+#endif
+}
+
+// プロセスが動いているか
+bool IsProcessAlive(UINT32 pid)
+{
+#ifdef _WIN32
+    HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, pid);
+    if (!hProcess) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    DWORD result = WaitForSingleObject(hProcess, 0);
+    CloseHandle(hProcess);
+    return result == WAIT_TIMEOUT;
+#else
+    return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+#endif
+}
+
+// 同じ名前で残っていた共有メモリを、作り直してよいか (書いたプロセスが終了していればよい)
+static bool CanReplaceSharedMemory(const char* name, const BYTE* pData, size_t size, size_t ownerPidOffset)
+{
+    UINT32 ownerPid = 0;
+    if (pData && size >= ownerPidOffset + sizeof(ownerPid)) {
+        memcpy(&ownerPid, pData + ownerPidOffset, sizeof(ownerPid));
+    }
+    if (ownerPid == 0) {
+        // 作成の途中か、作成の途中で終了したもの。どちらか分からないので触れない
+        printf("Shared memory %s already exists and has no owner yet (remove it if it is left over)\n", name);
+        return false;
+    }
+    if (IsProcessAlive(ownerPid)) {
+        printf("Shared memory %s is in use by pid %u; use another name\n", name, ownerPid);
+        return false;
+    }
+    printf("Replacing shared memory %s left by pid %u\n", name, ownerPid);
+    return true;
+}
+
+#ifndef _WIN32
+// 残っていた共有メモリを読み取り専用で開いて、作り直してよいかを確かめる
+static bool CanReplaceExistingSharedMemory(const char* name, size_t ownerPidOffset)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        // 確かめる間に消えたなら、もう一度作成すればよい
+        if (errno == ENOENT) {
+            return true;
+        }
+        printf("Shared memory %s already exists and cannot be read\n", name);
+        return false;
+    }
+    struct stat st;
+    void* pData = MAP_FAILED;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = static_cast<size_t>(st.st_size);
+        pData = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    bool replace = CanReplaceSharedMemory(name, pData == MAP_FAILED ? NULL : static_cast<const BYTE*>(pData), size,
+                                          ownerPidOffset);
+    if (pData != MAP_FAILED) {
+        munmap(pData, size);
+    }
+    return replace;
+}
+#endif
+
+// 共有メモリを作成してマップする関数
+HRESULT CreateSharedMemory(SharedMemory* pMemory, const char* name, size_t size, UINT32 mode, size_t ownerPidOffset)
+{
+    if (!pMemory || !name) {
+        return E_POINTER;
+    }
+    if (size == 0) {
+        return E_INVALIDARG;
+    }
+    memset(pMemory, 0, sizeof(*pMemory));
+    MakeSharedMemoryName(name, pMemory->name, sizeof(pMemory->name));
+    void* pData = NULL;
+
+#ifdef _WIN32
+    (void)mode;
+    pMemory->hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                           static_cast<DWORD>(static_cast<UINT64>(size) >> 32),
+                                           static_cast<DWORD>(size), pMemory->name);
+    if (!pMemory->hMapping) {
+        printf("CreateFileMapping failed for %s\n", pMemory->name);
+        return E_FAIL;
+    }
+    // 名前付きのマッピングは誰かが開いている間だけ残る (削除できないので、作り直すときは中身を消して使う)
+    const bool exists = GetLastError() == ERROR_ALREADY_EXISTS;
+    pData = MapViewOfFile(pMemory->hMapping, FILE_MAP_ALL_ACCESS, 0, 0, exists ? 0 : size);
+    if (!pData) {
+        printf("MapViewOfFile failed for %s\n", pMemory->name);
+        CloseHandle(pMemory->hMapping);
+        pMemory->hMapping = NULL;
+        return E_FAIL;
+    }
+    if (exists) {
+        MEMORY_BASIC_INFORMATION info;
+        size_t existingSize = VirtualQuery(pData, &info, sizeof(info)) == sizeof(info) ? info.RegionSize : 0;
+        bool replace = CanReplaceSharedMemory(pMemory->name, static_cast<const BYTE*>(pData), existingSize,
+                                              ownerPidOffset);
+        if (replace && existingSize < size) {
+            printf("Shared memory %s is still open with a smaller size\n", pMemory->name);
+            replace = false;
+        }
+        if (!replace) {
+            UnmapViewOfFile(pData);
+            CloseHandle(pMemory->hMapping);
+            pMemory->hMapping = NULL;
+            return E_FAIL;
+        }
+        memset(pData, 0, size);
+    }
+#else
+    int fd = shm_open(pMemory->name, O_CREAT | O_EXCL | O_RDWR, static_cast<mode_t>(mode));
+    if (fd < 0 && errno == EEXIST) {
+        if (!CanReplaceExistingSharedMemory(pMemory->name, ownerPidOffset)) {
+            return E_FAIL;
+        }
+        // 前回の実行の残りなので作り直す (確かめてから削除するまでの間に、別のプロセスが作り直すことは考えない)
+        shm_unlink(pMemory->name);
+        fd = shm_open(pMemory->name, O_CREAT | O_EXCL | O_RDWR, static_cast<mode_t>(mode));
+    }
+    if (fd < 0) {
+        printf("shm_open failed for %s\n", pMemory->name);
+        return E_FAIL;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        printf("ftruncate failed for %s\n", pMemory->name);
+        close(fd);
+        shm_unlink(pMemory->name);
+        return E_FAIL;
+    }
+    pData = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pData == MAP_FAILED) {
+        printf("mmap failed for %s\n", pMemory->name);
+        shm_unlink(pMemory->name);
+        return E_FAIL;
+    }
+#endif
+
+    pMemory->pData = static_cast<BYTE*>(pData);
+    pMemory->size = size;
+    pMemory->owner = true;
+    return S_OK;
+}
+
+// 既存の共有メモリを開いてマップする関数
+HRESULT OpenSharedMemory(SharedMemory* pMemory, const char* name, size_t minSize, bool writable)
+{
+    if (!pMemory || !name) {
+        return E_POINTER;
+    }
+    memset(pMemory, 0, sizeof(*pMemory));
+    MakeSharedMemoryName(name, pMemory->name, sizeof(pMemory->name));
+    void* pData = NULL;
+    size_t size = 0;
+
+#ifdef _WIN32
+    const DWORD access = writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ;
+    pMemory->hMapping = OpenFileMappingA(access, FALSE, pMemory->name);
+    if (!pMemory->hMapping) {
+        return S_FALSE;
+    }
+    pData = MapViewOfFile(pMemory->hMapping, access, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (pData && VirtualQuery(pData, &info, sizeof(info)) == sizeof(info)) {
+        size = info.RegionSize;
+    }
+    if (!pData || size < minSize) {
+        if (pData) {
+            UnmapViewOfFile(pData);
+        }
+        CloseHandle(pMemory->hMapping);
+        pMemory->hMapping = NULL;
+        return S_FALSE;
+    }
+#else
+    int fd = shm_open(pMemory->name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0) {
+        return S_FALSE;
+    }
+    // 作成直後でまだサイズが決まっていなければ、作り終わるまで待ってもらう
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || static_cast<size_t>(st.st_size) < minSize) {
+        close(fd);
+        return S_FALSE;
+    }
+    size = static_cast<size_t>(st.st_size);
+    pData = mmap(NULL, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pData == MAP_FAILED) {
+        printf("mmap failed for %s\n", pMemory->name);
+        return E_FAIL;
+    }
+#endif
+
+    pMemory->pData = static_cast<BYTE*>(pData);
+    pMemory->size = size;
+    pMemory->owner = false;
+    return S_OK;
+}
+
+// マップを解除する関数
+void CloseSharedMemory(SharedMemory* pMemory)
+{
+    if (!pMemory || !pMemory->pData) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(pMemory->pData);
+    CloseHandle(pMemory->hMapping);
+    pMemory->hMapping = NULL;
+#else
+    munmap(pMemory->pData, pMemory->size);
+    if (pMemory->owner) {
+        shm_unlink(pMemory->name);
+    }
+#endif
+    pMemory->pData = NULL;
+    pMemory->size = 0;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "portable_types.h"
+
+// 名前付きの共有メモリ (POSIXではshm_open + mmap、WindowsではCreateFileMapping + MapViewOfFile)
+// ライブカウンターとフレームリングが、プロセス間で同じ領域をマップするのに使う
+struct SharedMemory {
+    BYTE* pData;                       // マップした先頭 (マップしていなければNULL)
+    size_t size;                       // マップしたサイズ (Windowsで開いた側はページ単位に切り上がる)
+    bool owner;                        // 作成した側 (閉じるときに名前を削除する)
+    char name[128];                    // プラットフォームの形式にした名前
+#ifdef _WIN32
+    HANDLE hMapping;
+#endif
+};
+
+// 名前をプラットフォームの形式にする関数 (POSIXは先頭に/、Windowsはセッション内のLocal\)
+void MakeSharedMemoryName(const char* name, char* pOut, size_t outSize);
+
+// 共有メモリを作成して読み書きできるようにマップする関数 (内容は0で始まる)
+// 作成した側は、作成した直後にownerPidOffsetの位置 (UINT32) に自分のプロセスIDを書くこと
+// 同じ名前が残っていれば、そこに書かれたプロセスが終了しているとき (前回の実行の残り) だけ作り直す
+// 動いているプロセスが使っているか、まだプロセスIDが書かれていなければ、その共有メモリには触れずにE_FAIL
+// modeはPOSIXでの作成時のアクセス許可 (Windowsでは使わない)
+HRESULT CreateSharedMemory(SharedMemory* pMemory, const char* name, size_t size, UINT32 mode, size_t ownerPidOffset);
+
+// 既存の共有メモリを開いてマップする関数 (全体をマップする)
+// まだ作成されていないか、作成の途中でminSizeに満たなければS_FALSE (相手の作成を待つ側は見直せばよい)
+// 名前 (pMemory->name) はS_FALSEのときも設定する
+HRESULT OpenSharedMemory(SharedMemory* pMemory, const char* name, size_t minSize, bool writable);
+
+// マップを解除する関数 (作成した側なら名前も削除する。マップ済みの相手はそのまま使える)
+void CloseSharedMemory(SharedMemory* pMemory);
+
+// プロセスが動いているか (確かめられないときは動いているとみなす)
+bool IsProcessAlive(UINT32 pid);
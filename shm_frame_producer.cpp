@@ -0,0 +1,83 @@
+// 共有メモリのフレームリングの生産者 (取り込みのプロセスの代わり)
+// リングを作成し、テストフレームをスロットに直接描画して公開する。nal_encode_decode --shm-input が受け取ってエンコードする
+// 既定では nal_encode_decode と同じ1920x1080のテストパターンを61フレーム送るので、出力はテストパターンのときと同じになる
+#include "shm_frame_ring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+// 消費者がすべてのフレームを返却するまで待つ時間の既定値
+#define PRODUCER_DRAIN_TIMEOUT_MS 30000
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [--name <shm name>] [--frames <n>] [--size <width>x<height>] [--slots <n>] [--fps <n>]\n",
+           program);
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = SHM_FRAME_RING_DEFAULT_NAME;
+    UINT32 frameCount = 61;
+    UINT32 width = 1920;
+    UINT32 height = 1080;
+    UINT32 slotCount = SHM_FRAME_RING_DEFAULT_SLOTS;
+    UINT32 fps = 0;                    // 0なら待たずに送る (空きスロットがなければ消費者を待つ)
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) {
+            name = argv[++i];
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%ux%u", &width, &height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+            slotCount = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = static_cast<UINT32>(atoi(argv[++i]));
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    ShmFrameRing ring;
+    HRESULT hr = CreateShmFrameRing(&ring, name, width, height, slotCount);
+    if (FAILED(hr)) {
+        printf("Failed to create frame ring: 0x%08X\n", hr);
+        return 1;
+    }
+
+    // --fpsなら取り込み時刻に合わせて公開する (カメラの代わり)
+    auto start = std::chrono::steady_clock::now();
+    for (UINT32 i = 0; i < frameCount; i++) {
+        if (fps > 0) {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(1000000ull * i / fps));
+        }
+        Nv12Frame frame;
+        hr = AcquireShmFrameSlot(&ring, &frame);
+        if (FAILED(hr)) {
+            break;
+        }
+        GenerateTestFrame(&frame, i);
+        hr = PublishShmFrameSlot(&ring, i);
+        if (FAILED(hr)) {
+            break;
+        }
+        if (i % 10 == 0) {
+            printf("Published frame %u/%u\n", i, frameCount);
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (SUCCEEDED(hr)) {
+        hr = FinishShmFrameRing(&ring, PRODUCER_DRAIN_TIMEOUT_MS);
+    }
+    PrintShmFrameRingStatistics(&ring);
+    printf("%.1f frames/s\n", elapsed > 0.0 ? ring.frames / elapsed : 0.0);
+    CloseShmFrameRing(&ring);
+    return FAILED(hr) ? 1 : 0;
+}
@@ -0,0 +1,526 @@
+#include "shm_frame_ring.h"
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <chrono>
+#include <thread>
+#include <new>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+// 別のプロセスと共有し、futexで待つので、アトミック変数がロックなしでUINT32と同じ大きさであること
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "32-bit atomics must be lock-free to live in shared memory");
+static_assert(sizeof(std::atomic<UINT32>) == sizeof(UINT32), "futex words must be plain 32-bit integers");
+
+// 待つときの時間の区切り (相手のプロセスが終了していないかをこの間隔で確かめる)
+#define SHM_FRAME_RING_POLL_MS 100
+
+static UINT64 GetSteadyTimeUs()
+{
+    return static_cast<UINT64>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static UINT32 GetProcessId()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<UINT32>(getpid());
+#endif
+}
+
+#ifdef _WIN32
+// 名前付きイベント (自動リセット) を作成または開く
+static HANDLE OpenRingEvent(const char* sharedName, const char* suffix, bool create)
+{
+    char eventName[160];
+    snprintf(eventName, sizeof(eventName), "%s.%s", sharedName, suffix);
+    if (create) {
+        return CreateEventA(NULL, FALSE, FALSE, eventName);
+    }
+    return OpenEventA(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE, eventName);
+}
+#endif
+
+// *pWordがvalueのままなら、起こされるかtimeoutMsたつまで待つ
+static void WaitOnWord(std::atomic<UINT32>* pWord, UINT32 value, void* pEvent, UINT32 timeoutMs)
+{
+#if defined(_WIN32)
+    (void)pWord;
+    (void)value;
+    WaitForSingleObject(static_cast<HANDLE>(pEvent), timeoutMs);
+#elif defined(__linux__)
+    (void)pEvent;
+    // 共有メモリ上のワードなので、プロセス間で使えるFUTEX_WAIT (FUTEX_PRIVATE_FLAGなし) を使う
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = static_cast<long>(timeoutMs % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<UINT32*>(pWord), FUTEX_WAIT, value, &timeout, NULL, 0);
+#else
+    // futexもイベントもないPOSIXでは短い間隔で見直す
+    (void)pEvent;
+    (void)timeoutMs;
+    if (pWord->load(std::memory_order_acquire) == value) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+#endif
+}
+
+// *pWordで待っている相手を起こす
+static void WakeWord(std::atomic<UINT32>* pWord, void* pEvent)
+{
+#if defined(_WIN32)
+    (void)pWord;
+    SetEvent(static_cast<HANDLE>(pEvent));
+#elif defined(__linux__)
+    (void)pEvent;
+    syscall(SYS_futex, reinterpret_cast<UINT32*>(pWord), FUTEX_WAKE, 1, NULL, NULL, 0);
+#else
+    (void)pWord;
+    (void)pEvent;
+#endif
+}
+
+static void* GetFrameEvent(ShmFrameRing* pRing)
+{
+#ifdef _WIN32
+    return pRing->hFrameEvent;
+#else
+    (void)pRing;
+    return NULL;
+#endif
+}
+
+static void* GetSlotEvent(ShmFrameRing* pRing)
+{
+#ifdef _WIN32
+    return pRing->hSlotEvent;
+#else
+    (void)pRing;
+    return NULL;
+#endif
+}
+
+static size_t AlignSize(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// スロットを指すフレームのビューを作る
+static void MakeSlotFrame(const ShmFrameRing* pRing, UINT32 index, Nv12Frame* pFrame)
+{
+    const ShmFrameRingHeader* pHeader = pRing->pHeader;
+    BYTE* pSlot = pRing->memory.pData + pHeader->slotsOffset + pHeader->slotSize * (index % pHeader->slotCount);
+    memset(pFrame, 0, sizeof(*pFrame));
+    pFrame->pY = pSlot;
+    pFrame->pUV = pSlot + pHeader->uvOffset;
+    pFrame->width = pHeader->width;
+    pFrame->height = pHeader->codedHeight;
+    pFrame->stride = pHeader->stride;
+    pFrame->cropWidth = pHeader->width;
+    pFrame->cropHeight = pHeader->height;
+}
+
+// リングを作成する関数
+HRESULT CreateShmFrameRing(ShmFrameRing* pRing, const char* name, UINT32 width, UINT32 height, UINT32 slotCount)
+{
+    if (!pRing || !name) {
+        return E_POINTER;
+    }
+    if (width == 0 || height == 0 || (width & 1) || (height & 1) || slotCount == 0 ||
+        slotCount > SHM_FRAME_RING_MAX_SLOTS) {
+        return E_INVALIDARG;
+    }
+    memset(pRing, 0, sizeof(*pRing));
+
+    // スロットのレイアウトはAllocateNv12Frameと同じ (ストライド・UVプレーンの先頭を64バイトに揃える)
+    const UINT32 codedHeight = AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT);
+    const UINT32 stride = AlignUp(width, NV12_FRAME_ALIGNMENT);
+    const size_t uvOffset = AlignSize(static_cast<size_t>(stride) * codedHeight, NV12_FRAME_ALIGNMENT);
+    const size_t slotSize = AlignSize(uvOffset + static_cast<size_t>(stride) * (codedHeight / 2),
+                                      SHM_FRAME_RING_SLOT_ALIGNMENT);
+    const size_t slotsOffset = AlignSize(sizeof(ShmFrameRingHeader), SHM_FRAME_RING_SLOT_ALIGNMENT);
+    const size_t size = slotsOffset + slotSize * slotCount;
+    // フレームは同じユーザーの消費者だけに見せる
+    HRESULT hr = CreateSharedMemory(&pRing->memory, name, size, 0600, offsetof(ShmFrameRingHeader, producerPid));
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+#ifdef _WIN32
+    pRing->hFrameEvent = OpenRingEvent(pRing->memory.name, "frame", true);
+    pRing->hSlotEvent = OpenRingEvent(pRing->memory.name, "slot", true);
+    if (!pRing->hFrameEvent || !pRing->hSlotEvent) {
+        printf("Failed to create the events of frame ring %s\n", pRing->memory.name);
+        if (pRing->hFrameEvent) {
+            CloseHandle(pRing->hFrameEvent);
+        }
+        if (pRing->hSlotEvent) {
+            CloseHandle(pRing->hSlotEvent);
+        }
+        CloseSharedMemory(&pRing->memory);
+        memset(pRing, 0, sizeof(*pRing));
+        return E_FAIL;
+    }
+#endif
+
+    // ヘッダーを初期化してから、最後にmagicを書いて消費者に見せる
+    ShmFrameRingHeader* pHeader = new (pRing->memory.pData) ShmFrameRingHeader();
+    pHeader->version = SHM_FRAME_RING_VERSION;
+    pHeader->headerSize = static_cast<UINT32>(sizeof(ShmFrameRingHeader));
+    pHeader->slotCount = slotCount;
+    pHeader->width = width;
+    pHeader->height = height;
+    pHeader->codedHeight = codedHeight;
+    pHeader->stride = stride;
+    pHeader->uvOffset = uvOffset;
+    pHeader->slotSize = slotSize;
+    pHeader->slotsOffset = slotsOffset;
+    pHeader->totalSize = size;
+    pHeader->producerPid = GetProcessId();
+    pHeader->magic.store(SHM_FRAME_RING_MAGIC, std::memory_order_release);
+
+    pRing->pHeader = pHeader;
+    pRing->producer = true;
+    printf("Frame ring: %s (%u slots of %ux%u, %.1f MB)\n", pRing->memory.name, slotCount, width, height,
+           size / (1024.0 * 1024.0));
+    return S_OK;
+}
+
+// 共有メモリをマップしてヘッダーを確かめる (まだ作成・初期化の途中ならS_FALSE)
+static HRESULT MapExistingRing(ShmFrameRing* pRing, const char* name)
+{
+    HRESULT hr = OpenSharedMemory(&pRing->memory, name, sizeof(ShmFrameRingHeader), true);
+    if (hr != S_OK) {
+        return hr;
+    }
+
+    ShmFrameRingHeader* pHeader = reinterpret_cast<ShmFrameRingHeader*>(pRing->memory.pData);
+    pRing->pHeader = pHeader;
+    // magicのacquireで、生産者が先に書いたヘッダーの項目が見える
+    if (pHeader->magic.load(std::memory_order_acquire) != SHM_FRAME_RING_MAGIC) {
+        CloseShmFrameRing(pRing);
+        return S_FALSE;
+    }
+    // Windowsのビューはページ単位に切り上がるので、共有メモリのサイズ以上であればよい
+    if (pHeader->version != SHM_FRAME_RING_VERSION || pHeader->headerSize != sizeof(ShmFrameRingHeader) ||
+        pHeader->slotCount == 0 || pHeader->slotCount > SHM_FRAME_RING_MAX_SLOTS || pHeader->totalSize > pRing->memory.size) {
+        printf("%s: unknown layout (version %u, %u bytes)\n", pRing->memory.name, pHeader->version, pHeader->headerSize);
+        CloseShmFrameRing(pRing);
+        return E_INVALIDARG;
+    }
+    return S_OK;
+}
+
+// 既存のリングを開く関数
+HRESULT OpenShmFrameRing(ShmFrameRing* pRing, const char* name, UINT32 timeoutMs)
+{
+    if (!pRing || !name) {
+        return E_POINTER;
+    }
+    memset(pRing, 0, sizeof(*pRing));
+
+    // 生産者が先に起動しているとは限らないので、作成されるまで待つ
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    HRESULT hr = S_FALSE;
+    bool announced = false;
+    while ((hr = MapExistingRing(pRing, name)) == S_FALSE) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            printf("Frame ring %s was not created within %u ms\n", pRing->memory.name, timeoutMs);
+            return E_FAIL;
+        }
+        if (!announced) {
+            printf("Waiting for frame ring %s...\n", pRing->memory.name);
+            announced = true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+#ifdef _WIN32
+    pRing->hFrameEvent = OpenRingEvent(pRing->memory.name, "frame", false);
+    pRing->hSlotEvent = OpenRingEvent(pRing->memory.name, "slot", false);
+    if (!pRing->hFrameEvent || !pRing->hSlotEvent) {
+        printf("Failed to open the events of frame ring %s\n", pRing->memory.name);
+        CloseShmFrameRing(pRing);
+        return E_FAIL;
+    }
+#endif
+
+    // 消費者は1つだけ (前の消費者が終了していれば引き継ぐ)
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+    const UINT32 pid = GetProcessId();
+    UINT32 current = 0;
+    while (!pHeader->consumerPid.compare_exchange_strong(current, pid)) {
+        if (IsProcessAlive(current)) {
+            printf("Frame ring %s already has a consumer (pid %u)\n", pRing->memory.name, current);
+            CloseShmFrameRing(pRing);
+            return E_FAIL;
+        }
+    }
+    pHeader->consumerClosed.store(0, std::memory_order_relaxed);
+    pRing->next = pHeader->released.load(std::memory_order_acquire);
+    pRing->producer = false;
+    printf("Frame ring opened: %s (%u slots of %ux%u, producer pid %u)\n", pRing->memory.name, pHeader->slotCount,
+           pHeader->width, pHeader->height, pHeader->producerPid);
+    return S_OK;
+}
+
+// 書き込み用の空きスロットを取得する関数
+HRESULT AcquireShmFrameSlot(ShmFrameRing* pRing, Nv12Frame* pFrame)
+{
+    if (!pRing || !pRing->pHeader || !pFrame) {
+        return E_POINTER;
+    }
+    if (!pRing->producer || pRing->slotHeld) {
+        return E_UNEXPECTED;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+
+    // 消費者が返却するまで、公開済みで返却されていないスロットは使えない
+    // (releasedのacquireで、消費者がそのスロットを読み終えたことも見える)
+    UINT32 released = pHeader->released.load(std::memory_order_acquire);
+    if (pRing->next - released >= pHeader->slotCount) {
+        auto waitStart = std::chrono::steady_clock::now();
+        pRing->waits++;
+        HRESULT hr = S_OK;
+        for (;;) {
+            if (pHeader->consumerClosed.load(std::memory_order_acquire)) {
+                printf("Frame ring consumer closed\n");
+                hr = E_ABORT;
+                break;
+            }
+            // 待っていることを先に書いてから見直す (消費者はreleasedの更新の後にこれを見るので、起こし忘れはない)
+            pHeader->producerWaiting.store(1);
+            released = pHeader->released.load();
+            if (pRing->next - released < pHeader->slotCount) {
+                break;
+            }
+            WaitOnWord(&pHeader->released, released, GetSlotEvent(pRing), SHM_FRAME_RING_POLL_MS);
+            if (pHeader->released.load(std::memory_order_relaxed) == released) {
+                UINT32 consumerPid = pHeader->consumerPid.load(std::memory_order_relaxed);
+                if (consumerPid != 0 && !IsProcessAlive(consumerPid)) {
+                    printf("Frame ring consumer (pid %u) exited\n", consumerPid);
+                    hr = E_ABORT;
+                    break;
+                }
+            }
+        }
+        pHeader->producerWaiting.store(0, std::memory_order_relaxed);
+        pRing->waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        if (FAILED(hr)) {
+            return hr;
+        }
+    }
+
+    MakeSlotFrame(pRing, pRing->next, pFrame);
+    pRing->slotHeld = true;
+    return S_OK;
+}
+
+// 書き込んだスロットを公開する関数
+HRESULT PublishShmFrameSlot(ShmFrameRing* pRing, UINT64 frameIndex)
+{
+    if (!pRing || !pRing->pHeader) {
+        return E_POINTER;
+    }
+    if (!pRing->slotHeld) {
+        return E_UNEXPECTED;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+    ShmFrameSlotInfo& info = pHeader->slots[pRing->next % pHeader->slotCount];
+    info.frameIndex = frameIndex;
+    info.publishTimeUs = GetSteadyTimeUs();
+
+    // producedの更新 (release) で、スロットの中身と情報を消費者に見せる
+    pRing->next++;
+    pHeader->produced.store(pRing->next);
+    if (pHeader->consumerWaiting.load()) {
+        WakeWord(&pHeader->produced, GetFrameEvent(pRing));
+    }
+    pRing->slotHeld = false;
+    pRing->frames++;
+    return S_OK;
+}
+
+// ストリームの終わりを知らせ、すべてのフレームが返却されるまで待つ関数
+HRESULT FinishShmFrameRing(ShmFrameRing* pRing, UINT32 timeoutMs)
+{
+    if (!pRing || !pRing->pHeader) {
+        return E_POINTER;
+    }
+    if (!pRing->producer) {
+        return E_UNEXPECTED;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+    pHeader->endOfStream.store(1);
+    if (pHeader->consumerWaiting.load()) {
+        WakeWord(&pHeader->produced, GetFrameEvent(pRing));
+    }
+
+    // 閉じる前に消費者が最後のフレームまで読み終えるのを待つ (まだ開いていない消費者も、この間なら間に合う)
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        pHeader->producerWaiting.store(1);
+        UINT32 released = pHeader->released.load();
+        if (released == pRing->next) {
+            break;
+        }
+        if (pHeader->consumerClosed.load(std::memory_order_acquire)) {
+            printf("Frame ring consumer closed before reading all frames\n");
+            pHeader->producerWaiting.store(0, std::memory_order_relaxed);
+            return E_ABORT;
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            printf("Frame ring: %u frames were not returned within %u ms\n", pRing->next - released, timeoutMs);
+            pHeader->producerWaiting.store(0, std::memory_order_relaxed);
+            return E_FAIL;
+        }
+        WaitOnWord(&pHeader->released, released, GetSlotEvent(pRing), SHM_FRAME_RING_POLL_MS);
+    }
+    pHeader->producerWaiting.store(0, std::memory_order_relaxed);
+    return S_OK;
+}
+
+// 次のフレームを受け取る関数
+HRESULT TakeShmFrame(ShmFrameRing* pRing, Nv12Frame* pFrame, ShmFrameSlotInfo* pInfo)
+{
+    if (!pRing || !pRing->pHeader || !pFrame) {
+        return E_POINTER;
+    }
+    if (pRing->producer) {
+        return E_UNEXPECTED;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+
+    // producedのacquireで、生産者が書いたスロットの中身と情報が見える
+    UINT32 produced = pHeader->produced.load(std::memory_order_acquire);
+    if (produced == pRing->next) {
+        auto waitStart = std::chrono::steady_clock::now();
+        bool waited = false;
+        HRESULT hr = S_OK;
+        for (;;) {
+            // ストリームの終わりは、公開済みのフレームをすべて受け取った後に返す
+            bool ended = pHeader->endOfStream.load() != 0;
+            pHeader->consumerWaiting.store(1);
+            produced = pHeader->produced.load();
+            if (produced != pRing->next) {
+                break;
+            }
+            if (ended) {
+                hr = S_FALSE;
+                break;
+            }
+            waited = true;
+            WaitOnWord(&pHeader->produced, produced, GetFrameEvent(pRing), SHM_FRAME_RING_POLL_MS);
+            if (pHeader->produced.load(std::memory_order_relaxed) == produced &&
+                !pHeader->endOfStream.load(std::memory_order_relaxed) && !IsProcessAlive(pHeader->producerPid)) {
+                printf("Frame ring producer (pid %u) exited\n", pHeader->producerPid);
+                hr = E_ABORT;
+                break;
+            }
+        }
+        pHeader->consumerWaiting.store(0, std::memory_order_relaxed);
+        if (waited) {
+            pRing->waits++;
+            pRing->waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+        }
+        if (hr != S_OK) {
+            return hr;
+        }
+    }
+
+    const ShmFrameSlotInfo& info = pHeader->slots[pRing->next % pHeader->slotCount];
+    MakeSlotFrame(pRing, pRing->next, pFrame);
+    if (pInfo) {
+        *pInfo = info;
+    }
+    UINT64 now = GetSteadyTimeUs();
+    UINT64 latencyUs = now > info.publishTimeUs ? now - info.publishTimeUs : 0;
+    pRing->latencyUsSum += latencyUs;
+    if (latencyUs > pRing->latencyUsMax) {
+        pRing->latencyUsMax = latencyUs;
+    }
+    pRing->next++;
+    pRing->frames++;
+    return S_OK;
+}
+
+// 受け取ったフレームのうち最も古いものを返却する関数
+void ReleaseShmFrame(ShmFrameRing* pRing)
+{
+    if (!pRing || !pRing->pHeader || pRing->producer) {
+        return;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+    // 受け取った数より多くは返却しない (返却するのはこのプロセスだけなので、読んでから足してよい)
+    if (pHeader->released.load(std::memory_order_relaxed) == pRing->next) {
+        return;
+    }
+    // releaseの順序で、スロットを読み終えてから生産者に返す
+    pHeader->released.fetch_add(1);
+    if (pHeader->producerWaiting.load()) {
+        WakeWord(&pHeader->released, GetSlotEvent(pRing));
+    }
+}
+
+// リングを閉じる関数
+void CloseShmFrameRing(ShmFrameRing* pRing)
+{
+    if (!pRing || !pRing->pHeader) {
+        return;
+    }
+    ShmFrameRingHeader* pHeader = pRing->pHeader;
+    if (pHeader->magic.load(std::memory_order_acquire) == SHM_FRAME_RING_MAGIC) {
+        if (pRing->producer) {
+            // Finishを呼ばずに閉じた (エラーで止まった) ときも、消費者が待ち続けないようにする
+            if (!pHeader->endOfStream.exchange(1)) {
+                WakeWord(&pHeader->produced, GetFrameEvent(pRing));
+            }
+        } else {
+            UINT32 pid = GetProcessId();
+            if (pHeader->consumerPid.compare_exchange_strong(pid, 0)) {
+                pHeader->consumerClosed.store(1);
+                WakeWord(&pHeader->released, GetSlotEvent(pRing));
+            }
+        }
+    }
+
+#ifdef _WIN32
+    if (pRing->hFrameEvent) {
+        CloseHandle(pRing->hFrameEvent);
+    }
+    if (pRing->hSlotEvent) {
+        CloseHandle(pRing->hSlotEvent);
+    }
+    pRing->hFrameEvent = NULL;
+    pRing->hSlotEvent = NULL;
+#endif
+    CloseSharedMemory(&pRing->memory);
+    pRing->pHeader = NULL;
+}
+
+// 受け渡しの統計情報を表示する関数
+void PrintShmFrameRingStatistics(const ShmFrameRing* pRing)
+{
+    if (pRing->producer) {
+        printf("Frame ring (producer): %llu frames published, waited %llu times for a free slot (%.1f ms)\n",
+               static_cast<unsigned long long>(pRing->frames), static_cast<unsigned long long>(pRing->waits),
+               pRing->waitMs);
+        return;
+    }
+    printf("Frame ring (consumer): %llu frames taken, waited %llu times for a frame (%.1f ms), "
+           "publish-to-take latency avg %.1f us, max %llu us\n",
+           static_cast<unsigned long long>(pRing->frames), static_cast<unsigned long long>(pRing->waits),
+           pRing->waitMs, pRing->frames ? static_cast<double>(pRing->latencyUsSum) / pRing->frames : 0.0,
+           static_cast<unsigned long long>(pRing->latencyUsMax));
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include "shared_memory.h"
+#include <atomic>
+
+// プロセス間で共有するNV12フレームのリング (取り込みのプロセスからエンコーダーのプロセスへの受け渡し)
+// - 共有メモリにヘッダーと固定数のフレームスロットを置く。生産者はスロットに直接書き込み、
+//   消費者はスロットをNv12Frameのビューとしてそのままエンコードする (プロセス間のコピーはない)
+// - 生産者と消費者は1つずつ。受け渡しは単調増加する2つの番号 (公開したフレーム数と返却したフレーム数) の
+//   アトミック操作だけで行い、ロックはない。スロットは番号の順に使い、順に返却する
+// - 待つのはリングが満杯または空のときだけで、LinuxではfutexでWindowsでは名前付きイベントで起こす
+//   (相手が待っていなければ、起こすためのシステムコールもない)
+// - リングは生産者が作成する (フレームの形式を決めるのは取り込み側)。消費者は名前で開く
+
+// 共有メモリの既定の名前 (POSIXでは/dev/shm/nal_frame_ring、WindowsではLocal\nal_frame_ring)
+#define SHM_FRAME_RING_DEFAULT_NAME "nal_frame_ring"
+
+#define SHM_FRAME_RING_MAGIC   0x474E5246u  // "FRNG"
+#define SHM_FRAME_RING_VERSION 2
+
+// スロット数の既定値と上限
+#define SHM_FRAME_RING_DEFAULT_SLOTS 4
+#define SHM_FRAME_RING_MAX_SLOTS 16
+
+// スロットの先頭のアライメント (ページ境界。プレーンの先頭はさらにNV12_FRAME_ALIGNMENTに揃える)
+#define SHM_FRAME_RING_SLOT_ALIGNMENT 4096
+
+// スロットごとのフレームの情報 (生産者が書き、公開したフレーム数の更新で消費者に見せる)
+struct ShmFrameSlotInfo {
+    UINT64 frameIndex;                 // 取り込み順の番号
+    UINT64 publishTimeUs;              // 公開した時刻 (steady_clock、マイクロ秒。同じマシンのプロセス間で共通)
+};
+
+// 共有メモリの先頭のヘッダー (生産者と消費者で同じ定義を使う。項目を変えたらSHM_FRAME_RING_VERSIONを上げる)
+struct ShmFrameRingHeader {
+    std::atomic<UINT32> magic;         // 生産者がほかの項目を書き終えてから最後に書く (releaseで書き、acquireで読む)
+    UINT32 version;
+    UINT32 headerSize;                 // sizeof(ShmFrameRingHeader)
+    UINT32 slotCount;
+    UINT32 width;                      // 表示幅 (符号化幅も同じ)
+    UINT32 height;                     // 表示高さ
+    UINT32 codedHeight;                // 符号化高さ (16の倍数にパディング)
+    UINT32 stride;                     // 行ピッチ (Y/UV共通)
+    UINT64 uvOffset;                   // スロットの先頭からUVプレーンまで
+    UINT64 slotSize;                   // スロット1つのサイズ (SHM_FRAME_RING_SLOT_ALIGNMENTの倍数)
+    UINT64 slotsOffset;                // 共有メモリの先頭から最初のスロットまで
+    UINT64 totalSize;                  // 共有メモリ全体のサイズ
+    UINT32 producerPid;                // 生産者のプロセスID
+
+    // 生産者が更新する (消費者はproducedをfutexで待つ)
+    alignas(64) std::atomic<UINT32> produced;        // 公開したフレーム数
+    std::atomic<UINT32> producerWaiting;             // 生産者が空きを待っている
+    std::atomic<UINT32> endOfStream;                 // これ以上フレームを公開しない
+
+    // 消費者が更新する (生産者はreleasedをfutexで待つ)
+    alignas(64) std::atomic<UINT32> released;        // 返却したフレーム数
+    std::atomic<UINT32> consumerWaiting;             // 消費者がフレームを待っている
+    std::atomic<UINT32> consumerPid;                 // 接続中の消費者のプロセスID (0なら未接続)
+    std::atomic<UINT32> consumerClosed;              // 消費者が途中で閉じた (生産者の待ちを終わらせる)
+
+    ShmFrameSlotInfo slots[SHM_FRAME_RING_MAX_SLOTS];
+};
+
+// リングのハンドル (プロセスごと)
+struct ShmFrameRing {
+    ShmFrameRingHeader* pHeader;       // 共有メモリの先頭
+    SharedMemory memory;
+    bool producer;                     // リングを作成した側
+    UINT32 next;                       // 生産者: 次に公開する番号、消費者: 次に受け取る番号
+    bool slotHeld;                     // 生産者: 書き込み中のスロットがある
+
+    // 統計情報
+    UINT64 frames;                     // 公開した、または受け取ったフレーム数
+    UINT64 waits;                      // 満杯 (生産者) または空 (消費者) で待った回数
+    double waitMs;                     // 待った時間の合計
+    UINT64 latencyUsSum;               // 消費者: 公開から受け取りまでの時間の合計
+    UINT64 latencyUsMax;
+#ifdef _WIN32
+    HANDLE hFrameEvent;                // フレームが公開された (消費者が待つ)
+    HANDLE hSlotEvent;                 // スロットが返却された (生産者が待つ)
+#endif
+};
+
+// リングを作成する関数 (生産者。同じ名前が残っていれば、その生産者が終了しているときだけ作り直す)
+// width x heightのフレームをslotCount枚持つ (符号化高さとストライドはAllocateNv12Frameと同じ規則で決める)
+HRESULT CreateShmFrameRing(ShmFrameRing* pRing, const char* name, UINT32 width, UINT32 height, UINT32 slotCount);
+
+// 既存のリングを開く関数 (消費者)
+// 生産者がまだ作成していなければ、timeoutMsまで作成を待つ。ほかの消費者が接続中ならE_FAIL
+HRESULT OpenShmFrameRing(ShmFrameRing* pRing, const char* name, UINT32 timeoutMs);
+
+// 書き込み用の空きスロットを取得する関数 (生産者)
+// 満杯なら消費者が返却するまで待つ。消費者が閉じたか終了していればE_ABORT
+HRESULT AcquireShmFrameSlot(ShmFrameRing* pRing, Nv12Frame* pFrame);
+
+// 書き込んだスロットを公開する関数 (生産者。消費者が待っていれば起こす)
+HRESULT PublishShmFrameSlot(ShmFrameRing* pRing, UINT64 frameIndex);
+
+// ストリームの終わりを知らせ、消費者がすべてのフレームを返却するまでtimeoutMsまで待つ関数 (生産者)
+HRESULT FinishShmFrameRing(ShmFrameRing* pRing, UINT32 timeoutMs);
+
+// 次のフレームを受け取る関数 (消費者)
+// pFrameはスロットを指すビューで、ReleaseShmFrameまで有効 (FreeNv12Frameは呼ばないこと)
+// フレームがなければ公開されるまで待つ。ストリームが終わっていればS_FALSE、生産者が終了していればE_ABORT
+HRESULT TakeShmFrame(ShmFrameRing* pRing, Nv12Frame* pFrame, ShmFrameSlotInfo* pInfo);
+
+// 受け取ったフレームのうち最も古いものを返却する関数 (消費者。生産者が待っていれば起こす)
+void ReleaseShmFrame(ShmFrameRing* pRing);
+
+// リングを閉じる関数 (生産者なら名前も削除する。マップ済みの相手はそのまま使える)
+void CloseShmFrameRing(ShmFrameRing* pRing);
+
+// 受け渡しの統計情報を表示する関数
+void PrintShmFrameRingStatistics(const ShmFrameRing* pRing);
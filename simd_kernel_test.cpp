@@ -0,0 +1,268 @@
+// SIMDカーネルの等価性テスト (CTestから実行する)
+// SSE2/NEON版のカーネルが、検証用のスカラー版とビット単位で同じ結果を返すことを、乱数の入力で確認する
+// - h264_transform: 4x4変換・量子化・逆量子化・逆変換・SATD (QP 0〜51のすべて、firstIndex 0/1)
+// - nv12_scaler: ScaleNv12FrameとScaleNv12FrameScalar (縮小・拡大、双線形・面積平均)
+// - pre_analysis: 輝度の4x4縮小とSAD (SIMDの幅で割り切れない端数を含む)
+// SIMDのない環境では両方ともスカラー版になるので、常に一致する
+#include "h264_transform.h"
+#include "nv12_scaler.h"
+#include "pre_analysis.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// QPごとに試すブロック数
+#define BLOCKS_PER_QP 2000
+
+// 再現性のある疑似乱数 (xorshift64)
+static UINT64 NextRandom(UINT64& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// 基準値±amplitudeの画素 (0〜255に飽和)
+static BYTE RandomPixel(UINT64& state, int base, int amplitude)
+{
+    int value = base + static_cast<int>(NextRandom(state) % (2 * amplitude + 1)) - amplitude;
+    return static_cast<BYTE>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static bool SameBlock(const INT16 a[16], const INT16 b[16])
+{
+    return memcmp(a, b, 16 * sizeof(INT16)) == 0;
+}
+
+// 4x4変換のカーネルを比較する関数 (不一致の数を返す)
+// 入力はエンコーダーと同じ流れで作る: 残差 → 変換 → 量子化 → 逆量子化 → 逆変換
+static size_t CheckTransformKernels(UINT64 seed)
+{
+    // ストライドのある8x8の領域の中ほどに4x4ブロックを置き、書き込みが外にはみ出さないことも確認する
+    const UINT32 stride = 8;
+    const size_t offset = 2 * stride + 2;
+    static const int amplitudes[] = { 2, 12, 60, 255 };
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    size_t mismatches = 0;
+
+    for (int qp = 0; qp <= 51; qp++) {
+        for (int n = 0; n < BLOCKS_PER_QP; n++) {
+            BYTE src[64], pred[64];
+            int amplitude = amplitudes[n % 4];
+            int base = static_cast<int>(NextRandom(state) % 256);
+            for (int i = 0; i < 64; i++) {
+                src[i] = RandomPixel(state, base, amplitude);
+                pred[i] = RandomPixel(state, base, amplitude);
+            }
+
+            INT16 coeffs[16], coeffsRef[16];
+            H264ForwardTransform4x4(src + offset, stride, pred + offset, stride, coeffs);
+            H264ForwardTransform4x4Scalar(src + offset, stride, pred + offset, stride, coeffsRef);
+            if (!SameBlock(coeffs, coeffsRef)) {
+                printf("H264ForwardTransform4x4 mismatch: QP %d, block %d\n", qp, n);
+                mismatches++;
+            }
+
+            UINT32 satd = H264Satd4x4(src + offset, stride, pred + offset, stride);
+            UINT32 satdRef = H264Satd4x4Scalar(src + offset, stride, pred + offset, stride);
+            if (satd != satdRef) {
+                printf("H264Satd4x4 mismatch: QP %d, block %d (%u, expected %u)\n", qp, n, satd, satdRef);
+                mismatches++;
+            }
+
+            for (int firstIndex = 0; firstIndex <= 1; firstIndex++) {
+                INT16 levels[16], levelsRef[16];
+                int nonZero = H264Quantize4x4(coeffsRef, levels, qp, firstIndex);
+                int nonZeroRef = H264Quantize4x4Scalar(coeffsRef, levelsRef, qp, firstIndex);
+                if (!SameBlock(levels, levelsRef) || nonZero != nonZeroRef) {
+                    printf("H264Quantize4x4 mismatch: QP %d, block %d, firstIndex %d\n", qp, n, firstIndex);
+                    mismatches++;
+                }
+
+                // firstIndex = 1 ではcoeffs[0] (別に復号したDC) を書き換えないこと
+                INT16 dequant[16], dequantRef[16];
+                dequant[0] = dequantRef[0] = static_cast<INT16>(NextRandom(state) % 512) - 256;
+                H264Dequantize4x4(levelsRef, dequant, qp, firstIndex);
+                H264Dequantize4x4Scalar(levelsRef, dequantRef, qp, firstIndex);
+                if (!SameBlock(dequant, dequantRef)) {
+                    printf("H264Dequantize4x4 mismatch: QP %d, block %d, firstIndex %d\n", qp, n, firstIndex);
+                    mismatches++;
+                }
+
+                BYTE recon[64], reconRef[64];
+                memcpy(recon, pred, sizeof(recon));
+                memcpy(reconRef, pred, sizeof(reconRef));
+                H264InverseTransformAdd4x4(dequant, recon + offset, stride);
+                H264InverseTransformAdd4x4Scalar(dequantRef, reconRef + offset, stride);
+                if (memcmp(recon, reconRef, sizeof(recon)) != 0) {
+                    printf("H264InverseTransformAdd4x4 mismatch: QP %d, block %d, firstIndex %d\n", qp, n, firstIndex);
+                    mismatches++;
+                }
+            }
+        }
+    }
+    printf("h264_transform: %d QPs x %d blocks, %zu mismatches\n", 52, BLOCKS_PER_QP, mismatches);
+    return mismatches;
+}
+
+// 乱数のNV12フレームを確保する (表示領域の外も乱数で埋めて、読み過ぎがあれば結果に出るようにする)
+static HRESULT AllocateRandomFrame(Nv12Frame* pFrame, UINT32 width, UINT32 height, UINT64& state)
+{
+    HRESULT hr = AllocateNv12Frame(pFrame, width, height);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    // 滑らかな部分と細かい部分が混ざるよう、行ごとに振幅を変える
+    size_t planeSize = static_cast<size_t>(pFrame->stride) * pFrame->height;
+    for (size_t i = 0; i < planeSize; i++) {
+        pFrame->pY[i] = RandomPixel(state, static_cast<int>((i / pFrame->stride) % 256), ((i / pFrame->stride) & 1) ? 255 : 8);
+    }
+    for (size_t i = 0; i < planeSize / 2; i++) {
+        pFrame->pUV[i] = static_cast<BYTE>(NextRandom(state));
+    }
+    return S_OK;
+}
+
+// 出力フレームを同じ値で埋めて確保する (書き込まれない部分も比較できるように)
+static HRESULT AllocateOutputFrame(Nv12Frame* pFrame, UINT32 width, UINT32 height)
+{
+    HRESULT hr = AllocateNv12Frame(pFrame, width, height);
+    if (SUCCEEDED(hr)) {
+        memset(pFrame->pBuffer, 0x5A, pFrame->bufferSize);
+    }
+    return hr;
+}
+
+// スケーラーのSIMD版とスカラー版を比較する関数 (不一致の数を返す)
+static size_t CheckScaler(UINT64 seed)
+{
+    struct ScaleCase {
+        UINT32 srcWidth, srcHeight, dstWidth, dstHeight;
+    };
+    // 縮小 (整数比・非整数比・2倍を超える縮小)、拡大、同じサイズ、SIMDの幅で割り切れない幅
+    static const ScaleCase cases[] = {
+        { 1920, 1080, 1280,  720 },
+        { 1920, 1080,  640,  360 },
+        { 1280,  720,  426,  240 },
+        {  640,  360,  854,  480 },
+        {  352,  288,  352,  288 },
+        {  150,   98,   62,   34 },
+        {   62,   34,  150,   98 },
+    };
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    size_t mismatches = 0;
+    size_t compared = 0;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const ScaleCase& sc = cases[c];
+        for (int f = NV12_SCALE_BILINEAR; f <= NV12_SCALE_AREA; f++) {
+            Nv12ScaleFilter filter = static_cast<Nv12ScaleFilter>(f);
+            Nv12Frame src, dst, dstRef;
+            if (FAILED(AllocateRandomFrame(&src, sc.srcWidth, sc.srcHeight, state))) {
+                printf("Failed to allocate %ux%u frame\n", sc.srcWidth, sc.srcHeight);
+                return mismatches + 1;
+            }
+            if (FAILED(AllocateOutputFrame(&dst, sc.dstWidth, sc.dstHeight)) ||
+                FAILED(AllocateOutputFrame(&dstRef, sc.dstWidth, sc.dstHeight))) {
+                printf("Failed to allocate %ux%u frame\n", sc.dstWidth, sc.dstHeight);
+                FreeNv12Frame(&src);
+                FreeNv12Frame(&dst);
+                return mismatches + 1;
+            }
+
+            Nv12Scaler scaler;
+            HRESULT hr = InitializeNv12Scaler(&scaler, sc.srcWidth, sc.srcHeight, sc.dstWidth, sc.dstHeight, filter);
+            if (SUCCEEDED(hr)) {
+                hr = ScaleNv12Frame(&scaler, &src, &dst);
+            }
+            if (SUCCEEDED(hr)) {
+                hr = ScaleNv12FrameScalar(&scaler, &src, &dstRef);
+            }
+            if (FAILED(hr)) {
+                printf("Scaling %ux%u -> %ux%u (%s) failed: 0x%08X\n", sc.srcWidth, sc.srcHeight,
+                       sc.dstWidth, sc.dstHeight, GetNv12ScaleFilterName(filter), hr);
+                mismatches++;
+            } else if (memcmp(dst.pBuffer, dstRef.pBuffer, dst.bufferSize) != 0) {
+                printf("ScaleNv12Frame mismatch: %ux%u -> %ux%u (%s)\n", sc.srcWidth, sc.srcHeight,
+                       sc.dstWidth, sc.dstHeight, GetNv12ScaleFilterName(filter));
+                mismatches++;
+            }
+            compared++;
+
+            FreeNv12Frame(&src);
+            FreeNv12Frame(&dst);
+            FreeNv12Frame(&dstRef);
+        }
+    }
+    printf("nv12_scaler: %zu size/filter combinations, %zu mismatches\n", compared, mismatches);
+    return mismatches;
+}
+
+// 先読み解析のカーネルを比較する関数 (不一致の数を返す)
+static size_t CheckPreAnalysisKernels(UINT64 seed)
+{
+    UINT64 state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    size_t mismatches = 0;
+
+    // 縮小: 出力幅は16の倍数とその前後 (SIMDのループと端数のループの境目)
+    static const UINT32 widths[] = { 1, 15, 16, 17, 31, 32, 33, 80, 120, 480 };
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        UINT32 dstWidth = widths[w];
+        UINT32 dstHeight = 1 + static_cast<UINT32>(NextRandom(state) % 9);
+        UINT32 srcStride = dstWidth * 4 + static_cast<UINT32>(NextRandom(state) % 64);
+        std::vector<BYTE> src(static_cast<size_t>(srcStride) * dstHeight * 4);
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = static_cast<BYTE>(NextRandom(state));
+        }
+        std::vector<BYTE> dst(static_cast<size_t>(dstWidth) * dstHeight, 0);
+        std::vector<BYTE> dstRef(dst.size(), 0);
+        DownsampleLuma4x4(src.data(), srcStride, dst.data(), dstWidth, dstHeight);
+        DownsampleLuma4x4Scalar(src.data(), srcStride, dstRef.data(), dstWidth, dstHeight);
+        if (dst != dstRef) {
+            printf("DownsampleLuma4x4 mismatch: %ux%u, stride %u\n", dstWidth, dstHeight, srcStride);
+            mismatches++;
+        }
+    }
+
+    // SAD: 長さとアライメントをずらす (差が最大の255になる組み合わせも含める)
+    std::vector<BYTE> a(4096 + 16), b(4096 + 16);
+    for (int n = 0; n < 200; n++) {
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = static_cast<BYTE>(NextRandom(state));
+            b[i] = (n % 4 == 0) ? static_cast<BYTE>(~a[i]) : static_cast<BYTE>(NextRandom(state));
+        }
+        size_t size = (n < 64) ? static_cast<size_t>(n) : static_cast<size_t>(NextRandom(state) % 4096);
+        size_t offsetA = NextRandom(state) % 16;
+        size_t offsetB = NextRandom(state) % 16;
+        UINT64 sad = SumAbsDiff(a.data() + offsetA, b.data() + offsetB, size);
+        UINT64 sadRef = SumAbsDiffScalar(a.data() + offsetA, b.data() + offsetB, size);
+        if (sad != sadRef) {
+            printf("SumAbsDiff mismatch: %zu bytes (%llu, expected %llu)\n", size,
+                   static_cast<unsigned long long>(sad), static_cast<unsigned long long>(sadRef));
+            mismatches++;
+        }
+    }
+    printf("pre_analysis: %zu downsample widths, 200 SAD runs, %zu mismatches\n",
+           sizeof(widths) / sizeof(widths[0]), mismatches);
+    return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+    UINT64 seed = (argc > 1) ? static_cast<UINT64>(strtoull(argv[1], NULL, 10)) : 1;
+
+    size_t mismatches = 0;
+    mismatches += CheckTransformKernels(seed);
+    mismatches += CheckScaler(seed);
+    mismatches += CheckPreAnalysisKernels(seed);
+
+    if (mismatches > 0) {
+        printf("SIMD kernel test FAILED: %zu mismatches against the scalar reference (seed %llu)\n",
+               mismatches, static_cast<unsigned long long>(seed));
+        return 1;
+    }
+    printf("SIMD kernel test passed (seed %llu)\n", static_cast<unsigned long long>(seed));
+    return 0;
+}
@@ -0,0 +1,626 @@
+#include "yuv_archive.h"
+#include "lz_block.h"
+#include "pipeline_trace.h"
+#include <string.h>
+#include <chrono>
+
+// ファイルの先頭のマジックとバージョン
+static const BYTE ARCHIVE_MAGIC[8] = { 'N', 'V', '1', '2', 'A', 'R', 'C', '1' };
+#define ARCHIVE_VERSION 1
+
+// ヘッダー・フレームのチャンク表・索引の1項目のバイト数
+#define ARCHIVE_HEADER_SIZE 40
+#define ARCHIVE_RECORD_HEADER_SIZE 8
+#define ARCHIVE_CHUNK_ENTRY_SIZE 12
+#define ARCHIVE_INDEX_ENTRY_SIZE 16
+
+static void PutLE32(BYTE* p, UINT32 value)
+{
+    p[0] = static_cast<BYTE>(value);
+    p[1] = static_cast<BYTE>(value >> 8);
+    p[2] = static_cast<BYTE>(value >> 16);
+    p[3] = static_cast<BYTE>(value >> 24);
+}
+
+static void PutLE64(BYTE* p, UINT64 value)
+{
+    PutLE32(p, static_cast<UINT32>(value));
+    PutLE32(p + 4, static_cast<UINT32>(value >> 32));
+}
+
+static UINT32 GetLE32(const BYTE* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<UINT32>(p[3]) << 24);
+}
+
+static UINT64 GetLE64(const BYTE* p)
+{
+    return GetLE32(p) | (static_cast<UINT64>(GetLE32(p + 4)) << 32);
+}
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// ヘッダーを書き直す (書き込み位置は末尾に戻す)
+static bool WriteArchiveHeader(YuvArchiveWriter* pWriter, UINT32 frameCount, UINT64 indexOffset)
+{
+    BYTE header[ARCHIVE_HEADER_SIZE];
+    memcpy(header, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    PutLE32(header + 8, ARCHIVE_VERSION);
+    PutLE32(header + 12, pWriter->width);
+    PutLE32(header + 16, pWriter->height);
+    PutLE32(header + 20, pWriter->keyFrameInterval);
+    PutLE32(header + 24, pWriter->chunkSize);
+    PutLE32(header + 28, frameCount);
+    PutLE64(header + 32, indexOffset);
+
+    if (fseek(pWriter->pFile, 0, SEEK_SET) != 0 ||
+        fwrite(header, 1, sizeof(header), pWriter->pFile) != sizeof(header) ||
+        fseek(pWriter->pFile, 0, SEEK_END) != 0) {
+        return false;
+    }
+    return true;
+}
+
+// inputを圧縮してoutputに書き、格納サイズを返す
+// 元より小さくならなければinputをそのまま格納する (格納サイズ = 展開後のサイズで区別する)
+static size_t PackChunk(const BYTE* input, size_t size, BYTE* output, UINT32* pHashTable, const BYTE** ppStored)
+{
+    size_t compressedSize = CompressLzBlock(input, size, output, size - 1, pHashTable);
+    if (compressedSize == 0) {
+        *ppStored = input;
+        return size;
+    }
+    *ppStored = output;
+    return compressedSize;
+}
+
+// チャンクの行をフレームから詰め、必要なら差分を取って圧縮する
+static void CompressChunk(YuvArchiveWriter* pWriter, YuvArchiveChunk* pChunk, UINT32* pHashTable)
+{
+    const Nv12Frame* pFrame = pWriter->pFrame;
+    const UINT32 width = pWriter->width;
+    const UINT32 left = pFrame->cropLeft & ~1u;
+    const UINT32 top = pChunk->plane == 0 ? (pFrame->cropTop & ~1u) : (pFrame->cropTop & ~1u) / 2;
+    const BYTE* plane = pChunk->plane == 0 ? pFrame->pY : pFrame->pUV;
+
+    BYTE* current = &pWriter->current[pChunk->offset];
+    const BYTE* previous = &pWriter->previous[pChunk->offset];
+    BYTE* delta = pChunk->delta.data();
+    const bool needDelta = !pWriter->keyFrame && (pWriter->probeFrame || pChunk->useDelta);
+    for (UINT32 row = 0; row < pChunk->rowCount; row++) {
+        const BYTE* src = plane + static_cast<size_t>(top + pChunk->firstRow + row) * pFrame->stride + left;
+        BYTE* dst = current + static_cast<size_t>(row) * width;
+        memcpy(dst, src, width);
+        if (needDelta) {
+            const BYTE* prev = previous + static_cast<size_t>(row) * width;
+            BYTE* diff = delta + static_cast<size_t>(row) * width;
+            for (UINT32 x = 0; x < width; x++) {
+                diff[x] = static_cast<BYTE>(dst[x] - prev[x]);
+            }
+        }
+    }
+
+    if (!needDelta) {
+        pChunk->storedSize = PackChunk(current, pChunk->size, pChunk->compressed.data(), pHashTable, &pChunk->pStored);
+        pChunk->storedFlags = 0;
+        return;
+    }
+    pChunk->storedSize = PackChunk(delta, pChunk->size, pChunk->compressed.data(), pHashTable, &pChunk->pStored);
+    pChunk->storedFlags = YUV_ARCHIVE_CHUNK_DELTA;
+    if (pWriter->probeFrame) {
+        // 差分を取らない方も圧縮し、小さい方をこのチャンクの次のキーフレームまでの方法にする
+        const BYTE* pAlternative = NULL;
+        size_t alternativeSize = PackChunk(current, pChunk->size, pChunk->alternative.data(), pHashTable, &pAlternative);
+        pChunk->useDelta = pChunk->storedSize <= alternativeSize;
+        if (!pChunk->useDelta) {
+            pChunk->pStored = pAlternative;
+            pChunk->storedSize = alternativeSize;
+            pChunk->storedFlags = 0;
+        }
+    }
+}
+
+// 残っているチャンクを1つずつ取って処理する (呼び出し元のスレッドとワーカーで共有する)
+static void RunChunks(YuvArchiveWriter* pWriter, UINT32* pHashTable)
+{
+    while (true) {
+        size_t chunkIndex;
+        {
+            std::lock_guard<std::mutex> lock(pWriter->mutex);
+            if (pWriter->nextChunk >= pWriter->chunks.size()) {
+                return;
+            }
+            chunkIndex = pWriter->nextChunk++;
+        }
+
+        CompressChunk(pWriter, pWriter->chunks[chunkIndex], pHashTable);
+
+        std::lock_guard<std::mutex> lock(pWriter->mutex);
+        if (--pWriter->pendingChunks == 0) {
+            pWriter->done.notify_one();
+        }
+    }
+}
+
+// ワーカースレッド (フレームごとに起こされ、チャンクがなくなるまで処理する)
+static void ArchiveWorker(YuvArchiveWriter* pWriter)
+{
+    TRACE_THREAD_NAME("yuv archive worker");
+    std::vector<UINT32> hashTable(LZ_BLOCK_HASH_SIZE);
+    UINT64 seenGeneration = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pWriter->mutex);
+            pWriter->start.wait(lock, [pWriter, seenGeneration] {
+                return pWriter->shuttingDown || pWriter->generation != seenGeneration;
+            });
+            if (pWriter->shuttingDown) {
+                return;
+            }
+            seenGeneration = pWriter->generation;
+        }
+        RunChunks(pWriter, hashTable.data());
+    }
+}
+
+// プレーンを行単位のチャンクに分ける
+static void AddPlaneChunks(YuvArchiveWriter* pWriter, UINT32 plane, UINT32 rows, size_t planeOffset)
+{
+    UINT32 rowsPerChunk = pWriter->chunkSize / pWriter->width;
+    if (rowsPerChunk == 0) {
+        rowsPerChunk = 1;
+    }
+    for (UINT32 row = 0; row < rows; row += rowsPerChunk) {
+        YuvArchiveChunk* pChunk = new YuvArchiveChunk();
+        pChunk->plane = plane;
+        pChunk->firstRow = row;
+        pChunk->rowCount = (rows - row < rowsPerChunk) ? rows - row : rowsPerChunk;
+        pChunk->offset = planeOffset + static_cast<size_t>(row) * pWriter->width;
+        pChunk->size = static_cast<size_t>(pChunk->rowCount) * pWriter->width;
+        pChunk->delta.resize(pChunk->size);
+        pChunk->compressed.resize(pChunk->size);
+        pChunk->alternative.resize(pChunk->size);
+        pChunk->useDelta = true;
+        pChunk->pStored = NULL;
+        pChunk->storedSize = 0;
+        pChunk->storedFlags = 0;
+        pWriter->chunks.push_back(pChunk);
+    }
+}
+
+// 最初のフレームでサイズを決め、作業領域とワーカースレッドを用意する
+static HRESULT StartArchive(YuvArchiveWriter* pWriter, UINT32 width, UINT32 height)
+{
+    pWriter->width = width;
+    pWriter->height = height;
+    pWriter->current.assign(GetNv12PackedSize(width, height), 0);
+    pWriter->previous.assign(pWriter->current.size(), 0);
+
+    AddPlaneChunks(pWriter, 0, height, 0);
+    AddPlaneChunks(pWriter, 1, height / 2, static_cast<size_t>(width) * height);
+
+    UINT32 threadCount = pWriter->threadCount;
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+    }
+    if (threadCount == 0) {
+        threadCount = 1;
+    }
+    if (threadCount > pWriter->chunks.size()) {
+        threadCount = static_cast<UINT32>(pWriter->chunks.size());
+    }
+    pWriter->threadCount = threadCount;
+    for (UINT32 i = 1; i < threadCount; i++) {
+        pWriter->workers.push_back(std::thread(ArchiveWorker, pWriter));
+    }
+
+    // サイズの入ったヘッダーにしておく (途中で止まっても索引を作り直して読めるように)
+    if (!WriteArchiveHeader(pWriter, 0, 0)) {
+        printf("Failed to write YUV archive header\n");
+        return E_FAIL;
+    }
+    return S_OK;
+}
+
+HRESULT OpenYuvArchive(YuvArchiveWriter* pWriter, const char* filename, UINT32 threadCount,
+                       UINT32 keyFrameInterval, UINT32 chunkSize)
+{
+    if (!pWriter || !filename) {
+        return E_POINTER;
+    }
+
+    pWriter->pFile = fopen(filename, "wb");
+    if (!pWriter->pFile) {
+        printf("Failed to open %s for writing.\n", filename);
+        return E_FAIL;
+    }
+    setvbuf(pWriter->pFile, NULL, _IOFBF, 1024 * 1024);
+
+    pWriter->width = 0;
+    pWriter->height = 0;
+    pWriter->keyFrameInterval = keyFrameInterval == 0 ? 1 : keyFrameInterval;
+    pWriter->chunkSize = chunkSize == 0 ? YUV_ARCHIVE_DEFAULT_CHUNK_SIZE : chunkSize;
+    pWriter->threadCount = threadCount;
+    pWriter->fileOffset = ARCHIVE_HEADER_SIZE;
+    pWriter->index.clear();
+    pWriter->current.clear();
+    pWriter->previous.clear();
+    pWriter->chunks.clear();
+    pWriter->hashTable.assign(LZ_BLOCK_HASH_SIZE, 0);
+    pWriter->recordHeader.clear();
+    pWriter->pFrame = NULL;
+    pWriter->keyFrame = true;
+    pWriter->probeFrame = false;
+    pWriter->workers.clear();
+    pWriter->generation = 0;
+    pWriter->nextChunk = 0;
+    pWriter->pendingChunks = 0;
+    pWriter->shuttingDown = false;
+    pWriter->rawBytes = 0;
+    pWriter->storedBytes = ARCHIVE_HEADER_SIZE;
+    pWriter->compressSeconds = 0.0;
+    pWriter->writeSeconds = 0.0;
+
+    if (!WriteArchiveHeader(pWriter, 0, 0)) {
+        printf("Failed to write YUV archive header\n");
+        fclose(pWriter->pFile);
+        pWriter->pFile = NULL;
+        return E_FAIL;
+    }
+    printf("YUV archive opened: %s (key frame every %u frames)\n", filename, pWriter->keyFrameInterval);
+    return S_OK;
+}
+
+HRESULT WriteYuvArchiveFrame(YuvArchiveWriter* pWriter, const Nv12Frame* pFrame)
+{
+    if (!pWriter || !pWriter->pFile) {
+        return E_POINTER;
+    }
+    if (!pFrame || !pFrame->pBuffer) {
+        return E_INVALIDARG;
+    }
+
+    // WriteNv12FrameCroppedと同じく、クロマに合わせて偶数位置に揃える
+    UINT32 width = pFrame->cropWidth & ~1u;
+    UINT32 height = pFrame->cropHeight & ~1u;
+    if (width == 0 || height == 0) {
+        return E_INVALIDARG;
+    }
+    if (pWriter->width == 0) {
+        HRESULT hr = StartArchive(pWriter, width, height);
+        if (FAILED(hr)) {
+            return hr;
+        }
+    } else if (width != pWriter->width || height != pWriter->height) {
+        printf("YUV archive frame size changed: %ux%u -> %ux%u\n", pWriter->width, pWriter->height, width, height);
+        return E_INVALIDARG;
+    }
+
+    // 全チャンクを並列に詰めて圧縮する (呼び出し元のスレッドも処理に加わる)
+    std::chrono::steady_clock::time_point compressStart = std::chrono::steady_clock::now();
+    pWriter->pFrame = pFrame;
+    pWriter->keyFrame = (pWriter->index.size() % pWriter->keyFrameInterval) == 0;
+    pWriter->probeFrame = (pWriter->index.size() % pWriter->keyFrameInterval) == 1;
+    {
+        std::lock_guard<std::mutex> lock(pWriter->mutex);
+        pWriter->generation++;
+        pWriter->nextChunk = 0;
+        pWriter->pendingChunks = pWriter->chunks.size();
+    }
+    pWriter->start.notify_all();
+    RunChunks(pWriter, pWriter->hashTable.data());
+    {
+        std::unique_lock<std::mutex> lock(pWriter->mutex);
+        pWriter->done.wait(lock, [pWriter] { return pWriter->pendingChunks == 0; });
+    }
+    pWriter->pFrame = NULL;
+    pWriter->compressSeconds += SecondsSince(compressStart);
+
+    // フラグとチャンクの表、続けてチャンクのデータを書く
+    std::chrono::steady_clock::time_point writeStart = std::chrono::steady_clock::now();
+    const size_t chunkCount = pWriter->chunks.size();
+    pWriter->recordHeader.resize(ARCHIVE_RECORD_HEADER_SIZE + chunkCount * ARCHIVE_CHUNK_ENTRY_SIZE);
+    BYTE* p = pWriter->recordHeader.data();
+    const UINT32 flags = pWriter->keyFrame ? YUV_ARCHIVE_FRAME_KEY : 0;
+    PutLE32(p, flags);
+    PutLE32(p + 4, static_cast<UINT32>(chunkCount));
+    p += ARCHIVE_RECORD_HEADER_SIZE;
+    UINT64 recordSize = pWriter->recordHeader.size();
+    for (const YuvArchiveChunk* pChunk : pWriter->chunks) {
+        PutLE32(p, static_cast<UINT32>(pChunk->size));
+        PutLE32(p + 4, static_cast<UINT32>(pChunk->storedSize));
+        PutLE32(p + 8, pChunk->storedFlags);
+        p += ARCHIVE_CHUNK_ENTRY_SIZE;
+        recordSize += pChunk->storedSize;
+    }
+
+    bool written = fwrite(pWriter->recordHeader.data(), 1, pWriter->recordHeader.size(), pWriter->pFile) ==
+                   pWriter->recordHeader.size();
+    for (size_t i = 0; written && i < chunkCount; i++) {
+        const YuvArchiveChunk* pChunk = pWriter->chunks[i];
+        written = fwrite(pChunk->pStored, 1, pChunk->storedSize, pWriter->pFile) == pChunk->storedSize;
+    }
+    if (!written) {
+        printf("Failed to write YUV archive frame %zu\n", pWriter->index.size());
+        return E_FAIL;
+    }
+    pWriter->writeSeconds += SecondsSince(writeStart);
+
+    YuvArchiveIndexEntry entry;
+    entry.offset = pWriter->fileOffset;
+    entry.size = static_cast<UINT32>(recordSize);
+    entry.flags = flags;
+    pWriter->index.push_back(entry);
+    pWriter->fileOffset += recordSize;
+    pWriter->rawBytes += pWriter->current.size();
+    pWriter->storedBytes += recordSize;
+
+    // 次のフレームの差分の基準にする
+    pWriter->current.swap(pWriter->previous);
+    return S_OK;
+}
+
+HRESULT CloseYuvArchive(YuvArchiveWriter* pWriter)
+{
+    if (!pWriter) {
+        return E_POINTER;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pWriter->mutex);
+        pWriter->shuttingDown = true;
+    }
+    pWriter->start.notify_all();
+    for (std::thread& worker : pWriter->workers) {
+        worker.join();
+    }
+    pWriter->workers.clear();
+    for (YuvArchiveChunk* pChunk : pWriter->chunks) {
+        delete pChunk;
+    }
+    pWriter->chunks.clear();
+    pWriter->current.clear();
+    pWriter->previous.clear();
+
+    if (!pWriter->pFile) {
+        return S_OK;
+    }
+
+    // 末尾に索引を書き、ヘッダーにフレーム数と索引の位置を入れる
+    HRESULT hr = S_OK;
+    std::vector<BYTE> indexData(pWriter->index.size() * ARCHIVE_INDEX_ENTRY_SIZE);
+    for (size_t i = 0; i < pWriter->index.size(); i++) {
+        BYTE* p = &indexData[i * ARCHIVE_INDEX_ENTRY_SIZE];
+        PutLE64(p, pWriter->index[i].offset);
+        PutLE32(p + 8, pWriter->index[i].size);
+        PutLE32(p + 12, pWriter->index[i].flags);
+    }
+    if ((!indexData.empty() && fwrite(indexData.data(), 1, indexData.size(), pWriter->pFile) != indexData.size()) ||
+        !WriteArchiveHeader(pWriter, static_cast<UINT32>(pWriter->index.size()), pWriter->fileOffset)) {
+        printf("Failed to write YUV archive index\n");
+        hr = E_FAIL;
+    }
+    pWriter->storedBytes += indexData.size();
+    if (fclose(pWriter->pFile) != 0) {
+        hr = E_FAIL;
+    }
+    pWriter->pFile = NULL;
+    return hr;
+}
+
+void PrintYuvArchiveStatistics(const YuvArchiveWriter* pWriter)
+{
+    if (!pWriter) {
+        return;
+    }
+    const double MB = 1024.0 * 1024.0;
+    printf("YUV archive: %zu frames (%ux%u), %.1f MB -> %.1f MB (%.1f%%)\n",
+           pWriter->index.size(), pWriter->width, pWriter->height, pWriter->rawBytes / MB,
+           pWriter->storedBytes / MB, pWriter->rawBytes > 0 ? 100.0 * pWriter->storedBytes / pWriter->rawBytes : 0.0);
+    if (pWriter->compressSeconds > 0.0 && pWriter->writeSeconds > 0.0) {
+        printf("  compress %.0f MB/s of NV12 (%u threads), write %.0f MB/s of NV12 (%.0f MB/s to disk)\n",
+               pWriter->rawBytes / MB / pWriter->compressSeconds, pWriter->threadCount,
+               pWriter->rawBytes / MB / pWriter->writeSeconds, pWriter->storedBytes / MB / pWriter->writeSeconds);
+    }
+}
+
+// 索引がないファイルのフレームを先頭から辿る
+static void RebuildIndex(YuvArchiveReader* pReader)
+{
+    const BYTE* data = pReader->file.pData;
+    const UINT64 fileSize = pReader->file.size;
+    UINT64 pos = ARCHIVE_HEADER_SIZE;
+    while (pos + ARCHIVE_RECORD_HEADER_SIZE <= fileSize) {
+        UINT32 flags = GetLE32(data + pos);
+        UINT64 chunkCount = GetLE32(data + pos + 4);
+        UINT64 size = ARCHIVE_RECORD_HEADER_SIZE + chunkCount * ARCHIVE_CHUNK_ENTRY_SIZE;
+        if (pos + size > fileSize) {
+            break;
+        }
+        for (UINT64 i = 0; i < chunkCount; i++) {
+            size += GetLE32(data + pos + ARCHIVE_RECORD_HEADER_SIZE + i * ARCHIVE_CHUNK_ENTRY_SIZE + 4);
+        }
+        if (pos + size > fileSize) {
+            break;                     // 書きかけのフレーム
+        }
+        YuvArchiveIndexEntry entry;
+        entry.offset = pos;
+        entry.size = static_cast<UINT32>(size);
+        entry.flags = flags;
+        pReader->index.push_back(entry);
+        pos += size;
+    }
+}
+
+HRESULT OpenYuvArchiveReader(YuvArchiveReader* pReader, const char* filename)
+{
+    if (!pReader || !filename) {
+        return E_POINTER;
+    }
+    pReader->index.clear();
+    pReader->frame.clear();
+    pReader->delta.clear();
+    pReader->currentFrame = 0;
+    pReader->hasFrame = false;
+
+    HRESULT hr = OpenMappedFile(&pReader->file, filename);
+    if (FAILED(hr)) {
+        return hr;
+    }
+
+    const BYTE* header = pReader->file.pData;
+    if (pReader->file.size < ARCHIVE_HEADER_SIZE || memcmp(header, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+        GetLE32(header + 8) != ARCHIVE_VERSION) {
+        printf("Not a YUV archive: %s\n", filename);
+        CloseMappedFile(&pReader->file);
+        return E_FAIL;
+    }
+    pReader->width = GetLE32(header + 12);
+    pReader->height = GetLE32(header + 16);
+    pReader->keyFrameInterval = GetLE32(header + 20);
+    UINT32 frameCount = GetLE32(header + 28);
+    UINT64 indexOffset = GetLE64(header + 32);
+
+    if (indexOffset == 0) {
+        printf("YUV archive has no index (writer did not finish), scanning frames\n");
+        RebuildIndex(pReader);
+    } else {
+        const UINT64 fileSize = pReader->file.size;
+        if (indexOffset > fileSize || (fileSize - indexOffset) / ARCHIVE_INDEX_ENTRY_SIZE < frameCount) {
+            printf("YUV archive index is truncated: %s\n", filename);
+            CloseMappedFile(&pReader->file);
+            return E_FAIL;
+        }
+        pReader->index.resize(frameCount);
+        for (UINT32 i = 0; i < frameCount; i++) {
+            const BYTE* p = pReader->file.pData + indexOffset + static_cast<UINT64>(i) * ARCHIVE_INDEX_ENTRY_SIZE;
+            YuvArchiveIndexEntry& entry = pReader->index[i];
+            entry.offset = GetLE64(p);
+            entry.size = GetLE32(p + 8);
+            entry.flags = GetLE32(p + 12);
+            if (entry.offset > indexOffset || entry.size < ARCHIVE_RECORD_HEADER_SIZE ||
+                indexOffset - entry.offset < entry.size) {
+                printf("YUV archive index entry %u is out of range\n", i);
+                CloseMappedFile(&pReader->file);
+                return E_FAIL;
+            }
+        }
+    }
+
+    if (!pReader->index.empty() && (pReader->width == 0 || pReader->height == 0 ||
+                                    (pReader->width % 2) != 0 || (pReader->height % 2) != 0)) {
+        printf("YUV archive has an invalid frame size: %ux%u\n", pReader->width, pReader->height);
+        CloseMappedFile(&pReader->file);
+        return E_FAIL;
+    }
+    pReader->frame.resize(GetNv12PackedSize(pReader->width, pReader->height));
+    pReader->delta.resize(pReader->frame.size());
+    return S_OK;
+}
+
+// frameIndex番目のフレームを復元してframeに入れる (キーフレームでなければframeが直前のフレームであること)
+// 差分のチャンクは直前のフレームに足し、そうでないチャンクはframeに直接展開する
+static HRESULT DecodeArchiveFrame(YuvArchiveReader* pReader, UINT32 frameIndex)
+{
+    const YuvArchiveIndexEntry& entry = pReader->index[frameIndex];
+    const BYTE* record = pReader->file.pData + entry.offset;
+    const BYTE* recordEnd = record + entry.size;
+    const bool keyFrame = (GetLE32(record) & YUV_ARCHIVE_FRAME_KEY) != 0;
+    const UINT32 chunkCount = GetLE32(record + 4);
+    if (!keyFrame && !(pReader->hasFrame && pReader->currentFrame + 1 == frameIndex)) {
+        return E_UNEXPECTED;
+    }
+    if ((entry.size - ARCHIVE_RECORD_HEADER_SIZE) / ARCHIVE_CHUNK_ENTRY_SIZE < chunkCount) {
+        return E_FAIL;
+    }
+
+    // 途中で失敗するとframeが壊れるので、終わるまで無効にしておく
+    pReader->hasFrame = false;
+    const size_t frameSize = pReader->frame.size();
+    const BYTE* table = record + ARCHIVE_RECORD_HEADER_SIZE;
+    const BYTE* data = table + static_cast<size_t>(chunkCount) * ARCHIVE_CHUNK_ENTRY_SIZE;
+    size_t offset = 0;
+    for (UINT32 i = 0; i < chunkCount; i++) {
+        const size_t rawSize = GetLE32(table + i * ARCHIVE_CHUNK_ENTRY_SIZE);
+        const size_t storedSize = GetLE32(table + i * ARCHIVE_CHUNK_ENTRY_SIZE + 4);
+        const bool deltaChunk = (GetLE32(table + i * ARCHIVE_CHUNK_ENTRY_SIZE + 8) & YUV_ARCHIVE_CHUNK_DELTA) != 0;
+        if (rawSize > frameSize - offset || storedSize > static_cast<size_t>(recordEnd - data) ||
+            (keyFrame && deltaChunk)) {
+            return E_FAIL;
+        }
+
+        BYTE* target = deltaChunk ? &pReader->delta[offset] : &pReader->frame[offset];
+        if (storedSize == rawSize) {
+            memcpy(target, data, rawSize);
+        } else if (DecompressLzBlock(data, storedSize, target, rawSize) != rawSize) {
+            return E_FAIL;
+        }
+        if (deltaChunk) {
+            BYTE* frame = &pReader->frame[offset];
+            for (size_t x = 0; x < rawSize; x++) {
+                frame[x] = static_cast<BYTE>(frame[x] + target[x]);
+            }
+        }
+        offset += rawSize;
+        data += storedSize;
+    }
+    if (offset != frameSize) {
+        return E_FAIL;
+    }
+
+    pReader->currentFrame = frameIndex;
+    pReader->hasFrame = true;
+    return S_OK;
+}
+
+HRESULT ReadYuvArchiveFrame(YuvArchiveReader* pReader, UINT32 frameIndex, const BYTE** ppFrame)
+{
+    if (!pReader || !ppFrame) {
+        return E_POINTER;
+    }
+    if (frameIndex >= pReader->index.size()) {
+        return E_INVALIDARG;
+    }
+
+    if (!pReader->hasFrame || pReader->currentFrame != frameIndex) {
+        // 直前のキーフレームを探す
+        UINT32 keyFrame = frameIndex;
+        while ((pReader->index[keyFrame].flags & YUV_ARCHIVE_FRAME_KEY) == 0) {
+            if (keyFrame == 0) {
+                printf("YUV archive has no key frame before frame %u\n", frameIndex);
+                return E_FAIL;
+            }
+            keyFrame--;
+        }
+
+        // 復元済みのフレームが同じキーフレームの区間にあれば、その続きから復元する
+        UINT32 first = keyFrame;
+        if (pReader->hasFrame && pReader->currentFrame >= keyFrame && pReader->currentFrame < frameIndex) {
+            first = pReader->currentFrame + 1;
+        }
+        for (UINT32 i = first; i <= frameIndex; i++) {
+            HRESULT hr = DecodeArchiveFrame(pReader, i);
+            if (FAILED(hr)) {
+                printf("YUV archive frame %u is corrupt: 0x%08X\n", i, hr);
+                return hr;
+            }
+        }
+    }
+    *ppFrame = pReader->frame.data();
+    return S_OK;
+}
+
+void CloseYuvArchiveReader(YuvArchiveReader* pReader)
+{
+    if (!pReader) {
+        return;
+    }
+    CloseMappedFile(&pReader->file);
+    pReader->index.clear();
+    pReader->frame.clear();
+    pReader->delta.clear();
+    pReader->hasFrame = false;
+}
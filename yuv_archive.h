@@ -0,0 +1,151 @@
+#pragma once
+
+#include "portable_types.h"
+#include "nv12_frame.h"
+#include "mapped_file.h"
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// デコード結果のNV12を可逆圧縮して保存するコンテナ (YUVアーカイブ、拡張子 .yuvz)
+// - フレームは表示領域だけを詰めたNV12 (WriteNv12FrameCroppedと同じバイト列) として扱う
+// - キーフレーム以外は、プレーンごとに直前のフレームとの差分 (バイトごとの減算、mod 256) を取る
+//   (静止した背景や一定の動きは差分がほぼ一定の値になり、LZで大きく縮む)
+// - 各プレーンを行単位のチャンクに分け、ワーカースレッドで並列に差分を取って圧縮する (LZ4のブロック形式)
+// - 量子化ノイズの多い領域などは差分の方が縮まないので、差分を使うかどうかはチャンクごとに決める
+//   (キーフレームの直後のフレームで両方を圧縮して小さい方を選び、次のキーフレームまで使い続ける)
+// - 末尾にフレームの索引 (ファイル内の位置) を置き、任意のフレームを直前のキーフレームから復元できる
+//
+// ファイルの構成 (数値はすべてリトルエンディアン)
+//   ヘッダー (40バイト): マジック "NV12ARC1", バージョン, 幅, 高さ, キーフレーム間隔, チャンクサイズ,
+//                        フレーム数, 索引の位置 (64ビット)
+//   フレーム: フラグ, チャンク数, (展開後のサイズ, 格納サイズ, チャンクのフラグ) x チャンク数, チャンクのデータ
+//             (格納サイズ = 展開後のサイズのチャンクは圧縮せずにそのまま格納している)
+//   索引: (フレームの位置 (64ビット), フレームのバイト数, フラグ) x フレーム数
+// 書き込み中に止まったファイル (索引の位置が0) は、フレームを先頭から辿って索引を作り直す
+
+// 既定のキーフレーム間隔 (ランダムアクセスで復元するフレーム数の上限)
+#define YUV_ARCHIVE_DEFAULT_KEY_INTERVAL 30
+
+// 既定のチャンクサイズ (この大きさ以下になるように行をまとめる)
+#define YUV_ARCHIVE_DEFAULT_CHUNK_SIZE (256 * 1024)
+
+// フレームのフラグ
+#define YUV_ARCHIVE_FRAME_KEY 0x1      // 差分を取らずにそのまま圧縮したフレーム
+
+// チャンクのフラグ
+#define YUV_ARCHIVE_CHUNK_DELTA 0x1    // 直前のフレームとの差分を格納したチャンク
+
+// 1チャンク分の作業領域 (担当スレッドだけが書き込む)
+struct YuvArchiveChunk {
+    UINT32 plane;                      // 0: Y, 1: UV
+    UINT32 firstRow;                   // プレーン内の先頭行
+    UINT32 rowCount;                   // 行数
+    size_t offset;                     // 詰めたフレーム内の先頭
+    size_t size;                       // 展開後のバイト数
+    std::vector<BYTE> delta;           // 直前のフレームとの差分
+    std::vector<BYTE> compressed;      // 圧縮結果
+    std::vector<BYTE> alternative;     // 差分を使うか試すときの、差分を取らない方の圧縮結果
+    bool useDelta;                     // キーフレーム以外で差分を使うか
+    const BYTE* pStored;               // 格納するデータ (圧縮結果、縮まなければ差分か元のデータ)
+    size_t storedSize;                 // 格納するバイト数
+    UINT32 storedFlags;                // YUV_ARCHIVE_CHUNK_*
+};
+
+// 索引の1項目
+struct YuvArchiveIndexEntry {
+    UINT64 offset;                     // フレームの先頭の位置
+    UINT32 size;                       // フレームのバイト数 (チャンクの表を含む)
+    UINT32 flags;                      // YUV_ARCHIVE_FRAME_*
+};
+
+// 書き込み側
+struct YuvArchiveWriter {
+    FILE* pFile;
+    UINT32 width;                      // 表示領域のサイズ (最初のフレームで決まる)
+    UINT32 height;
+    UINT32 keyFrameInterval;
+    UINT32 chunkSize;
+    UINT32 threadCount;                // 呼び出し元のスレッドを含む
+    UINT64 fileOffset;                 // 次に書く位置
+    std::vector<YuvArchiveIndexEntry> index;
+
+    std::vector<BYTE> current;         // 詰めた現在のフレーム
+    std::vector<BYTE> previous;        // 詰めた直前のフレーム
+    std::vector<YuvArchiveChunk*> chunks;
+    std::vector<UINT32> hashTable;     // 呼び出し元のスレッドが使うLZのハッシュ表
+    std::vector<BYTE> recordHeader;    // フレームのフラグとチャンクの表
+
+    // 現在のフレーム (WriteYuvArchiveFrameの間だけ有効)
+    const Nv12Frame* pFrame;
+    bool keyFrame;
+    bool probeFrame;                   // チャンクごとに差分を使うかを決め直すフレーム
+
+    // チャンクを圧縮するワーカースレッド
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;     // フレームの開始・終了を通知する
+    std::condition_variable done;      // ワーカーがチャンクを処理し終えたことを通知する
+    UINT64 generation;                 // 開始したフレームの通し番号
+    size_t nextChunk;                  // 次に処理するチャンク (mutexで保護)
+    size_t pendingChunks;              // 処理が終わっていないチャンク数
+    bool shuttingDown;
+
+    // 統計情報
+    UINT64 rawBytes;                   // 詰めたフレームの合計
+    UINT64 storedBytes;                // 書き込んだ合計 (ヘッダーと索引を含む)
+    double compressSeconds;            // 差分と圧縮にかかった時間
+    double writeSeconds;               // ファイルへの書き込みにかかった時間
+};
+
+// 読み取り側 (ファイルはメモリマップして読む)
+struct YuvArchiveReader {
+    MappedFile file;
+    UINT32 width;
+    UINT32 height;
+    UINT32 keyFrameInterval;
+    std::vector<YuvArchiveIndexEntry> index;
+    std::vector<BYTE> frame;           // 最後に復元したフレーム
+    std::vector<BYTE> delta;           // 差分の展開先
+    UINT32 currentFrame;               // frameに入っているフレームの番号
+    bool hasFrame;
+};
+
+// コンテナを作成する関数 (threadCountが0なら論理コア数のスレッドで圧縮する)
+HRESULT OpenYuvArchive(YuvArchiveWriter* pWriter, const char* filename, UINT32 threadCount = 0,
+                       UINT32 keyFrameInterval = YUV_ARCHIVE_DEFAULT_KEY_INTERVAL,
+                       UINT32 chunkSize = YUV_ARCHIVE_DEFAULT_CHUNK_SIZE);
+
+// フレームの表示領域を追加する関数 (偶数位置に揃える。サイズは最初のフレームと同じであること)
+HRESULT WriteYuvArchiveFrame(YuvArchiveWriter* pWriter, const Nv12Frame* pFrame);
+
+// 索引とヘッダーを書いてコンテナを閉じる関数 (ワーカースレッドも終了する)
+HRESULT CloseYuvArchive(YuvArchiveWriter* pWriter);
+
+// 圧縮率と速度を表示する関数
+void PrintYuvArchiveStatistics(const YuvArchiveWriter* pWriter);
+
+// コンテナを開いて索引を読む関数
+HRESULT OpenYuvArchiveReader(YuvArchiveReader* pReader, const char* filename);
+
+// フレーム数を返す
+inline UINT32 GetYuvArchiveFrameCount(const YuvArchiveReader* pReader)
+{
+    return static_cast<UINT32>(pReader->index.size());
+}
+
+// 詰めたNV12の1フレームのバイト数を返す
+inline size_t GetYuvArchiveFrameSize(const YuvArchiveReader* pReader)
+{
+    return GetNv12PackedSize(pReader->width, pReader->height);
+}
+
+// frameIndex番目のフレームを復元する関数
+// ppFrameには詰めたNV12 (GetYuvArchiveFrameSizeバイト) が入る (次の呼び出しまで有効)
+// 直前に復元したフレームの続きならそこから、そうでなければ直前のキーフレームから順に復元する
+HRESULT ReadYuvArchiveFrame(YuvArchiveReader* pReader, UINT32 frameIndex, const BYTE** ppFrame);
+
+// コンテナを閉じる関数
+void CloseYuvArchiveReader(YuvArchiveReader* pReader);
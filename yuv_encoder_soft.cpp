@@ -0,0 +1,373 @@
+#include "yuv_encoder_soft.h"
+#include "pipeline_trace.h"
+#include "live_stats.h"
+#include <math.h>
+#include <thread>
+
+// 簡素化されたエラーチェック用マクロ
+#define CHECK_HR(hr, msg) if (FAILED(hr)) { \
+    printf("%s error: 0x%08X\n", msg, hr); \
+    return hr; \
+}
+
+// レート制御の範囲 (QPが小さすぎると係数のレベルが大きくなり、符号化が遅くなる)
+#define SOFT_ENCODER_INITIAL_QP 30
+#define SOFT_ENCODER_MIN_QP     10
+#define SOFT_ENCODER_MAX_QP     51
+#define SOFT_ENCODER_MAX_QP_STEP 4
+
+// エンコーダーを初期化する関数
+HRESULT InitializeEncoder(NalEncoder* pEncoder)
+{
+    return InitializeEncoder(pEncoder, 1920, 1080, 1500000); // 1.5 Mbps
+}
+
+// 映像サイズとビットレートを指定してエンコーダーを初期化する関数
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate)
+{
+    return InitializeEncoder(pEncoder, width, height, bitrate, 0);
+}
+
+// スライス数も指定してエンコーダーを初期化する関数
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate, UINT32 sliceCount)
+{
+    HRESULT hr = S_OK;
+
+    pEncoder->pCore = NULL;
+    pEncoder->width = width;
+    pEncoder->height = height;
+    pEncoder->codedHeight = AlignUp(height, NV12_FRAME_HEIGHT_ALIGNMENT);
+    pEncoder->stride = AlignUp(width, NV12_FRAME_ALIGNMENT);
+    pEncoder->frameRateNum = ENCODER_FRAME_RATE_NUM;
+    pEncoder->frameRateDenom = ENCODER_FRAME_RATE_DENOM;
+    pEncoder->bitrate = bitrate;
+    pEncoder->frameCount = 0;
+    pEncoder->outputSamples.clear();
+    pEncoder->qp = SOFT_ENCODER_INITIAL_QP;
+    pEncoder->gopLength = pEncoder->frameRateNum / pEncoder->frameRateDenom; // 1秒ごとにIDR
+    pEncoder->framesSinceIdr = 0;
+    pEncoder->forceKeyFrame = true;
+    pEncoder->encodedFrames = 0;
+    pEncoder->totalBytes = 0;
+    pEncoder->qpSum = 0;
+
+    if (sliceCount == 0) {
+        sliceCount = std::thread::hardware_concurrency();
+    }
+
+    pEncoder->pCore = new H264IntraEncoder();
+    hr = InitializeH264IntraEncoder(pEncoder->pCore, width, height, sliceCount);
+    if (FAILED(hr)) {
+        delete pEncoder->pCore;
+        pEncoder->pCore = NULL;
+    }
+    CHECK_HR(hr, "InitializeH264IntraEncoder");
+
+    // 入力プール (生産者が直接書き込み、エンコーダーはそのフレームをコピーせずに読む)
+    hr = InitializeNv12FramePool(&pEncoder->inputPool, ENCODER_INPUT_POOL_SIZE, width, height,
+                                 pEncoder->codedHeight, pEncoder->stride);
+    if (FAILED(hr)) {
+        ShutdownH264IntraEncoder(pEncoder->pCore);
+        delete pEncoder->pCore;
+        pEncoder->pCore = NULL;
+    }
+    CHECK_HR(hr, "InitializeNv12FramePool");
+    LIVE_STATS_SET(inputPoolSize, ENCODER_INPUT_POOL_SIZE);
+
+    printf("Software H.264 encoder: %dx%d, %d slices, %d kbps\n",
+           width, height, pEncoder->pCore->sliceCount, bitrate / 1000);
+    return hr;
+}
+
+// フレームをエンコードして、NALユニットを取得する関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    // 隙間なく詰めたNV12 (width x codedHeight) をストライド付きフレームのビューとして扱う
+    if (frameData.size() != GetNv12PackedSize(pEncoder->width, pEncoder->codedHeight)) {
+        printf("Frame data size mismatch: %zu bytes\n", frameData.size());
+        return E_INVALIDARG;
+    }
+
+    Nv12Frame view = {};
+    view.pY = const_cast<BYTE*>(frameData.data());
+    view.pUV = view.pY + pEncoder->width * pEncoder->codedHeight;
+    view.width = pEncoder->width;
+    view.height = pEncoder->codedHeight;
+    view.stride = pEncoder->width;
+    view.cropWidth = pEncoder->width;
+    view.cropHeight = pEncoder->height;
+
+    return EncodeFrame(pEncoder, view, outputNalUnits);
+}
+
+// フレーム単位のレート制御: 目標との比の対数 (QP 6で約2倍) だけQPを動かす
+static void UpdateQp(NalEncoder* pEncoder, size_t frameBytes)
+{
+    if (pEncoder->bitrate == 0 || frameBytes == 0) {
+        return;
+    }
+    double targetBits = static_cast<double>(pEncoder->bitrate) * pEncoder->frameRateDenom / pEncoder->frameRateNum;
+    int step = static_cast<int>(floor(3.0 * log2(frameBytes * 8.0 / targetBits) + 0.5));
+    if (step > SOFT_ENCODER_MAX_QP_STEP) {
+        step = SOFT_ENCODER_MAX_QP_STEP;
+    } else if (step < -SOFT_ENCODER_MAX_QP_STEP) {
+        step = -SOFT_ENCODER_MAX_QP_STEP;
+    }
+    int qp = pEncoder->qp + step;
+    pEncoder->qp = qp < SOFT_ENCODER_MIN_QP ? SOFT_ENCODER_MIN_QP : (qp > SOFT_ENCODER_MAX_QP ? SOFT_ENCODER_MAX_QP : qp);
+}
+
+// 次のフレームをIDRにするかどうか
+static bool IsNextFrameIdr(const NalEncoder* pEncoder)
+{
+    return pEncoder->forceKeyFrame || pEncoder->framesSinceIdr >= pEncoder->gopLength;
+}
+
+// 1フレームのエンコード後の処理 (出力サンプル情報を作り、統計・レート制御・IDRの間隔を更新する)
+static EncodedSampleInfo FinishEncodedFrame(NalEncoder* pEncoder, bool idr, size_t firstNalIndex, size_t nalCount,
+                                            size_t frameBytes)
+{
+    EncodedSampleInfo info = {};
+    info.sampleTime = pEncoder->frameCount * 10000000LL * pEncoder->frameRateDenom / pEncoder->frameRateNum;
+    info.duration = 10000000LL * pEncoder->frameRateDenom / pEncoder->frameRateNum;
+    info.keyFrame = idr ? TRUE : FALSE;
+    info.firstNalIndex = firstNalIndex;
+    info.nalCount = nalCount;
+
+    pEncoder->encodedFrames++;
+    pEncoder->totalBytes += frameBytes;
+    pEncoder->qpSum += pEncoder->qp;
+    UpdateQp(pEncoder, frameBytes);
+
+    pEncoder->forceKeyFrame = false;
+    pEncoder->framesSinceIdr = idr ? 1 : pEncoder->framesSinceIdr + 1;
+    pEncoder->frameCount++;
+    return info;
+}
+
+// ストライド付きフレームをエンコードする関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    HRESULT hr = S_OK;
+
+    if (!pEncoder->pCore) {
+        return E_POINTER;
+    }
+    if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+        printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+        return E_INVALIDARG;
+    }
+
+    pEncoder->outputSamples.clear();
+    bool idr = IsNextFrameIdr(pEncoder);
+    size_t firstNalIndex = outputNalUnits.size();
+    {
+        TRACE_SPAN("EncodeH264IntraFrame", pEncoder->frameCount);
+        hr = EncodeH264IntraFrame(pEncoder->pCore, frame, pEncoder->qp, idr, outputNalUnits);
+    }
+    CHECK_HR(hr, "EncodeH264IntraFrame");
+
+    size_t frameBytes = 0;
+    for (size_t i = firstNalIndex; i < outputNalUnits.size(); i++) {
+        frameBytes += outputNalUnits[i].size();
+    }
+    pEncoder->outputSamples.push_back(FinishEncodedFrame(pEncoder, idr, firstNalIndex,
+                                                         outputNalUnits.size() - firstNalIndex, frameBytes));
+    return hr;
+}
+
+// ストライド付きフレームをエンコードし、NALユニットをストアに追加する関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, NalStore* pStore)
+{
+    HRESULT hr = S_OK;
+
+    if (!pEncoder->pCore || !pStore) {
+        return E_POINTER;
+    }
+    if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+        printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+        return E_INVALIDARG;
+    }
+
+    pEncoder->outputSamples.clear();
+    bool idr = IsNextFrameIdr(pEncoder);
+    size_t firstNalIndex = GetNalStoreCount(pStore);
+    UINT64 firstByte = pStore->totalBytes;
+    {
+        TRACE_SPAN("EncodeH264IntraFrame", pEncoder->frameCount);
+        hr = EncodeH264IntraFrame(pEncoder->pCore, frame, pEncoder->qp, idr, pStore);
+    }
+    CHECK_HR(hr, "EncodeH264IntraFrame");
+
+    pEncoder->outputSamples.push_back(FinishEncodedFrame(pEncoder, idr, firstNalIndex,
+                                                         GetNalStoreCount(pStore) - firstNalIndex,
+                                                         static_cast<size_t>(pStore->totalBytes - firstByte)));
+    return hr;
+}
+
+// 複数のフレームをまとめてエンコードし、結果をアリーナに詰める関数
+HRESULT EncodeFrameBatch(NalEncoder* pEncoder, const Nv12Frame* pFrames, size_t frameCount, EncodeBatchArena* pArena)
+{
+    HRESULT hr = S_OK;
+
+    if (!pEncoder->pCore || !pArena) {
+        return E_POINTER;
+    }
+    ResetEncodeBatchArena(pArena);
+    pEncoder->outputSamples.clear();
+
+    for (size_t i = 0; i < frameCount; i++) {
+        const Nv12Frame& frame = pFrames[i];
+        if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+            printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+            return E_INVALIDARG;
+        }
+
+        bool idr = IsNextFrameIdr(pEncoder);
+        size_t firstNalIndex = pArena->nals.size();
+        size_t firstByte = pArena->data.size();
+        hr = EncodeH264IntraFrame(pEncoder->pCore, frame, pEncoder->qp, idr, pArena->data, pArena->nals);
+        CHECK_HR(hr, "EncodeH264IntraFrame");
+
+        EncodeBatchItem item;
+        item.inputIndex = i;
+        item.sample = FinishEncodedFrame(pEncoder, idr, firstNalIndex, pArena->nals.size() - firstNalIndex,
+                                         pArena->data.size() - firstByte);
+        pArena->items.push_back(item);
+    }
+    return hr;
+}
+
+// フレームが入力プールのものかどうかを返す
+static bool IsInputPoolFrame(NalEncoder* pEncoder, const Nv12Frame* pFrame)
+{
+    const std::vector<Nv12Frame>& frames = pEncoder->inputPool.frames;
+    return !frames.empty() && pFrame >= &frames.front() && pFrame <= &frames.back();
+}
+
+// 入力プールから書き込み用のフレームを取得する関数
+HRESULT AcquireInputFrame(NalEncoder* pEncoder, Nv12Frame** ppFrame)
+{
+    if (!ppFrame) {
+        return E_POINTER;
+    }
+    *ppFrame = NULL;
+    if (!pEncoder->pCore) {
+        return E_POINTER;
+    }
+
+    Nv12Frame* pFrame = AcquireNv12Frame(&pEncoder->inputPool);
+    LIVE_STATS_ADD(inputPoolInUse, 1);
+    pFrame->cropLeft = 0;
+    pFrame->cropTop = 0;
+    pFrame->cropWidth = pEncoder->width;
+    pFrame->cropHeight = pEncoder->height;
+    *ppFrame = pFrame;
+    return S_OK;
+}
+
+// 書き込み済みの入力フレームをエンコードする関数 (エンコーダーはプールのフレームを直接読む)
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    if (!pFrame || !IsInputPoolFrame(pEncoder, pFrame)) {
+        printf("Frame is not from the encoder input pool\n");
+        return E_INVALIDARG;
+    }
+
+    // EncodeH264IntraFrameは戻るまでに全スライスの符号化を終えるので、その後すぐに返却できる
+    HRESULT hr = EncodeFrame(pEncoder, *pFrame, outputNalUnits);
+    ReleaseNv12Frame(&pEncoder->inputPool, pFrame);
+    LIVE_STATS_SUB(inputPoolInUse, 1);
+    return hr;
+}
+
+// 書き込み済みの入力フレームをエンコードし、NALユニットをストアに追加する関数
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, NalStore* pStore)
+{
+    if (!pFrame || !IsInputPoolFrame(pEncoder, pFrame)) {
+        printf("Frame is not from the encoder input pool\n");
+        return E_INVALIDARG;
+    }
+
+    HRESULT hr = EncodeFrame(pEncoder, *pFrame, pStore);
+    ReleaseNv12Frame(&pEncoder->inputPool, pFrame);
+    LIVE_STATS_SUB(inputPoolInUse, 1);
+    return hr;
+}
+
+// 入力フレームをエンコードせずにプールに返す関数
+void DiscardInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame)
+{
+    if (pFrame && IsInputPoolFrame(pEncoder, pFrame)) {
+        ReleaseNv12Frame(&pEncoder->inputPool, pFrame);
+        LIVE_STATS_SUB(inputPoolInUse, 1);
+    }
+}
+
+// 次のフレームをキーフレームにする関数
+HRESULT ForceKeyFrame(NalEncoder* pEncoder)
+{
+    pEncoder->forceKeyFrame = true;
+    return S_OK;
+}
+
+// エンコードの速さを優先するモードを切り替える関数 (Intra4x4の探索をやめる)
+HRESULT SetEncoderFastMode(NalEncoder* pEncoder, BOOL fast)
+{
+    if (!pEncoder->pCore) {
+        return E_POINTER;
+    }
+    pEncoder->pCore->fastModeDecision = fast;
+    return S_OK;
+}
+
+// フレームをエンコードせずに時刻だけ進める関数
+void SkipFrame(NalEncoder* pEncoder)
+{
+    // タイムスタンプはframeCountから作るので、次のフレームは元の時刻のままになる
+    pEncoder->frameCount++;
+}
+
+// FlushEncoder: イントラのみで並べ替えがないので、追加するNALユニットはない
+HRESULT FlushEncoder(NalEncoder* pEncoder, std::vector<std::vector<BYTE>>& allNalUnits)
+{
+    (void)allNalUnits;
+    pEncoder->outputSamples.clear();
+    return S_OK;
+}
+
+HRESULT FlushEncoder(NalEncoder* pEncoder, NalStore* pStore)
+{
+    (void)pStore;
+    pEncoder->outputSamples.clear();
+    return S_OK;
+}
+
+// エンコーダーリソースを解放する関数
+HRESULT ShutdownEncoder(NalEncoder* pEncoder)
+{
+    if (!pEncoder->pCore) {
+        return S_OK;
+    }
+
+    if (pEncoder->encodedFrames > 0) {
+        UINT64 intra4x4 = 0, intra16x16 = 0;
+        for (H264SliceContext* pSlice : pEncoder->pCore->slices) {
+            intra4x4 += pSlice->intra4x4Count;
+            intra16x16 += pSlice->intra16x16Count;
+        }
+        double seconds = static_cast<double>(pEncoder->encodedFrames) * pEncoder->frameRateDenom / pEncoder->frameRateNum;
+        printf("Software encoder: %llu frames, %.1f kbps, average QP %.1f, I4x4 %.1f%%\n",
+               static_cast<unsigned long long>(pEncoder->encodedFrames),
+               pEncoder->totalBytes * 8.0 / seconds / 1000.0,
+               static_cast<double>(pEncoder->qpSum) / pEncoder->encodedFrames,
+               100.0 * intra4x4 / (intra4x4 + intra16x16 ? intra4x4 + intra16x16 : 1));
+    }
+
+    ShutdownH264IntraEncoder(pEncoder->pCore);
+    delete pEncoder->pCore;
+    pEncoder->pCore = NULL;
+    FreeNv12FramePool(&pEncoder->inputPool);
+    pEncoder->outputSamples.clear();
+    return S_OK;
+}
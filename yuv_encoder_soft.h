@@ -0,0 +1,99 @@
+#pragma once
+
+#include "portable_types.h"
+#include <stdio.h>
+#include <vector>
+#include "nv12_frame.h"
+#include "nv12_frame_pool.h"
+#include "encoded_sample.h"
+#include "codec_batch.h"
+#include "nal_store.h"
+#include "h264_intra_encoder.h"
+
+// ソフトウェアエンコーダー (イントラのみのH.264) によるNalEncoder
+// yuv_encoder_win.hと同じ関数を提供するので、どちらか一方をリンクする (NAL_SOFTWARE_CODEC)
+// Media Foundationのない環境 (Linuxのビルドホストなど) でもエンコードとビットレートの計測ができる
+
+// 入力プールのフレーム数 (生産者が書き込み中・エンコード待ち・エンコード中のフレームを合わせた上限)
+#define ENCODER_INPUT_POOL_SIZE 3
+
+// NALエンコーダー構造体
+struct NalEncoder {
+    H264IntraEncoder* pCore;           // イントラエンコーダー本体 (スレッドを持つのでヒープに置く)
+    Nv12FramePool inputPool;           // 書き込み用の入力フレーム (AcquireInputFrame/CommitInputFrame)
+
+    UINT32 width;                      // 映像幅
+    UINT32 height;                     // 映像高さ (表示サイズ)
+    UINT32 codedHeight;                // 符号化高さ (16の倍数にパディング)
+    UINT32 stride;                     // 入力バッファの行ピッチ
+    UINT32 frameRateNum;               // フレームレート分子
+    UINT32 frameRateDenom;             // フレームレート分母
+    UINT32 bitrate;                    // ビットレート (0ならqpで固定)
+    UINT64 frameCount;                 // 処理したフレーム数
+    std::vector<EncodedSampleInfo> outputSamples; // 直前のEncodeFrame/FlushEncoderの出力サンプル情報
+
+    int qp;                            // 次のフレームのQP (フレーム単位のレート制御で更新する)
+    UINT32 gopLength;                  // IDRの間隔 (フレーム数)
+    UINT64 framesSinceIdr;             // 直前のIDRからエンコードしたフレーム数
+    bool forceKeyFrame;                // 次のフレームをIDRにする
+
+    // 統計情報
+    UINT64 encodedFrames;              // エンコードしたフレーム数 (SkipFrameを除く)
+    UINT64 totalBytes;                 // 出力したNALユニットの合計サイズ
+    UINT64 qpSum;                      // 平均QPの計算用
+};
+
+// エンコーダーを初期化する関数 (1920x1080、1.5Mbps、スライス数は論理コア数)
+HRESULT InitializeEncoder(NalEncoder* pEncoder);
+
+// 映像サイズ (表示サイズ) とビットレートを指定してエンコーダーを初期化する関数
+// 幅は16の倍数にすること (高さは16の倍数にパディングしてクロップで指定する)
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate);
+
+// スライス数も指定してエンコーダーを初期化する関数 (0なら論理コア数、スライスごとに1スレッド)
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate, UINT32 sliceCount);
+
+// フレームをエンコードする関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, std::vector<std::vector<BYTE>>& outputNalUnits);
+
+// ストライド付きフレームをエンコードする関数 (フレームはwidth x codedHeightであること)
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, std::vector<std::vector<BYTE>>& outputNalUnits);
+
+// ストライド付きフレームをエンコードし、NALユニットをストアの末尾に追加する関数
+// outputSamplesのfirstNalIndexはストア全体での番号になる (フレームごとの出力ベクターの確保とコピーがない)
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, NalStore* pStore);
+
+// 複数のフレームをまとめてエンコードする関数 (pFramesはframeCount個のフレームのビューの配列)
+// 結果はアリーナに詰め、出力サンプルごとに入力フレームの番号を付ける (outputSamplesは空になる)
+// 呼び出しごとの出力ベクターの作り直しがなく、小さい解像度で呼び出しの固定コストを均せる
+HRESULT EncodeFrameBatch(NalEncoder* pEncoder, const Nv12Frame* pFrames, size_t frameCount, EncodeBatchArena* pArena);
+
+// 入力プールから書き込み用のフレームを取得する関数 (width x codedHeight、ストライドはエンコーダーの入力と同じ)
+// 空きがなければ、エンコードの終わったフレームが返却されるまで待つ。生産者のスレッドから呼んでよい
+HRESULT AcquireInputFrame(NalEncoder* pEncoder, Nv12Frame** ppFrame);
+
+// 書き込み済みの入力フレームをコピーせずにエンコードする関数 (終わったらフレームはプールに戻る)
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, std::vector<std::vector<BYTE>>& outputNalUnits);
+
+// 同じく、NALユニットをストアの末尾に追加する関数
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, NalStore* pStore);
+
+// 入力フレームをエンコードせずにプールに返す関数 (間引いたフレーム用、生産者のスレッドから呼んでよい)
+void DiscardInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame);
+
+// 次にエンコードするフレームをキーフレーム (IDR) にするよう要求する関数 (シーンチェンジ用)
+HRESULT ForceKeyFrame(NalEncoder* pEncoder);
+
+// エンコードの速さを優先するモードを切り替える関数 (リアルタイムで遅れたときの劣化モード)
+HRESULT SetEncoderFastMode(NalEncoder* pEncoder, BOOL fast);
+
+// フレームをエンコードせずに時刻だけ進める関数 (静止フレームの間引き用)
+// 直前のサンプルの長さは、次のサンプルの時刻までに伸ばして扱うこと
+void SkipFrame(NalEncoder* pEncoder);
+
+// 遅延出力はないので、出力サンプル情報をクリアするだけ
+HRESULT FlushEncoder(NalEncoder* pEncoder, std::vector<std::vector<BYTE>>& allNalUnits);
+HRESULT FlushEncoder(NalEncoder* pEncoder, NalStore* pStore);
+
+// エンコーダーリソースを解放する関数 (統計情報を表示する)
+HRESULT ShutdownEncoder(NalEncoder* pEncoder);
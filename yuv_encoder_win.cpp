@@ -4,6 +4,10 @@
 #include <codecapi.h>
 #include <strmif.h>
 // clang-format on
+#include "pipeline_trace.h"
+#include "live_stats.h"
+#include <atomic>
+#include <chrono>
 
 // Media Foundationライブラリをリンク
 #pragma comment(lib, "mfplat.lib")
@@ -20,30 +24,288 @@ static const GUID CLSID_CMSH264EncoderMFT =
     return hr; \
 }
 
-// GenerateTestFrameメソッドをNV12形式に修正
-void GenerateTestFrame(std::vector<BYTE>& buffer, UINT32 width, UINT32 height, UINT32 frameIndex)
+// フレームメモリ (ヒュージページ、NUMAノード指定) を持つメディアバッファ
+// MFCreateMemoryBufferは4KBページのヒープから確保するため、4Kの入力フレームや出力バッファでTLBミスが多い
+class FrameMemoryMediaBuffer : public IMFMediaBuffer {
+public:
+    static HRESULT Create(DWORD maxLength, const FrameMemoryPolicy* pPolicy, IMFMediaBuffer** ppBuffer)
+    {
+        FrameMemoryMediaBuffer* pBuffer = new FrameMemoryMediaBuffer(maxLength);
+        HRESULT hr = AllocateFrameMemory(maxLength, pPolicy, &pBuffer->pData, &pBuffer->memoryKind);
+        if (FAILED(hr)) {
+            pBuffer->Release();
+            return hr;
+        }
+        *ppBuffer = pBuffer;
+        return S_OK;
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override
+    {
+        if (!ppv) {
+            return E_POINTER;
+        }
+        if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IMFMediaBuffer)) {
+            *ppv = static_cast<IMFMediaBuffer*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++refCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = --refCount;
+        if (count == 0) {
+            delete this;
+        }
+        return count;
+    }
+
+    // IMFMediaBuffer
+    HRESULT STDMETHODCALLTYPE Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) override
+    {
+        if (!ppbBuffer) {
+            return E_POINTER;
+        }
+        *ppbBuffer = pData;
+        if (pcbMaxLength) {
+            *pcbMaxLength = maxLength;
+        }
+        if (pcbCurrentLength) {
+            *pcbCurrentLength = currentLength;
+        }
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE Unlock() override
+    {
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetCurrentLength(DWORD* pcbCurrentLength) override
+    {
+        if (!pcbCurrentLength) {
+            return E_POINTER;
+        }
+        *pcbCurrentLength = currentLength;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE SetCurrentLength(DWORD cbCurrentLength) override
+    {
+        if (cbCurrentLength > maxLength) {
+            return E_INVALIDARG;
+        }
+        currentLength = cbCurrentLength;
+        return S_OK;
+    }
+    HRESULT STDMETHODCALLTYPE GetMaxLength(DWORD* pcbMaxLength) override
+    {
+        if (!pcbMaxLength) {
+            return E_POINTER;
+        }
+        *pcbMaxLength = maxLength;
+        return S_OK;
+    }
+
+private:
+    explicit FrameMemoryMediaBuffer(DWORD length)
+        : refCount(1), pData(NULL), maxLength(length), currentLength(0), memoryKind(FRAME_MEMORY_HEAP)
+    {
+    }
+    virtual ~FrameMemoryMediaBuffer()
+    {
+        FreeFrameMemory(pData, maxLength, memoryKind);
+    }
+
+    std::atomic<ULONG> refCount;
+    BYTE* pData;
+    DWORD maxLength;
+    DWORD currentLength;
+    UINT32 memoryKind;
+};
+
+// プールのすべてをエンコーダーが持っていて、これ以上増やせないときに解放を待つ時間
+static const int ENCODER_INPUT_RELEASE_TIMEOUT_MS = 1000;
+
+static void OnInputSampleReleased(NalEncoder* pEncoder, IUnknown* pState);
+
+// エンコーダーが入力サンプルを解放したときに呼ばれるコールバック
+// トラッキングサンプルは、SetAllocatorの後にほかの参照がすべて解放されるとInvokeを呼ぶ (作業キューのスレッドから)
+class InputSampleReleaseCallback : public IMFAsyncCallback {
+public:
+    explicit InputSampleReleaseCallback(NalEncoder* pOwner)
+        : refCount(1), pEncoder(pOwner)
+    {
+    }
+
+    // IUnknown
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv) override
+    {
+        if (!ppv) {
+            return E_POINTER;
+        }
+        if (IsEqualIID(riid, IID_IUnknown) || IsEqualIID(riid, IID_IMFAsyncCallback)) {
+            *ppv = static_cast<IMFAsyncCallback*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override
+    {
+        return ++refCount;
+    }
+    ULONG STDMETHODCALLTYPE Release() override
+    {
+        ULONG count = --refCount;
+        if (count == 0) {
+            delete this;
+        }
+        return count;
+    }
+
+    // IMFAsyncCallback
+    HRESULT STDMETHODCALLTYPE GetParameters(DWORD* pdwFlags, DWORD* pdwQueue) override
+    {
+        (void)pdwFlags;
+        (void)pdwQueue;
+        return E_NOTIMPL;
+    }
+    HRESULT STDMETHODCALLTYPE Invoke(IMFAsyncResult* pResult) override
+    {
+        // 状態はSetAllocatorに渡したスロットの入力バッファ
+        IUnknown* pState = NULL;
+        HRESULT hr = pResult->GetState(&pState);
+        if (FAILED(hr) || !pState) {
+            printf("Input sample release without a state: 0x%08X\n", hr);
+            return FAILED(hr) ? hr : E_POINTER;
+        }
+        OnInputSampleReleased(pEncoder, pState);
+        pState->Release();
+        return S_OK;
+    }
+
+private:
+    virtual ~InputSampleReleaseCallback()
+    {
+    }
+
+    std::atomic<ULONG> refCount;
+    NalEncoder* pEncoder;
+};
+
+// 入力プールのスロットを1つ作成する関数 (入力サンプルはトラッキングサンプルにする)
+static HRESULT CreateInputSlot(NalEncoder* pEncoder, EncoderInputSlot** ppSlot)
 {
-    // NV12形式のサイズを計算 (YプレーンとUVプレーン)
-    UINT32 ySize = width * height;
-    buffer.resize(ySize + (ySize / 2)); // Y + UV
+    HRESULT hr = S_OK;
+    EncoderInputSlot* pSlot = new EncoderInputSlot();
     
-    // Yプレーン（輝度）- 動くグラデーションパターン
-    for (UINT32 y = 0; y < height; y++) {
-        for (UINT32 x = 0; x < width; x++) {
-            // フレーム番号に基づいて変化するパターン
-            BYTE value = static_cast<BYTE>((x + y + frameIndex * 5) % 256);
-            buffer[y * width + x] = value;
+    IMFTrackedSample* pTracked = NULL;
+    hr = MFCreateTrackedSample(&pTracked);
+    if (SUCCEEDED(hr)) {
+        // スロットはIMFSampleの参照だけを持つ (参照が残るとエンコーダーの解放が通知されない)
+        hr = pTracked->QueryInterface(IID_PPV_ARGS(&pSlot->pSample));
+        pTracked->Release();
+        LIVE_STATS_ADD(samplesCreated, 1);
+    }
+    
+    // ストライド込みのNV12のバッファを1つ持たせる (生産者はこのバッファに直接書き込む)
+    UINT32 nv12Size = pEncoder->stride * pEncoder->codedHeight * 3 / 2;
+    if (SUCCEEDED(hr)) {
+        hr = FrameMemoryMediaBuffer::Create(nv12Size, &pEncoder->memoryPolicy, &pSlot->pBuffer);
+    }
+    if (SUCCEEDED(hr)) {
+        hr = pSlot->pSample->AddBuffer(pSlot->pBuffer);
+    }
+    if (FAILED(hr)) {
+        printf("Create input slot error: 0x%08X\n", hr);
+        if (pSlot->pBuffer) {
+            pSlot->pBuffer->Release();
+        }
+        if (pSlot->pSample) {
+            pSlot->pSample->Release();
         }
+        delete pSlot;
+        return hr;
     }
+    
+    pSlot->frame.width = pEncoder->width;
+    pSlot->frame.height = pEncoder->codedHeight;
+    pSlot->frame.stride = pEncoder->stride;
+    pSlot->frame.cropWidth = pEncoder->width;
+    pSlot->frame.cropHeight = pEncoder->height;
+    *ppSlot = pSlot;
+    return hr;
+}
 
-    // UVプレーン (交互にUとV) - 固定値で灰色設定
-    BYTE* uvPlane = buffer.data() + ySize;
-    for (UINT32 i = 0; i < ySize / 2; i += 2) {
-        uvPlane[i] = 128;     // U値 (128 = 無彩色)
-        uvPlane[i + 1] = 128; // V値 (128 = 無彩色)
+// Nv12Frameのビューから入力プールのスロットを探す関数
+static EncoderInputSlot* FindInputSlot(NalEncoder* pEncoder, Nv12Frame* pFrame)
+{
+    std::lock_guard<std::mutex> lock(pEncoder->inputMutex);
+    for (EncoderInputSlot* pSlot : pEncoder->inputSlots) {
+        if (&pSlot->frame == pFrame) {
+            return pSlot;
+        }
     }
+    return NULL;
 }
 
+// スロットをプールに返す関数 (バッファのロックは解除済みで、スロットがサンプルの参照を持っていること)
+static void ReturnInputSlot(NalEncoder* pEncoder, EncoderInputSlot* pSlot)
+{
+    pSlot->frame.pY = NULL;
+    pSlot->frame.pUV = NULL;
+    {
+        std::lock_guard<std::mutex> lock(pEncoder->inputMutex);
+        pEncoder->freeInputSlots.push_back(pSlot);
+    }
+    pEncoder->inputAvailable.notify_all();
+    LIVE_STATS_SUB(inputPoolInUse, 1);
+}
+
+// エンコーダーが入力サンプルを解放したときに、スロットをプールに戻す関数 (作業キューのスレッドから呼ばれる)
+static void OnInputSampleReleased(NalEncoder* pEncoder, IUnknown* pState)
+{
+    EncoderInputSlot* pSlot = NULL;
+    {
+        std::lock_guard<std::mutex> lock(pEncoder->inputMutex);
+        for (EncoderInputSlot* pCandidate : pEncoder->inputSlots) {
+            if (pCandidate->inEncoder && static_cast<IUnknown*>(pCandidate->pBuffer) == pState) {
+                pSlot = pCandidate;
+                break;
+            }
+        }
+        if (pSlot) {
+            pSlot->inEncoder = false;
+            pEncoder->inputSlotsInEncoder--;
+        }
+    }
+    if (!pSlot) {
+        printf("Released input sample is not from the encoder input pool\n");
+        return;
+    }
+    
+    // エンコーダーに渡すときに手放した参照を持ち直す (トラッキングサンプルはコールバックの間は解放されない)
+    pSlot->pSample->AddRef();
+    ReturnInputSlot(pEncoder, pSlot);
+}
+
+// 書き込みの終わった入力スロットのロックを解除する関数（書き込みはここまでに終わっていること）
+static HRESULT UnlockInputSlot(NalEncoder* pEncoder, EncoderInputSlot* pSlot)
+{
+    DWORD inputSize = pEncoder->stride * pEncoder->codedHeight * 3 / 2;
+    HRESULT hr = pSlot->pBuffer->SetCurrentLength(inputSize);
+    pSlot->pBuffer->Unlock();
+    if (FAILED(hr)) {
+        printf("SetCurrentLength error: 0x%08X\n", hr);
+    }
+    return hr;
+}
 
 // IMFSampleからNALユニットを抽出する関数
 HRESULT ExtractNalUnitsFromSample(IMFSample* pSample, std::vector<std::vector<BYTE>>& outputNalUnits)
@@ -116,6 +378,17 @@ HRESULT ExtractNalUnitsFromSample(IMFSample* pSample, std::vector<std::vector<BY
 
 // エンコーダーを初期化する関数
 HRESULT InitializeEncoder(NalEncoder* pEncoder)
+{
+    // デフォルトパラメータ設定
+#if 1
+    return InitializeEncoder(pEncoder, 1920, 1080, 1500000); // 1.5 Mbps
+#else
+    return InitializeEncoder(pEncoder, 640, 480, 1500000);
+#endif
+}
+
+// 映像サイズとビットレートを指定してエンコーダーを初期化する関数
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate)
 {
     HRESULT hr = S_OK;
     
@@ -123,21 +396,24 @@ HRESULT InitializeEncoder(NalEncoder* pEncoder)
     pEncoder->pEncoder = NULL;
     pEncoder->pInputType = NULL;
     pEncoder->pOutputType = NULL;
-    pEncoder->pInputSample = NULL;
-    pEncoder->pInputBuffer = NULL;
+    pEncoder->inputSlots.clear();
+    pEncoder->freeInputSlots.clear();
+    pEncoder->inputSlotsInEncoder = 0;
+    pEncoder->pInputReleaseCallback = NULL;
+    pEncoder->pOutputBuffer = NULL;
     pEncoder->frameCount = 0;
     
-    // デフォルトパラメータ設定
-#if 1
-    pEncoder->width = 1920;
-    pEncoder->height = 1088;//8の倍数にする必要がある
-#else
-pEncoder->width = 640;
-pEncoder->height = 480;
-#endif
-    pEncoder->frameRateNum = 30;
-    pEncoder->frameRateDenom = 1;
-    pEncoder->bitrate = 1500000; // 1.5 Mbps
+    // 入出力バッファは、このセッションを動かすスレッド (初期化したスレッド) のNUMAノードに置く
+    GetThreadFrameMemoryPolicy(&pEncoder->memoryPolicy);
+    
+    pEncoder->width = width;
+    pEncoder->height = height;
+    // 符号化高さは16の倍数にする必要がある（表示領域はクロップで指定する）
+    pEncoder->codedHeight = AlignUp(pEncoder->height, NV12_FRAME_HEIGHT_ALIGNMENT);
+    pEncoder->stride = AlignUp(pEncoder->width, NV12_FRAME_ALIGNMENT);
+    pEncoder->frameRateNum = ENCODER_FRAME_RATE_NUM;
+    pEncoder->frameRateDenom = ENCODER_FRAME_RATE_DENOM;
+    pEncoder->bitrate = bitrate;
     
     // NAL出力ファイルを開く
     
@@ -188,7 +464,7 @@ pEncoder->height = 480;
     hr = pEncoder->pOutputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
     CHECK_HR(hr, "Set output interlace mode");
     
-    hr = MFSetAttributeSize(pEncoder->pOutputType, MF_MT_FRAME_SIZE, pEncoder->width, pEncoder->height);
+    hr = MFSetAttributeSize(pEncoder->pOutputType, MF_MT_FRAME_SIZE, pEncoder->width, pEncoder->codedHeight);
     CHECK_HR(hr, "Set output frame size");
     
     hr = MFSetAttributeRatio(pEncoder->pOutputType, MF_MT_FRAME_RATE, 
@@ -216,7 +492,7 @@ pEncoder->height = 480;
     hr = pEncoder->pInputType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
     CHECK_HR(hr, "Set input interlace mode");
     
-    hr = MFSetAttributeSize(pEncoder->pInputType, MF_MT_FRAME_SIZE, pEncoder->width, pEncoder->height);
+    hr = MFSetAttributeSize(pEncoder->pInputType, MF_MT_FRAME_SIZE, pEncoder->width, pEncoder->codedHeight);
     CHECK_HR(hr, "Set input frame size");
     
     hr = MFSetAttributeRatio(pEncoder->pInputType, MF_MT_FRAME_RATE, 
@@ -227,9 +503,19 @@ pEncoder->height = 480;
     CHECK_HR(hr, "Set input pixel aspect ratio");
     
     // 重要: デフォルトストライドの設定
-    hr = pEncoder->pInputType->SetUINT32(MF_MT_DEFAULT_STRIDE, pEncoder->width);
+    hr = pEncoder->pInputType->SetUINT32(MF_MT_DEFAULT_STRIDE, pEncoder->stride);
     CHECK_HR(hr, "Set input default stride");
     
+    // 表示領域（パディング行を除いた領域）の設定
+    if (pEncoder->codedHeight != pEncoder->height) {
+        MFVideoArea displayArea = {0};
+        displayArea.Area.cx = pEncoder->width;
+        displayArea.Area.cy = pEncoder->height;
+        hr = pEncoder->pInputType->SetBlob(MF_MT_MINIMUM_DISPLAY_APERTURE,
+                                           reinterpret_cast<const UINT8*>(&displayArea), sizeof(displayArea));
+        CHECK_HR(hr, "Set input display aperture");
+    }
+    
     // 入力タイプをエンコーダに設定
     hr = pEncoder->pEncoder->SetInputType(0, pEncoder->pInputType, 0);
     CHECK_HR(hr, "SetInputType");
@@ -238,86 +524,160 @@ pEncoder->height = 480;
     hr = pEncoder->pEncoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
     CHECK_HR(hr, "ProcessMessage BEGIN_STREAMING");
     
-    // 入力サンプル用のバッファを作成 - NV12のサイズ計算
-    UINT32 nv12Size = pEncoder->width * pEncoder->height * 3 / 2;  // NV12のサイズ計算
-    
-    hr = MFCreateSample(&pEncoder->pInputSample);
-    CHECK_HR(hr, "MFCreateSample");
-    
-    hr = MFCreateMemoryBuffer(nv12Size, &pEncoder->pInputBuffer);
-    CHECK_HR(hr, "MFCreateMemoryBuffer");
+    // 入力プールの作成 - 入力サンプルごとにストライド込みのNV12のバッファを1つ持たせる
+    // (生産者はこのバッファに直接書き込むので、エンコード時のコピーが要らない)
+    // スロットは、エンコーダーが入力サンプルを解放したときにコールバックからプールに戻る
+    pEncoder->pInputReleaseCallback = new InputSampleReleaseCallback(pEncoder);
+    for (int i = 0; i < ENCODER_INPUT_POOL_SIZE; i++) {
+        EncoderInputSlot* pSlot = NULL;
+        hr = CreateInputSlot(pEncoder, &pSlot);
+        CHECK_HR(hr, "CreateInputSlot");
+        pEncoder->inputSlots.push_back(pSlot);
+        pEncoder->freeInputSlots.push_back(pSlot);
+    }
+    LIVE_STATS_SET(inputPoolSize, ENCODER_INPUT_POOL_SIZE);
     
-    hr = pEncoder->pInputSample->AddBuffer(pEncoder->pInputBuffer);
-    CHECK_HR(hr, "AddBuffer");
+    // 出力バッファサイズは十分大きく設定（NV12サイズより大きく）
+    // 出力サンプルは取り出したらすぐに解放するので、バッファは1つを使い回す
+    hr = FrameMemoryMediaBuffer::Create(pEncoder->width * pEncoder->height * 2, &pEncoder->memoryPolicy,
+                                        &pEncoder->pOutputBuffer);
+    CHECK_HR(hr, "Create output buffer");
     
-    printf("Encoder initialized: %dx%d @ %d fps\n", 
-           pEncoder->width, pEncoder->height, 
-           pEncoder->frameRateNum / pEncoder->frameRateDenom);
+    printf("Encoder initialized: %dx%d (coded %dx%d, stride %d) @ %d fps\n", 
+           pEncoder->width, pEncoder->height, pEncoder->width, pEncoder->codedHeight,
+           pEncoder->stride, pEncoder->frameRateNum / pEncoder->frameRateDenom);
     
     return hr;
 }
 
-// フレームをエンコードして、NALユニットを取得する関数
-HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, std::vector<std::vector<BYTE>>& outputNalUnits)
+// 出力サンプルのタイムスタンプとNALユニットの範囲を返す関数
+static EncodedSampleInfo GetOutputSampleInfo(NalEncoder* pEncoder, IMFSample* pSample, size_t firstNalIndex, size_t endNalIndex)
 {
-    HRESULT hr = S_OK;
-    MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
-    DWORD processOutputStatus = 0;
-    
-    // 入力バッファへのフレームデータのコピー
-    BYTE* pData = NULL;
-    DWORD maxLength = 0;
-    DWORD currentLength = 0;
+    EncodedSampleInfo info = {0};
+    info.firstNalIndex = firstNalIndex;
+    info.nalCount = endNalIndex - firstNalIndex;
     
-    hr = pEncoder->pInputBuffer->Lock(&pData, &maxLength, &currentLength);
-    CHECK_HR(hr, "Lock input buffer");
-    
-    // フレームデータをコピー
-    if (frameData.size() <= maxLength) {
-        memcpy(pData, frameData.data(), frameData.size());
-        // 型変換の警告を修正（size_tからDWORDへの変換）
-        hr = pEncoder->pInputBuffer->SetCurrentLength(static_cast<DWORD>(frameData.size()));
-    } else {
-        hr = E_INVALIDARG;
-        printf("Frame data too large for buffer\n");
+    // 入力サンプルに設定した時刻がそのまま出力サンプルに引き継がれる
+    if (FAILED(pSample->GetSampleTime(&info.sampleTime))) {
+        info.sampleTime = 0;
     }
-    
-    hr = pEncoder->pInputBuffer->Unlock();
-    CHECK_HR(hr, "Unlock input buffer");
+    if (FAILED(pSample->GetSampleDuration(&info.duration))) {
+        info.duration = 10000000LL * pEncoder->frameRateDenom / pEncoder->frameRateNum;
+    }
+    UINT32 cleanPoint = 0;
+    if (SUCCEEDED(pSample->GetUINT32(MFSampleExtension_CleanPoint, &cleanPoint))) {
+        info.keyFrame = cleanPoint ? TRUE : FALSE;
+    }
+    return info;
+}
+
+// 出力サンプルのタイムスタンプとNALユニットの範囲を記録する関数
+static void RecordOutputSample(NalEncoder* pEncoder, IMFSample* pSample, size_t firstNalIndex, size_t endNalIndex)
+{
+    pEncoder->outputSamples.push_back(GetOutputSampleInfo(pEncoder, pSample, firstNalIndex, endNalIndex));
+}
+
+// 入力サンプルにタイムスタンプを設定し、解放の通知を登録する関数
+static HRESULT PrepareInputSample(NalEncoder* pEncoder, EncoderInputSlot* pSlot)
+{
+    HRESULT hr = S_OK;
     
     // タイムスタンプの設定（フレーム番号に基づく）
     LONGLONG timestamp = pEncoder->frameCount * 
                           (10000000LL * pEncoder->frameRateDenom / pEncoder->frameRateNum);
     
-    hr = pEncoder->pInputSample->SetSampleTime(timestamp);
+    hr = pSlot->pSample->SetSampleTime(timestamp);
     CHECK_HR(hr, "SetSampleTime");
     
     LONGLONG duration = 10000000LL * pEncoder->frameRateDenom / pEncoder->frameRateNum;
-    hr = pEncoder->pInputSample->SetSampleDuration(duration);
+    hr = pSlot->pSample->SetSampleDuration(duration);
     CHECK_HR(hr, "SetSampleDuration");
     
-    // フレームをエンコーダーに渡す
-    hr = pEncoder->pEncoder->ProcessInput(0, pEncoder->pInputSample, 0);
-    CHECK_HR(hr, "ProcessInput");
+    // 通知は1回だけなので、渡すたびに登録し直す (状態はスロットを探すための入力バッファ)
+    IMFTrackedSample* pTracked = NULL;
+    hr = pSlot->pSample->QueryInterface(IID_PPV_ARGS(&pTracked));
+    CHECK_HR(hr, "QueryInterface IMFTrackedSample");
+    hr = pTracked->SetAllocator(pEncoder->pInputReleaseCallback, pSlot->pBuffer);
+    pTracked->Release();
+    CHECK_HR(hr, "SetAllocator");
+    return hr;
+}
+
+// 書き込みの終わった入力スロットをエンコーダーに渡す関数
+// エンコーダーは出力が出るまで入力サンプルを持ち続けることがあるので、スロットはここでは返さない
+// (成功・失敗にかかわらず、エンコーダーが入力サンプルを解放したときにコールバックからプールに戻る)
+static HRESULT ProcessInputSlot(NalEncoder* pEncoder, EncoderInputSlot* pSlot)
+{
+    TRACE_SPAN("ProcessInput", pEncoder->frameCount);
+    HRESULT hr = UnlockInputSlot(pEncoder, pSlot);
+    if (SUCCEEDED(hr)) {
+        hr = PrepareInputSample(pEncoder, pSlot);
+    }
+    if (FAILED(hr)) {
+        // まだエンコーダーに渡していないので、そのまま返す
+        ReturnInputSlot(pEncoder, pSlot);
+        return hr;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(pEncoder->inputMutex);
+        pSlot->inEncoder = true;
+        pEncoder->inputSlotsInEncoder++;
+    }
+    hr = pEncoder->pEncoder->ProcessInput(0, pSlot->pSample, 0);
+    if (FAILED(hr)) {
+        printf("ProcessInput error: 0x%08X\n", hr);
+    }
     
-    // 出力サンプルの取得
+    // スロットの参照を手放す (エンコーダーが持っていなければ、ここで解放の通知が来る)
+    pSlot->pSample->Release();
+    return hr;
+}
+
+// 出力サンプルを作成する関数
+static HRESULT CreateOutputSample(NalEncoder* pEncoder, IMFSample** ppOutSample)
+{
+    HRESULT hr = S_OK;
     IMFSample* pOutSample = NULL;
     IMFMediaBuffer* pOutBuffer = NULL;
     
     // 修正：出力バッファを作成してサンプルに追加（E_INVALIDARGエラーの修正）
     hr = MFCreateSample(&pOutSample);
     CHECK_HR(hr, "MFCreateSample for output");
+    LIVE_STATS_ADD(samplesCreated, 1);
     
-    // 出力バッファサイズは十分大きく設定（NV12サイズより大きく）
-    hr = MFCreateMemoryBuffer(pEncoder->width * pEncoder->height * 2, &pOutBuffer);
-    CHECK_HR(hr, "MFCreateMemoryBuffer for output");
+    // 出力バッファはエンコーダーが持つものを空にして使い回す
+    pOutBuffer = pEncoder->pOutputBuffer;
+    hr = pOutBuffer->SetCurrentLength(0);
+    if (SUCCEEDED(hr)) {
+        hr = pOutSample->AddBuffer(pOutBuffer);
+    }
+    if (FAILED(hr)) {
+        pOutSample->Release();
+    }
+    CHECK_HR(hr, "Create output buffer");
     
-    hr = pOutSample->AddBuffer(pOutBuffer);
-    CHECK_HR(hr, "AddBuffer to output sample");
+    *ppOutSample = pOutSample;
+    return hr;
+}
+
+// 書き込み済みの入力スロットをエンコーダーに渡し、NALユニットを取得する関数
+static HRESULT SubmitInputSlot(NalEncoder* pEncoder, EncoderInputSlot* pSlot, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    HRESULT hr = S_OK;
+    MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
+    DWORD processOutputStatus = 0;
     
-    if (pOutBuffer) {
-        pOutBuffer->Release();
-        pOutBuffer = NULL;
+    hr = ProcessInputSlot(pEncoder, pSlot);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    
+    // 出力サンプルの取得
+    IMFSample* pOutSample = NULL;
+    hr = CreateOutputSample(pEncoder, &pOutSample);
+    if (FAILED(hr)) {
+        return hr;
     }
     
     outputDataBuffer.dwStreamID = 0;
@@ -327,8 +687,10 @@ HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, st
     
     // 出力データを格納するベクターをクリア
     outputNalUnits.clear();
+    pEncoder->outputSamples.clear();
     
     // エンコード結果を取得（複数のNALユニットが出力される可能性あり）
+    TRACE_SPAN("ProcessOutput", pEncoder->frameCount);
     do {
         hr = pEncoder->pEncoder->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
         
@@ -339,8 +701,10 @@ HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, st
             break;
         } else if (SUCCEEDED(hr)) {
             // NALユニットを取得してvectorに追加
+            size_t firstNalIndex = outputNalUnits.size();
             hr = ExtractNalUnitsFromSample(outputDataBuffer.pSample, outputNalUnits);
             CHECK_HR(hr, "ExtractNalUnitsFromSample");
+            RecordOutputSample(pEncoder, outputDataBuffer.pSample, firstNalIndex, outputNalUnits.size());
         } else if (hr == E_INVALIDARG) {
             // 無効な引数エラーの詳細情報を表示（デバッグ用）
             printf("E_INVALIDARG error - Check buffer configuration, StreamID: %d, Status: 0x%08X\n", 
@@ -365,6 +729,417 @@ HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, st
     return hr;
 }
 
+// フレームをエンコードして、NALユニットを取得する関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    // 隙間なく詰めたNV12 (width x codedHeight) をストライド付きフレームのビューとして扱う
+    if (frameData.size() != GetNv12PackedSize(pEncoder->width, pEncoder->codedHeight)) {
+        printf("Frame data size mismatch: %zu bytes\n", frameData.size());
+        return E_INVALIDARG;
+    }
+    
+    Nv12Frame view = {0};
+    view.pY = const_cast<BYTE*>(frameData.data());
+    view.pUV = view.pY + pEncoder->width * pEncoder->codedHeight;
+    view.width = pEncoder->width;
+    view.height = pEncoder->codedHeight;
+    view.stride = pEncoder->width;
+    view.cropWidth = pEncoder->width;
+    view.cropHeight = pEncoder->height;
+    
+    return EncodeFrame(pEncoder, view, outputNalUnits);
+}
+
+// ストライド付きフレームをエンコードする関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    HRESULT hr = S_OK;
+    
+    if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+        printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+        return E_INVALIDARG;
+    }
+    
+    // 入力プールのフレームへのコピー（エンコーダーのストライドに合わせて行単位、ストライドが同じならプレーンごとに1回）
+    Nv12Frame* pInput = NULL;
+    hr = AcquireInputFrame(pEncoder, &pInput);
+    CHECK_HR(hr, "AcquireInputFrame");
+    
+    {
+        TRACE_SPAN("InputCopy", pEncoder->frameCount);
+        CopyNv12Frame(&frame, pInput);
+    }
+    return CommitInputFrame(pEncoder, pInput, outputNalUnits);
+}
+
+// 入力プールから書き込み用のフレームを取得する関数
+HRESULT AcquireInputFrame(NalEncoder* pEncoder, Nv12Frame** ppFrame)
+{
+    HRESULT hr = S_OK;
+    
+    if (!ppFrame) {
+        return E_POINTER;
+    }
+    *ppFrame = NULL;
+    if (pEncoder->inputSlots.empty()) {
+        return E_POINTER;
+    }
+    
+    EncoderInputSlot* pSlot = NULL;
+    {
+        std::unique_lock<std::mutex> lock(pEncoder->inputMutex);
+        while (pEncoder->freeInputSlots.empty()) {
+            // プールのすべてをエンコーダーが持っていると、次の入力を渡すまで解放されないので、待たずに1つ追加する
+            bool allInEncoder = pEncoder->inputSlotsInEncoder == pEncoder->inputSlots.size();
+            if (allInEncoder && pEncoder->inputSlots.size() < ENCODER_INPUT_POOL_MAX_SIZE) {
+                hr = CreateInputSlot(pEncoder, &pSlot);
+                CHECK_HR(hr, "CreateInputSlot");
+                pEncoder->inputSlots.push_back(pSlot);
+                LIVE_STATS_SET(inputPoolSize, pEncoder->inputSlots.size());
+                printf("Encoder input pool grown to %zu frames (the encoder holds all the others)\n",
+                       pEncoder->inputSlots.size());
+                break;
+            }
+            if (!allInEncoder) {
+                pEncoder->inputAvailable.wait(lock);
+            } else if (pEncoder->inputAvailable.wait_for(lock, std::chrono::milliseconds(ENCODER_INPUT_RELEASE_TIMEOUT_MS)) ==
+                       std::cv_status::timeout && pEncoder->freeInputSlots.empty()) {
+                printf("The encoder holds all %zu input frames\n", pEncoder->inputSlots.size());
+                return E_FAIL;
+            }
+        }
+        if (!pSlot) {
+            pSlot = pEncoder->freeInputSlots.back();
+            pEncoder->freeInputSlots.pop_back();
+        }
+    }
+    
+    // コミットまでロックしたままにして、バッファのメモリをフレームのビューとして渡す
+    BYTE* pData = NULL;
+    DWORD maxLength = 0;
+    hr = pSlot->pBuffer->Lock(&pData, &maxLength, NULL);
+    if (FAILED(hr)) {
+        std::lock_guard<std::mutex> lock(pEncoder->inputMutex);
+        pEncoder->freeInputSlots.push_back(pSlot);
+    }
+    CHECK_HR(hr, "Lock input buffer");
+    LIVE_STATS_ADD(inputPoolInUse, 1);
+    
+    pSlot->frame.pY = pData;
+    pSlot->frame.pUV = pData + pEncoder->stride * pEncoder->codedHeight;
+    pSlot->frame.cropLeft = 0;
+    pSlot->frame.cropTop = 0;
+    pSlot->frame.cropWidth = pEncoder->width;
+    pSlot->frame.cropHeight = pEncoder->height;
+    *ppFrame = &pSlot->frame;
+    return hr;
+}
+
+// 書き込み済みの入力フレームをコピーせずにエンコードする関数
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, std::vector<std::vector<BYTE>>& outputNalUnits)
+{
+    EncoderInputSlot* pSlot = FindInputSlot(pEncoder, pFrame);
+    if (!pSlot) {
+        printf("Frame is not from the encoder input pool\n");
+        return E_INVALIDARG;
+    }
+    
+    // ロックを解除してからエンコーダーに渡す (スロットはエンコーダーが入力サンプルを解放したときにプールに戻る)
+    return SubmitInputSlot(pEncoder, pSlot, outputNalUnits);
+}
+
+// 出力サンプルのNALユニットをストアに追加する関数
+// (ExtractNalUnitsFromSampleと同じく、バッファ1つを1つのNALユニットとして先頭5バイトを除く。ログは出さない)
+static HRESULT AppendSampleToStore(IMFSample* pSample, NalStore* pStore)
+{
+    HRESULT hr = S_OK;
+    DWORD bufferCount = 0;
+    
+    hr = pSample->GetBufferCount(&bufferCount);
+    CHECK_HR(hr, "GetBufferCount");
+    
+    for (DWORD i = 0; i < bufferCount; i++) {
+        IMFMediaBuffer* pBuffer = NULL;
+        hr = pSample->GetBufferByIndex(i, &pBuffer);
+        CHECK_HR(hr, "GetBufferByIndex");
+        
+        BYTE* pData = NULL;
+        DWORD maxLength = 0;
+        DWORD currentLength = 0;
+        hr = pBuffer->Lock(&pData, &maxLength, &currentLength);
+        if (SUCCEEDED(hr)) {
+            if (currentLength > 0 && pData != NULL) {
+                DWORD skip = (currentLength > 5) ? 5 : 0;
+                hr = AppendNalUnit(pStore, pData + skip, currentLength - skip);
+            }
+            HRESULT hrUnlock = pBuffer->Unlock();
+            if (SUCCEEDED(hr)) {
+                hr = hrUnlock;
+            }
+        }
+        pBuffer->Release();
+        CHECK_HR(hr, "Append output buffer");
+    }
+    return hr;
+}
+
+// エンコーダーの出力をすべて取り出してストアに追加し、出力サンプル情報を記録する関数
+// 出力サンプルは1つを使い回し、取り出すたびに長さと属性を戻す
+static HRESULT DrainOutputToStore(NalEncoder* pEncoder, NalStore* pStore)
+{
+    TRACE_SPAN("ProcessOutput", pEncoder->frameCount);
+    HRESULT hr = S_OK;
+    IMFSample* pOutSample = NULL;
+    hr = CreateOutputSample(pEncoder, &pOutSample);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    
+    while (SUCCEEDED(hr)) {
+        IMFMediaBuffer* pOutBuffer = NULL;
+        if (SUCCEEDED(pOutSample->GetBufferByIndex(0, &pOutBuffer))) {
+            pOutBuffer->SetCurrentLength(0);
+            pOutBuffer->Release();
+        }
+        pOutSample->DeleteAllItems();
+        
+        MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
+        DWORD processOutputStatus = 0;
+        outputDataBuffer.dwStreamID = 0;
+        outputDataBuffer.pSample = pOutSample;
+        HRESULT hrOut = pEncoder->pEncoder->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
+        if (hrOut == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+            break;
+        }
+        if (FAILED(hrOut)) {
+            printf("ProcessOutput error: 0x%08X\n", hrOut);
+            hr = hrOut;
+            break;
+        }
+        
+        size_t firstNalIndex = GetNalStoreCount(pStore);
+        hr = AppendSampleToStore(pOutSample, pStore);
+        if (SUCCEEDED(hr)) {
+            RecordOutputSample(pEncoder, pOutSample, firstNalIndex, GetNalStoreCount(pStore));
+        }
+    }
+    
+    pOutSample->Release();
+    return hr;
+}
+
+// 書き込み済みの入力フレームをエンコードし、NALユニットをストアに追加する関数
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, NalStore* pStore)
+{
+    HRESULT hr = S_OK;
+    
+    EncoderInputSlot* pSlot = FindInputSlot(pEncoder, pFrame);
+    if (!pSlot) {
+        printf("Frame is not from the encoder input pool\n");
+        return E_INVALIDARG;
+    }
+    
+    pEncoder->outputSamples.clear();
+    hr = ProcessInputSlot(pEncoder, pSlot);
+    if (SUCCEEDED(hr)) {
+        hr = DrainOutputToStore(pEncoder, pStore);
+    }
+    
+    pEncoder->frameCount++;
+    return hr;
+}
+
+// ストライド付きフレームをエンコードし、NALユニットをストアに追加する関数
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, NalStore* pStore)
+{
+    HRESULT hr = S_OK;
+    
+    if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+        printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+        return E_INVALIDARG;
+    }
+    
+    Nv12Frame* pInput = NULL;
+    hr = AcquireInputFrame(pEncoder, &pInput);
+    CHECK_HR(hr, "AcquireInputFrame");
+    
+    {
+        TRACE_SPAN("InputCopy", pEncoder->frameCount);
+        CopyNv12Frame(&frame, pInput);
+    }
+    return CommitInputFrame(pEncoder, pInput, pStore);
+}
+
+// 入力フレームをエンコードせずにプールに返す関数
+void DiscardInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame)
+{
+    EncoderInputSlot* pSlot = FindInputSlot(pEncoder, pFrame);
+    if (pSlot) {
+        pSlot->pBuffer->Unlock();
+        ReturnInputSlot(pEncoder, pSlot);
+    }
+}
+
+// 出力サンプルのNALユニットをアリーナに追加する関数
+// (ExtractNalUnitsFromSampleと同じく、バッファ1つを1つのNALユニットとして先頭5バイトを除く。ログは出さない)
+static HRESULT AppendSampleToArena(IMFSample* pSample, EncodeBatchArena* pArena)
+{
+    HRESULT hr = S_OK;
+    DWORD bufferCount = 0;
+    
+    hr = pSample->GetBufferCount(&bufferCount);
+    CHECK_HR(hr, "GetBufferCount");
+    
+    for (DWORD i = 0; i < bufferCount; i++) {
+        IMFMediaBuffer* pBuffer = NULL;
+        hr = pSample->GetBufferByIndex(i, &pBuffer);
+        CHECK_HR(hr, "GetBufferByIndex");
+        
+        BYTE* pData = NULL;
+        DWORD maxLength = 0;
+        DWORD currentLength = 0;
+        hr = pBuffer->Lock(&pData, &maxLength, &currentLength);
+        if (SUCCEEDED(hr)) {
+            if (currentLength > 0 && pData != NULL) {
+                DWORD skip = (currentLength > 5) ? 5 : 0;
+                BatchNalRange range;
+                range.offset = pArena->data.size();
+                range.size = currentLength - skip;
+                pArena->data.insert(pArena->data.end(), pData + skip, pData + currentLength);
+                pArena->nals.push_back(range);
+            }
+            hr = pBuffer->Unlock();
+        }
+        pBuffer->Release();
+        CHECK_HR(hr, "Lock output buffer");
+    }
+    return hr;
+}
+
+// 複数のフレームをまとめてエンコードし、結果をアリーナに詰める関数
+// 出力サンプルはバッチ内で使い回し、入力は入力プールのサンプルに1回コピーして渡す
+HRESULT EncodeFrameBatch(NalEncoder* pEncoder, const Nv12Frame* pFrames, size_t frameCount, EncodeBatchArena* pArena)
+{
+    HRESULT hr = S_OK;
+    
+    if (!pEncoder->pEncoder || !pArena) {
+        return E_POINTER;
+    }
+    ResetEncodeBatchArena(pArena);
+    pEncoder->outputSamples.clear();
+    
+    IMFSample* pOutSample = NULL;
+    hr = CreateOutputSample(pEncoder, &pOutSample);
+    if (FAILED(hr)) {
+        return hr;
+    }
+    
+    for (size_t i = 0; i < frameCount && SUCCEEDED(hr); i++) {
+        const Nv12Frame& frame = pFrames[i];
+        if (frame.width != pEncoder->width || frame.height != pEncoder->codedHeight) {
+            printf("Frame size mismatch: %dx%d\n", frame.width, frame.height);
+            hr = E_INVALIDARG;
+            break;
+        }
+        
+        Nv12Frame* pInput = NULL;
+        hr = AcquireInputFrame(pEncoder, &pInput);
+        if (FAILED(hr)) {
+            break;
+        }
+        CopyNv12Frame(&frame, pInput);
+        
+        EncoderInputSlot* pSlot = FindInputSlot(pEncoder, pInput);
+        hr = ProcessInputSlot(pEncoder, pSlot);
+        
+        // 出力をすべて取り出す（使い回す出力サンプルは、取り出すたびに長さと属性を戻す）
+        while (SUCCEEDED(hr)) {
+            IMFMediaBuffer* pOutBuffer = NULL;
+            if (SUCCEEDED(pOutSample->GetBufferByIndex(0, &pOutBuffer))) {
+                pOutBuffer->SetCurrentLength(0);
+                pOutBuffer->Release();
+            }
+            pOutSample->DeleteAllItems();
+            
+            MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
+            DWORD processOutputStatus = 0;
+            outputDataBuffer.dwStreamID = 0;
+            outputDataBuffer.pSample = pOutSample;
+            HRESULT hrOut = pEncoder->pEncoder->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
+            if (hrOut == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+                break;
+            }
+            if (FAILED(hrOut)) {
+                printf("ProcessOutput error: 0x%08X\n", hrOut);
+                hr = hrOut;
+                break;
+            }
+            
+            size_t firstNalIndex = pArena->nals.size();
+            hr = AppendSampleToArena(pOutSample, pArena);
+            if (SUCCEEDED(hr)) {
+                EncodeBatchItem item;
+                item.inputIndex = i;
+                item.sample = GetOutputSampleInfo(pEncoder, pOutSample, firstNalIndex, pArena->nals.size());
+                pArena->items.push_back(item);
+            }
+        }
+        
+        pEncoder->frameCount++;
+    }
+    
+    pOutSample->Release();
+    return hr;
+}
+
+// 次にエンコードするフレームをキーフレーム (IDR) にするよう要求する関数
+HRESULT ForceKeyFrame(NalEncoder* pEncoder)
+{
+    HRESULT hr = S_OK;
+    ICodecAPI* pCodecApi = NULL;
+    
+    hr = pEncoder->pEncoder->QueryInterface(IID_PPV_ARGS(&pCodecApi));
+    CHECK_HR(hr, "QueryInterface ICodecAPI");
+    
+    VARIANT value;
+    VariantInit(&value);
+    value.vt = VT_UI4;
+    value.ulVal = 1;
+    hr = pCodecApi->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &value);
+    pCodecApi->Release();
+    CHECK_HR(hr, "SetValue CODECAPI_AVEncVideoForceKeyFrame");
+    
+    return hr;
+}
+
+// エンコードの速さを優先するモードを切り替える関数
+// CODECAPI_AVEncCommonQualityVsSpeed: 0が最速、100が最高画質 (通常時は中間の50に戻す)
+HRESULT SetEncoderFastMode(NalEncoder* pEncoder, BOOL fast)
+{
+    HRESULT hr = S_OK;
+    ICodecAPI* pCodecApi = NULL;
+    
+    hr = pEncoder->pEncoder->QueryInterface(IID_PPV_ARGS(&pCodecApi));
+    CHECK_HR(hr, "QueryInterface ICodecAPI");
+    
+    VARIANT value;
+    VariantInit(&value);
+    value.vt = VT_UI4;
+    value.ulVal = fast ? 0 : 50;
+    hr = pCodecApi->SetValue(&CODECAPI_AVEncCommonQualityVsSpeed, &value);
+    pCodecApi->Release();
+    CHECK_HR(hr, "SetValue CODECAPI_AVEncCommonQualityVsSpeed");
+    
+    return hr;
+}
+
+// フレームをエンコードせずに時刻だけ進める関数
+void SkipFrame(NalEncoder* pEncoder)
+{
+    // タイムスタンプはframeCountから作るので、次のフレームは元の時刻のままになる
+    pEncoder->frameCount++;
+}
+
 /**
  * FlushEncoder: Flush後のNALユニットをallNalUnitsに追加する
  */
@@ -376,22 +1151,15 @@ HRESULT FlushEncoder(NalEncoder* pEncoder, std::vector<std::vector<BYTE>>& allNa
     // フラッシュのためにストリーミング終了を通知
     pEncoder->pEncoder->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
     pEncoder->pEncoder->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
+    pEncoder->outputSamples.clear();
 
     // Flush後の出力回収
     while (true) {
         MFT_OUTPUT_DATA_BUFFER outputDataBuffer = {0};
         DWORD processOutputStatus = 0;
         IMFSample* pOutSample = nullptr;
-        IMFMediaBuffer* pOutBuffer = nullptr;
 
-        HRESULT hrSample = MFCreateSample(&pOutSample);
-        if (FAILED(hrSample)) break;
-        HRESULT hrBuffer = MFCreateMemoryBuffer(pEncoder->width * pEncoder->height * 2, &pOutBuffer);
-        if (FAILED(hrBuffer)) {
-            pOutSample->Release();
-            break;
-        }
-        pOutSample->AddBuffer(pOutBuffer);
+        if (FAILED(CreateOutputSample(pEncoder, &pOutSample))) break;
 
         outputDataBuffer.dwStreamID = 0;
         outputDataBuffer.pSample = pOutSample;
@@ -399,23 +1167,34 @@ HRESULT FlushEncoder(NalEncoder* pEncoder, std::vector<std::vector<BYTE>>& allNa
         HRESULT hrOut = pEncoder->pEncoder->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
         if (hrOut == MF_E_TRANSFORM_NEED_MORE_INPUT) {
             // もう出力はない
-            pOutBuffer->Release();
             pOutSample->Release();
             break;
         } else if (SUCCEEDED(hrOut)) {
             // NALユニットを抽出してallNalUnitsに追加
             std::vector<std::vector<BYTE>> nalUnits;
             ExtractNalUnitsFromSample(outputDataBuffer.pSample, nalUnits);
+            size_t firstNalIndex = allNalUnits.size();
             for (auto& nalu : nalUnits) {
                 allNalUnits.push_back(std::move(nalu));
             }
+            RecordOutputSample(pEncoder, outputDataBuffer.pSample, firstNalIndex, allNalUnits.size());
         }
-        if (pOutBuffer) pOutBuffer->Release();
         if (pOutSample) pOutSample->Release();
     }
     return hr;
 }
 
+// Flush後のNALユニットをストアに追加する関数
+HRESULT FlushEncoder(NalEncoder* pEncoder, NalStore* pStore)
+{
+    if (!pEncoder || !pEncoder->pEncoder || !pStore) return E_POINTER;
+
+    pEncoder->pEncoder->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+    pEncoder->pEncoder->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, 0);
+    pEncoder->outputSamples.clear();
+    return DrainOutputToStore(pEncoder, pStore);
+}
+
 // エンコーダーリソースを解放する関数
 HRESULT ShutdownEncoder(NalEncoder* pEncoder)
 {
@@ -423,15 +1202,41 @@ HRESULT ShutdownEncoder(NalEncoder* pEncoder)
     
     // NAL出力ファイルを閉じる
     
-    // リソースの解放
-    if (pEncoder->pInputBuffer) {
-        pEncoder->pInputBuffer->Release();
-        pEncoder->pInputBuffer = NULL;
+    // エンコーダーを先に解放し、持っていた入力サンプルの解放の通知をすべて待ってからプールを解放する
+    if (pEncoder->pEncoder) {
+        pEncoder->pEncoder->Release();
+        pEncoder->pEncoder = NULL;
+    }
+    bool released = true;
+    {
+        std::unique_lock<std::mutex> lock(pEncoder->inputMutex);
+        released = pEncoder->inputAvailable.wait_for(lock, std::chrono::milliseconds(ENCODER_INPUT_RELEASE_TIMEOUT_MS),
+                                                      [pEncoder] { return pEncoder->inputSlotsInEncoder == 0; });
     }
+    if (released) {
+        for (EncoderInputSlot* pSlot : pEncoder->inputSlots) {
+            if (pSlot->pBuffer) {
+                pSlot->pBuffer->Release();
+            }
+            if (pSlot->pSample) {
+                pSlot->pSample->Release();
+            }
+            delete pSlot;
+        }
+        if (pEncoder->pInputReleaseCallback) {
+            pEncoder->pInputReleaseCallback->Release();
+        }
+    } else {
+        // 後から通知が来てもよいように、プールとコールバックは解放しない
+        printf("%zu input samples were not released by the encoder\n", pEncoder->inputSlotsInEncoder);
+    }
+    pEncoder->pInputReleaseCallback = NULL;
+    pEncoder->inputSlots.clear();
+    pEncoder->freeInputSlots.clear();
     
-    if (pEncoder->pInputSample) {
-        pEncoder->pInputSample->Release();
-        pEncoder->pInputSample = NULL;
+    if (pEncoder->pOutputBuffer) {
+        pEncoder->pOutputBuffer->Release();
+        pEncoder->pOutputBuffer = NULL;
     }
     
     if (pEncoder->pInputType) {
@@ -444,11 +1249,6 @@ HRESULT ShutdownEncoder(NalEncoder* pEncoder)
         pEncoder->pOutputType = NULL;
     }
     
-    if (pEncoder->pEncoder) {
-        pEncoder->pEncoder->Release();
-        pEncoder->pEncoder = NULL;
-    }
-    
     // Media Foundationのシャットダウン
     hr = MFShutdown();
     
@@ -10,42 +10,110 @@
 #include <vector>
 #include <fstream>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+#include "nv12_frame.h"
+#include "encoded_sample.h"
+#include "codec_batch.h"
+#include "nal_store.h"
+
+// 入力プールのフレーム数 (生産者が書き込み中・エンコード待ち・エンコード中のフレームを合わせた数)
+// エンコーダーは出力が出るまで入力サンプルを持ち続けることがあるので、プールのすべてをエンコーダーが
+// 持っているときは、ENCODER_INPUT_POOL_MAX_SIZEまでフレームを追加する (エンコーダーの遅延に合わせて増える)
+#define ENCODER_INPUT_POOL_SIZE 3
+#define ENCODER_INPUT_POOL_MAX_SIZE 16
+
+// 書き込み用の入力フレーム (入力サンプルのメディアバッファを、そのままストライド付きフレームとして見せる)
+// 入力サンプルはトラッキングサンプルで、エンコーダーがサンプルを解放したときにプールに戻る
+struct EncoderInputSlot {
+    IMFSample* pSample;                // 入力サンプル (pBufferを1つ持つ。エンコーダーに渡している間は参照を持たない)
+    IMFMediaBuffer* pBuffer;           // 入力バッファ (取得してからコミットするまでロックしておく)
+    Nv12Frame frame;                   // pBufferのメモリを指すビュー
+    bool inEncoder;                    // エンコーダーに渡して、まだ解放されていない
+};
 
 // NALエンコーダー構造体
 struct NalEncoder {
     IMFTransform* pEncoder;            // H.264エンコーダートランスフォーム
     IMFMediaType* pInputType;          // 入力メディアタイプ
     IMFMediaType* pOutputType;         // 出力メディアタイプ
-    IMFSample* pInputSample;           // 入力サンプル
-    IMFMediaBuffer* pInputBuffer;      // 入力バッファ
+    std::vector<EncoderInputSlot*> inputSlots;     // 入力プール (所有者)
+    std::vector<EncoderInputSlot*> freeInputSlots; // 空いている入力フレーム
+    size_t inputSlotsInEncoder;        // エンコーダーに渡して、まだ解放されていない入力フレーム数
+    std::mutex inputMutex;             // 入力プールの一覧と空き、inputSlotsInEncoderを守る
+    std::condition_variable inputAvailable; // 入力フレームが返却されたときに通知する
+    IMFAsyncCallback* pInputReleaseCallback; // エンコーダーが入力サンプルを解放したときに呼ばれる
+    IMFMediaBuffer* pOutputBuffer;     // 出力サンプルのバッファ (出力サンプルを作るたびに使い回す)
+    FrameMemoryPolicy memoryPolicy;    // 入出力バッファの確保に使うポリシー (初期化したスレッドのNUMAノード)
     
     UINT32 width;                      // 映像幅
-    UINT32 height;                     // 映像高さ
+    UINT32 height;                     // 映像高さ (表示サイズ)
+    UINT32 codedHeight;                // 符号化高さ (16の倍数にパディング)
+    UINT32 stride;                     // 入力バッファの行ピッチ
     UINT32 frameRateNum;               // フレームレート分子
     UINT32 frameRateDenom;             // フレームレート分母
     UINT32 bitrate;                    // ビットレート
     UINT64 frameCount;                 // 処理したフレーム数
+    std::vector<EncodedSampleInfo> outputSamples; // 直前のEncodeFrame/FlushEncoderの出力サンプル情報
 
     // 出力NALユニットファイル
 };
 
-// テストフレームをNV12形式で生成する関数
-void GenerateTestFrame(std::vector<BYTE>& buffer, UINT32 width, UINT32 height, UINT32 frameIndex);
-
 // エンコーダーを初期化する関数
 HRESULT InitializeEncoder(NalEncoder* pEncoder, const char* outputFilename);
 
 // エンコーダーを初期化する関数
 HRESULT InitializeEncoder(NalEncoder* pEncoder);
 
+// 映像サイズ (表示サイズ) とビットレートを指定してエンコーダーを初期化する関数
+// 幅は16の倍数にすること (高さは16の倍数にパディングしてクロップで指定する)
+HRESULT InitializeEncoder(NalEncoder* pEncoder, UINT32 width, UINT32 height, UINT32 bitrate);
+
 // フレームをエンコードする関数
 HRESULT EncodeFrame(NalEncoder* pEncoder, const std::vector<BYTE>& frameData, std::vector<std::vector<BYTE>>& outputNalUnits);
 
+// ストライド付きフレームをエンコードする関数 (フレームはwidth x codedHeightであること)
+// 入力プールのフレームにコピーしてからコミットする。コピーを避けるにはAcquireInputFrameを使う
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, std::vector<std::vector<BYTE>>& outputNalUnits);
+
+// ストライド付きフレームをエンコードし、NALユニットをストアの末尾に追加する関数
+// outputSamplesのfirstNalIndexはストア全体での番号になる (出力サンプルを使い回し、NALユニットごとの確保もない)
+HRESULT EncodeFrame(NalEncoder* pEncoder, const Nv12Frame& frame, NalStore* pStore);
+
+// 複数のフレームをまとめてエンコードする関数 (pFramesはframeCount個のフレームのビューの配列)
+// 結果はアリーナに詰め、出力サンプルごとに入力フレームの番号を付ける (outputSamplesは空になる)
+// 出力サンプルをバッチ内で使い回し、フレームごとのログも出さないので、小さい解像度で呼び出しの固定コストを均せる
+HRESULT EncodeFrameBatch(NalEncoder* pEncoder, const Nv12Frame* pFrames, size_t frameCount, EncodeBatchArena* pArena);
+
+// 入力プールから書き込み用のフレームを取得する関数 (width x codedHeight、ストライドはエンコーダーの入力と同じ)
+// 空きがなければ、エンコーダーが入力サンプルを解放するまで待つ。生産者のスレッドから呼んでよい
+HRESULT AcquireInputFrame(NalEncoder* pEncoder, Nv12Frame** ppFrame);
+
+// 書き込み済みの入力フレームをコピーせずにエンコードする関数
+// フレームは、エンコーダーが入力サンプルを解放したときにプールに戻る (出力より後になることがある)
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, std::vector<std::vector<BYTE>>& outputNalUnits);
+
+// 同じく、NALユニットをストアの末尾に追加する関数
+HRESULT CommitInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame, NalStore* pStore);
+
+// 入力フレームをエンコードせずにプールに返す関数 (間引いたフレーム用、生産者のスレッドから呼んでよい)
+void DiscardInputFrame(NalEncoder* pEncoder, Nv12Frame* pFrame);
+
+// 次にエンコードするフレームをキーフレーム (IDR) にするよう要求する関数 (シーンチェンジ用)
+HRESULT ForceKeyFrame(NalEncoder* pEncoder);
+
+// エンコードの速さを優先するモードを切り替える関数 (リアルタイムで遅れたときの劣化モード)
+HRESULT SetEncoderFastMode(NalEncoder* pEncoder, BOOL fast);
+
+// フレームをエンコードせずに時刻だけ進める関数 (静止フレームの間引き用)
+// 直前のサンプルの長さは、次のサンプルの時刻までに伸ばして扱うこと
+void SkipFrame(NalEncoder* pEncoder);
 
 // IMFSampleからNALユニットを抽出する関数
 HRESULT ExtractNalUnitsFromSample(IMFSample* pSample, std::vector<std::vector<BYTE>>& outputNalUnits);
 
 HRESULT FlushEncoder(NalEncoder* pEncoder, std::vector<std::vector<BYTE>>& allNalUnits);
+HRESULT FlushEncoder(NalEncoder* pEncoder, NalStore* pStore);
 
 // エンコーダーリソースを解放する関数
 HRESULT ShutdownEncoder(NalEncoder* pEncoder);
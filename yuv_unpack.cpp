@@ -0,0 +1,110 @@
+// YUVアーカイブの展開ツール
+// nal_encode_decode --yuv-archive が書いたコンテナから、output.yuvと同じバイト列のNV12を復元する
+// 出力ファイルを省略すると、フレーム数や圧縮率などの情報だけを表示する
+#include "yuv_archive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s <input.yuvz> [<output.yuv>] [--first <frame>] [--count <frames>]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    const char* inputFilename = NULL;
+    const char* outputFilename = NULL;
+    UINT32 firstFrame = 0;
+    UINT32 frameCount = 0xFFFFFFFF;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--first") == 0 && i + 1 < argc) {
+            firstFrame = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            frameCount = static_cast<UINT32>(atoi(argv[++i]));
+        } else if (argv[i][0] != '-' && !inputFilename) {
+            inputFilename = argv[i];
+        } else if (argv[i][0] != '-' && !outputFilename) {
+            outputFilename = argv[i];
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (!inputFilename) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    YuvArchiveReader reader;
+    if (FAILED(OpenYuvArchiveReader(&reader, inputFilename))) {
+        return 1;
+    }
+
+    const UINT32 totalFrames = GetYuvArchiveFrameCount(&reader);
+    const size_t frameSize = GetYuvArchiveFrameSize(&reader);
+    UINT32 keyFrames = 0;
+    for (UINT32 i = 0; i < totalFrames; i++) {
+        if (reader.index[i].flags & YUV_ARCHIVE_FRAME_KEY) {
+            keyFrames++;
+        }
+    }
+    const double MB = 1024.0 * 1024.0;
+    const double rawBytes = static_cast<double>(frameSize) * totalFrames;
+    printf("%s: %u frames (%ux%u NV12), %u key frames, %.1f MB -> %.1f MB (%.1f%%)\n",
+           inputFilename, totalFrames, reader.width, reader.height, keyFrames, rawBytes / MB,
+           reader.file.size / MB, rawBytes > 0.0 ? 100.0 * reader.file.size / rawBytes : 0.0);
+
+    if (!outputFilename) {
+        CloseYuvArchiveReader(&reader);
+        return 0;
+    }
+
+    if (firstFrame > totalFrames) {
+        firstFrame = totalFrames;
+    }
+    if (frameCount > totalFrames - firstFrame) {
+        frameCount = totalFrames - firstFrame;
+    }
+
+    FILE* pOutput = fopen(outputFilename, "wb");
+    if (!pOutput) {
+        printf("Failed to open %s for writing.\n", outputFilename);
+        CloseYuvArchiveReader(&reader);
+        return 1;
+    }
+
+    // 先頭のフレームだけ直前のキーフレームから復元し、以降は1フレームずつ差分を足していく
+    HRESULT hr = S_OK;
+    double decodeSeconds = 0.0;
+    for (UINT32 i = firstFrame; i < firstFrame + frameCount; i++) {
+        const BYTE* pFrame = NULL;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        hr = ReadYuvArchiveFrame(&reader, i, &pFrame);
+        decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (FAILED(hr)) {
+            break;
+        }
+        if (fwrite(pFrame, 1, frameSize, pOutput) != frameSize) {
+            printf("Failed to write %s\n", outputFilename);
+            hr = E_FAIL;
+            break;
+        }
+    }
+    if (fclose(pOutput) != 0) {
+        hr = E_FAIL;
+    }
+    CloseYuvArchiveReader(&reader);
+    if (FAILED(hr)) {
+        return 1;
+    }
+
+    printf("Wrote %u frames from frame %u to %s", frameCount, firstFrame, outputFilename);
+    if (decodeSeconds > 0.0) {
+        printf(" (decompress %.0f MB/s of NV12)", static_cast<double>(frameSize) * frameCount / MB / decodeSeconds);
+    }
+    printf("\n");
+    return 0;
+}